@@ -0,0 +1,226 @@
+/**
+ * @file affinity.c
+ * @brief pinning landslides to cores and their memory to numa nodes
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "array_list.h"
+#include "common.h"
+#include "xcalls.h"
+
+/* Simics's working set is the whole simulated machine's memory, so one that
+ * migrates between sockets spends its time on remote memory accesses. When
+ * enabled, each cpu slot gets its own core, slots are dealt out round-robin
+ * across numa nodes, and each landslide (with its simics) is pinned to its
+ * slot's core and prefers its node's memory. Cores come from /sys; without it
+ * everything is on node 0, which is still fine for pinning. */
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1 /* from <numaif.h>, so as not to need libnuma */
+#endif
+#define MAX_NODES 1024
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+
+struct core {
+	int cpu;
+	int node;
+};
+
+static bool pinning = false;
+static ARRAY_LIST(struct core) cores; /* all usable ones */
+static ARRAY_LIST(struct core) slot_cores; /* indexed by slot */
+
+static int cpu_node(int cpu)
+{
+	char buf[BUF_SIZE];
+	int node = 0;
+	scnprintf(buf, BUF_SIZE, SYSFS_CPU "/cpu%d", cpu);
+	DIR *dir = opendir(buf);
+	if (dir != NULL) {
+		struct dirent *d;
+		while ((d = readdir(dir)) != NULL) {
+			if (sscanf(d->d_name, "node%d", &node) == 1) {
+				break;
+			}
+		}
+		closedir(dir);
+	}
+	return node;
+}
+
+/* Is this the lowest-numbered hyperthread of its physical core? */
+static bool first_smt_sibling(int cpu)
+{
+	char buf[BUF_SIZE];
+	int first;
+	bool result = true;
+	scnprintf(buf, BUF_SIZE, SYSFS_CPU "/cpu%d/topology/thread_siblings_list",
+		  cpu);
+	FILE *siblings = fopen(buf, "r");
+	if (siblings != NULL) {
+		if (fscanf(siblings, "%d", &first) == 1) {
+			result = first == cpu;
+		}
+		fclose(siblings);
+	}
+	return result;
+}
+
+void affinity_init(unsigned int num_slots, bool enabled, bool skip_smt)
+{
+	if (!enabled) {
+		return;
+	}
+
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		WARN("can't get cpu affinity; not pinning landslides\n");
+		return;
+	}
+
+	int max_node = 0;
+	ARRAY_LIST_INIT(&cores, 16);
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed) &&
+		    (!skip_smt || first_smt_sibling(cpu))) {
+			struct core c = { .cpu = cpu, .node = cpu_node(cpu) };
+			assert(c.node < MAX_NODES && "too many numa nodes");
+			ARRAY_LIST_APPEND(&cores, c);
+			max_node = MAX(max_node, c.node);
+		}
+	}
+	assert(ARRAY_LIST_SIZE(&cores) > 0 && "running on no cpus?");
+
+	/* Deal out slots to each node in turn (skipping memory-only ones), so
+	 * concurrent simics share out the memory bandwidth. If there are more
+	 * slots than cores, some have to double up. */
+	unsigned int num_cores = ARRAY_LIST_SIZE(&cores);
+	bool *taken = XMALLOC(num_cores, bool);
+	memset(taken, 0, num_cores * sizeof(bool));
+	unsigned int num_taken = 0;
+	int node = 0;
+	ARRAY_LIST_INIT(&slot_cores, num_slots);
+	while (ARRAY_LIST_SIZE(&slot_cores) < num_slots) {
+		if (num_taken == num_cores) {
+			WARN("%u cpus but only %u %s; some will share\n",
+			     num_slots, num_cores,
+			     skip_smt ? "physical cores" : "cores");
+			memset(taken, 0, num_cores * sizeof(bool));
+			num_taken = 0;
+		}
+		for (unsigned int i = 0; i < num_cores; i++) {
+			struct core *c = ARRAY_LIST_GET(&cores, i);
+			if (!taken[i] && c->node == node) {
+				DBG("cpu slot %u -> core %d (node %d)\n",
+				    ARRAY_LIST_SIZE(&slot_cores), c->cpu, c->node);
+				ARRAY_LIST_APPEND(&slot_cores, *c);
+				taken[i] = true;
+				num_taken++;
+				break;
+			}
+		}
+		node = (node + 1) % (max_node + 1);
+	}
+	FREE(taken);
+	pinning = true;
+}
+
+int affinity_node(unsigned int slot)
+{
+	return pinning ? ARRAY_LIST_GET(&slot_cores, slot)->node : -1;
+}
+
+void affinity_pin_self(unsigned int slot)
+{
+	if (!pinning) {
+		return;
+	}
+	struct core *c = ARRAY_LIST_GET(&slot_cores, slot);
+
+	/* both of these are inherited across fork and exec, by simics too */
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(c->cpu, &set);
+	int ret = sched_setaffinity(0, sizeof(set), &set);
+	EXPECT(ret == 0, "failed pin to cpu %d\n", c->cpu);
+
+	unsigned long nodemask[MAX_NODES / BITS_PER_LONG];
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[c->node / BITS_PER_LONG] |= 1UL << (c->node % BITS_PER_LONG);
+	ret = syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, MAX_NODES);
+	/* (kernels without numa support needn't be told) */
+	EXPECT(ret == 0 || errno == ENOSYS, "failed prefer node %d\n", c->node);
+}
+
+/* sched_setaffinity() is per-thread, so set it on every thread of every
+ * process in the tree. Any exiting as we go are no loss. */
+static void pin_tree(pid_t pid, cpu_set_t *set)
+{
+	char buf[BUF_SIZE];
+	scnprintf(buf, BUF_SIZE, "/proc/%d/task", pid);
+	DIR *tasks = opendir(buf);
+	if (tasks == NULL) {
+		return;
+	}
+
+	struct dirent *d;
+	while ((d = readdir(tasks)) != NULL) {
+		pid_t tid = atoi(d->d_name);
+		if (tid <= 0) {
+			continue;
+		}
+		sched_setaffinity(tid, sizeof(*set), set);
+
+		scnprintf(buf, BUF_SIZE, "/proc/%d/task/%d/children", pid, tid);
+		FILE *children = fopen(buf, "r");
+		if (children != NULL) {
+			int child;
+			while (fscanf(children, "%d", &child) == 1) {
+				pin_tree(child, set);
+			}
+			fclose(children);
+		}
+	}
+	closedir(tasks);
+}
+
+void affinity_follow(pid_t pid, unsigned int slot, int home_node)
+{
+	if (!pinning) {
+		return;
+	}
+	struct core *c = ARRAY_LIST_GET(&slot_cores, slot);
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (home_node == -1 || home_node == c->node) {
+		CPU_SET(c->cpu, &set);
+	} else {
+		/* Its memory is all on the other node. Running there, even on
+		 * a core shared with another slot, beats remote accesses. */
+		DBG("pid %d stays on node %d rather than follow slot %u to "
+		    "node %d\n", pid, home_node, slot, c->node);
+		struct core *c2;
+		unsigned int i;
+		ARRAY_LIST_FOREACH(&cores, i, c2) {
+			if (c2->node == home_node) {
+				CPU_SET(c2->cpu, &set);
+			}
+		}
+	}
+	pin_tree(pid, &set);
+}
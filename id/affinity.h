@@ -0,0 +1,24 @@
+/**
+ * @file affinity.h
+ * @brief pinning landslides to cores and their memory to numa nodes
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_AFFINITY_H
+#define __ID_AFFINITY_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Each workqueue thread's cpu slot (see time.c) gets a core of its own. */
+void affinity_init(unsigned int num_slots, bool enabled, bool skip_smt);
+int affinity_node(unsigned int slot); /* -1 if not pinning */
+
+/* in a freshly forked child, before it execs landslide */
+void affinity_pin_self(unsigned int slot);
+/* moves an already-running landslide (and its simics) to a new slot's core,
+ * unless that's on a different node than its memory, in which case it stays
+ * on that node, on whichever of its cores */
+void affinity_follow(pid_t pid, unsigned int slot, int home_node);
+
+#endif
@@ -0,0 +1,350 @@
+/**
+ * @file agent.c
+ * @brief lending this host's CPUs to a coordinator's run (quicksand -A)
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ *
+ * An agent has no workqueue, PPs, or bugs of its own. It connects to the
+ * coordinator (see remote.c), says how many CPUs it has to offer, and then
+ * starts a landslide for each job it's sent, on the configs it's sent, and
+ * relays messages between that landslide's rings and the connection until it
+ * exits. Trace files are sent along ahead of the FOUND_A_BUG naming them, so
+ * the coordinator can deal with them as if its own landslide had left them.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "agent.h"
+#include "array_list.h"
+#include "common.h"
+#include "io.h"
+#include "job.h"
+#include "messaging.h"
+#include "net.h"
+#include "sync.h"
+#include "xcalls.h"
+
+extern bool leave_logs;
+
+struct agent_job {
+	unsigned int id;
+	char *payload; /* the NET_JOB frame's */
+	unsigned int size;
+	struct net_inbox inbox; /* messages for its landslide */
+	pid_t pid; /* -1 until started; protected by the jobs lock */
+};
+
+static int coordinator_fd;
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+static ARRAY_LIST(struct agent_job *) jobs;
+static bool hung_up = false;
+/* protects the above; signalled when a job is done */
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static void send_frame(enum net_frame_kind kind, unsigned int job_id,
+		       const char *payload, unsigned int size)
+{
+	LOCK(&send_lock);
+	/* (if this fails, the main thread will notice soon enough) */
+	net_send(coordinator_fd, kind, job_id, payload, size);
+	UNLOCK(&send_lock);
+}
+
+static void send_exit(unsigned int job_id, int exit_status)
+{
+	char buf[BUF_SIZE];
+	scnprintf(buf, BUF_SIZE, "%d", exit_status);
+	send_frame(NET_EXIT, job_id, buf, strlen(buf) + 1);
+}
+
+/* Sends a trace file named by landslide's FOUND_A_BUG, then removes it, as
+ * it's the coordinator's now. */
+static void send_trace_file(unsigned int job_id, const char *trace_filename)
+{
+	char path[BUF_SIZE];
+	scnprintf(path, BUF_SIZE, "%s/%s", LANDSLIDE_PATH, trace_filename);
+	unsigned int size;
+	char *contents = read_whole_file(path, &size);
+	if (contents == NULL) {
+		WARN("[JOB %d] couldn't read trace file '%s'\n", job_id, path);
+		return;
+	}
+	unsigned int name_size = strlen(trace_filename) + 1;
+	char *payload = XMALLOC(name_size + size, char);
+	memcpy(payload, trace_filename, name_size);
+	memcpy(payload + name_size, contents, size);
+	send_frame(NET_FILE, job_id, payload, name_size + size);
+	FREE(payload);
+	FREE(contents);
+	XREMOVE(path);
+}
+
+/* The NET_JOB payload is four NUL-terminated strings; see net.h. */
+static bool unpack_job(struct agent_job *aj, char **fields, unsigned int num)
+{
+	char *p = aj->payload;
+	char *end = aj->payload + aj->size;
+	for (unsigned int i = 0; i < num; i++) {
+		char *nul = p < end ? memchr(p, '\0', end - p) : NULL;
+		if (nul == NULL) {
+			return false;
+		}
+		fields[i] = p;
+		p = nul + 1;
+	}
+	return true;
+}
+
+static void write_config(struct file *f, const char *template, const char *text)
+{
+	create_file(f, template);
+	bool ok = write_all(f->fd, text, strlen(text));
+	assert(ok && "failed write config file");
+}
+
+/* Passes messages both ways until the landslide hangs up. */
+static void relay(struct agent_job *aj, struct messaging_state *mess)
+{
+	bool inbox_closed = false;
+	while (true) {
+		bool child_hung_up;
+		unsigned int size;
+		char *msg;
+		while ((msg = messaging_recv_raw(mess, &size, &child_hung_up))
+		       != NULL) {
+			const char *trace_filename =
+				messaging_trace_filename(msg, size);
+			if (trace_filename != NULL) {
+				send_trace_file(aj->id, trace_filename);
+			}
+			send_frame(NET_MSG, aj->id, msg, size);
+		}
+		if (child_hung_up) {
+			return;
+		}
+
+		while (!inbox_closed &&
+		       (msg = net_inbox_pop(&aj->inbox, false, &size,
+					    &inbox_closed)) != NULL) {
+			messaging_send_raw(mess, msg, size);
+			FREE(msg);
+		}
+
+		/* (once the coordinator's gone, its landslide's been killed;
+		 * just wait for that to be noticed) */
+		struct pollfd pfds[2] = {
+			{ .fd = mess->input_pipe.fd, .events = POLLIN },
+			{ .fd = inbox_closed ? -1 : aj->inbox.doorbell[0],
+			  .events = POLLIN },
+		};
+		int ret = poll(pfds, 2, -1);
+		assert((ret > 0 || (ret < 0 && errno == EINTR)) &&
+		       "poll for messages failed");
+	}
+}
+
+/* Returns the landslide's exit status. */
+static int run_agent_job(struct agent_job *aj)
+{
+	char *fields[4];
+	if (!unpack_job(aj, fields, 4)) {
+		WARN("[JOB %d] garbled job from coordinator\n", aj->id);
+		return EXIT_FAILURE;
+	}
+	const char *test_name = fields[0];
+	bool rebuild = strcmp(fields[1], "1") == 0;
+
+	struct file config_static, config_dynamic, log_stdout, log_stderr;
+	write_config(&config_static, CONFIG_STATIC_TEMPLATE, fields[2]);
+	write_config(&config_dynamic, CONFIG_DYNAMIC_TEMPLATE, fields[3]);
+	create_file(&log_stdout, LOG_FILE_TEMPLATE("setup"));
+	create_file(&log_stderr, LOG_FILE_TEMPLATE("output"));
+
+	struct messaging_state mess;
+	messaging_init(&mess, &config_static, &config_dynamic, aj->id);
+	move_file_to(&config_static,  LANDSLIDE_PATH);
+	move_file_to(&config_dynamic, LANDSLIDE_PATH);
+
+	bool need_compile = landslide_build_begin(test_name, rebuild);
+	pid_t pid = fork_landslide(aj->id, &config_static, &config_dynamic,
+				   &log_stdout, &log_stderr, (unsigned long)-1);
+	if (pid < 0) {
+		/* (and mustn't be stored, or a hangup would kill(-1)) */
+		ERR("[JOB %d] Couldn't fork Landslide: %s\n", aj->id,
+		    strerror(errno));
+		landslide_build_end(test_name, false, false);
+		messaging_abort(&mess);
+		delete_file(&log_stdout, true);
+		delete_file(&log_stderr, true);
+		delete_file(&config_static, true);
+		delete_file(&config_dynamic, true);
+		return EXIT_FAILURE;
+	}
+	LOCK(&jobs_lock);
+	aj->pid = pid;
+	if (hung_up) {
+		kill(pid, SIGKILL);
+	}
+	UNLOCK(&jobs_lock);
+
+	bool child_alive = wait_for_child(&mess);
+	landslide_build_end(test_name, need_compile, child_alive);
+	if (child_alive) {
+		DBG("[JOB %d] up; output in %s\n", aj->id, log_stderr.filename);
+		send_frame(NET_STARTED, aj->id, log_stderr.filename,
+			   strlen(log_stderr.filename) + 1);
+		relay(aj, &mess);
+	} else {
+		ERR("[JOB %d] There was a problem setting up Landslide.\n",
+		    aj->id);
+		ERR("[JOB %d] For details see %s and %s\n", aj->id,
+		    log_stdout.filename, log_stderr.filename);
+	}
+
+	int child_status;
+	pid_t result_pid = waitpid(pid, &child_status, 0);
+	assert(result_pid == pid && "wait failed");
+	int exit_status = WIFEXITED(child_status) ?
+		WEXITSTATUS(child_status) : EXIT_FAILURE;
+	DBG("Landslide pid %d exited with status %d\n", pid, exit_status);
+
+	finish_messaging(&mess);
+	bool should_delete = !leave_logs && exit_status == LS_NO_KNOWN_BUG;
+	delete_file(&log_stdout, should_delete);
+	delete_file(&log_stderr, should_delete);
+	delete_file(&config_static, true);
+	delete_file(&config_dynamic, true);
+	return exit_status;
+}
+
+static void *agent_job_thread(void *arg)
+{
+	struct agent_job *aj = (struct agent_job *)arg;
+	send_exit(aj->id, run_agent_job(aj));
+
+	LOCK(&jobs_lock);
+	struct agent_job **aj2;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&jobs, i, aj2) {
+		if (*aj2 == aj) {
+			ARRAY_LIST_REMOVE_SWAP(&jobs, i);
+			break;
+		}
+	}
+	BROADCAST(&jobs_cond);
+	UNLOCK(&jobs_lock);
+
+	net_inbox_destroy(&aj->inbox);
+	FREE(aj->payload);
+	FREE(aj);
+	return NULL;
+}
+
+/* with the jobs lock held */
+static struct agent_job *find_job(unsigned int id)
+{
+	struct agent_job **aj;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&jobs, i, aj) {
+		if ((*aj)->id == id) {
+			return *aj;
+		}
+	}
+	return NULL;
+}
+
+static void start_agent_job(unsigned int id, char *payload, unsigned int size)
+{
+	struct agent_job *aj = XMALLOC(1, struct agent_job);
+	aj->id = id;
+	aj->payload = payload;
+	aj->size = size;
+	net_inbox_init(&aj->inbox);
+	aj->pid = -1;
+
+	LOCK(&jobs_lock);
+	ARRAY_LIST_APPEND(&jobs, aj);
+	UNLOCK(&jobs_lock);
+
+	pthread_t child;
+	int ret = pthread_create(&child, NULL, agent_job_thread, (void *)aj);
+	assert(ret == 0 && "failed create agent job thread");
+	ret = pthread_detach(child);
+	assert(ret == 0 && "failed detach agent job thread");
+}
+
+/* Runs jobs for the coordinator until it hangs up, then cleans up after any
+ * left running. Returns the process's exit status. */
+int agent_main(const char *host, unsigned int port, unsigned long num_cpus,
+	       const char *token)
+{
+	coordinator_fd = net_connect(host, port);
+	if (coordinator_fd < 0) {
+		return EXIT_FAILURE;
+	}
+	ARRAY_LIST_INIT(&jobs, 16);
+
+	/* (see net.h) */
+	char buf[BUF_SIZE * 2];
+	unsigned int token_size = strlen(token) + 1;
+	assert(token_size <= BUF_SIZE);
+	memcpy(buf, token, token_size);
+	scnprintf(buf + token_size, BUF_SIZE, "%lu", num_cpus);
+	send_frame(NET_HELLO, 0, buf,
+		   token_size + strlen(buf + token_size) + 1);
+	PRINT("Lending %lu CPU%s to %s:%u\n", num_cpus,
+	      num_cpus == 1 ? "" : "s", host, port);
+
+	struct net_header h;
+	char *payload;
+	while ((payload = net_recv(coordinator_fd, &h, NET_MAX_PAYLOAD))
+	       != NULL) {
+		if (h.kind == NET_JOB) {
+			DBG("[JOB %d] received from coordinator\n", h.job_id);
+			start_agent_job(h.job_id, payload, h.size);
+			continue;
+		} else if (h.kind == NET_MSG) {
+			LOCK(&jobs_lock);
+			struct agent_job *aj = find_job(h.job_id);
+			if (aj != NULL) {
+				net_inbox_push(&aj->inbox, payload, h.size);
+				payload = NULL;
+			}
+			UNLOCK(&jobs_lock);
+		} else {
+			WARN("Coordinator sent a frame of unknown kind %u\n",
+			     h.kind);
+		}
+		FREE(payload);
+	}
+
+	/* Whatever's still running is of no use to anyone now. */
+	PRINT("Coordinator hung up; done.\n");
+	LOCK(&jobs_lock);
+	hung_up = true;
+	struct agent_job **aj;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&jobs, i, aj) {
+		net_inbox_close(&(*aj)->inbox);
+		if ((*aj)->pid != -1) {
+			kill((*aj)->pid, SIGKILL);
+		}
+	}
+	while (ARRAY_LIST_SIZE(&jobs) > 0) {
+		WAIT(&jobs_cond, &jobs_lock);
+	}
+	UNLOCK(&jobs_lock);
+	XCLOSE(coordinator_fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,13 @@
+/**
+ * @file agent.h
+ * @brief lending this host's CPUs to a coordinator's run (quicksand -A)
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_AGENT_H
+#define __ID_AGENT_H
+
+int agent_main(const char *host, unsigned int port, unsigned long num_cpus,
+	       const char *token);
+
+#endif
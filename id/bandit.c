@@ -0,0 +1,200 @@
+/**
+ * @file bandit.c
+ * @brief learning which PPs are worth CPU time, to prioritize jobs by
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ *
+ * Some PPs pay off far more than others -- a data race that's been confirmed
+ * tends to lead to more of them, and to bugs. With -B, each PP is treated as
+ * an arm of a multi-armed bandit: every job's CPU time is charged to each of
+ * its PPs, and whatever it finds (new PPs, confirmed races, bugs) is credited
+ * to each of them too. Each PP's yield per CPU-second is then modelled as a
+ * Poisson rate with a Gamma posterior, whose prior is the yield of all jobs so
+ * far, weighted as though from PRIOR_SECS of CPU time; so a PP no job has
+ * spent time on yet looks average, but with wide error bars. A job's score is
+ * the mean of its PPs' scores, each of which is either
+ *
+ *   ucb:      the posterior mean plus a few standard deviations, more of them
+ *             as more total time passes (a Bayes-UCB rule), or
+ *   thompson: a random draw from the posterior.
+ *
+ * Either way, PPs are tried in proportion to how likely they are to be the
+ * best, and the workqueue (see work.c) runs the best-scoring job next, fresh
+ * or deferred alike.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "array_list.h"
+#include "bandit.h"
+#include "common.h"
+#include "pp.h"
+#include "sync.h"
+#include "time.h"
+
+/* how much each kind of find is worth */
+#define REWARD_NEW_PP          1.0L
+#define REWARD_CONFIRMED_RACE  4.0L
+#define REWARD_BUG            16.0L
+
+/* weight of the prior, in CPU-seconds */
+#define PRIOR_SECS 60.0L
+
+struct arm {
+	long double reward;
+	long double secs; /* cpu time charged */
+};
+
+static enum bandit_policy policy = BANDIT_OFF;
+/* indexed by pp id; plus the total over all jobs, which also serves as the arm
+ * for jobs with no PPs */
+static ARRAY_LIST(struct arm) arms;
+static struct arm total;
+static unsigned int seed;
+/* protects all the above; a leaf lock */
+static pthread_mutex_t bandit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool bandit_parse_policy(const char *name, enum bandit_policy *result)
+{
+	if (strcmp(name, "off") == 0) {
+		*result = BANDIT_OFF;
+	} else if (strcmp(name, "ucb") == 0) {
+		*result = BANDIT_UCB;
+	} else if (strcmp(name, "thompson") == 0) {
+		*result = BANDIT_THOMPSON;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void bandit_init(enum bandit_policy arg_policy)
+{
+	policy = arg_policy;
+	ARRAY_LIST_INIT(&arms, 64);
+	total.reward = 0;
+	total.secs = 0;
+	seed = (unsigned int)(timestamp() ^ getpid());
+}
+
+bool bandit_enabled()
+{
+	return policy != BANDIT_OFF;
+}
+
+/* with the bandit lock held */
+static struct arm *get_arm(unsigned int pp_id)
+{
+	while (ARRAY_LIST_SIZE(&arms) <= pp_id) {
+		struct arm fresh = { .reward = 0, .secs = 0 };
+		ARRAY_LIST_APPEND(&arms, fresh);
+	}
+	return ARRAY_LIST_GET(&arms, pp_id);
+}
+
+void bandit_reward(struct pp_set *config, enum bandit_reward what)
+{
+	if (policy == BANDIT_OFF) {
+		return;
+	}
+	long double reward = what == BANDIT_BUG ? REWARD_BUG :
+		what == BANDIT_CONFIRMED_RACE ? REWARD_CONFIRMED_RACE :
+		REWARD_NEW_PP;
+	struct pp *pp;
+	LOCK(&bandit_lock);
+	FOR_EACH_PP(pp, config) {
+		get_arm(pp->id)->reward += reward;
+	}
+	total.reward += reward;
+	UNLOCK(&bandit_lock);
+}
+
+void bandit_charge(struct pp_set *config, unsigned long cpu_usecs)
+{
+	if (policy == BANDIT_OFF) {
+		return;
+	}
+	long double secs = (long double)cpu_usecs / 1000000;
+	struct pp *pp;
+	LOCK(&bandit_lock);
+	FOR_EACH_PP(pp, config) {
+		get_arm(pp->id)->secs += secs;
+	}
+	total.secs += secs;
+	UNLOCK(&bandit_lock);
+}
+
+/* with the bandit lock held */
+static long double uniform()
+{
+	/* in (0,1), so it's always safe to take the log of */
+	return ((long double)rand_r(&seed) + 1) / ((long double)RAND_MAX + 2);
+}
+
+/* with the bandit lock held */
+static long double normal()
+{
+	return sqrtl(-2 * logl(uniform())) * cosl(2 * M_PI * uniform());
+}
+
+/* Marsaglia & Tsang's method; with the bandit lock held */
+static long double sample_gamma(long double shape, long double rate)
+{
+	if (shape < 1) {
+		return sample_gamma(shape + 1, rate) * powl(uniform(), 1 / shape);
+	}
+	long double d = shape - 1.0L / 3;
+	long double c = 1 / sqrtl(9 * d);
+	while (true) {
+		long double x = normal();
+		long double v = 1 + c * x;
+		if (v <= 0) {
+			continue;
+		}
+		v = v * v * v;
+		if (logl(uniform()) < x * x / 2 + d - d * v + d * logl(v)) {
+			return d * v / rate;
+		}
+	}
+}
+
+/* with the bandit lock held */
+static long double arm_score(struct arm *arm, long double prior_rate)
+{
+	long double shape = arm->reward + prior_rate * PRIOR_SECS;
+	long double rate = arm->secs + PRIOR_SECS;
+	if (policy == BANDIT_THOMPSON) {
+		return sample_gamma(shape, rate);
+	} else {
+		/* a wider bound the more time has been spent overall, so that
+		 * no arm is given up on for good */
+		long double z = sqrtl(2 * logl(2 + total.secs / PRIOR_SECS));
+		return shape / rate + z * sqrtl(shape) / rate;
+	}
+}
+
+long double bandit_score(struct pp_set *config)
+{
+	assert(policy != BANDIT_OFF);
+	LOCK(&bandit_lock);
+	/* (the +1 keeps the prior from being exactly 0 before any finds) */
+	long double prior_rate = (total.reward + 1) / (total.secs + PRIOR_SECS);
+	long double score;
+	if (config->size == 0) {
+		score = arm_score(&total, prior_rate);
+	} else {
+		long double sum = 0;
+		struct pp *pp;
+		FOR_EACH_PP(pp, config) {
+			sum += arm_score(get_arm(pp->id), prior_rate);
+		}
+		score = sum / config->size;
+	}
+	UNLOCK(&bandit_lock);
+	return score;
+}
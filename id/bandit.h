@@ -0,0 +1,29 @@
+/**
+ * @file bandit.h
+ * @brief learning which PPs are worth CPU time, to prioritize jobs by
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_BANDIT_H
+#define __ID_BANDIT_H
+
+#include <stdbool.h>
+
+struct pp_set;
+
+enum bandit_policy { BANDIT_OFF, BANDIT_UCB, BANDIT_THOMPSON };
+enum bandit_reward { BANDIT_NEW_PP, BANDIT_CONFIRMED_RACE, BANDIT_BUG };
+
+bool bandit_parse_policy(const char *name, enum bandit_policy *result);
+void bandit_init(enum bandit_policy policy);
+bool bandit_enabled();
+
+/* credited to each of the PPs of the job it happened in */
+void bandit_reward(struct pp_set *config, enum bandit_reward what);
+void bandit_charge(struct pp_set *config, unsigned long cpu_usecs);
+
+/* how promising a job with these PPs is; higher is better. With Thompson
+ * sampling, a fresh random draw each time. */
+long double bandit_score(struct pp_set *config);
+
+#endif
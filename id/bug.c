@@ -16,6 +16,7 @@
 #include "xcalls.h"
 
 struct bug_info {
+	struct test *test;
 	char *trace_filename;
 	struct pp_set *config;
 	char *log_filename;
@@ -40,9 +41,10 @@ static void check_init()
 void found_a_bug(char *trace_filename, struct job *j)
 {
 	struct bug_info b;
+	b.test = j->test;
 	b.trace_filename = XSTRDUP(trace_filename);
 	b.config = clone_pp_set(j->config);
-	b.log_filename = XSTRDUP(j->log_stderr.filename);
+	b.log_filename = XSTRDUP(j->log_filename);
 
 	check_init();
 
@@ -51,8 +53,9 @@ void found_a_bug(char *trace_filename, struct job *j)
 	UNLOCK(&fab_lock);
 }
 
-/* Did a prior job with a subset of the given PPs already find a bug? */
-bool bug_already_found(struct pp_set *config)
+/* Did a prior job of the same test with a subset of the given PPs already
+ * find a bug? */
+bool bug_already_found(struct test *test, struct pp_set *config)
 {
 	unsigned int i;
 	struct bug_info *b;
@@ -62,7 +65,7 @@ bool bug_already_found(struct pp_set *config)
 
 	LOCK(&fab_lock);
 	ARRAY_LIST_FOREACH(&fab_list, i, b) {
-		if (pp_subset(b->config, config)) {
+		if (b->test == test && pp_subset(b->config, config)) {
 			result = true;
 			break;
 		}
@@ -81,8 +84,11 @@ bool found_any_bugs()
 
 	LOCK(&fab_lock);
 	ARRAY_LIST_FOREACH(&fab_list, i, b) {
-		printf(COLOUR_BOLD COLOUR_RED
-		       "Found a bug - %s - with PPs: ", b->trace_filename);
+		printf(COLOUR_BOLD COLOUR_RED "Found a bug ");
+		if (num_tests() > 1) {
+			printf("in %s ", b->test->name);
+		}
+		printf("- %s - with PPs: ", b->trace_filename);
 		print_pp_set(b->config, true);
 		// FIXME: do something better than hardcode print "id/"
 		printf(" (log file: id/%s)\n" COLOUR_DEFAULT, b->log_filename);
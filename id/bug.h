@@ -11,9 +11,10 @@
 
 struct job;
 struct pp_set;
+struct test;
 
 void found_a_bug(char *trace_filename, struct job *j);
-bool bug_already_found(struct pp_set *config);
+bool bug_already_found(struct test *test, struct pp_set *config);
 bool found_any_bugs();
 
 #endif
@@ -0,0 +1,519 @@
+/**
+ * @file cache.c
+ * @brief remembering job results across runs of the same test
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ *
+ * A job's outcome depends only on the kernel image, the test, the static
+ * config, and its set of PPs. So if the same test is run again on the same
+ * image, there's no need to re-explore a state space that was already completed
+ * last time: we can report its bug (if any) and replay the data races it found
+ * (which seeds the same follow-up jobs) without ever starting landslide.
+ *
+ * Results are kept in one append-only file per image/test/config (so a test run
+ * alongside others in one batch shares results with it run alone), one line per
+ * fact, tab-separated, keyed by the sorted config_strs of the job's PPs (PP ids
+ * themselves are assigned in discovery order, so differ from run to run):
+ *
+ *     done <key>
+ *     bug  <key> <trace file> <log file>
+ *     dr   <key> <eip> <tid> <confirmed> <deterministic> <free_re_malloc>
+ *          <last_call> <most_recent_syscall> <pretty-printed>
+ *
+ * Jobs that timed out or were cancelled have only their "dr" lines recorded;
+ * these are still replayed to seed follow-up jobs early, but the job is rerun.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "array_list.h"
+#include "bug.h"
+#include "cache.h"
+#include "common.h"
+#include "io.h"
+#include "job.h"
+#include "messaging.h"
+#include "pp.h"
+#include "sync.h"
+#include "time.h"
+#include "xcalls.h"
+
+struct cached_dr {
+	unsigned int eip;
+	unsigned int tid;
+	bool confirmed;
+	bool deterministic;
+	bool free_re_malloc;
+	unsigned int last_call;
+	unsigned int most_recent_syscall;
+	char *pretty;
+};
+
+typedef ARRAY_LIST(struct cached_dr) cached_dr_list_t;
+
+struct cache_entry {
+	char *key;
+	enum { CACHE_PARTIAL, CACHE_DONE, CACHE_BUG } result;
+	char *trace_filename; /* if CACHE_BUG */
+	char *log_filename; /* if CACHE_BUG */
+	cached_dr_list_t drs;
+};
+
+#define CACHE_BUCKETS 256
+
+/* one per test */
+struct test_cache {
+	bool active;
+	char *filename;
+	int fd;
+	ARRAY_LIST(struct cache_entry *) table[CACHE_BUCKETS];
+};
+
+/* indexed by test; NULL if not caching at all */
+static struct test_cache *caches = NULL;
+/* protects the tables and appends to the files; a leaf lock */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+extern bool pintos;
+extern bool pathos;
+extern bool use_icb;
+extern bool preempt_everywhere;
+extern bool pure_hb;
+
+static unsigned int hash_key(const char *key)
+{
+	unsigned int hash = 5381;
+	for (; *key != '\0'; key++) {
+		hash = hash * 33 + (unsigned char)*key;
+	}
+	return hash;
+}
+
+/* call with cache_lock held */
+static struct cache_entry *find_entry(struct test_cache *c, const char *key,
+				      bool create)
+{
+	unsigned int bucket = hash_key(key) % CACHE_BUCKETS;
+	struct cache_entry **ep;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&c->table[bucket], i, ep) {
+		if (strcmp((*ep)->key, key) == 0) {
+			return *ep;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+	struct cache_entry *e = XMALLOC(1, struct cache_entry);
+	e->key = XSTRDUP((char *)key);
+	e->result = CACHE_PARTIAL;
+	e->trace_filename = NULL;
+	e->log_filename = NULL;
+	ARRAY_LIST_INIT(&e->drs, 4);
+	ARRAY_LIST_APPEND(&c->table[bucket], e);
+	return e;
+}
+
+/* call with cache_lock held; returns true if it was new */
+static bool add_dr(struct cache_entry *e, struct cached_dr *dr)
+{
+	struct cached_dr *old;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&e->drs, i, old) {
+		if (old->eip == dr->eip && old->tid == dr->tid &&
+		    old->last_call == dr->last_call &&
+		    old->most_recent_syscall == dr->most_recent_syscall &&
+		    old->confirmed == dr->confirmed) {
+			return false;
+		}
+	}
+	ARRAY_LIST_APPEND(&e->drs, *dr);
+	return true;
+}
+
+/* call with cache_lock held */
+static void append_line(struct test_cache *c, const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	int len = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+
+	char *buf = XMALLOC(len + 1, char);
+	va_start(ap, format);
+	vsnprintf(buf, len + 1, format, ap);
+	va_end(ap);
+
+	/* a single O_APPEND write, so a crash can only truncate the last line */
+	int ret = write(c->fd, buf, len);
+	EXPECT(ret == len, "failed write to cache file '%s'\n", c->filename);
+	FREE(buf);
+}
+
+static int compare_strs(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static char *make_key(struct pp_set *config)
+{
+	struct pp *pp;
+	unsigned int num_pps = 0;
+	unsigned int len = 1;
+	FOR_EACH_PP(pp, config) {
+		num_pps++;
+		len += strlen(pp->config_str) + 1;
+	}
+
+	char **strs = XMALLOC(MAX(num_pps, 1U), char *);
+	unsigned int i = 0;
+	FOR_EACH_PP(pp, config) {
+		strs[i++] = pp->config_str;
+	}
+	qsort(strs, num_pps, sizeof(char *), compare_strs);
+
+	char *key = XMALLOC(len, char);
+	unsigned int pos = 0;
+	key[0] = '\0';
+	for (i = 0; i < num_pps; i++) {
+		pos += scnprintf(key + pos, len - pos, "%s%s",
+				 i == 0 ? "" : ",", strs[i]);
+	}
+	FREE(strs);
+	return key;
+}
+
+/* tabs and newlines would break the file format */
+static char *sanitize(const char *str)
+{
+	char *result = XSTRDUP((char *)str);
+	for (char *c = result; *c != '\0'; c++) {
+		if (*c == '\t' || *c == '\n') {
+			*c = ' ';
+		}
+	}
+	return result;
+}
+
+static bool parse_uint(char *str, unsigned int *result)
+{
+	char *end;
+	if (str == NULL || *str == '\0') {
+		return false;
+	}
+	*result = strtoul(str, &end, 0);
+	return *end == '\0';
+}
+
+static bool parse_line(struct test_cache *c, char *line)
+{
+	char *kind = strsep(&line, "\t");
+	char *key = strsep(&line, "\t");
+	if (key == NULL) {
+		return false;
+	}
+
+	if (strcmp(kind, "done") == 0) {
+		struct cache_entry *e = find_entry(c, key, true);
+		if (e->result == CACHE_PARTIAL) {
+			e->result = CACHE_DONE;
+		}
+		return true;
+	} else if (strcmp(kind, "bug") == 0) {
+		char *trace_filename = strsep(&line, "\t");
+		char *log_filename = strsep(&line, "\t");
+		if (log_filename == NULL) {
+			return false;
+		}
+		struct cache_entry *e = find_entry(c, key, true);
+		if (e->result != CACHE_BUG) {
+			e->result = CACHE_BUG;
+			e->trace_filename = XSTRDUP(trace_filename);
+			e->log_filename = XSTRDUP(log_filename);
+		}
+		return true;
+	} else if (strcmp(kind, "dr") == 0) {
+		struct cached_dr dr;
+		unsigned int confirmed, deterministic, free_re_malloc;
+		if (!parse_uint(strsep(&line, "\t"), &dr.eip) ||
+		    !parse_uint(strsep(&line, "\t"), &dr.tid) ||
+		    !parse_uint(strsep(&line, "\t"), &confirmed) ||
+		    !parse_uint(strsep(&line, "\t"), &deterministic) ||
+		    !parse_uint(strsep(&line, "\t"), &free_re_malloc) ||
+		    !parse_uint(strsep(&line, "\t"), &dr.last_call) ||
+		    !parse_uint(strsep(&line, "\t"), &dr.most_recent_syscall) ||
+		    line == NULL) {
+			return false;
+		}
+		dr.confirmed = confirmed != 0;
+		dr.deterministic = deterministic != 0;
+		dr.free_re_malloc = free_re_malloc != 0;
+		dr.pretty = XSTRDUP(line);
+		if (!add_dr(find_entry(c, key, true), &dr)) {
+			FREE(dr.pretty);
+		}
+		return true;
+	} else {
+		return false;
+	}
+}
+
+static void load_cache(struct test_cache *c)
+{
+	FILE *f = fopen(c->filename, "r");
+	if (f == NULL) {
+		return;
+	}
+
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	unsigned int num_lines = 0;
+	unsigned int num_bad = 0;
+	while ((len = getline(&line, &line_size, f)) != -1) {
+		if (len > 0 && line[len - 1] == '\n') {
+			line[len - 1] = '\0';
+		} else {
+			/* truncated by a crash mid-write */
+			num_bad++;
+			continue;
+		}
+		if (parse_line(c, line)) {
+			num_lines++;
+		} else {
+			num_bad++;
+		}
+	}
+	free(line);
+	fclose(f);
+
+	DBG("Loaded %u cached results from %s\n", num_lines, c->filename);
+	if (num_bad > 0) {
+		WARN("Ignored %u malformed lines in %s\n", num_bad, c->filename);
+	}
+}
+
+/* Identifies the kernel image (which, for pebbles, includes the user tests),
+ * landslide config, and landslide itself, by asking the build glue to hash
+ * them. */
+static bool get_image_hash(char *buf, unsigned int maxlen)
+{
+	FILE *p = popen("cd " LANDSLIDE_PATH " && ./" CACHEKEY_PROGNAME, "r");
+	if (p == NULL) {
+		return false;
+	}
+	bool ok = fgets(buf, maxlen, p) != NULL;
+	int status = pclose(p);
+	if (!ok || status != 0) {
+		return false;
+	}
+	buf[strcspn(buf, "\n")] = '\0';
+	return buf[0] != '\0';
+}
+
+void cache_init(const char *cache_dir)
+{
+	if (cache_dir == NULL) {
+		return;
+	}
+	assert(num_tests() > 0 && "cache_init before set_job_options");
+
+	char image_hash[BUF_SIZE];
+	if (!get_image_hash(image_hash, BUF_SIZE)) {
+		WARN("Couldn't identify the kernel image; not using the cache\n");
+		return;
+	}
+	if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+		WARN("Couldn't create cache directory '%s' (%s); not using the "
+		     "cache\n", cache_dir, strerror(errno));
+		return;
+	}
+
+	caches = XMALLOC(num_tests(), struct test_cache);
+	for (unsigned int t = 0; t < num_tests(); t++) {
+		struct test_cache *c = &caches[t];
+		const char *test_name = get_test(t)->name;
+		unsigned int len = strlen(cache_dir) + strlen(image_hash) +
+			strlen(test_name) + BUF_SIZE;
+		c->filename = XMALLOC(len, char);
+		/* verbosity and warm workers don't affect what a job finds */
+		scnprintf(c->filename, len, "%s/%s-%s%s%s%s%s%s.cache",
+			  cache_dir, image_hash, test_name,
+			  pintos ? "-pintos" : "", pathos ? "-pathos" : "",
+			  use_icb ? "-icb" : "",
+			  preempt_everywhere ? "-everywhere" : "",
+			  pure_hb ? "-purehb" : "");
+
+		for (unsigned int i = 0; i < CACHE_BUCKETS; i++) {
+			ARRAY_LIST_INIT(&c->table[i], 4);
+		}
+		load_cache(c);
+
+		c->fd = open(c->filename,
+			     O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		c->active = c->fd >= 0;
+		if (!c->active) {
+			WARN("Couldn't open cache file '%s' (%s); not caching "
+			     "%s\n", c->filename, strerror(errno), test_name);
+		}
+	}
+}
+
+/* NULL if not caching this job's test */
+static struct test_cache *job_cache(struct job *j)
+{
+	if (caches == NULL || !caches[j->test->index].active) {
+		return NULL;
+	}
+	return &caches[j->test->index];
+}
+
+static bool file_exists(const char *dir, const char *filename)
+{
+	char path[BUF_SIZE];
+	scnprintf(path, BUF_SIZE, "%s/%s", dir, filename);
+	return access(path, F_OK) == 0;
+}
+
+/* Called before a fresh job starts. If a previous run already completed the
+ * same state space, marks it complete as that run did and returns true. */
+bool cache_replay_job(struct job *j)
+{
+	struct test_cache *c = job_cache(j);
+	if (c == NULL) {
+		return false;
+	}
+	if (j->cache_key == NULL) {
+		j->cache_key = make_key(j->config);
+	}
+
+	LOCK(&cache_lock);
+	struct cache_entry *e = find_entry(c, j->cache_key, false);
+	if (e == NULL) {
+		UNLOCK(&cache_lock);
+		return false;
+	}
+	/* entries are never removed, nor their filenames changed once set */
+	bool found_bug = e->result == CACHE_BUG;
+	bool skip = e->result == CACHE_DONE ||
+		(found_bug && file_exists(ROOT_PATH, e->trace_filename));
+	char *trace_filename = e->trace_filename;
+	char *log_filename = e->log_filename;
+	cached_dr_list_t drs;
+	ARRAY_LIST_CLONE(&drs, &e->drs);
+	UNLOCK(&cache_lock);
+
+	/* Replaying the data races adds the same new jobs this one would have.
+	 * Even if we must rerun it, this gets them going a little sooner. */
+	struct pp_set *discovered_pps = create_pp_set(j->test, PRIORITY_NONE);
+	struct data_race_batch batch = { .big_pps = NULL, .small_pps = NULL };
+	struct cached_dr *dr;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&drs, i, dr) {
+		handle_data_race(j, &discovered_pps, &batch, dr->eip, dr->tid,
+				 dr->confirmed, dr->deterministic,
+				 dr->free_re_malloc, dr->last_call,
+				 dr->most_recent_syscall, dr->pretty);
+	}
+	flush_data_races(j, &batch);
+	free_pp_set(discovered_pps);
+	ARRAY_LIST_FREE(&drs);
+
+	if (!skip) {
+		return false;
+	}
+
+	DBG("[JOB %d] Already explored in a previous run; skipping.\n", j->id);
+	WRITE_LOCK(&j->stats_lock);
+	j->complete = true;
+	if (found_bug) {
+		j->trace_filename = XSTRDUP(trace_filename);
+		if (file_exists(".", log_filename)) {
+			j->log_filename = XSTRDUP(log_filename);
+		}
+		j->fab_timestamp = time_elapsed();
+		j->fab_cputime = total_cpu_time();
+	}
+	STATS_WRITE_UNLOCK(j);
+
+	if (found_bug) {
+		found_a_bug(trace_filename, j);
+	}
+	return true;
+}
+
+void cache_record_data_race(struct job *j, unsigned int eip, unsigned int tid,
+			    bool confirmed, bool deterministic, bool free_re_malloc,
+			    unsigned int last_call, unsigned int most_recent_syscall,
+			    const char *pretty)
+{
+	struct test_cache *c = job_cache(j);
+	if (c == NULL || j->cache_key == NULL) {
+		return;
+	}
+
+	struct cached_dr dr;
+	dr.eip = eip;
+	dr.tid = tid;
+	dr.confirmed = confirmed;
+	dr.deterministic = deterministic;
+	dr.free_re_malloc = free_re_malloc;
+	dr.last_call = last_call;
+	dr.most_recent_syscall = most_recent_syscall;
+	dr.pretty = sanitize(pretty);
+
+	LOCK(&cache_lock);
+	if (add_dr(find_entry(c, j->cache_key, true), &dr)) {
+		append_line(c, "dr\t%s\t0x%x\t0x%x\t%d\t%d\t%d\t0x%x\t0x%x\t%s\n",
+			    j->cache_key, eip, tid, confirmed ? 1 : 0,
+			    deterministic ? 1 : 0, free_re_malloc ? 1 : 0,
+			    last_call, most_recent_syscall, dr.pretty);
+	} else {
+		FREE(dr.pretty);
+	}
+	UNLOCK(&cache_lock);
+}
+
+/* Called when a job's landslide is done with it. Only results that a rerun
+ * would reproduce are recorded: not time-outs, cancellations, or crashes. */
+void cache_record_job(struct job *j, bool bug_free)
+{
+	struct test_cache *c = job_cache(j);
+	if (c == NULL || j->cache_key == NULL) {
+		return;
+	}
+
+	READ_LOCK(&j->stats_lock);
+	char *trace_filename = XSTRDUP(j->trace_filename);
+	char *log_filename = XSTRDUP(j->log_filename);
+	/* a parked job will be back to finish up later */
+	bool finished = !j->cancelled && !j->timed_out && !j->need_rerun &&
+		j->park_filename == NULL;
+	RW_UNLOCK(&j->stats_lock);
+
+	LOCK(&cache_lock);
+	struct cache_entry *e = find_entry(c, j->cache_key, true);
+	if (trace_filename != NULL && log_filename != NULL &&
+	    e->result != CACHE_BUG) {
+		e->result = CACHE_BUG;
+		e->trace_filename = trace_filename;
+		e->log_filename = log_filename;
+		append_line(c, "bug\t%s\t%s\t%s\n", j->cache_key, trace_filename,
+			    log_filename);
+		trace_filename = log_filename = NULL;
+	} else if (trace_filename == NULL && bug_free && finished &&
+		   e->result == CACHE_PARTIAL) {
+		e->result = CACHE_DONE;
+		append_line(c, "done\t%s\n", j->cache_key);
+	}
+	UNLOCK(&cache_lock);
+
+	FREE(trace_filename);
+	FREE(log_filename);
+}
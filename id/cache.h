@@ -0,0 +1,22 @@
+/**
+ * @file cache.h
+ * @brief remembering job results across runs of the same test
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_CACHE_H
+#define __ID_CACHE_H
+
+#include <stdbool.h>
+
+struct job;
+
+void cache_init(const char *cache_dir);
+bool cache_replay_job(struct job *j); /* true if the job needn't be run */
+void cache_record_data_race(struct job *j, unsigned int eip, unsigned int tid,
+			    bool confirmed, bool deterministic, bool free_re_malloc,
+			    unsigned int last_call, unsigned int most_recent_syscall,
+			    const char *pretty);
+void cache_record_job(struct job *j, bool bug_free);
+
+#endif
@@ -10,6 +10,7 @@
 #include <fcntl.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -95,6 +96,30 @@ void delete_unused_fifo(char *name)
 	FREE(name);
 }
 
+/* creates a zero-filled file on the ramdisk and maps it shared; the filename
+ * (for the other process to map too) is left in f->filename. */
+void *create_shm(struct file *f, const char *prefix, unsigned int id,
+		 unsigned int size)
+{
+	char buf[BUF_SIZE];
+	scnprintf(buf, BUF_SIZE, FIFO_DIR "%s-%u-XXXXXX", prefix, id);
+	create_file(f, buf);
+
+	int ret = ftruncate(f->fd, size);
+	assert(ret == 0 && "failed size shm file");
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  f->fd, 0);
+	assert(addr != MAP_FAILED && "failed map shm file");
+	return addr;
+}
+
+void delete_shm(struct file *f, void *addr, unsigned int size)
+{
+	int ret = munmap(addr, size);
+	assert(ret == 0 && "failed unmap shm file");
+	delete_file(f, true);
+}
+
 void unset_cloexec(int fd)
 {
 	/* communication pipes were opened with CLOEXEC set so as not to race
@@ -115,6 +140,52 @@ void move_file_to(struct file *f, const char *dirpath)
 	f->filename = new_filename;
 }
 
+/* returns false on error; retries short writes */
+bool write_all(int fd, const char *buf, unsigned int size)
+{
+	while (size > 0) {
+		int ret = write(fd, buf, size);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0) {
+			return false;
+		}
+		buf += ret;
+		size -= ret;
+	}
+	return true;
+}
+
+/* returns a malloced copy of the whole file, NUL-terminated (past *size), or
+ * NULL if it couldn't be read */
+char *read_whole_file(const char *filename, unsigned int *size)
+{
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		XCLOSE(fd);
+		return NULL;
+	}
+	char *buf = XMALLOC(st.st_size + 1, char);
+	unsigned int done = 0;
+	while (done < st.st_size) {
+		int ret = read(fd, buf + done, st.st_size - done);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0) {
+			break;
+		}
+		done += ret;
+	}
+	XCLOSE(fd);
+	buf[done] = '\0';
+	*size = done;
+	return buf;
+}
+
 /* utilities related to logging the wrapper script needs for snapshotting */
 
 bool logging_inited = false;
@@ -19,6 +19,8 @@
 
 // FIXME make more flexible
 #define LANDSLIDE_PROGNAME "landslide"
+#define PPGEN_PROGNAME "ppgen.sh"
+#define CACHEKEY_PROGNAME "cachekey.sh"
 #define LANDSLIDE_PATH "../pebsim"
 #define ROOT_PATH ".."
 
@@ -34,9 +36,16 @@ char *create_fifo(const char *prefix, unsigned int id);
 void open_fifo(struct file *f, char *name, int flags);
 void delete_unused_fifo(char *name);
 
+void *create_shm(struct file *f, const char *prefix, unsigned int id,
+		 unsigned int size);
+void delete_shm(struct file *f, void *addr, unsigned int size);
+
 void move_file_to(struct file *f, const char *dirpath);
 void unset_cloexec(int fd);
 
+bool write_all(int fd, const char *buf, unsigned int size);
+char *read_whole_file(const char *filename, unsigned int *size);
+
 void set_logging_options(bool use_log, char *filename);
 void log_msg(const char *pfx, const char *format, ...);
 
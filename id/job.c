@@ -7,35 +7,63 @@
 #define _XOPEN_SOURCE 700
 #define _GNU_SOURCE
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include "affinity.h"
+#include "array_list.h"
 #include "bug.h"
+#include "cache.h"
 #include "common.h"
 #include "job.h"
 #include "io.h"
 #include "messaging.h"
 #include "pp.h"
+#include "record.h"
+#include "remote.h"
+#include "supervisor.h"
 #include "sync.h"
 #include "time.h"
 #include "xcalls.h"
 
 static unsigned int job_id = 0;
 
-static pthread_mutex_t compile_landslide_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Every job of a test has the same static config, so once one landslide has
+ * been built for it and come alive, the build is reused as-is (see build.sh),
+ * and the rest can start up concurrently. These take this lock for reading
+ * until their landslides are up. Building for another test regenerates the one
+ * shared config and header in place, though, so that takes it for writing,
+ * also until its landslide is up. (work.c tries hard not to switch tests.)
+ * Agents (see agent.c) share it the same way, by test name. */
+static pthread_rwlock_t landslide_build_lock = PTHREAD_RWLOCK_INITIALIZER;
+/* Agents on this host (and other quicksands) share LANDSLIDE_PATH too, so this
+ * process also holds a flock() on this file whenever it holds the above, shared
+ * among all its readers. The file holds the name of the test it was last built
+ * for, or nothing while a build's in progress (or if it failed). */
+#define BUILD_LOCK_FILE LANDSLIDE_PATH "/.quicksand-build-lock"
+static int build_lock_fd = -1;
+static unsigned int build_lock_readers = 0;
+static pthread_mutex_t build_lock_fd_lock = PTHREAD_MUTEX_INITIALIZER;
 
 extern char **environ;
 
-// TODO-FIXME: Insert timestamps so log files are sorted chronologically.
-#define CONFIG_STATIC_TEMPLATE  "config.quicksand.XXXXXX"
-#define CONFIG_DYNAMIC_TEMPLATE "pps-and-such.quicksand.XXXXXX"
-#define LOG_FILE_TEMPLATE(x) "ls-" x ".log.XXXXXX"
+/* must be an absolute path for landslide to see it; it removes it when done */
+#define WARM_PPS_TEMPLATE "/dev/shm/landslide-dynamic-pps.XXXXXX"
 
-char *test_name = NULL;
+
+static ARRAY_LIST(struct test *) tests;
 bool verbose = false;
 bool leave_logs = false;
 bool pintos = false;
@@ -43,12 +71,39 @@ bool pathos = false;
 bool use_icb = false;
 bool preempt_everywhere = false;
 bool pure_hb = false;
+bool use_warm_workers = false;
 
-void set_job_options(char *arg_test_name, bool arg_verbose, bool arg_leave_logs,
+/* test names are comma-separated */
+void set_job_options(char *arg_test_names, bool arg_verbose, bool arg_leave_logs,
 		     bool arg_pintos, bool arg_use_icb, bool arg_preempt_everywhere,
-		     bool arg_pure_hb, bool arg_pathos)
+		     bool arg_pure_hb, bool arg_pathos, bool arg_warm_workers)
 {
-	test_name = XSTRDUP(arg_test_name);
+	char *names = XSTRDUP(arg_test_names);
+	char *rest = names;
+	char *name;
+	ARRAY_LIST_INIT(&tests, 4);
+	while ((name = strsep(&rest, ",")) != NULL) {
+		if (name[0] == '\0') {
+			continue;
+		}
+		bool duplicate = false;
+		struct test **t;
+		unsigned int i;
+		ARRAY_LIST_FOREACH(&tests, i, t) {
+			duplicate = duplicate || strcmp((*t)->name, name) == 0;
+		}
+		if (duplicate) {
+			WARN("Test '%s' given more than once; ignoring\n", name);
+			continue;
+		}
+		struct test *test = XMALLOC(1, struct test);
+		test->index = ARRAY_LIST_SIZE(&tests);
+		test->name = XSTRDUP(name);
+		test->cputime = 0;
+		ARRAY_LIST_APPEND(&tests, test);
+	}
+	FREE(names);
+
 	verbose = arg_verbose;
 	leave_logs = arg_leave_logs;
 	pintos = arg_pintos;
@@ -56,14 +111,25 @@ void set_job_options(char *arg_test_name, bool arg_verbose, bool arg_leave_logs,
 	use_icb = arg_use_icb;
 	preempt_everywhere = arg_preempt_everywhere;
 	pure_hb = arg_pure_hb;
+	use_warm_workers = arg_warm_workers;
 }
 
 bool testing_pintos() { return pintos; }
 bool testing_pathos() { return pathos; }
 
-struct job *new_job(struct pp_set *config, bool should_reproduce)
+unsigned int num_tests() { return ARRAY_LIST_SIZE(&tests); }
+
+struct test *get_test(unsigned int index)
+{
+	assert(index < ARRAY_LIST_SIZE(&tests) && "nonexistent test");
+	return *ARRAY_LIST_GET(&tests, index);
+}
+
+struct job *new_job(struct test *test, struct pp_set *config,
+		    bool should_reproduce, struct job *parent)
 {
 	struct job *j = XMALLOC(1, struct job);
+	j->test = test;
 	j->config = config;
 
 	j->id = __sync_fetch_and_add(&job_id, 1);
@@ -76,35 +142,474 @@ struct job *new_job(struct pp_set *config, bool should_reproduce)
 	j->estimate_proportion = 0;
 	human_friendly_time(0.0L, &j->estimate_elapsed);
 	human_friendly_time(0.0L, &j->estimate_eta);
+	j->estimate_elapsed_numeric = 0.0L;
 	j->estimate_eta_numeric = 0.0L;
+	j->estimate_eta_lo_numeric = 0.0L;
+	j->estimate_eta_hi_numeric = 0.0L;
+	j->rss = 0;
+	j->peak_rss = 0;
+	j->pps_discovered = 0;
+	j->start_latency = 0;
+	j->record_usecs = 0;
+	j->record_since = 0;
 	j->cancelled = false;
 	j->complete = false;
 	j->timed_out = false;
 	j->kill_job = false;
+	j->park_job = false;
 	j->log_filename = NULL;
 	j->trace_filename = NULL;
+	j->park_filename = NULL;
 	j->need_rerun = false;
 	j->fab_timestamp = 0;
 	j->fab_cputime = 0;
 	j->current_cpu = (unsigned long)-1;
+	j->blocked_subsets = 0;
+	j->heap_index = UINT_MAX;
+	j->wq_priority = PRIORITY_NONE;
+	j->wq_epoch = 0;
+	j->next_incoming = NULL;
+	j->cache_key = NULL;
+	j->worker = NULL;
+	j->rss_sampled_at = 0;
+	j->icb_current_bound = 0;
+	j->icb_fab_preemptions = 0;
+	j->stats_seq = 0;
+	publish_job_stats(j);
 
 	COND_INIT(&j->done_cvar);
-	COND_INIT(&j->blocking_cvar);
 	MUTEX_INIT(&j->lifecycle_lock);
 
+	record_job_spawned(j, parent);
 	return j;
 }
 
-/* job thread main */
+/* A running landslide process. Each owns its messaging pipes and log files for
+ * its whole life, which, if using warm workers (-w), may span many jobs; in
+ * between it waits on the idle list. There are never more of these than jobs
+ * that were running at once, i.e. about one per CPU. */
+struct warm_worker {
+	pid_t pid;
+	int pidfd; /* -1 if the kernel's too old for pidfds */
+	struct messaging_state mess;
+	struct file log_stdout;
+	struct file log_stderr;
+	struct test *test; /* the test it booted; it can run no others */
+	struct job *job; /* while running one */
+	struct watch watch; /* for the supervisor */
+	int home_node; /* where its memory lives; -1 if not pinning */
+	struct warm_worker *next;
+};
+
+static struct warm_worker *idle_workers = NULL;
+static pthread_mutex_t idle_workers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* NULL test means any */
+static struct warm_worker *claim_idle_worker(struct test *test)
+{
+	LOCK(&idle_workers_lock);
+	struct warm_worker **wp = &idle_workers;
+	while (*wp != NULL && test != NULL && (*wp)->test != test) {
+		wp = &(*wp)->next;
+	}
+	struct warm_worker *w = *wp;
+	if (w != NULL) {
+		*wp = w->next;
+		w->next = NULL;
+	}
+	UNLOCK(&idle_workers_lock);
+	return w;
+}
+
+static void release_idle_worker(struct warm_worker *w)
+{
+	LOCK(&idle_workers_lock);
+	w->next = idle_workers;
+	idle_workers = w;
+	UNLOCK(&idle_workers_lock);
+}
+
+/* Waits for a worker's landslide to exit, then cleans up after it. If it was
+ * waiting for a new job, it must have been told there isn't one first. */
+static int retire_worker(struct warm_worker *w)
+{
+	if (w->mess.remote != NULL) {
+		/* its process and log files are the agent's to clean up */
+		finish_messaging(&w->mess);
+		int exit_status = remote_job_finish(w->mess.remote);
+		FREE(w);
+		return exit_status;
+	}
+
+	int child_status;
+	pid_t result_pid = waitpid(w->pid, &child_status, 0);
+	assert(result_pid == w->pid && "wait failed");
+	assert(WIFEXITED(child_status) && "wait returned before child exit");
+	DBG("Landslide pid %d exited with status %d\n", w->pid,
+	    WEXITSTATUS(child_status));
+
+	finish_messaging(&w->mess);
+	if (w->pidfd != -1) {
+		XCLOSE(w->pidfd);
+	}
+
+	bool should_delete = !leave_logs &&
+		WEXITSTATUS(child_status) == LS_NO_KNOWN_BUG;
+	delete_file(&w->log_stdout, should_delete);
+	delete_file(&w->log_stderr, should_delete);
+	FREE(w);
+	return WEXITSTATUS(child_status);
+}
+
+/* Translates the job's dynamic config for a warm worker the same way build.sh
+ * would have for a fresh landslide, and sends it over. Returns false if that
+ * failed, in which case the worker is still waiting to hear about a job. */
+static bool hand_off_job(struct job *j, struct warm_worker *w)
+{
+	char pps_filename[] = WARM_PPS_TEMPLATE;
+	int fd = mkstemp(pps_filename);
+	assert(fd >= 0 && "failed create pp file");
+	XCLOSE(fd);
+
+	pid_t ppgen_pid = fork();
+	if (ppgen_pid == 0) {
+		char *execname = "./" PPGEN_PROGNAME;
+		char *const argv[5] = {
+			[0] = execname,
+			[1] = j->config_static.filename,
+			[2] = j->config_dynamic.filename,
+			[3] = pps_filename,
+			[4] = NULL,
+		};
+
+		/* unsetting cloexec not necessary for these */
+		XDUP2(w->log_stdout.fd, STDOUT_FILENO);
+		XDUP2(w->log_stderr.fd, STDERR_FILENO);
+
+		XCHDIR(LANDSLIDE_PATH);
+
+		execve(execname, argv, environ);
+
+		EXPECT(false, "execve() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	int ppgen_status;
+	pid_t result_pid = waitpid(ppgen_pid, &ppgen_status, 0);
+	assert(result_pid == ppgen_pid && "wait failed");
+	if (!WIFEXITED(ppgen_status) || WEXITSTATUS(ppgen_status) != 0) {
+		ERR("[JOB %d] There was a problem generating PPs for Landslide.\n",
+		    j->id);
+		ERR("[JOB %d] For details see %s\n", j->id, w->log_stderr.filename);
+		XREMOVE(pps_filename);
+		messaging_no_more_jobs(&w->mess);
+		return false;
+	}
+
+	DBG("[JOB %d] handing off to warm landslide pid %d\n", j->id, w->pid);
+	affinity_follow(w->pid, j->current_cpu, w->home_node);
+	messaging_next_job(&w->mess, pps_filename);
+	return true;
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	return -1;
+#endif
+}
+
+static void forget_parked_tree(struct job *j, bool do_remove)
+{
+	if (j->park_filename != NULL) {
+		if (do_remove) {
+			/* (landslide may have loaded it already, and died) */
+			unlink(j->park_filename);
+		}
+		WRITE_LOCK(&j->stats_lock);
+		FREE(j->park_filename);
+		j->park_filename = NULL;
+		STATS_WRITE_UNLOCK(j);
+	}
+}
+
+static void record_job_outcome(struct job *j, bool parked)
+{
+	if (parked) {
+		/* it'll be back; its clock just stops until then */
+		record_job_paused(j);
+		return;
+	}
+	READ_LOCK(&j->stats_lock);
+	const char *outcome = j->need_rerun ? "rerun" :
+		j->cancelled ? "cancelled" : j->timed_out ? "timedout" :
+		j->trace_filename != NULL ? "bug" : "complete";
+	RW_UNLOCK(&j->stats_lock);
+	record_job_finished(j, outcome);
+}
+
+/* cleans up after a job once its landslide is done with it */
+static void finish_job(struct job *j, int exit_status)
+{
+	delete_file(&j->config_static, true);
+	delete_file(&j->config_dynamic, true);
+	bool should_delete = !leave_logs && exit_status == LS_NO_KNOWN_BUG;
+
+	/* Asked to park, landslide may still have declined to (e.g. with ICB),
+	 * in which case the job is just cancelled, as if killed. */
+	bool parked = false;
+	if (j->park_filename != NULL) {
+		struct stat st;
+		parked = exit_status == LS_NO_KNOWN_BUG &&
+			stat(j->park_filename, &st) == 0 && st.st_size > 0;
+		if (!parked) {
+			forget_parked_tree(j, true);
+			WRITE_LOCK(&j->stats_lock);
+			j->cancelled = true;
+			STATS_WRITE_UNLOCK(j);
+		}
+	}
+
+	WRITE_LOCK(&j->stats_lock);
+	j->complete = !parked;
+	j->rss = 0; /* (a warm worker's memory is no longer this job's) */
+	if (exit_status == REMOTE_AGENT_LOST) {
+		/* whatever it found before is still good, but not the rest */
+		j->need_rerun = true;
+	}
+	if (j->need_rerun) {
+		j->cancelled = true;
+	}
+	if (should_delete) {
+		FREE(j->log_filename);
+		j->log_filename = NULL;
+	}
+	STATS_WRITE_UNLOCK(j);
+	record_job_outcome(j, parked);
+	cache_record_job(j, exit_status == LS_NO_KNOWN_BUG);
+	LOCK(&j->lifecycle_lock);
+	j->worker = NULL;
+	j->status = JOB_DONE;
+	BROADCAST(&j->done_cvar);
+	UNLOCK(&j->lifecycle_lock);
+}
+
+/* The rest of a job's life after its landslide comes up is driven from the
+ * supervisor thread, so neither blocked nor running jobs need threads of
+ * their own. These all run there. */
+
+static bool worker_exited(struct watch *watch)
+{
+	struct warm_worker *w = container_of(watch, struct warm_worker, watch);
+	struct job *j = w->job;
+	finish_job(j, retire_worker(w));
+	return false;
+}
+
+static bool worker_messages_ready(struct watch *watch)
+{
+	struct warm_worker *w = container_of(watch, struct warm_worker, watch);
+	struct job *j = w->job;
+
+	enum child_status status = talk_to_child(&w->mess, j);
+	if (status == CHILD_RUNNING) {
+		return true;
+	} else if (status == CHILD_BLOCKED) {
+		/* resume_job() will pick the conversation back up */
+		return false;
+	} else if (status == CHILD_FINISHED) {
+		/* it's waiting for a NEXT_JOB; hand it to the next taker */
+		w->job = NULL;
+		release_idle_worker(w);
+		finish_job(j, LS_NO_KNOWN_BUG);
+		return false;
+	} else if (w->pidfd != -1) {
+		/* reap it once it's gone, without waiting around */
+		w->watch.fd = w->pidfd;
+		w->watch.ready = worker_exited;
+		supervisor_watch(&w->watch);
+		return false;
+	} else {
+		finish_job(j, retire_worker(w));
+		return false;
+	}
+}
+
+static void start_talking(void *arg)
+{
+	struct warm_worker *w = (struct warm_worker *)arg;
+	w->watch.fd = w->mess.input_pipe.fd;
+	w->watch.ready = worker_messages_ready;
+	/* catch up on anything it said before we were listening */
+	if (worker_messages_ready(&w->watch)) {
+		supervisor_watch(&w->watch);
+	}
+}
+
+static void resume_talking(void *arg)
+{
+	struct warm_worker *w = (struct warm_worker *)arg;
+	messaging_resume(&w->mess);
+	start_talking(w);
+}
+
+/* Takes this process's flock() on the build lock file, along with
+ * landslide_build_lock; exclusively iff that's held for writing. */
+static void build_flock(bool exclusive)
+{
+	LOCK(&build_lock_fd_lock);
+	if (build_lock_fd == -1) {
+		build_lock_fd = open(BUILD_LOCK_FILE,
+				     O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		assert(build_lock_fd >= 0 && "failed open build lock file");
+	}
+	if (exclusive) {
+		assert(build_lock_readers == 0);
+		XFLOCK(build_lock_fd, LOCK_EX);
+	} else if (build_lock_readers++ == 0) {
+		XFLOCK(build_lock_fd, LOCK_SH);
+	}
+	UNLOCK(&build_lock_fd_lock);
+}
+
+/* (whichever way it was taken is plain from whether there are any readers) */
+static void build_funlock()
+{
+	LOCK(&build_lock_fd_lock);
+	if (build_lock_readers == 0 || --build_lock_readers == 0) {
+		XFLOCK(build_lock_fd, LOCK_UN);
+	}
+	UNLOCK(&build_lock_fd_lock);
+}
+
+/* with the build lock held, either way */
+static bool landslide_build_needed(const char *test_name, bool always_rebuild)
+{
+	if (always_rebuild) {
+		return true;
+	}
+	unsigned int len = strlen(test_name);
+	char *built_for = XMALLOC(len + 1, char);
+	ssize_t ret = pread(build_lock_fd, built_for, len + 1, 0);
+	assert(ret >= 0 && "failed read build lock file");
+	bool needed = (size_t)ret != len || memcmp(built_for, test_name, len) != 0;
+	FREE(built_for);
+	return needed;
+}
+
+/* Takes the build lock (see above) as needed to start a landslide for this
+ * test, until landslide_build_end(). Returns true if it'll be rebuilt. */
+bool landslide_build_begin(const char *test_name, bool always_rebuild)
+{
+	while (true) {
+		READ_LOCK(&landslide_build_lock);
+		build_flock(false);
+		if (!landslide_build_needed(test_name, always_rebuild)) {
+			return false;
+		}
+		build_funlock();
+		RW_UNLOCK(&landslide_build_lock);
+		WRITE_LOCK(&landslide_build_lock);
+		build_flock(true);
+		/* Someone else may have built it for us while we waited. If
+		 * so, go back to sharing it, rather than holding everyone else
+		 * off for nothing. */
+		if (landslide_build_needed(test_name, always_rebuild)) {
+			/* in case we die mid-build */
+			int ret = ftruncate(build_lock_fd, 0);
+			assert(ret == 0 && "failed truncate build lock file");
+			return true;
+		}
+		build_funlock();
+		RW_UNLOCK(&landslide_build_lock);
+	}
+}
+
+/* once the landslide is up, or failed to come up, or won't be started after
+ * all (in which case need_compile can be false; the next will just rebuild) */
+void landslide_build_end(const char *test_name, bool need_compile,
+			 bool child_alive)
+{
+	if (need_compile && child_alive) {
+		unsigned int len = strlen(test_name);
+		ssize_t ret = pwrite(build_lock_fd, test_name, len, 0);
+		assert(ret == (ssize_t)len && "failed write build lock file");
+	}
+	build_funlock();
+	RW_UNLOCK(&landslide_build_lock);
+}
+
+/* Forks and execs a landslide on the given config files, which must be in
+ * LANDSLIDE_PATH already. cpu is where to pin it, if pinning; -1 for none. */
+pid_t fork_landslide(unsigned int job_id, struct file *config_static,
+		     struct file *config_dynamic, struct file *log_stdout,
+		     struct file *log_stderr, unsigned long cpu)
+{
+	pid_t landslide_pid = fork();
+	if (landslide_pid == 0) {
+		/* child process; landslide-to-be */
+		/* assemble commandline arguments */
+		char *execname = "./" LANDSLIDE_PROGNAME;
+		char *const argv[4] = {
+			[0] = execname,
+			[1] = config_static->filename,
+			[2] = config_dynamic->filename,
+			[3] = NULL,
+		};
+
+		DBG("[JOB %d] '%s %s %s > %s 2> %s'\n", job_id, execname,
+		       config_static->filename, config_dynamic->filename,
+		       log_stdout->filename, log_stderr->filename);
+
+		/* unsetting cloexec not necessary for these */
+		XDUP2(log_stdout->fd, STDOUT_FILENO);
+		XDUP2(log_stderr->fd, STDERR_FILENO);
+
+		XCHDIR(LANDSLIDE_PATH);
+
+		if (cpu != (unsigned long)-1) {
+			affinity_pin_self(cpu);
+		}
+
+		execve(execname, argv, environ);
+
+		EXPECT(false, "execve() failed\n");
+		exit(EXIT_FAILURE);
+	}
+	return landslide_pid;
+}
+
+/* job thread main; exits once the job's landslide is up and running */
 static void *run_job(void *arg)
 {
 	struct job *j = (struct job *)arg;
 	struct messaging_state mess;
+	/* if so, this job's landslide is to run on an agent; see remote.c */
+	bool remote = remote_cpu(j->current_cpu);
+	/* if set, this job reuses an already-running landslide */
+	struct warm_worker *w = use_warm_workers && !remote ?
+		claim_idle_worker(j->test) : NULL;
+	unsigned long started_at = timestamp();
+
+	/* Any others idle must be for other tests. This one's about to start a
+	 * landslide of its own, so one of those can make way for it. */
+	struct warm_worker *stale = w == NULL && use_warm_workers && !remote ?
+		claim_idle_worker(NULL) : NULL;
+	if (stale != NULL) {
+		DBG("[JOB %d] retiring idle landslide pid %d (for %s)\n",
+		    j->id, stale->pid, stale->test->name);
+		messaging_no_more_jobs(&stale->mess);
+		retire_worker(stale);
+	}
 
 	create_file(&j->config_static,  CONFIG_STATIC_TEMPLATE);
 	create_file(&j->config_dynamic, CONFIG_DYNAMIC_TEMPLATE);
-	create_file(&j->log_stdout, LOG_FILE_TEMPLATE("setup"));
-	create_file(&j->log_stderr, LOG_FILE_TEMPLATE("output"));
+	if (w == NULL && !remote) {
+		create_file(&j->log_stdout, LOG_FILE_TEMPLATE("setup"));
+		create_file(&j->log_stderr, LOG_FILE_TEMPLATE("output"));
+	}
 
 	const char *without   = pintos || pathos ? "without_function"
 	                                         : "without_user_function";
@@ -113,14 +618,15 @@ static void *run_job(void *arg)
 
 	/* write config file */
 
-	XWRITE(&j->config_static, "TEST_CASE=%s\n", test_name);
+	XWRITE(&j->config_static, "TEST_CASE=%s\n", j->test->name);
 	XWRITE(&j->config_static, "VERBOSE=%d\n", preempt_everywhere ? 0 : verbose ? 1 : 0);
 	XWRITE(&j->config_static, "ICB=%d\n", use_icb ? 1 : 0);
 	XWRITE(&j->config_static, "PREEMPT_EVERYWHERE=%d\n", preempt_everywhere ? 1 : 0);
 	XWRITE(&j->config_static, "PURE_HAPPENS_BEFORE=%d\n", pure_hb ? 1 : 0);
+	XWRITE(&j->config_static, "WARM_WORKER=%d\n", use_warm_workers && !remote ? 1 : 0);
 
 	// XXX(#120): TEST_CASE must be defined before PPs are specified.
-	XWRITE(&j->config_dynamic, "TEST_CASE=%s\n", test_name);
+	XWRITE(&j->config_dynamic, "TEST_CASE=%s\n", j->test->name);
 	XWRITE(&j->config_dynamic, "%s %s\n", without, mx_lock);
 	XWRITE(&j->config_dynamic, "%s %s\n", without, mx_unlock);
 	if (pintos) {
@@ -161,11 +667,11 @@ static void *run_job(void *arg)
 		XWRITE(&j->config_dynamic, "%s vga_putc\n", without);
 		XWRITE(&j->config_dynamic, "%s is_runqueue\n", without);
 		XWRITE(&j->config_dynamic, "%s idle\n", without);
-		if (0 == strcmp(test_name, "alarm-simultaneous")) {
+		if (0 == strcmp(j->test->name, "alarm-simultaneous")) {
 			XWRITE(&j->config_dynamic, "%s child_done\n", without);
 			XWRITE(&j->config_dynamic, "%s parent_done\n", without);
 		}
-	} else if (0 == strcmp(test_name, "mutex_test")) {
+	} else if (0 == strcmp(j->test->name, "mutex_test")) {
 		// XXX: Hack. This is special cased here, instead of being a
 		// cmdline option, so the studence don't have to worry about
 		// setting the special flag when they run this test.
@@ -178,11 +684,11 @@ static void *run_job(void *arg)
 		XWRITE(&j->config_dynamic, "%s thr_init\n", without);
 		XWRITE(&j->config_dynamic, "%s thr_create\n", without);
 		XWRITE(&j->config_dynamic, "%s thr_exit\n", without);
-	} else if (0 == strcmp(test_name, "paraguay")) {
+	} else if (0 == strcmp(j->test->name, "paraguay")) {
 		XWRITE(&j->config_dynamic, "%s thr_init\n", without);
 		XWRITE(&j->config_dynamic, "%s thr_create\n", without);
 		XWRITE(&j->config_dynamic, "%s thr_exit\n", without);
-	} else if (0 == strcmp(test_name, "paradise_lost")) {
+	} else if (0 == strcmp(j->test->name, "paradise_lost")) {
 		XWRITE(&j->config_dynamic, "%s thr_init\n", without);
 		XWRITE(&j->config_dynamic, "%s thr_create\n", without);
 		XWRITE(&j->config_dynamic, "%s thr_exit\n", without);
@@ -203,7 +709,17 @@ static void *run_job(void *arg)
 		}
 	}
 
-	messaging_init(&mess, &j->config_static, &j->config_dynamic, j->id);
+	/* pick up where we left off, if cant_swap() parked us */
+	if (j->park_filename != NULL) {
+		XWRITE(&j->config_dynamic, "resume_parked_tree %s\n",
+		       j->park_filename);
+	}
+
+	/* warm workers keep the pipes they were started with; agents make
+	 * their own */
+	if (w == NULL && !remote) {
+		messaging_init(&mess, &j->config_static, &j->config_dynamic, j->id);
+	}
 
 	// XXX: Need to do this here so the parent can have the path into pebsim
 	// to properly delete the file, but it brittle-ly causes the child's
@@ -215,27 +731,37 @@ static void *run_job(void *arg)
 	 * different config is mutually exclusive. we'll release this as soon as
 	 * we get a message from the child that it's up and running. */
 	assert(j->current_cpu != (unsigned long)-1);
-	stop_using_cpu(j->current_cpu);
-	LOCK(&compile_landslide_lock);
-	start_using_cpu(j->current_cpu);
+	bool need_compile = false;
+	if (w == NULL && !remote) {
+		stop_using_cpu(j->current_cpu);
+		/* (pintos remakes its bootfd image in build.sh every time.) */
+		need_compile = landslide_build_begin(j->test->name, pintos);
+		start_using_cpu(j->current_cpu);
+	}
 
-	bool bug_in_subspace = bug_already_found(j->config);
+	bool bug_in_subspace = bug_already_found(j->test, j->config);
 	bool too_late = TIME_UP();
 	if (bug_in_subspace || too_late) {
 		DBG("[JOB %d] %s; aborting compilation.\n", j->id,
 		    bug_in_subspace ? "bug already found" : "time ran out");
-		UNLOCK(&compile_landslide_lock);
-		messaging_abort(&mess);
+		if (w == NULL && !remote) {
+			landslide_build_end(j->test->name, false, false);
+			messaging_abort(&mess);
+			delete_file(&j->log_stdout, true);
+			delete_file(&j->log_stderr, true);
+		} else if (w != NULL) {
+			release_idle_worker(w);
+		}
 		delete_file(&j->config_static, true);
 		delete_file(&j->config_dynamic, true);
-		delete_file(&j->log_stdout, true);
-		delete_file(&j->log_stderr, true);
+		forget_parked_tree(j, true);
 		if (bug_in_subspace) {
 			WRITE_LOCK(&j->stats_lock);
 			j->complete = true;
 			j->cancelled = true;
-			RW_UNLOCK(&j->stats_lock);
+			STATS_WRITE_UNLOCK(j);
 		}
+		record_job_finished(j, bug_in_subspace ? "cancelled" : "timedout");
 		LOCK(&j->lifecycle_lock);
 		j->status = JOB_DONE;
 		BROADCAST(&j->done_cvar);
@@ -244,110 +770,199 @@ static void *run_job(void *arg)
 	}
 
 	WRITE_LOCK(&j->stats_lock);
-	j->log_filename = XSTRDUP(j->log_stderr.filename);
+	FREE(j->log_filename); /* if resuming from a parked tree */
+	j->log_filename = remote ? NULL :
+		XSTRDUP(w != NULL ? w->log_stderr.filename : j->log_stderr.filename);
 	j->need_rerun = false;
-	RW_UNLOCK(&j->stats_lock);
+	STATS_WRITE_UNLOCK(j);
 
-	pid_t landslide_pid = fork();
-	if (landslide_pid == 0) {
-		/* child process; landslide-to-be */
-		/* assemble commandline arguments */
-		char *execname = "./" LANDSLIDE_PROGNAME;
-		char *const argv[4] = {
-			[0] = execname,
-			[1] = j->config_static.filename,
-			[2] = j->config_dynamic.filename,
-			[3] = NULL,
-		};
+	bool child_alive;
+	if (w != NULL) {
+		child_alive = hand_off_job(j, w);
+	} else if (remote) {
+		struct remote_job *rj =
+			remote_job_start(j->current_cpu, j, pintos, &child_alive);
+		WRITE_LOCK(&j->stats_lock);
+		j->log_filename = remote_job_log_filename(rj);
+		STATS_WRITE_UNLOCK(j);
 
-		DBG("[JOB %d] '%s %s %s > %s 2> %s'\n", j->id, execname,
-		       j->config_static.filename, j->config_dynamic.filename,
-		       j->log_stdout.filename, j->log_stderr.filename);
-
-		/* unsetting cloexec not necessary for these */
-		XDUP2(j->log_stdout.fd, STDOUT_FILENO);
-		XDUP2(j->log_stderr.fd, STDERR_FILENO);
+		w = XMALLOC(1, struct warm_worker);
+		w->pid = -1;
+		w->pidfd = -1;
+		messaging_init_remote(&w->mess, rj);
+		w->log_stdout.fd = -1;
+		w->log_stdout.filename = NULL;
+		w->log_stderr.fd = -1;
+		w->log_stderr.filename = NULL;
+		w->home_node = -1;
+		w->test = j->test;
+		w->job = NULL;
+		w->next = NULL;
+	} else {
+		pid_t landslide_pid = fork_landslide(j->id, &j->config_static,
+						     &j->config_dynamic,
+						     &j->log_stdout, &j->log_stderr,
+						     j->current_cpu);
 
-		XCHDIR(LANDSLIDE_PATH);
+		/* should take 1 to 4 seconds for child to come alive */
+		child_alive = wait_for_child(&mess);
+		landslide_build_end(j->test->name, need_compile, child_alive);
 
-		execve(execname, argv, environ);
+		if (!child_alive) {
+			// TODO: record job in "failed to run" list or some such
+			ERR("[JOB %d] There was a problem setting up Landslide.\n", j->id);
+			// TODO: err_pp_set or some such
+			ERR("[JOB %d] For details see %s and %s\n", j->id,
+			    j->log_stdout.filename, j->log_stderr.filename);
+		}
 
-		EXPECT(false, "execve() failed\n");
-		exit(EXIT_FAILURE);
+		/* From here on, the worker owns the landslide process, its
+		 * pipes, and its log files, whether or not it lives on. */
+		w = XMALLOC(1, struct warm_worker);
+		w->pid = landslide_pid;
+		w->pidfd = open_pidfd(landslide_pid);
+		w->mess = mess;
+		w->log_stdout = j->log_stdout;
+		w->log_stderr = j->log_stderr;
+		w->home_node = affinity_node(j->current_cpu);
+		w->test = j->test;
+		w->job = NULL;
+		w->next = NULL;
 	}
 
-	/* parent */
-
-	/* should take 1 to 4 seconds for child to come alive */
-	bool child_alive = wait_for_child(&mess);
-
-	UNLOCK(&compile_landslide_lock);
+	/* landslide deletes the parked tree once it's loaded it */
+	forget_parked_tree(j, !child_alive);
 
-	if (child_alive) {
-		/* may take as long as the state space is large */
-		talk_to_child(&mess, j);
-	} else {
-		// TODO: record job in "failed to run" list or some such
-		ERR("[JOB %d] There was a problem setting up Landslide.\n", j->id);
-		// TODO: err_pp_set or some such
-		ERR("[JOB %d] For details see %s and %s\n", j->id,
-		    j->log_stdout.filename, j->log_stderr.filename);
+	if (!child_alive) {
+		finish_job(j, retire_worker(w));
+		return NULL;
 	}
 
-	int child_status;
-	pid_t result_pid = waitpid(landslide_pid, &child_status, 0);
-	assert(result_pid == landslide_pid && "wait failed");
-	assert(WIFEXITED(child_status) && "wait returned before child exit");
-	DBG("Landslide pid %d exited with status %d\n", landslide_pid,
-	    WEXITSTATUS(child_status));
-
-	finish_messaging(&mess);
-
-	delete_file(&j->config_static, true);
-	delete_file(&j->config_dynamic, true);
-	bool should_delete = !leave_logs && WEXITSTATUS(child_status) == 0;
-	delete_file(&j->log_stdout, should_delete);
-	delete_file(&j->log_stderr, should_delete);
-
 	WRITE_LOCK(&j->stats_lock);
-	j->complete = true;
-	if (j->need_rerun) {
-		j->cancelled = true;
+	if (j->start_latency == 0) { /* (not if resuming a parked tree) */
+		j->start_latency = MAX(timestamp() - started_at, 1UL);
 	}
-	if (should_delete) {
-		FREE(j->log_filename);
-		j->log_filename = NULL;
-	}
-	RW_UNLOCK(&j->stats_lock);
-	LOCK(&j->lifecycle_lock);
-	j->status = JOB_DONE;
-	BROADCAST(&j->done_cvar);
-	UNLOCK(&j->lifecycle_lock);
+	STATS_WRITE_UNLOCK(j);
+	record_job_up(j, timestamp() - started_at);
 
+	/* the supervisor takes it from here */
+	w->job = j;
+	j->worker = w;
+	supervisor_call(start_talking, w);
 	return NULL;
 }
 
-/* to be called by job thread of its own volition */
+/* Called on the supervisor thread once a job's landslide has been told to
+ * suspend itself. Its workqueue thread goes to find something else to do, and
+ * it stays suspended until resume_job(). */
 void job_block(struct job *j)
 {
+	sample_job_rss(j, true);
+	record_job_paused(j);
 	LOCK(&j->lifecycle_lock);
 	assert(j->status == JOB_NORMAL);
 	j->status = JOB_BLOCKED;
-	/* signal workqueue thread to go find something else to do */
 	BROADCAST(&j->done_cvar);
-	/* wait until there's nothing better to do */
-	while (j->status == JOB_BLOCKED) {
-		WAIT(&j->blocking_cvar, &j->lifecycle_lock);
-	}
-	/* we have been woken up and rescheduled */
-	assert(j->status == JOB_NORMAL);
 	UNLOCK(&j->lifecycle_lock);
 }
 
+/* Memory used by one process, in bytes, or 0 if it's gone. Prefers PSS, which
+ * splits pages shared among processes (like simics's own text, when several are
+ * running) between them, so summing over all landslides doesn't overcount. */
+static unsigned long process_rss(pid_t pid)
+{
+	char buf[BUF_SIZE];
+	unsigned long kbytes;
+
+	scnprintf(buf, BUF_SIZE, "/proc/%d/smaps_rollup", pid);
+	FILE *smaps = fopen(buf, "r");
+	if (smaps != NULL) {
+		bool found = false;
+		while (!found && fgets(buf, BUF_SIZE, smaps) != NULL) {
+			found = sscanf(buf, "Pss: %lu kB", &kbytes) == 1;
+		}
+		fclose(smaps);
+		if (found) {
+			return kbytes * 1024;
+		}
+	}
+
+	/* older kernels: resident set size, shared pages and all */
+	scnprintf(buf, BUF_SIZE, "/proc/%d/statm", pid);
+	FILE *statm = fopen(buf, "r");
+	unsigned long pages;
+	if (statm == NULL) {
+		return 0;
+	} else if (fscanf(statm, "%*u %lu", &pages) != 1) {
+		pages = 0;
+	}
+	fclose(statm);
+	return pages * sysconf(_SC_PAGESIZE);
+}
+
+/* The landslide process is only the build/run script; simics is among its
+ * descendants. Without /proc/.../children (CONFIG_PROC_CHILDREN), this sees
+ * just the one process, which is better than nothing. */
+static unsigned long process_tree_rss(pid_t pid)
+{
+	unsigned long total = process_rss(pid);
+	char buf[BUF_SIZE];
+
+	scnprintf(buf, BUF_SIZE, "/proc/%d/task/%d/children", pid, pid);
+	FILE *children = fopen(buf, "r");
+	if (children != NULL) {
+		int child;
+		while (fscanf(children, "%d", &child) == 1) {
+			total += process_tree_rss(child);
+		}
+		fclose(children);
+	}
+	return total;
+}
+
+#define RSS_SAMPLE_INTERVAL 1000000 /* usecs */
+
+/* Updates the job's memory footprint, at most once a second unless forced
+ * (e.g. as it's suspended, so work.c sees what it'll keep holding). */
+void sample_job_rss(struct job *j, bool force)
+{
+	unsigned long now = time_elapsed();
+	if (j->worker == NULL ||
+	    (!force && now - j->rss_sampled_at < RSS_SAMPLE_INTERVAL)) {
+		return;
+	}
+	j->rss_sampled_at = now;
+
+	/* (an agent's landslides don't count against our memory) */
+	if (j->worker->mess.remote != NULL) {
+		return;
+	}
+	unsigned long rss = process_tree_rss(j->worker->pid);
+	WRITE_LOCK(&j->stats_lock);
+	j->rss = rss;
+	j->peak_rss = MAX(j->peak_rss, rss);
+	STATS_WRITE_UNLOCK(j);
+}
+
+/* to be called once all work is done; lets any warm workers exit */
+void retire_warm_workers()
+{
+	struct warm_worker *w;
+	while ((w = claim_idle_worker(NULL)) != NULL) {
+		messaging_no_more_jobs(&w->mess);
+		retire_worker(w);
+	}
+}
+
 /* the workqueue threads use the following calls to manage the job threads */
 
 void start_job(struct job *j)
 {
+	/* (a parked job is started over; see cant_swap()) */
+	LOCK(&j->lifecycle_lock);
+	j->status = JOB_NORMAL;
+	UNLOCK(&j->lifecycle_lock);
+
 	pthread_t child;
 	int ret = pthread_create(&child, NULL, run_job, (void *)j);
 	assert(ret == 0 && "failed thread fork");
@@ -372,88 +987,175 @@ void resume_job(struct job *j)
 {
 	LOCK(&j->lifecycle_lock);
 	assert(j->status == JOB_BLOCKED);
+	assert(j->worker != NULL);
 	j->status = JOB_NORMAL;
-	SIGNAL(&j->blocking_cvar);
 	UNLOCK(&j->lifecycle_lock);
+	record_job_resumed(j);
+	/* it may have been deferred on another cpu; in cant_swap() it's only
+	 * woken to be parked, and isn't on any cpu of its own */
+	if (j->current_cpu != (unsigned long)-1 &&
+	    j->worker->mess.remote == NULL) {
+		affinity_follow(j->worker->pid, j->current_cpu,
+				j->worker->home_node);
+	}
+	supervisor_call(resume_talking, j->worker);
+}
+
+/* is its landslide running on an agent? */
+bool job_remote(struct job *j)
+{
+	return j->worker != NULL && j->worker->mess.remote != NULL;
+}
+
+/* A suspended job's landslide is on one host; see remote_job_resumable_on(). */
+bool job_resumable_on(struct job *j, unsigned long cpu)
+{
+	if (j->worker == NULL || j->park_filename != NULL) {
+		return true; /* (it'll get a new landslide wherever) */
+	}
+	return remote_job_resumable_on(j->worker->mess.remote, cpu);
+}
+
+/* Called with the stats lock held for writing (or before anyone else can see
+ * the job), so there is only ever one writer. The display thread may be
+ * reading the snapshot as it changes; the sequence number tells it to retry. */
+void publish_job_stats(struct job *j)
+{
+	struct job_stats *s = &j->stats_snapshot;
+	unsigned int seq = j->stats_seq;
+
+	__atomic_store_n(&j->stats_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->elapsed_branches    = j->elapsed_branches;
+	s->estimate_proportion = j->estimate_proportion;
+	s->estimate_elapsed    = j->estimate_elapsed;
+	s->estimate_eta        = j->estimate_eta;
+	s->estimate_elapsed_numeric = j->estimate_elapsed_numeric;
+	s->estimate_eta_numeric     = j->estimate_eta_numeric;
+	s->estimate_eta_hi_numeric  = j->estimate_eta_hi_numeric;
+	s->rss                 = j->rss;
+	s->pps_discovered      = j->pps_discovered;
+	s->start_latency       = j->start_latency;
+	s->cancelled           = j->cancelled;
+	s->complete            = j->complete;
+	s->timed_out           = j->timed_out;
+	s->need_rerun          = j->need_rerun;
+	s->parked              = j->park_filename != NULL;
+	s->fab_timestamp       = j->fab_timestamp;
+	s->fab_cputime         = j->fab_cputime;
+	s->icb_current_bound   = j->icb_current_bound;
+	s->icb_fab_preemptions = j->icb_fab_preemptions;
+	scnprintf(s->log_filename, BUF_SIZE, "%s",
+		  j->log_filename == NULL ? "" : j->log_filename);
+	scnprintf(s->trace_filename, BUF_SIZE, "%s",
+		  j->trace_filename == NULL ? "" : j->trace_filename);
+	__atomic_store_n(&j->stats_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void snapshot_job_stats(struct job *j, struct job_stats *s)
+{
+	unsigned int seq;
+	do {
+		seq = __atomic_load_n(&j->stats_seq, __ATOMIC_ACQUIRE);
+		if (seq % 2 != 0) {
+			continue; /* mid-publish */
+		}
+		*s = j->stats_snapshot;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (seq % 2 != 0 ||
+		 __atomic_load_n(&j->stats_seq, __ATOMIC_RELAXED) != seq);
 }
 
 void print_job_stats(struct job *j, bool pending, bool blocked)
 {
 	assert(!pending || !blocked);
 
-	READ_LOCK(&j->stats_lock);
-	if (j->cancelled && !verbose) {
-		RW_UNLOCK(&j->stats_lock);
+	struct job_stats stats;
+	struct job_stats *s = &stats;
+	snapshot_job_stats(j, s);
+	if (s->cancelled && !verbose) {
 		return;
 	}
 	PRINT("[JOB %d] ", j->id);
-	if (j->cancelled) {
+	if (num_tests() > 1) {
+		PRINT("(%s) ", j->test->name);
+	}
+	if (s->cancelled) {
 		PRINT(COLOUR_DARK COLOUR_YELLOW "CANCELLED");
-		if (j->need_rerun) {
+		if (s->need_rerun) {
 			PRINT(" (need rerun)");
 		}
 		PRINT("\n");
-	} else if (j->trace_filename != NULL) {
-		PRINT(COLOUR_BOLD COLOUR_RED "BUG FOUND: %s ", j->trace_filename);
+	} else if (s->trace_filename[0] != '\0') {
+		PRINT(COLOUR_BOLD COLOUR_RED "BUG FOUND: %s ", s->trace_filename);
 		/* fab preemption count is valid even if not using ICB */
 		PRINT("(%u interleaving%s tested; %u preemptions",
-		      j->elapsed_branches, j->elapsed_branches == 1 ? "" : "s",
-		      j->icb_fab_preemptions);
+		      s->elapsed_branches, s->elapsed_branches == 1 ? "" : "s",
+		      s->icb_fab_preemptions);
 		if (verbose) {
 			PRINT("; job time ");
-			print_human_friendly_time(&j->estimate_elapsed);
+			print_human_friendly_time(&s->estimate_elapsed);
 			/* Time between start of any statespaces whatsoever
 			 * until a bug was found in this one. */
 			PRINT("; pldi time %lu; new-fixed pldi cputime %lu",
-			      j->fab_timestamp, j->fab_cputime);
+			      s->fab_timestamp, s->fab_cputime);
 		}
 		PRINT(")\n");
-	} else if (j->timed_out) {
+	} else if (s->timed_out) {
 		PRINT(COLOUR_BOLD COLOUR_YELLOW "TIMED OUT ");
-		PRINT("(%Lf%%; ETA ", j->estimate_proportion * 100);
-		print_human_friendly_time(&j->estimate_eta);
+		PRINT("(%Lf%%; ETA ", s->estimate_proportion * 100);
+		print_human_friendly_time(&s->estimate_eta);
 		if (use_icb) {
-			PRINT("; cur ICB bound %d", j->icb_current_bound);
+			PRINT("; cur ICB bound %d", s->icb_current_bound);
 		}
 		PRINT(")\n");
-	} else if (j->complete) {
+	} else if (s->complete) {
 		PRINT(COLOUR_BOLD COLOUR_GREEN "COMPLETE ");
-		PRINT("(%u interleaving%s tested; ", j->elapsed_branches,
-		      j->elapsed_branches == 1 ? "" : "s");
-		print_human_friendly_time(&j->estimate_elapsed);
+		PRINT("(%u interleaving%s tested; ", s->elapsed_branches,
+		      s->elapsed_branches == 1 ? "" : "s");
+		print_human_friendly_time(&s->estimate_elapsed);
 		PRINT(" elapsed");
 		if (use_icb) {
-			PRINT("; max ICB bound %d", j->icb_current_bound);
+			PRINT("; max ICB bound %d", s->icb_current_bound);
 		}
 		PRINT(")\n");
 	} else if (pending) {
 		PRINT("Pending...\n");
-	} else if (j->elapsed_branches == 0) {
+	} else if (s->elapsed_branches == 0) {
 		PRINT("Setting up...\n");
 	} else if (blocked) {
 		PRINT(COLOUR_DARK COLOUR_MAGENTA "Deferred... ");
-		PRINT("(%Lf%%; ETA ", j->estimate_proportion * 100);
-		print_human_friendly_time(&j->estimate_eta);
+		PRINT("(%Lf%%; ETA ", s->estimate_proportion * 100);
+		print_human_friendly_time(&s->estimate_eta);
+		if (s->parked) {
+			PRINT("; parked on disk");
+		} else if (s->rss != 0) {
+			PRINT("; holding ");
+			print_human_friendly_size(s->rss);
+		}
 		PRINT(")\n");
 	} else {
 		PRINT(COLOUR_BOLD COLOUR_MAGENTA "Running ");
-		PRINT("(%Lf%%; ETA ", j->estimate_proportion * 100);
-		print_human_friendly_time(&j->estimate_eta);
+		PRINT("(%Lf%%; ETA ", s->estimate_proportion * 100);
+		print_human_friendly_time(&s->estimate_eta);
 		if (use_icb) {
-			PRINT("; cur ICB bound %d", j->icb_current_bound);
+			PRINT("; cur ICB bound %d", s->icb_current_bound);
+		}
+		if (s->rss != 0) {
+			PRINT("; using ");
+			print_human_friendly_size(s->rss);
 		}
 		PRINT(")\n");
 	}
 	PRINT("       ");
-	if (j->log_filename != NULL) {
+	if (s->log_filename[0] != '\0') {
 		// FIXME: "id/" -- better solution for where log files should go
-		PRINT(COLOUR_DARK COLOUR_GREY "Log: id/%s -- ", j->log_filename);
+		PRINT(COLOUR_DARK COLOUR_GREY "Log: id/%s -- ", s->log_filename);
 	}
 	PRINT(COLOUR_DARK COLOUR_GREY "PPs: ");
 	printf(COLOUR_GREY);
 	print_pp_set(j->config, true);
 	PRINT(COLOUR_DEFAULT "\n");
-	RW_UNLOCK(&j->stats_lock);
 }
 
 /* Positive result = j0's ETA bigger. Negative result = j1's ETA bigger.
@@ -461,13 +1163,42 @@ void print_job_stats(struct job *j, bool pending, bool blocked)
  * Smaller is better. */
 int compare_job_eta(struct job *j0, struct job *j1)
 {
+	/* By the pessimistic end of each ETA, so a job whose estimate is still
+	 * all over the place doesn't look better than one known to be close. */
 	READ_LOCK(&j0->stats_lock);
-	long double eta0 = j0->estimate_eta_numeric;
+	long double eta0 = j0->estimate_eta_hi_numeric;
 	RW_UNLOCK(&j0->stats_lock);
 
 	READ_LOCK(&j1->stats_lock);
-	long double eta1 = j1->estimate_eta_numeric;
+	long double eta1 = j1->estimate_eta_hi_numeric;
 	RW_UNLOCK(&j1->stats_lock);
 
 	return eta0 == eta1 ? 0 : eta0 < eta1 ? -1 : 1;
 }
+
+/* Is j1 better than j0 even if j1's ETA is as bad as it could be and j0's is
+ * as good? Switching between jobs on anything less is how they thrash. */
+bool job_eta_surely_better(struct job *j0, struct job *j1)
+{
+	READ_LOCK(&j0->stats_lock);
+	long double eta0 = j0->estimate_eta_lo_numeric;
+	RW_UNLOCK(&j0->stats_lock);
+
+	READ_LOCK(&j1->stats_lock);
+	long double eta1 = j1->estimate_eta_hi_numeric;
+	RW_UNLOCK(&j1->stats_lock);
+
+	return eta1 < eta0;
+}
+
+void print_human_friendly_size(unsigned long bytes)
+{
+	const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+	long double size = bytes;
+	unsigned int i = 0;
+	while (size >= 1024.0L && i + 1 < ARRAY_SIZE(units)) {
+		size /= 1024.0L;
+		i++;
+	}
+	PRINT("%.1Lf %s", size, units[i]);
+}
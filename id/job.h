@@ -8,44 +8,110 @@
 #define __ID_JOB_H
 
 #include <pthread.h>
+#include <sys/types.h>
 
 #include "io.h"
 #include "messaging.h"
 #include "time.h"
 
 struct pp_set;
+struct warm_worker;
+
+/* (shared with agent.c, which writes the same files on the far end) */
+#define CONFIG_STATIC_TEMPLATE  "config.quicksand.XXXXXX"
+#define CONFIG_DYNAMIC_TEMPLATE "pps-and-such.quicksand.XXXXXX"
+#define LOG_FILE_TEMPLATE(x) "ls-" x ".log.XXXXXX"
+
+#define LS_NO_KNOWN_BUG 0
+
+/* A test program under test. Given several (-p a,b,c), each has PPs, jobs, and
+ * bugs of its own, but all share the one workqueue and pool of CPUs. */
+struct test {
+	unsigned int index; /* among all tests, in -p order */
+	char *name;
+	/* wall-clock usecs its jobs have spent on CPUs so far, for fairness;
+	 * maintained by work.c, protected by the workqueue lock */
+	unsigned long cputime;
+};
+
+/* What the progress report needs to know about a job, copied out of it each
+ * time its stats change, so the reporter never needs the stats lock. */
+struct job_stats {
+	unsigned int elapsed_branches;
+	long double estimate_proportion;
+	struct human_friendly_time estimate_elapsed;
+	struct human_friendly_time estimate_eta;
+	long double estimate_elapsed_numeric;
+	long double estimate_eta_numeric;
+	long double estimate_eta_hi_numeric;
+	unsigned long rss;
+	unsigned int pps_discovered;
+	unsigned long start_latency;
+	bool cancelled;
+	bool complete;
+	bool timed_out;
+	bool need_rerun;
+	bool parked;
+	unsigned long fab_timestamp;
+	unsigned long fab_cputime;
+	unsigned int icb_current_bound;
+	unsigned int icb_fab_preemptions;
+	char log_filename[BUF_SIZE]; /* empty if none */
+	char trace_filename[BUF_SIZE]; /* likewise */
+};
 
 struct job {
 	/* local state */
+	struct test *test;
 	struct pp_set *config; /* shared but read-only after init */
 	unsigned int id;
 	unsigned int generation; /* max among generations of pps + 1 */
 	bool should_reproduce;
-	/* static config should not change between jobs, and defines cpp macros
-	 * that cause landslide recompiles. dynamic config defines pps and such
-	 * and is interpreted more "at runtime" by the build glue, to avoid
-	 * costly recompiles each time a new job starts. */
+	/* static config should not change between jobs of the same test, and
+	 * defines cpp macros that cause landslide recompiles. dynamic config
+	 * defines pps and such and is interpreted more "at runtime" by the
+	 * build glue, to avoid costly recompiles each time a new job starts. */
 	struct file config_static;
 	struct file config_dynamic;
 	struct file log_stdout;
 	struct file log_stderr;
 
-	/* stats -- writable by owner, readable by display thread.
+	/* stats -- writable by owner, readable by others. writers must drop
+	 * the lock with STATS_WRITE_UNLOCK so the display thread sees it.
 	 * LOCK NOTICE: this is taken while workqueue lock is held. */
 	pthread_rwlock_t stats_lock;
 	unsigned int elapsed_branches;
 	long double estimate_proportion;
 	struct human_friendly_time estimate_elapsed;
 	struct human_friendly_time estimate_eta;
+	long double estimate_elapsed_numeric;
 	long double estimate_eta_numeric;
+	/* confidence interval around the ETA; infinite (hi) until landslide
+	 * has seen enough branches to tell how far off the estimate may be */
+	long double estimate_eta_lo_numeric;
+	long double estimate_eta_hi_numeric;
+	/* memory held by its landslide (incl. simics), in bytes; see
+	 * sample_job_rss(). rss is 0 while no landslide holds any for it. */
+	unsigned long rss;
+	unsigned long peak_rss;
+	/* new data race PPs its landslide has reported */
+	unsigned int pps_discovered;
+	/* usecs from being started until its landslide was up; 0 until then */
+	unsigned long start_latency;
+	/* the job's own running time, for -R; see record.c. protected by
+	 * record.c's lock, not the stats lock. */
+	unsigned long record_usecs;
+	unsigned long record_since; /* 0 if not running */
 	/* job lifecycle */
 	bool cancelled;
 	bool complete;
 	bool timed_out;
 	bool kill_job;
+	bool park_job; /* like kill_job, but save its progress to resume later */
 	/* associated files */
 	char *log_filename;
 	char *trace_filename;
+	char *park_filename; /* landslide's parked exploration tree, if any */
 	bool need_rerun;
 	unsigned long fab_timestamp;
 	unsigned long fab_cputime;
@@ -53,26 +119,70 @@ struct job {
 	/* used iff -C option (control_experiment) is provided */
 	unsigned int icb_current_bound; /* last completed bound = this - 1 */
 	unsigned int icb_fab_preemptions; /* used only when FAB */
+	/* a seqlock over the display thread's copy of the above; see
+	 * publish_job_stats(). odd while being rewritten. */
+	unsigned int stats_seq;
+	struct job_stats stats_snapshot;
+
+	/* workqueue bookkeeping; maintained by work.c, protected by the
+	 * workqueue lock. blocked_subsets counts deferred jobs whose PP sets
+	 * are subsets of this one's. wq_priority is this job's cached
+	 * unexplored_priority(), valid as of explored_epoch() == wq_epoch. */
+	unsigned int blocked_subsets;
+	unsigned int heap_index;
+	unsigned int wq_priority;
+	unsigned int wq_epoch;
+	struct job *next_incoming;
+	/* canonical string of this job's PPs, if caching results; see cache.c */
+	char *cache_key;
+	/* the landslide running this job, once it's up */
+	struct warm_worker *worker;
+	unsigned long rss_sampled_at; /* owned by the supervisor thread */
 
 	/* misc shared state */
 	enum { JOB_NORMAL, JOB_BLOCKED, JOB_DONE } status;
 	pthread_cond_t done_cvar; /* workqueue thread waits on this */
-	pthread_cond_t blocking_cvar; /* job thread waits on this */
 	pthread_mutex_t lifecycle_lock;
 };
 
-void set_job_options(char *test_name, bool verbose, bool leave_logs, bool pintos,
-		     bool use_icb, bool preempt_everywhere, bool pure_hb, bool pathos);
+void set_job_options(char *test_names, bool verbose, bool leave_logs, bool pintos,
+		     bool use_icb, bool preempt_everywhere, bool pure_hb, bool pathos,
+		     bool warm_workers);
 bool testing_pintos();
 bool testing_pathos();
+unsigned int num_tests();
+struct test *get_test(unsigned int index);
 
-struct job *new_job(struct pp_set *config, bool should_reproduce);
+struct job *new_job(struct test *test, struct pp_set *config,
+		    bool should_reproduce,
+		    struct job *parent); /* parent may be NULL */
 void start_job(struct job *j);
 bool wait_on_job(struct job *j); /* true if job blocked, false if done */
 void resume_job(struct job *j);
+bool job_remote(struct job *j);
+bool job_resumable_on(struct job *j, unsigned long cpu);
+
+void job_block(struct job *j); /* to be called by the supervisor */
+void sample_job_rss(struct job *j, bool force); /* likewise */
+void retire_warm_workers();
+
+/* for agents, which start landslides the same way on their own hosts */
+bool landslide_build_begin(const char *test_name, bool always_rebuild);
+void landslide_build_end(const char *test_name, bool need_compile,
+			 bool child_alive);
+pid_t fork_landslide(unsigned int job_id, struct file *config_static,
+		     struct file *config_dynamic, struct file *log_stdout,
+		     struct file *log_stderr, unsigned long cpu);
 
-void job_block(struct job *j); /* to be called by job itself */
+#define STATS_WRITE_UNLOCK(j) do {					\
+		publish_job_stats(j);					\
+		RW_UNLOCK(&(j)->stats_lock);				\
+	} while (0)
+void publish_job_stats(struct job *j); /* with stats_lock write-held */
+void snapshot_job_stats(struct job *j, struct job_stats *s); /* lock-free */
 void print_job_stats(struct job *j, bool pending, bool blocked);
 int compare_job_eta(struct job *j0, struct job *j1);
+bool job_eta_surely_better(struct job *j0, struct job *j1);
+void print_human_friendly_size(unsigned long bytes);
 
 #endif
@@ -10,12 +10,20 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "affinity.h"
+#include "agent.h"
+#include "bandit.h"
 #include "bug.h"
+#include "cache.h"
 #include "common.h"
 #include "job.h"
+#include "metrics.h"
 #include "option.h"
 #include "pp.h"
+#include "record.h"
+#include "remote.h"
 #include "signals.h"
+#include "supervisor.h"
 #include "time.h"
 #include "work.h"
 
@@ -25,7 +33,7 @@ unsigned long eta_threshold;
 
 int main(int argc, char **argv)
 {
-	char test_name[BUF_SIZE];
+	char test_names[BUF_SIZE * 16];
 	unsigned long max_time;
 	unsigned long num_cpus;
 	bool verbose;
@@ -37,42 +45,88 @@ int main(int argc, char **argv)
 	bool use_icb;
 	bool preempt_everywhere;
 	bool pure_hb;
+	bool warm_workers;
+	bool use_cache;
+	char cache_dir[BUF_SIZE];
+	bool use_metrics;
+	char metrics_file[BUF_SIZE];
+	bool use_record;
+	char record_file[BUF_SIZE];
+	unsigned long mem_budget;
+	bool pin_cpus;
+	bool skip_smt;
+	enum bandit_policy bandit_policy;
 	unsigned long progress_interval;
+	unsigned int listen_port;
+	char listen_addr[BUF_SIZE];
+	bool agent;
+	char coordinator_host[BUF_SIZE];
+	unsigned int coordinator_port;
+	char token[BUF_SIZE];
 
-	if (!get_options(argc, argv, test_name, BUF_SIZE, &max_time, &num_cpus,
+	if (!get_options(argc, argv, test_names, BUF_SIZE * 16, &max_time, &num_cpus,
 			 &verbose, &leave_logs, &control_experiment,
 			 &use_wrapper_log, wrapper_log, BUF_SIZE, &pintos,
 			 &use_icb, &preempt_everywhere, &pure_hb, &pathos,
-			 &progress_interval, &eta_factor, &eta_threshold)) {
+			 &warm_workers, &use_cache, cache_dir, BUF_SIZE,
+			 &use_metrics, metrics_file, BUF_SIZE,
+			 &use_record, record_file, BUF_SIZE,
+			 &mem_budget, &pin_cpus, &skip_smt, &bandit_policy,
+			 &progress_interval, &eta_factor,
+			 &eta_threshold, &listen_port, listen_addr, BUF_SIZE,
+			 &agent, coordinator_host, BUF_SIZE, &coordinator_port,
+			 token, BUF_SIZE)) {
 		usage(argv[0]);
 		exit(ID_EXIT_USAGE);
 	}
 
 	set_logging_options(use_wrapper_log, wrapper_log);
 
+	if (agent) {
+		/* the coordinator decides everything else */
+		set_job_options(test_names, verbose, leave_logs, pintos, use_icb, preempt_everywhere, pure_hb, pathos, false);
+		return agent_main(coordinator_host, coordinator_port, num_cpus,
+				  token);
+	}
+
 	DBG("will run for at most %lu seconds\n", max_time);
 
-	set_job_options(test_name, verbose, leave_logs, pintos, use_icb, preempt_everywhere, pure_hb, pathos);
+	set_job_options(test_names, verbose, leave_logs, pintos, use_icb, preempt_everywhere, pure_hb, pathos, warm_workers);
+	cache_init(use_cache ? cache_dir : NULL);
 	init_signal_handling();
 	start_time(max_time * 1000000, num_cpus);
+	affinity_init(num_cpus, pin_cpus, skip_smt);
+	metrics_init(use_metrics ? metrics_file : NULL, num_cpus);
+	record_init(use_record ? record_file : NULL);
+	bandit_init(bandit_policy);
 
-	if (!control_experiment) {
-		add_work(new_job(create_pp_set(PRIORITY_NONE), true));
-		add_work(new_job(create_pp_set(PRIORITY_MUTEX_LOCK), true));
-		add_work(new_job(create_pp_set(PRIORITY_MUTEX_UNLOCK), true));
-		if (testing_pintos()) {
-			add_work(new_job(create_pp_set(PRIORITY_CLI), true));
-			add_work(new_job(create_pp_set(PRIORITY_STI), true));
+	for (unsigned int i = 0; i < num_tests(); i++) {
+		struct test *t = get_test(i);
+		if (!control_experiment) {
+			add_work(new_job(t, create_pp_set(t, PRIORITY_NONE), true, NULL));
+			add_work(new_job(t, create_pp_set(t, PRIORITY_MUTEX_LOCK), true, NULL));
+			add_work(new_job(t, create_pp_set(t, PRIORITY_MUTEX_UNLOCK), true, NULL));
+			if (testing_pintos()) {
+				add_work(new_job(t, create_pp_set(t, PRIORITY_CLI), true, NULL));
+				add_work(new_job(t, create_pp_set(t, PRIORITY_STI), true, NULL));
+			}
 		}
+		add_work(new_job(t, create_pp_set(t, PRIORITY_MUTEX_LOCK | PRIORITY_MUTEX_UNLOCK | PRIORITY_CLI | PRIORITY_STI), true, NULL));
+	}
+	start_supervisor();
+	start_work(num_cpus, progress_interval, mem_budget);
+	if (listen_port != 0 &&
+	    !remote_listen(listen_addr, listen_port, token)) {
+		exit(ID_EXIT_USAGE);
 	}
-	add_work(new_job(create_pp_set(PRIORITY_MUTEX_LOCK | PRIORITY_MUTEX_UNLOCK | PRIORITY_CLI | PRIORITY_STI), true));
-	start_work(num_cpus, progress_interval);
 	wait_to_finish_work();
+	retire_warm_workers();
+	stop_supervisor();
 	print_live_data_race_pps();
 	print_free_re_malloc_false_positives();
 
 	unsigned long cputime = total_cpu_time();
-	unsigned long saturation = (cputime / num_cpus) * 100 / time_elapsed();
+	unsigned long saturation = (cputime / num_cpu_slots()) * 100 / time_elapsed();
 	struct human_friendly_time cputime_hft;
 	human_friendly_time(cputime, &cputime_hft);
 	PRINT("total CPU time consumed: ");
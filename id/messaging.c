@@ -7,15 +7,23 @@
 #define _XOPEN_SOURCE 700
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "array_list.h"
+#include "bandit.h"
 #include "bug.h"
+#include "cache.h"
 #include "job.h"
 #include "messaging.h"
 #include "pp.h"
+#include "record.h"
+#include "remote.h"
 #include "sync.h"
 #include "time.h"
 #include "work.h"
@@ -23,8 +31,52 @@
 
 #define MESSAGING_MAGIC 0x15410de0u
 #define DR_TID_WILDCARD 0x15410de0u /* 0 could be a valid tid */
+#define PARKED_TREE_TEMPLATE "parked-tree.quicksand.XXXXXX"
 
-#define MESSAGE_BUF_SIZE 256
+/* Messages in each direction go through a single-producer single-consumer
+ * ring in a shared memory file that both processes map. A record is a header,
+ * the fixed-size message struct, and then a variable-length string (the
+ * pretty-printed data race, trace filename, etc.; always at least "").
+ *
+ * The fifos are kept only as doorbells. A side with nothing to do sets the
+ * ring's waiting flag and blocks reading its input fifo; whoever next publishes
+ * a record (or frees space, if it was the producer waiting) clears the flag and
+ * writes it a byte. They also still give us EOF if the child dies.
+ *
+ * Must match work/modules/landslide/messaging.c. */
+
+#define RING_SIZE (64 * 1024) /* power of 2 */
+#define RING_ALIGN 8
+#define CACHELINE 64
+#define RECORD_MAX_TEXT (RING_SIZE / 4)
+
+struct ring {
+	/* written by the consumer */
+	unsigned int head;
+	unsigned int consumer_waiting;
+	char consumer_pad[CACHELINE - 2 * sizeof(unsigned int)];
+	/* written by the producer */
+	unsigned int tail;
+	unsigned int producer_waiting;
+	char producer_pad[CACHELINE - 2 * sizeof(unsigned int)];
+	char buf[RING_SIZE];
+};
+
+struct message_rings {
+	unsigned int magic;
+	char pad[CACHELINE - sizeof(unsigned int)];
+	struct ring to_quicksand;
+	struct ring to_landslide;
+};
+
+struct record_header {
+	unsigned int size; /* of the whole record, including this header */
+	unsigned int msg_size; /* 0 for padding up to the end of the ring */
+};
+
+#define RECORD_SIZE(msg_size, text_len) \
+	((sizeof(struct record_header) + (msg_size) + (text_len) + \
+	  RING_ALIGN - 1) & ~(RING_ALIGN - 1))
 
 struct input_message {
 	unsigned int magic;
@@ -36,36 +88,42 @@ struct input_message {
 		FOUND_A_BUG = 3,
 		SHOULD_CONTINUE = 4,
 		ASSERT_FAILED = 5,
+		JOB_FINISHED = 6,
 	} tag;
 
 	union {
+		/* text: pretty-printed stack of the racing access */
 		struct {
 			unsigned int eip;
 			unsigned int tid;
 			unsigned int last_call;
 			unsigned int most_recent_syscall;
+			/* the other access of the pair (0 if not sent); if
+			 * unconfirmed, eip was observed to come first */
+			unsigned int other_eip;
 			bool confirmed;
 			bool deterministic;
 			bool free_re_malloc;
-			char pretty_printed[MESSAGE_BUF_SIZE];
+			bool in_kernel;
 		} dr;
 
 		struct {
 			long double proportion;
 			unsigned int elapsed_branches;
 			long double total_usecs;
+			/* confidence interval around total_usecs */
+			long double total_usecs_lo;
+			long double total_usecs_hi;
 			long double elapsed_usecs;
 			unsigned int icb_cur_bound;
 		} estimate;
 
+		/* text: trace filename */
 		struct {
-			char trace_filename[MESSAGE_BUF_SIZE];
 			unsigned int icb_preemption_count;
 		} bug;
 
-		struct {
-			char assert_message[MESSAGE_BUF_SIZE];
-		} crash_report;
+		/* (ASSERT_FAILED's text is the assert message) */
 	} content;
 };
 
@@ -75,30 +133,302 @@ struct output_message {
 		SHOULD_CONTINUE_REPLY = 0,
 		SUSPEND_TIME = 1,
 		RESUME_TIME = 2,
+		NEXT_JOB = 3,
+		KNOWN_DATA_RACE = 4,
 	} tag;
+	/* NEXT_JOB's text names the next job's translated dynamic PPs.
+	 * KNOWN_DATA_RACE's is a data race candidate; see send_known_races() */
 	bool value;
 };
 
 /* glue */
 
-static void send(int output_fd, struct output_message *m)
+static bool ring_readable(struct ring *r, unsigned int head)
 {
+	return __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) != head;
+}
+
+/* true if the consumer has moved its head up to at least min_head */
+static bool ring_writable(struct ring *r, unsigned int min_head)
+{
+	return (int)(__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) - min_head) >= 0;
+}
+
+static void ring_doorbell(int fd, unsigned int *waiting)
+{
+	if (__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST)) {
+		char c = 0;
+		int ret = write(fd, &c, 1);
+		assert(ret == 1 && "ring doorbell failed");
+	}
+}
+
+/* Checks ready(r, arg) without blocking. If it doesn't hold, flags us as
+ * waiting, so the child will ring our doorbell when that changes, and eats any
+ * stale doorbell bytes. Sets *hung_up if the child is gone. */
+static bool ring_poll(int doorbell_fd, unsigned int *waiting,
+		      bool (*ready)(struct ring *r, unsigned int arg),
+		      struct ring *r, unsigned int arg, bool *hung_up)
+{
+	*hung_up = false;
+	while (!ready(r, arg)) {
+		__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+		if (ready(r, arg)) {
+			__atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+			break;
+		}
+		char buf[64];
+		int ret = read(doorbell_fd, buf, sizeof(buf));
+		if (ret == 0) {
+			/* records published before hanging up still count */
+			*hung_up = true;
+			return ready(r, arg);
+		} else if (ret < 0) {
+			assert(errno == EAGAIN && "read doorbell failed");
+			return false;
+		}
+		/* (spurious wakeups, e.g. from stale bytes, are fine) */
+	}
+	return true;
+}
+
+/* Blocks until ready(r, arg) holds. Returns false if the child hung up first. */
+static bool ring_wait(int doorbell_fd, unsigned int *waiting,
+		      bool (*ready)(struct ring *r, unsigned int arg),
+		      struct ring *r, unsigned int arg)
+{
+	bool hung_up;
+	while (!ring_poll(doorbell_fd, waiting, ready, r, arg, &hung_up)) {
+		if (hung_up) {
+			return false;
+		}
+		struct pollfd pfd = { .fd = doorbell_fd, .events = POLLIN };
+		int ret = poll(&pfd, 1, -1);
+		assert((ret == 1 || (ret < 0 && errno == EINTR)) &&
+		       "poll doorbell failed");
+	}
+	return true;
+}
+
+static void send(struct messaging_state *state, struct output_message *m,
+		 const char *text)
+{
+	struct ring *r = &state->rings->to_landslide;
 	m->magic = MESSAGING_MAGIC;
-	int ret = write(output_fd, m, sizeof(struct output_message));
-	assert(ret == sizeof(struct output_message) &&
-	       "write output msg failed");
+
+	if (text == NULL) {
+		text = "";
+	}
+	unsigned int text_len = strlen(text) + 1;
+	assert(text_len <= RECORD_MAX_TEXT && "output msg text too long");
+
+	if (state->remote != NULL) {
+		/* the same record, less the header; the agent puts it in the
+		 * ring on its side */
+		char *payload = XMALLOC(sizeof(*m) + text_len, char);
+		memcpy(payload, m, sizeof(*m));
+		memcpy(payload + sizeof(*m), text, text_len);
+		remote_job_send(state->remote, payload, sizeof(*m) + text_len);
+		FREE(payload);
+		return;
+	}
+
+	unsigned int size = RECORD_SIZE(sizeof(*m), text_len);
+
+	/* records don't wrap; pad out the end of the ring if need be */
+	unsigned int pos = r->tail;
+	unsigned int room = RING_SIZE - (pos & (RING_SIZE - 1));
+	unsigned int needed = size <= room ? size : room + size;
+	bool alive = ring_wait(state->input_pipe.fd, &r->producer_waiting,
+			       ring_writable, r, pos + needed - RING_SIZE);
+	assert(alive && "child hung up while we waited to send");
+	struct record_header *h;
+	if (size > room) {
+		h = (struct record_header *)&r->buf[pos & (RING_SIZE - 1)];
+		h->size = room;
+		h->msg_size = 0;
+		pos += room;
+	}
+
+	h = (struct record_header *)&r->buf[pos & (RING_SIZE - 1)];
+	h->size = size;
+	h->msg_size = sizeof(*m);
+	memcpy(h + 1, m, sizeof(*m));
+	memcpy((char *)(h + 1) + sizeof(*m), text, text_len);
+
+	__atomic_store_n(&r->tail, pos + size, __ATOMIC_SEQ_CST);
+	ring_doorbell(state->output_pipe.fd, &r->consumer_waiting);
+}
+
+static void release(struct messaging_state *state, struct ring *r,
+		    unsigned int size)
+{
+	__atomic_store_n(&r->head, r->head + size, __ATOMIC_SEQ_CST);
+	ring_doorbell(state->output_pipe.fd, &r->producer_waiting);
 }
 
-static bool recv(int input_fd, struct input_message *m)
+/* Returns false if there's no message, either because the child hung up
+ * (*hung_up) or, if !block, because none has arrived yet. Otherwise *text
+ * stays valid until the next recv(). */
+static bool recv(struct messaging_state *state, struct input_message *m,
+		 char **text, bool block, bool *hung_up)
 {
-	int ret = read(input_fd, m, sizeof(struct input_message));
-	if (ret == sizeof(struct input_message)) {
+	if (state->remote != NULL) {
+		FREE(state->remote_pending);
+		unsigned int size;
+		state->remote_pending =
+			remote_job_recv(state->remote, block, &size, hung_up);
+		if (state->remote_pending == NULL) {
+			return false;
+		}
+		assert(size > sizeof(*m) && state->remote_pending[size - 1] == '\0'
+		       && "wrong remote msg size");
+		memcpy(m, state->remote_pending, sizeof(*m));
 		assert(m->magic == MESSAGING_MAGIC && "wrong magic");
+		*text = state->remote_pending + sizeof(*m);
+		return true;
+	}
+
+	struct ring *r = &state->rings->to_quicksand;
+
+	/* the caller is done with the previous record by now */
+	if (state->recv_pending != 0) {
+		release(state, r, state->recv_pending);
+		state->recv_pending = 0;
+	}
+
+	while (true) {
+		if (block) {
+			*hung_up = !ring_wait(state->input_pipe.fd,
+					      &r->consumer_waiting,
+					      ring_readable, r, r->head);
+			if (*hung_up) {
+				return false;
+			}
+		} else if (!ring_poll(state->input_pipe.fd, &r->consumer_waiting,
+				      ring_readable, r, r->head, hung_up)) {
+			return false;
+		}
+
+		struct record_header *h =
+			(struct record_header *)&r->buf[r->head & (RING_SIZE - 1)];
+		if (h->msg_size == 0) {
+			release(state, r, h->size);
+			continue;
+		}
+		assert(h->msg_size == sizeof(*m) && "wrong input msg size");
+		memcpy(m, h + 1, sizeof(*m));
+		assert(m->magic == MESSAGING_MAGIC && "wrong magic");
+		*text = (char *)(h + 1) + sizeof(*m);
+		state->recv_pending = h->size;
 		return true;
-	} else {
-		/* pipe was closed before next message was sent */
-		assert(ret == 0 && "read input msg failed");
-		return false;
+	}
+}
+
+/* Data race candidates, as landslide's memory.c tracks them: an eip pair, and
+ * which order(s) it's been observed in. Each landslide only confirms those it
+ * sees reordered itself, so every job would otherwise have to rediscover the
+ * same ones the hard way. Instead, whatever any job's landslide reports is
+ * passed along to the others of the same test, which merge it into their own.
+ *
+ * Each test's list is append-only, with a new entry whenever a pair is seen in
+ * a new order, so each landslide need only be told what's been added since it
+ * was last told anything. */
+struct known_race {
+	unsigned int eip0;
+	unsigned int eip1;
+	bool eip0_before_eip1;
+	bool eip1_before_eip0;
+	bool in_kernel;
+	unsigned int job_id; /* whose landslide told us (needn't hear it back) */
+};
+typedef ARRAY_LIST(struct known_race) known_race_list_t;
+/* per test, lazily allocated; protected by the lock */
+static known_race_list_t *known_races = NULL;
+static pthread_mutex_t known_races_lock = PTHREAD_MUTEX_INITIALIZER;
+/* so as not to hold up a reply for too long; the rest can go with the next */
+#define KNOWN_RACES_PER_REPLY 64
+
+/* with the lock held */
+static void check_init_known_races()
+{
+	if (known_races == NULL) {
+		known_races = XMALLOC(num_tests(), known_race_list_t);
+		for (unsigned int i = 0; i < num_tests(); i++) {
+			ARRAY_LIST_INIT(&known_races[i], 16);
+		}
+	}
+}
+
+static void learn_data_race(struct job *j, unsigned int eip,
+			    unsigned int other_eip, bool confirmed,
+			    bool in_kernel)
+{
+	if (other_eip == 0 || other_eip == eip) {
+		return;
+	}
+	struct known_race new_race;
+	new_race.eip0 = MIN(eip, other_eip);
+	new_race.eip1 = MAX(eip, other_eip);
+	new_race.eip0_before_eip1 = confirmed || eip == new_race.eip0;
+	new_race.eip1_before_eip0 = confirmed || eip == new_race.eip1;
+	new_race.in_kernel = in_kernel;
+	new_race.job_id = j->id;
+
+	LOCK(&known_races_lock);
+	check_init_known_races();
+	known_race_list_t *races = &known_races[j->test->index];
+	/* the latest entry for the pair knows everything there is */
+	for (unsigned int i = ARRAY_LIST_SIZE(races); i > 0; i--) {
+		struct known_race *old = ARRAY_LIST_GET(races, i - 1);
+		if (old->eip0 == new_race.eip0 && old->eip1 == new_race.eip1 &&
+		    old->in_kernel == in_kernel) {
+			if ((old->eip0_before_eip1 || !new_race.eip0_before_eip1) &&
+			    (old->eip1_before_eip0 || !new_race.eip1_before_eip0)) {
+				/* nothing new */
+				UNLOCK(&known_races_lock);
+				return;
+			}
+			new_race.eip0_before_eip1 |= old->eip0_before_eip1;
+			new_race.eip1_before_eip0 |= old->eip1_before_eip0;
+			break;
+		}
+	}
+	ARRAY_LIST_APPEND(races, new_race);
+	UNLOCK(&known_races_lock);
+}
+
+/* Tells the child what the others have found since it was last told, before
+ * a reply it's waiting for (and so is reading its ring for). */
+static void send_known_races(struct messaging_state *state, struct job *j)
+{
+	struct known_race batch[KNOWN_RACES_PER_REPLY];
+	unsigned int batch_size = 0;
+
+	LOCK(&known_races_lock);
+	check_init_known_races();
+	known_race_list_t *races = &known_races[j->test->index];
+	while (state->known_races_sent < ARRAY_LIST_SIZE(races) &&
+	       batch_size < KNOWN_RACES_PER_REPLY) {
+		struct known_race *race =
+			ARRAY_LIST_GET(races, state->known_races_sent);
+		state->known_races_sent++;
+		if (race->job_id != j->id) {
+			batch[batch_size++] = *race;
+		}
+	}
+	UNLOCK(&known_races_lock);
+
+	for (unsigned int i = 0; i < batch_size; i++) {
+		char buf[BUF_SIZE];
+		scnprintf(buf, BUF_SIZE, "%c 0x%x 0x%x %d %d",
+			  batch[i].in_kernel ? 'k' : 'u', batch[i].eip0,
+			  batch[i].eip1, batch[i].eip0_before_eip1 ? 1 : 0,
+			  batch[i].eip1_before_eip0 ? 1 : 0);
+		struct output_message m;
+		m.tag = KNOWN_DATA_RACE;
+		m.value = false;
+		send(state, &m, buf);
 	}
 }
 
@@ -108,10 +438,23 @@ extern bool control_experiment;
 extern bool use_icb;
 extern bool verbose;
 
-static void handle_data_race(struct job *j, struct pp_set **discovered_pps,
-			     unsigned int eip, unsigned int tid, bool confirmed,
-			     bool deterministic, bool free_re_malloc, unsigned int last_call,
-			     unsigned int most_recent_syscall, char *pretty)
+static void batch_add_pp(struct job *j, struct pp_set **set, struct pp *pp)
+{
+	if (*set == NULL) {
+		*set = create_pp_set(j->test, PRIORITY_NONE);
+	}
+	struct pp_set *old_set = *set;
+	*set = add_pp_to_set(old_set, pp);
+	free_pp_set(old_set);
+}
+
+/* New jobs aren't made here, but buffered in the batch until the child's
+ * branch ends; see flush_data_races(). */
+void handle_data_race(struct job *j, struct pp_set **discovered_pps,
+		      struct data_race_batch *batch, unsigned int eip,
+		      unsigned int tid, bool confirmed, bool deterministic,
+		      bool free_re_malloc, unsigned int last_call,
+		      unsigned int most_recent_syscall, char *pretty)
 {
 	/* register a (possibly) new PP based on the data race */
 	bool duplicate;
@@ -138,8 +481,9 @@ static void handle_data_race(struct job *j, struct pp_set **discovered_pps,
 
 	unsigned int priority = confirmed ?
 		PRIORITY_DR_CONFIRMED : PRIORITY_DR_SUSPECTED;
-	struct pp *pp = pp_new(config_str, short_str, pretty, priority,
+	struct pp *pp = pp_new(j->test, config_str, short_str, pretty, priority,
 			       deterministic, free_re_malloc, j->generation, &duplicate);
+	record_data_race(j, pp->id, confirmed);
 	// Uncomment this to make LS/QS more comparable to 1-pass DR.
 	// Free-re-malloc PPs will be recorded as deterministic, so we don't
 	// unfairly classify them as false negatives.
@@ -155,38 +499,21 @@ static void handle_data_race(struct job *j, struct pp_set **discovered_pps,
 	if (free_re_malloc) return;
 #endif
 
+	/* (not counting free-re-malloc ones, being likely false positives) */
+	if (!duplicate) {
+		bandit_reward(j->config, confirmed ? BANDIT_CONFIRMED_RACE :
+			      BANDIT_NEW_PP);
+	}
+
 	/* If the data race PP is not already enabled in this job's config,
-	 * create a new job based on this one. */
+	 * create new jobs based on this one (a little one only for PPs new to
+	 * the test, and only if this job isn't already little). */
 	if (j->should_reproduce && !pp_set_contains(j->config, pp) &&
 	    !pp_set_contains(*discovered_pps, pp) && !control_experiment &&
-	    !bug_already_found(j->config)) {
-		struct pp_set *new_set;
-		bool added = false;
-		/* Add a little job. */
+	    !bug_already_found(j->test, j->config)) {
+		batch_add_pp(j, &batch->big_pps, pp);
 		if (!duplicate && j->config->size > 0) {
-			struct pp_set *empty = create_pp_set(PRIORITY_NONE);
-			new_set = add_pp_to_set(empty, pp);
-			free_pp_set(empty);
-			if (work_already_exists(new_set)) {
-				free_pp_set(new_set);
-			} else {
-				DBG("Adding small job with new PP '%s'\n",
-				    pp->config_str);
-				add_work(new_job(new_set, false));
-				added = true;
-			}
-		}
-		/* Add a big job. */
-		new_set = add_pp_to_set(j->config, pp);
-		if (work_already_exists(new_set) || bug_already_found(new_set)) {
-			free_pp_set(new_set);
-		} else {
-			DBG("Adding big job with new PP '%s'\n", pp->config_str);
-			add_work(new_job(new_set, true));
-			added = true;
-		}
-		if (added) {
-			signal_work();
+			batch_add_pp(j, &batch->small_pps, pp);
 		}
 	}
 
@@ -194,11 +521,83 @@ static void handle_data_race(struct job *j, struct pp_set **discovered_pps,
 	 * (ignoring discoveries by other threads). This allows us to decide
 	 * when to create a new job -- the data race was not part of this job's
 	 * initial config, nor did we already create the same job already. */
+	if (!pp_set_contains(j->config, pp) &&
+	    !pp_set_contains(*discovered_pps, pp)) {
+		WRITE_LOCK(&j->stats_lock);
+		j->pps_discovered++;
+		STATS_WRITE_UNLOCK(j);
+	}
 	struct pp_set *old_discovered = *discovered_pps;
 	*discovered_pps = add_pp_to_set(old_discovered, pp);
 	free_pp_set(old_discovered);
 }
 
+static void flush_new_job(struct job *j, struct pp_set *set, struct pp *pp,
+			  bool big, struct job **new_jobs,
+			  unsigned int *num_new_jobs)
+{
+	if (work_already_exists(j->test, set) ||
+	    bug_already_found(j->test, set)) {
+		free_pp_set(set);
+	} else {
+		DBG("Adding %s job with new PP '%s'\n", big ? "big" : "small",
+		    pp->config_str);
+		new_jobs[(*num_new_jobs)++] = new_job(j->test, set, big, j);
+	}
+}
+
+/* A branch reporting many data races used to make its new jobs one at a time,
+ * as each arrived, checking for a found bug among the job's own PPs and waking
+ * the workqueue every time. Instead they're buffered (as PP sets, so repeats
+ * within the branch coalesce), and once the branch is over the new jobs' PP
+ * sets are all made at once, filtered against existing work and found bugs (by
+ * subset), and queued together.
+ *
+ * They aren't filtered by subset against each other, though: each little set
+ * {pp} is a subset of its big one, config + {pp}, and both are kept on purpose,
+ * as they always were. The little job is the quick way to the bug, and the big
+ * one preserves the context it was found in. The workqueue already sorts the
+ * little one first, and parks the big one if the little one blocks (see
+ * work.c), and a bug found by either cancels its supersets. */
+void flush_data_races(struct job *j, struct data_race_batch *batch)
+{
+	if (batch->big_pps == NULL) {
+		assert(batch->small_pps == NULL);
+		return;
+	}
+
+	unsigned int max_new_jobs = batch->big_pps->size +
+		(batch->small_pps == NULL ? 0 : batch->small_pps->size);
+	struct job **new_jobs = XMALLOC(max_new_jobs, struct job *);
+	unsigned int num_new_jobs = 0;
+	struct pp *pp;
+
+	/* (if this job found a bug since, the whole batch is moot) */
+	if (!bug_already_found(j->test, j->config)) {
+		/* little jobs first, as they'd have been made before */
+		if (batch->small_pps != NULL) {
+			struct pp_set *empty =
+				create_pp_set(j->test, PRIORITY_NONE);
+			FOR_EACH_PP(pp, batch->small_pps) {
+				flush_new_job(j, add_pp_to_set(empty, pp), pp,
+					      false, new_jobs, &num_new_jobs);
+			}
+			free_pp_set(empty);
+		}
+		FOR_EACH_PP(pp, batch->big_pps) {
+			flush_new_job(j, add_pp_to_set(j->config, pp), pp, true,
+				      new_jobs, &num_new_jobs);
+		}
+	}
+	add_work_batch(new_jobs, num_new_jobs);
+	FREE(new_jobs);
+
+	free_pp_set(batch->big_pps);
+	free_pp_set(batch->small_pps);
+	batch->big_pps = NULL;
+	batch->small_pps = NULL;
+}
+
 extern unsigned long eta_factor;
 extern unsigned long eta_threshold;
 
@@ -207,20 +606,32 @@ extern unsigned long eta_threshold;
  * to fresh jobs. */
 #define HOMESTRETCH (60 * 1000000)
 
-static void handle_estimate(struct messaging_state *state, struct job *j,
+/* returns true if the job was blocked; see messaging_resume() */
+static bool handle_estimate(struct messaging_state *state, struct job *j,
 			    long double proportion, unsigned int elapsed_branches,
-			    long double total_usecs, long double elapsed_usecs,
+			    long double total_usecs, long double total_usecs_lo,
+			    long double total_usecs_hi, long double elapsed_usecs,
 			    unsigned int icb_bound)
 {
 	unsigned int total_branches =
 	    (unsigned int)((long double)elapsed_branches / proportion);
 	long double remaining_usecs = total_usecs - elapsed_usecs;
+	long double remaining_usecs_lo = total_usecs_lo - elapsed_usecs;
+	long double remaining_usecs_hi = total_usecs_hi - elapsed_usecs;
+
+	sample_job_rss(j, false);
 
 	WRITE_LOCK(&j->stats_lock);
+	/* (landslide's clock restarts if a job is rerun or unparked) */
+	unsigned long cpu_usecs = elapsed_usecs > j->estimate_elapsed_numeric ?
+		(unsigned long)(elapsed_usecs - j->estimate_elapsed_numeric) : 0;
 	j->elapsed_branches = elapsed_branches;
 	j->estimate_proportion = proportion;
 	human_friendly_time(elapsed_usecs, &j->estimate_elapsed);
+	j->estimate_elapsed_numeric = elapsed_usecs;
 	j->estimate_eta_numeric = remaining_usecs;
+	j->estimate_eta_lo_numeric = remaining_usecs_lo;
+	j->estimate_eta_hi_numeric = remaining_usecs_hi;
 	human_friendly_time(remaining_usecs, &j->estimate_eta);
 	DBG("[JOB %d] progress: %u/%u brs (%Lf%%), ", j->id,
 	    elapsed_branches, total_branches, proportion * 100);
@@ -232,12 +643,18 @@ static void handle_estimate(struct messaging_state *state, struct job *j,
 	dbg_human_friendly_time(&j->estimate_eta);
 	DBG(" (elapsed ");
 	dbg_human_friendly_time(&j->estimate_elapsed);
-	DBG(")\n");
-	RW_UNLOCK(&j->stats_lock);
+	DBG("; bounds %Lfs to %Lfs)\n", remaining_usecs_lo / 1000000,
+	    remaining_usecs_hi / 1000000);
+	STATS_WRITE_UNLOCK(j);
+	record_estimate(j, proportion, elapsed_branches, total_usecs,
+			total_usecs_lo, total_usecs_hi);
+	bandit_charge(j->config, cpu_usecs);
 
-	/* Does this ETA suck? (note all numbers here are in usecs) */
-	bool eta_overflow = remaining_usecs > (long double)ULONG_MAX;
-	unsigned long eta = (unsigned long)remaining_usecs;
+	/* Does this ETA suck? (note all numbers here are in usecs) Early on the
+	 * estimate swings wildly, so judge by its optimistic end, and block only
+	 * jobs that are too big even so. */
+	bool eta_overflow = remaining_usecs_lo > (long double)ULONG_MAX;
+	unsigned long eta = (unsigned long)remaining_usecs_lo;
 	unsigned long time_left = time_remaining();
 
 	struct output_message reply;
@@ -252,42 +669,55 @@ static void handle_estimate(struct messaging_state *state, struct job *j,
 		     elapsed_branches, time_left / 1000000, eta / 1000000);
 		/* Inform landslide instance to pause its time counter. */
 		reply.value = true;
-		send(state->output_pipe.fd, &reply);
-		/* Wait until we get rescheduled. */
+		send(state, &reply, NULL);
+		/* It stays paused until we get rescheduled. */
 		job_block(j);
-		/* Tell landslide instance to start timing again. */
-		reply.tag = RESUME_TIME;
-		send(state->output_pipe.fd, &reply);
+		return true;
 	} else {
 		/* Normal operation. Tell landslide not to pause timing. */
 		reply.value = false;
-		send(state->output_pipe.fd, &reply);
+		send(state, &reply, NULL);
+		return false;
 	}
 }
 
 static bool handle_should_continue(struct job *j)
 {
-	if (bug_already_found(j->config)) {
+	if (bug_already_found(j->test, j->config)) {
 		DBG("Aborting -- a subset of our PPs already found a bug.\n");
 		WRITE_LOCK(&j->stats_lock);
 		j->cancelled = true;
-		RW_UNLOCK(&j->stats_lock);
+		STATS_WRITE_UNLOCK(j);
 		return false;
 	} else if (TIME_UP()) {
 		DBG("Aborting -- time up!\n");
 		WRITE_LOCK(&j->stats_lock);
 		j->timed_out = true;
-		RW_UNLOCK(&j->stats_lock);
+		STATS_WRITE_UNLOCK(j);
 		return false;
 	} else {
 		READ_LOCK(&j->stats_lock);
 		bool should_kill_job = j->kill_job;
+		bool should_park_job = j->park_job;
 		RW_UNLOCK(&j->stats_lock);
-		if (should_kill_job) {
+		if (should_park_job) {
+			/* landslide writes its tree here as it aborts; it's
+			 * resumed from the file when the job gets rerun. */
+			DBG("Aborting -- can't swap! Parking tree on disk.\n");
+			struct file f;
+			create_file(&f, PARKED_TREE_TEMPLATE);
+			move_file_to(&f, LANDSLIDE_PATH);
+			WRITE_LOCK(&j->stats_lock);
+			assert(j->park_filename == NULL && "job parked twice");
+			j->park_filename = XSTRDUP(f.filename);
+			STATS_WRITE_UNLOCK(j);
+			delete_file(&f, false);
+			return false;
+		} else if (should_kill_job) {
 			DBG("Aborting -- can't swap!\n");
 			WRITE_LOCK(&j->stats_lock);
 			j->cancelled = true;
-			RW_UNLOCK(&j->stats_lock);
+			STATS_WRITE_UNLOCK(j);
 			return false;
 		} else {
 			return true;
@@ -295,16 +725,16 @@ static bool handle_should_continue(struct job *j)
 	}
 }
 
-static void handle_crash(struct job *j, struct input_message *m)
+static void handle_crash(struct job *j, const char *assert_message)
 {
 	WRITE_LOCK(&j->stats_lock);
 	j->cancelled = true;
-	RW_UNLOCK(&j->stats_lock);
+	STATS_WRITE_UNLOCK(j);
 
 	ERR("[JOB %d] Landslide crashed. The assert message was: %s\n",
-	    j->id, m->content.crash_report.assert_message);
+	    j->id, assert_message);
 	ERR("[JOB %d] For more detail see stderr log file: %s\n",
-	    j->id, j->log_stderr.filename);
+	    j->id, j->log_filename);
 
 	ERR("[JOB %d] THIS IS NOT YOUR FAULT.\n", j->id);
 	struct pp *pp;
@@ -340,20 +770,51 @@ static void move_trace_file(const char *trace_filename)
 
 /* messaging logic */
 
-/* creates the fifo files on the filesystem, but does not block on them yet. */
+/* creates the fifo and ring files on the filesystem, but does not block on
+ * them yet. */
 void messaging_init(struct messaging_state *state, struct file *config_static,
 		    struct file *config_dynamic, unsigned int job_id)
 {
 	state->input_pipe_name  = create_fifo("id-input-pipe",  job_id);
 	state->output_pipe_name = create_fifo("id-output-pipe", job_id);
+	state->rings = create_shm(&state->rings_file, "id-message-rings",
+				  job_id, sizeof(struct message_rings));
+	state->rings->magic = MESSAGING_MAGIC;
+	state->recv_pending = 0;
+	state->remote = NULL;
+	state->remote_pending = NULL;
+	state->discovered_pps = NULL;
+	state->batch.big_pps = NULL;
+	state->batch.small_pps = NULL;
+	state->known_races_sent = 0;
 	state->ready = false;
 
 	/* our output is the child's input and V. V. */
 	XWRITE(config_dynamic, "output_pipe %s\n", state->input_pipe_name);
 	XWRITE(config_dynamic, "input_pipe %s\n", state->output_pipe_name);
+	XWRITE(config_dynamic, "message_rings %s\n", state->rings_file.filename);
 	XWRITE(config_static, "id_magic %u\n", MESSAGING_MAGIC);
 }
 
+/* For a job on an agent, once its landslide is up there (see remote.c). There
+ * are no files on this side; the agent has its own. */
+void messaging_init_remote(struct messaging_state *state, struct remote_job *rj)
+{
+	state->input_pipe_name = NULL;
+	state->output_pipe_name = NULL;
+	state->input_pipe.fd = remote_job_doorbell(rj);
+	state->input_pipe.filename = NULL;
+	state->rings = NULL;
+	state->recv_pending = 0;
+	state->remote = rj;
+	state->remote_pending = NULL;
+	state->discovered_pps = NULL;
+	state->batch.big_pps = NULL;
+	state->batch.small_pps = NULL;
+	state->known_races_sent = 0;
+	state->ready = true;
+}
+
 bool wait_for_child(struct messaging_state *state)
 {
 	assert(state->input_pipe_name  != NULL);
@@ -362,9 +823,16 @@ bool wait_for_child(struct messaging_state *state)
 
 	open_fifo(&state->input_pipe, state->input_pipe_name, O_RDONLY);
 	state->input_pipe_name = NULL;
+	/* so the supervisor can poll it; see recv() for blocking */
+	int flags = fcntl(state->input_pipe.fd, F_GETFL);
+	assert(flags != -1 && "couldn't get input pipe flags");
+	int ret = fcntl(state->input_pipe.fd, F_SETFL, flags | O_NONBLOCK);
+	assert(ret == 0 && "couldn't make input pipe nonblocking");
 
 	struct input_message m;
-	if (recv(state->input_pipe.fd, &m)) {
+	char *text;
+	bool hung_up;
+	if (recv(state, &m, &text, true, &hung_up)) {
 		assert(m.tag == THUNDERBIRDS_ARE_GO && "wrong 1st message type");
 		/* child is alive. finalize the 2-way fifo setup. */
 		open_fifo(&state->output_pipe, state->output_pipe_name, O_WRONLY);
@@ -377,39 +845,69 @@ bool wait_for_child(struct messaging_state *state)
 	}
 }
 
-void talk_to_child(struct messaging_state *state, struct job *j)
+/* Handles whatever messages the child has sent so far, without blocking. Run
+ * by the supervisor thread whenever the child rings our doorbell. */
+enum child_status talk_to_child(struct messaging_state *state, struct job *j)
 {
 	assert(state->ready);
-	struct pp_set *discovered_pps = create_pp_set(PRIORITY_NONE);
+	if (state->discovered_pps == NULL) {
+		state->discovered_pps = create_pp_set(j->test, PRIORITY_NONE);
+	}
+	enum child_status status = CHILD_RUNNING;
 
 	struct input_message m;
-	while (recv(state->input_pipe.fd, &m)) {
+	char *text;
+	bool hung_up = false;
+	while (status == CHILD_RUNNING &&
+	       recv(state, &m, &text, false, &hung_up)) {
+		/* Landslide sends a branch's data races all together, then an
+		 * estimate (or whatever else) to end it. */
+		if (m.tag != DATA_RACE) {
+			flush_data_races(j, &state->batch);
+		}
 		if (m.tag == THUNDERBIRDS_ARE_GO) {
 			assert(false && "recvd duplicate thunderbirds message");
 		} else if (m.tag == DATA_RACE) {
-			handle_data_race(j, &discovered_pps, m.content.dr.eip,
+			cache_record_data_race(j, m.content.dr.eip,
+					       m.content.dr.tid,
+					       m.content.dr.confirmed,
+					       m.content.dr.deterministic,
+					       m.content.dr.free_re_malloc,
+					       m.content.dr.last_call,
+					       m.content.dr.most_recent_syscall,
+					       text);
+			handle_data_race(j, &state->discovered_pps,
+					 &state->batch, m.content.dr.eip,
 					 m.content.dr.tid, m.content.dr.confirmed,
 					 m.content.dr.deterministic,
 					 m.content.dr.free_re_malloc,
 					 m.content.dr.last_call,
 					 m.content.dr.most_recent_syscall,
-					 m.content.dr.pretty_printed);
+					 text);
+			learn_data_race(j, m.content.dr.eip,
+					m.content.dr.other_eip,
+					m.content.dr.confirmed,
+					m.content.dr.in_kernel);
 		} else if (m.tag == ESTIMATE) {
-			handle_estimate(state, j, m.content.estimate.proportion,
-					m.content.estimate.elapsed_branches,
-					m.content.estimate.total_usecs,
-					m.content.estimate.elapsed_usecs,
-					m.content.estimate.icb_cur_bound);
+			if (handle_estimate(state, j, m.content.estimate.proportion,
+					    m.content.estimate.elapsed_branches,
+					    m.content.estimate.total_usecs,
+					    m.content.estimate.total_usecs_lo,
+					    m.content.estimate.total_usecs_hi,
+					    m.content.estimate.elapsed_usecs,
+					    m.content.estimate.icb_cur_bound)) {
+				status = CHILD_BLOCKED;
+			}
 		} else if (m.tag == FOUND_A_BUG) {
-			move_trace_file(m.content.bug.trace_filename);
+			move_trace_file(text);
 			// NB. Harmless if/then/else race; could cause simply
 			// extraneous bug reports when this races itself.
-			if (bug_already_found(j->config)) {
+			if (bug_already_found(j->test, j->config)) {
 				DBG("Ignoring bug report -- a subset of our "
 				    "PPs already found a bug.\n");
 				WRITE_LOCK(&j->stats_lock);
 				j->cancelled = true;
-				RW_UNLOCK(&j->stats_lock);
+				STATS_WRITE_UNLOCK(j);
 			} else {
 				READ_LOCK(&j->stats_lock);
 				/* this should scare you. it scares me. */
@@ -420,42 +918,95 @@ void talk_to_child(struct messaging_state *state, struct job *j)
 					WRITE_LOCK(&j->stats_lock);
 					j->elapsed_branches++;
 					j->need_rerun = true;
-					RW_UNLOCK(&j->stats_lock);
+					STATS_WRITE_UNLOCK(j);
 				} else {
 					/* actual logic */
-					found_a_bug(m.content.bug.trace_filename, j);
+					found_a_bug(text, j);
+					record_bug(j);
+					bandit_reward(j->config, BANDIT_BUG);
 
 					WRITE_LOCK(&j->stats_lock);
 					assert(j->trace_filename == NULL &&
 					       "bug already found same job?");
-					j->trace_filename =
-						XSTRDUP(m.content.bug.trace_filename);
+					j->trace_filename = XSTRDUP(text);
 					j->fab_timestamp = time_elapsed();
 					j->fab_cputime = total_cpu_time();
 					j->elapsed_branches++;
 					j->icb_fab_preemptions =
 						m.content.bug.icb_preemption_count;
-					RW_UNLOCK(&j->stats_lock);
+					STATS_WRITE_UNLOCK(j);
 				}
 			}
 		} else if (m.tag == SHOULD_CONTINUE) {
 			struct output_message reply;
 			reply.tag = SHOULD_CONTINUE_REPLY;
 			reply.value = !handle_should_continue(j);
-			send(state->output_pipe.fd, &reply);
+			if (!reply.value) {
+				send_known_races(state, j);
+			}
+			/* (only this thread ever sets park_filename) */
+			send(state, &reply, reply.value ? j->park_filename : NULL);
 		} else if (m.tag == ASSERT_FAILED) {
-			handle_crash(j, &m);
-			break;
+			handle_crash(j, text);
+			status = CHILD_EXITED;
+		} else if (m.tag == JOB_FINISHED) {
+			status = CHILD_FINISHED;
 		} else {
 			assert(false && "unknown message type");
 		}
 	}
+	if (status == CHILD_RUNNING && hung_up) {
+		status = CHILD_EXITED;
+	}
+
+	if (status == CHILD_FINISHED || status == CHILD_EXITED) {
+		flush_data_races(j, &state->batch);
+		free_pp_set(state->discovered_pps);
+		state->discovered_pps = NULL;
+	}
+	return status;
+}
+
+/* lets a child blocked in handle_estimate() start running (and timing) again */
+void messaging_resume(struct messaging_state *state)
+{
+	assert(state->ready);
+	struct output_message m;
+	m.tag = RESUME_TIME;
+	m.value = false;
+	send(state, &m, NULL);
+}
 
-	free_pp_set(discovered_pps);
+/* hands a new job to a warm child that's waiting after JOB_FINISHED */
+void messaging_next_job(struct messaging_state *state, const char *pps_filename)
+{
+	assert(state->ready);
+	struct output_message m;
+	m.tag = NEXT_JOB;
+	m.value = true;
+	send(state, &m, pps_filename);
+	/* it forgets its data races between jobs */
+	state->known_races_sent = 0;
+}
+
+/* tells a warm child waiting after JOB_FINISHED to quit */
+void messaging_no_more_jobs(struct messaging_state *state)
+{
+	assert(state->ready);
+	struct output_message m;
+	m.tag = NEXT_JOB;
+	m.value = false;
+	send(state, &m, NULL);
 }
 
 void finish_messaging(struct messaging_state *state)
 {
+	if (state->remote != NULL) {
+		/* (the doorbell is the remote job's to close) */
+		FREE(state->remote_pending);
+		state->remote_pending = NULL;
+		return;
+	}
 	assert(state->input_pipe_name == NULL);
 	delete_file(&state->input_pipe, true);
 	if (state->output_pipe_name == NULL) {
@@ -463,6 +1014,7 @@ void finish_messaging(struct messaging_state *state)
 	} else {
 		delete_unused_fifo(state->output_pipe_name);
 	}
+	delete_shm(&state->rings_file, state->rings, sizeof(struct message_rings));
 }
 
 void messaging_abort(struct messaging_state *state)
@@ -471,4 +1023,40 @@ void messaging_abort(struct messaging_state *state)
 	assert(state->output_pipe_name != NULL);
 	delete_unused_fifo(state->input_pipe_name);
 	delete_unused_fifo(state->output_pipe_name);
+	delete_shm(&state->rings_file, state->rings, sizeof(struct message_rings));
+}
+
+/* agents' side of remote jobs */
+
+/* Like recv(), without blocking, but returns the message and its text as they
+ * were in the ring, valid until the next call. */
+char *messaging_recv_raw(struct messaging_state *state, unsigned int *size,
+			 bool *hung_up)
+{
+	struct input_message m;
+	char *text;
+	if (!recv(state, &m, &text, false, hung_up)) {
+		return NULL;
+	}
+	*size = sizeof(m) + strlen(text) + 1;
+	return text - sizeof(m);
+}
+
+void messaging_send_raw(struct messaging_state *state, const char *payload,
+			unsigned int size)
+{
+	struct output_message m;
+	assert(size > sizeof(m) && payload[size - 1] == '\0' &&
+	       "wrong output msg size");
+	memcpy(&m, payload, sizeof(m));
+	send(state, &m, payload + sizeof(m));
+}
+
+/* NULL unless it's a FOUND_A_BUG, whose text names the trace file */
+const char *messaging_trace_filename(const char *payload, unsigned int size)
+{
+	struct input_message m;
+	assert(size > sizeof(m) && "wrong input msg size");
+	memcpy(&m, payload, sizeof(m));
+	return m.tag == FOUND_A_BUG ? payload + sizeof(m) : NULL;
 }
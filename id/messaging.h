@@ -12,22 +12,74 @@
 #include "io.h"
 
 struct job;
+struct message_rings;
+struct pp_set;
+struct remote_job;
+
+/* Data race PPs found by a job since its last branch ended, to make new jobs
+ * from all at once; see flush_data_races(). */
+struct data_race_batch {
+	struct pp_set *big_pps;   /* each to add to the job's own config */
+	struct pp_set *small_pps; /* new to the test; each to try on its own */
+};
 
 struct messaging_state {
 	char *input_pipe_name;
 	char *output_pipe_name;
+	/* the fifos are only doorbells; messages go through the rings */
 	struct file input_pipe;
 	struct file output_pipe;
+	struct file rings_file;
+	struct message_rings *rings;
+	/* size of the last record recv()d, released on the next recv() */
+	unsigned int recv_pending;
+	/* if the landslide is on an agent elsewhere (see remote.c), messages
+	 * go through it instead, and input_pipe is just its doorbell */
+	struct remote_job *remote;
+	char *remote_pending; /* likewise freed on the next recv() */
+	/* PPs found by the current job so far; see talk_to_child() */
+	struct pp_set *discovered_pps;
+	struct data_race_batch batch;
+	/* how much of its test's known data races it's been told; see
+	 * send_known_races() */
+	unsigned int known_races_sent;
 	bool ready;
 };
 
+enum child_status {
+	CHILD_RUNNING,  /* nothing more to handle for now */
+	CHILD_BLOCKED,  /* suspended; call messaging_resume() to continue */
+	CHILD_FINISHED, /* done with the job; waiting warm for the next one */
+	CHILD_EXITED,   /* exited or crashed */
+};
+
 void messaging_init(struct messaging_state *state, struct file *config_static,
 		    struct file *config_dynamic, unsigned int job_id);
+void messaging_init_remote(struct messaging_state *state, struct remote_job *rj);
 bool wait_for_child(struct messaging_state *state);
-void talk_to_child(struct messaging_state *state, struct job *j);
+enum child_status talk_to_child(struct messaging_state *state, struct job *j);
+void messaging_resume(struct messaging_state *state);
+void messaging_next_job(struct messaging_state *state, const char *pps_filename);
+void messaging_no_more_jobs(struct messaging_state *state);
 void finish_messaging(struct messaging_state *state);
 void messaging_abort(struct messaging_state *state);
 
+/* Agents (see agent.c) pass messages along between their landslides and the
+ * coordinator without interpreting them, except to send trace files along. */
+char *messaging_recv_raw(struct messaging_state *state, unsigned int *size,
+			 bool *hung_up);
+void messaging_send_raw(struct messaging_state *state, const char *payload,
+			unsigned int size);
+const char *messaging_trace_filename(const char *payload, unsigned int size);
+
+/* also used to replay data races remembered from previous runs */
+void handle_data_race(struct job *j, struct pp_set **discovered_pps,
+		      struct data_race_batch *batch, unsigned int eip,
+		      unsigned int tid, bool confirmed, bool deterministic,
+		      bool free_re_malloc, unsigned int last_call,
+		      unsigned int most_recent_syscall, char *pretty);
+void flush_data_races(struct job *j, struct data_race_batch *batch);
+
 bool found_any_bugs();
 
 #endif
@@ -0,0 +1,228 @@
+/**
+ * @file metrics.c
+ * @brief machine-readable progress metrics, for unattended runs
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ *
+ * Alongside each progress report, the same numbers are written (all at once,
+ * by renaming over the previous file) in the Prometheus text exposition
+ * format, which node_exporter's textfile collector picks up directly, and
+ * which is easy enough for a log shipper to parse as well:
+ *
+ *     # HELP quicksand_job_progress_ratio Estimated fraction of ...
+ *     # TYPE quicksand_job_progress_ratio gauge
+ *     quicksand_job_progress_ratio{job_id="3",test="thr_exit_join"} 0.25
+ *
+ * Per-job samples are labelled by job_id (not "job", which Prometheus
+ * reserves for the scrape target), and by the test it's of.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "array_list.h"
+#include "common.h"
+#include "job.h"
+#include "metrics.h"
+#include "pp.h"
+#include "time.h"
+#include "xcalls.h"
+
+struct job_metrics {
+	unsigned int id;
+	const char *test;
+	const char *state;
+	struct job_stats stats;
+};
+
+struct metrics {
+	unsigned int num_pending;
+	unsigned long committed;
+	unsigned long mem_budget;
+	ARRAY_LIST(struct job_metrics) jobs;
+};
+
+static char *metrics_filename = NULL;
+static char *metrics_tmp_filename = NULL;
+static unsigned int metrics_num_cpus;
+
+void metrics_init(const char *filename, unsigned int num_cpus)
+{
+	if (filename == NULL) {
+		return;
+	}
+	unsigned int len = strlen(filename) + BUF_SIZE;
+	metrics_filename = XSTRDUP((char *)filename);
+	metrics_tmp_filename = XMALLOC(len, char);
+	scnprintf(metrics_tmp_filename, len, "%s.%d.tmp", filename, getpid());
+	metrics_num_cpus = num_cpus;
+}
+
+struct metrics *metrics_begin(unsigned int num_pending, unsigned long committed,
+			      unsigned long mem_budget)
+{
+	if (metrics_filename == NULL) {
+		return NULL;
+	}
+	struct metrics *m = XMALLOC(1, struct metrics);
+	m->num_pending = num_pending;
+	m->committed = committed;
+	m->mem_budget = mem_budget;
+	ARRAY_LIST_INIT(&m->jobs, 16);
+	return m;
+}
+
+void metrics_add_job(struct metrics *m, struct job *j, bool pending, bool blocked)
+{
+	struct job_metrics jm;
+	jm.id = j->id;
+	jm.test = j->test->name;
+	snapshot_job_stats(j, &jm.stats);
+	if (jm.stats.cancelled || jm.stats.complete || jm.stats.timed_out ||
+	    jm.stats.trace_filename[0] != '\0') {
+		jm.state = "done";
+	} else if (pending) {
+		jm.state = "pending";
+	} else if (blocked) {
+		jm.state = "deferred";
+	} else {
+		jm.state = "running";
+	}
+	ARRAY_LIST_APPEND(&m->jobs, jm);
+}
+
+#define METRIC_HEADER(f, name, type, help) \
+	fprintf((f), "# HELP " name " " help "\n# TYPE " name " " type "\n")
+
+#define METRIC(f, name, type, help, fmt, value) do {			\
+		METRIC_HEADER(f, name, type, help);			\
+		fprintf((f), name " " fmt "\n", (value));		\
+	} while (0)
+
+/* one sample per job, reading each job_metrics as 'jm' */
+#define JOB_METRIC(f, m, name, type, help, fmt, value) do {		\
+		METRIC_HEADER(f, name, type, help);			\
+		struct job_metrics *jm;					\
+		unsigned int __i;					\
+		ARRAY_LIST_FOREACH(&(m)->jobs, __i, jm) {		\
+			fprintf((f), name "{job_id=\"%u\",test=\"%s\"} "	\
+				fmt "\n", jm->id, jm->test, (value));	\
+		}							\
+	} while (0)
+
+static void write_metrics(FILE *f, struct metrics *m)
+{
+	long double elapsed = (long double)time_elapsed() / 1000000;
+	long double cputime = (long double)total_cpu_time() / 1000000;
+
+	METRIC(f, "quicksand_elapsed_seconds", "gauge",
+	       "Wall-clock time since quicksand started.", "%Lf", elapsed);
+	METRIC(f, "quicksand_remaining_seconds", "gauge",
+	       "Time left in the total time budget.", "%Lf",
+	       (long double)time_remaining() / 1000000);
+	METRIC(f, "quicksand_cpu_seconds_total", "counter",
+	       "Time spent by all workqueue threads running jobs.", "%Lf",
+	       cputime);
+	METRIC(f, "quicksand_core_saturation_ratio", "gauge",
+	       "Fraction of the CPUs' time spent running jobs.", "%Lf",
+	       elapsed == 0 ? 0 : cputime / metrics_num_cpus / elapsed);
+	METRIC(f, "quicksand_pps_discovered", "gauge",
+	       "Preemption points known so far, including data races.", "%u",
+	       num_pps());
+	METRIC(f, "quicksand_memory_committed_bytes", "gauge",
+	       "Memory held by all landslides together.", "%lu", m->committed);
+	METRIC(f, "quicksand_memory_budget_bytes", "gauge",
+	       "Memory budget for all landslides together.", "%lu", m->mem_budget);
+
+	/* job counts by state; pending jobs may not be listed individually */
+	unsigned int running = 0, deferred = 0, done = 0;
+	unsigned long latency_sum = 0;
+	unsigned int latency_count = 0;
+	struct job_metrics *jm;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&m->jobs, i, jm) {
+		if (strcmp(jm->state, "running") == 0) {
+			running++;
+		} else if (strcmp(jm->state, "deferred") == 0) {
+			deferred++;
+		} else if (strcmp(jm->state, "done") == 0) {
+			done++;
+		}
+		if (jm->stats.start_latency != 0) {
+			latency_sum += jm->stats.start_latency;
+			latency_count++;
+		}
+	}
+	METRIC_HEADER(f, "quicksand_jobs", "gauge", "Number of jobs by state.");
+	fprintf(f, "quicksand_jobs{state=\"pending\"} %u\n", m->num_pending);
+	fprintf(f, "quicksand_jobs{state=\"running\"} %u\n", running);
+	fprintf(f, "quicksand_jobs{state=\"deferred\"} %u\n", deferred);
+	fprintf(f, "quicksand_jobs{state=\"done\"} %u\n", done);
+
+	METRIC_HEADER(f, "quicksand_job_start_latency_seconds", "summary",
+		      "Time from a job being started to its landslide being up.");
+	fprintf(f, "quicksand_job_start_latency_seconds_sum %Lf\n",
+		(long double)latency_sum / 1000000);
+	fprintf(f, "quicksand_job_start_latency_seconds_count %u\n",
+		latency_count);
+
+	METRIC_HEADER(f, "quicksand_job_state", "gauge",
+		      "Always 1; the state label says what the job is doing.");
+	ARRAY_LIST_FOREACH(&m->jobs, i, jm) {
+		fprintf(f, "quicksand_job_state{job_id=\"%u\",test=\"%s\","
+			"state=\"%s\"} 1\n", jm->id, jm->test, jm->state);
+	}
+	JOB_METRIC(f, m, "quicksand_job_branches_total", "counter",
+		   "Interleavings tested so far.", "%u",
+		   jm->stats.elapsed_branches);
+	JOB_METRIC(f, m, "quicksand_job_branches_per_second", "gauge",
+		   "Interleavings tested per second of the job's running time.",
+		   "%Lf", jm->stats.estimate_elapsed_numeric == 0 ? 0 :
+		   jm->stats.elapsed_branches * 1000000 /
+		   jm->stats.estimate_elapsed_numeric);
+	JOB_METRIC(f, m, "quicksand_job_progress_ratio", "gauge",
+		   "Estimated fraction of the job's state space explored.",
+		   "%Lf", jm->stats.estimate_proportion);
+	JOB_METRIC(f, m, "quicksand_job_elapsed_seconds", "gauge",
+		   "Time the job's landslide has spent exploring.", "%Lf",
+		   jm->stats.estimate_elapsed_numeric / 1000000);
+	JOB_METRIC(f, m, "quicksand_job_eta_seconds", "gauge",
+		   "Estimated time left to finish exploring.", "%Lf",
+		   jm->stats.estimate_eta_numeric / 1000000);
+	JOB_METRIC(f, m, "quicksand_job_eta_upper_seconds", "gauge",
+		   "Upper confidence bound on the time left (+Inf if unknown).",
+		   "%Lf", jm->stats.estimate_eta_hi_numeric / 1000000);
+	JOB_METRIC(f, m, "quicksand_job_rss_bytes", "gauge",
+		   "Memory held by the job's landslide (including simics).",
+		   "%lu", jm->stats.rss);
+	JOB_METRIC(f, m, "quicksand_job_pps_discovered", "gauge",
+		   "New data-race preemption points the job has reported.",
+		   "%u", jm->stats.pps_discovered);
+	JOB_METRIC(f, m, "quicksand_job_setup_seconds", "gauge",
+		   "Time from the job being started to its landslide being up.",
+		   "%Lf", (long double)jm->stats.start_latency / 1000000);
+}
+
+void metrics_end(struct metrics *m)
+{
+	assert(m != NULL);
+	FILE *f = fopen(metrics_tmp_filename, "w");
+	if (f == NULL) {
+		WARN("couldn't write metrics to '%s' (%s)\n",
+		     metrics_tmp_filename, strerror(errno));
+	} else {
+		write_metrics(f, m);
+		if (fclose(f) != 0) {
+			WARN("couldn't write metrics to '%s' (%s)\n",
+			     metrics_tmp_filename, strerror(errno));
+			XREMOVE(metrics_tmp_filename);
+		} else {
+			/* so the collector never reads a half-written file */
+			XRENAME(metrics_tmp_filename, metrics_filename);
+		}
+	}
+	ARRAY_LIST_FREE(&m->jobs);
+	FREE(m);
+}
@@ -0,0 +1,24 @@
+/**
+ * @file metrics.h
+ * @brief machine-readable progress metrics, for unattended runs
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_METRICS_H
+#define __ID_METRICS_H
+
+#include <stdbool.h>
+
+struct job;
+struct metrics;
+
+void metrics_init(const char *filename, unsigned int num_cpus); /* NULL = off */
+
+/* Called once per progress report, without the workqueue lock held. begin
+ * returns NULL if metrics are off, in which case skip the rest. */
+struct metrics *metrics_begin(unsigned int num_pending, unsigned long committed,
+			      unsigned long mem_budget);
+void metrics_add_job(struct metrics *m, struct job *j, bool pending, bool blocked);
+void metrics_end(struct metrics *m);
+
+#endif
@@ -0,0 +1,297 @@
+/**
+ * @file net.c
+ * @brief framed tcp connections between a coordinator and its agents
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "io.h"
+#include "net.h"
+#include "sync.h"
+#include "xcalls.h"
+
+#define NET_MAGIC 0x15410de1u
+
+/* landslide's messages are small and latency-sensitive (it blocks waiting for
+ * some replies); don't let them sit in nagle's buffer */
+static void set_nodelay(int fd)
+{
+	int one = 1;
+	int ret = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	EXPECT(ret == 0, "failed set TCP_NODELAY\n");
+}
+
+/* addr is an IPv4 address to bind to, such as 0.0.0.0 for any.
+ * returns -1 on failure */
+int net_listen(const char *addr_str, unsigned int port)
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr_str, &addr.sin_addr) != 1) {
+		ERR("Can't listen on '%s': not an IPv4 address\n", addr_str);
+		return -1;
+	}
+
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	EXPECT(fd >= 0, "failed create socket\n");
+	if (fd < 0) {
+		return -1;
+	}
+	int one = 1;
+	int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	EXPECT(ret == 0, "failed set SO_REUSEADDR\n");
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(fd, 16) != 0) {
+		ERR("Couldn't listen on %s:%u: %s\n", addr_str, port,
+		    strerror(errno));
+		XCLOSE(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* blocks; fills in the peer's address as "host:port". returns -1 on failure */
+int net_accept(int listen_fd, char *peer, unsigned int peer_len)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int fd = accept4(listen_fd, (struct sockaddr *)&addr, &addr_len,
+			 SOCK_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	set_nodelay(fd);
+	char host[INET_ADDRSTRLEN];
+	if (inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host)) == NULL) {
+		scnprintf(host, sizeof(host), "?");
+	}
+	scnprintf(peer, peer_len, "%s:%u", host, ntohs(addr.sin_port));
+	return fd;
+}
+
+/* returns -1 on failure */
+int net_connect(const char *host, unsigned int port)
+{
+	char port_str[BUF_SIZE];
+	scnprintf(port_str, BUF_SIZE, "%u", port);
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *result;
+	int ret = getaddrinfo(host, port_str, &hints, &result);
+	if (ret != 0) {
+		ERR("Couldn't look up '%s': %s\n", host, gai_strerror(ret));
+		return -1;
+	}
+
+	int fd = -1;
+	for (struct addrinfo *a = result; a != NULL && fd < 0; a = a->ai_next) {
+		fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC,
+			    a->ai_protocol);
+		if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+			XCLOSE(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(result);
+	if (fd < 0) {
+		ERR("Couldn't connect to %s:%u\n", host, port);
+		return -1;
+	}
+	set_nodelay(fd);
+	return fd;
+}
+
+/* Makes reads give up after so long with nothing; 0 to wait forever again. */
+void net_set_recv_timeout(int fd, unsigned int secs)
+{
+	struct timeval tv = { .tv_sec = secs, .tv_usec = 0 };
+	int ret = setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	EXPECT(ret == 0, "failed set SO_RCVTIMEO\n");
+}
+
+/* (MSG_NOSIGNAL: a peer that's gone is noticed by its reader thread, rather
+ * than killing us with SIGPIPE) */
+static bool send_all(int fd, const char *buf, unsigned int size)
+{
+	while (size > 0) {
+		int ret = send(fd, buf, size, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0) {
+			return false;
+		}
+		buf += ret;
+		size -= ret;
+	}
+	return true;
+}
+
+bool net_send(int fd, enum net_frame_kind kind, unsigned int job_id,
+	      const char *payload, unsigned int size)
+{
+	struct net_header h;
+	h.magic = NET_MAGIC;
+	h.kind = kind;
+	h.job_id = job_id;
+	h.size = size;
+	/* (one write if it fits, so small frames go out in one segment) */
+	char buf[sizeof(h) + BUF_SIZE];
+	if (size <= BUF_SIZE) {
+		memcpy(buf, &h, sizeof(h));
+		memcpy(buf + sizeof(h), payload, size);
+		return send_all(fd, buf, sizeof(h) + size);
+	}
+	return send_all(fd, (const char *)&h, sizeof(h)) &&
+		send_all(fd, payload, size);
+}
+
+static bool read_all(int fd, char *buf, unsigned int size)
+{
+	while (size > 0) {
+		int ret = read(fd, buf, size);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0) {
+			return false;
+		}
+		buf += ret;
+		size -= ret;
+	}
+	return true;
+}
+
+char *net_recv(int fd, struct net_header *h, unsigned int max_size)
+{
+	assert(max_size <= NET_MAX_PAYLOAD);
+	if (!read_all(fd, (char *)h, sizeof(*h))) {
+		return NULL;
+	} else if (h->magic != NET_MAGIC || h->size > max_size) {
+		WARN("Garbled frame (magic 0x%x, size %u); hanging up\n",
+		     h->magic, h->size);
+		return NULL;
+	}
+	char *payload = XMALLOC(h->size + 1, char);
+	if (!read_all(fd, payload, h->size)) {
+		FREE(payload);
+		return NULL;
+	}
+	payload[h->size] = '\0';
+	return payload;
+}
+
+/* inboxes */
+
+struct net_frame {
+	char *payload;
+	unsigned int size;
+	struct net_frame *next;
+};
+
+void net_inbox_init(struct net_inbox *inbox)
+{
+	inbox->head = NULL;
+	inbox->tail = &inbox->head;
+	inbox->closed = false;
+	/* nonblocking both ways: a full pipe has been rung plenty already */
+	int ret = pipe2(inbox->doorbell, O_CLOEXEC | O_NONBLOCK);
+	assert(ret == 0 && "failed create inbox doorbell");
+	MUTEX_INIT(&inbox->lock);
+	COND_INIT(&inbox->cond);
+}
+
+/* takes ownership of the (malloced) payload */
+void net_inbox_push(struct net_inbox *inbox, char *payload, unsigned int size)
+{
+	struct net_frame *f = XMALLOC(1, struct net_frame);
+	f->payload = payload;
+	f->size = size;
+	f->next = NULL;
+
+	LOCK(&inbox->lock);
+	assert(!inbox->closed && "push to closed inbox");
+	*inbox->tail = f;
+	inbox->tail = &f->next;
+	char c = 0;
+	int ret = write(inbox->doorbell[1], &c, 1);
+	assert((ret == 1 || errno == EAGAIN) && "inbox doorbell failed");
+	BROADCAST(&inbox->cond);
+	UNLOCK(&inbox->lock);
+}
+
+/* Returns the next frame's (malloced) payload, or NULL if there's none, either
+ * because the inbox is closed (*closed) or, if !block, none has come yet. */
+char *net_inbox_pop(struct net_inbox *inbox, bool block, unsigned int *size,
+		    bool *closed)
+{
+	/* Eat the doorbell before looking, so that anything pushed after we
+	 * look rings it anew. (Once closed, it reads EOF forever anyway.) */
+	char buf[64];
+	while (read(inbox->doorbell[0], buf, sizeof(buf)) > 0) {
+		continue;
+	}
+
+	LOCK(&inbox->lock);
+	while (block && inbox->head == NULL && !inbox->closed) {
+		WAIT(&inbox->cond, &inbox->lock);
+	}
+	struct net_frame *f = inbox->head;
+	if (f != NULL) {
+		inbox->head = f->next;
+		if (inbox->head == NULL) {
+			inbox->tail = &inbox->head;
+		}
+	}
+	*closed = f == NULL && inbox->closed;
+	UNLOCK(&inbox->lock);
+
+	if (f == NULL) {
+		return NULL;
+	}
+	char *payload = f->payload;
+	*size = f->size;
+	FREE(f);
+	return payload;
+}
+
+void net_inbox_close(struct net_inbox *inbox)
+{
+	LOCK(&inbox->lock);
+	if (!inbox->closed) {
+		inbox->closed = true;
+		XCLOSE(inbox->doorbell[1]);
+		BROADCAST(&inbox->cond);
+	}
+	UNLOCK(&inbox->lock);
+}
+
+/* once nobody will touch it again */
+void net_inbox_destroy(struct net_inbox *inbox)
+{
+	net_inbox_close(inbox);
+	while (inbox->head != NULL) {
+		struct net_frame *f = inbox->head;
+		inbox->head = f->next;
+		FREE(f->payload);
+		FREE(f);
+	}
+	XCLOSE(inbox->doorbell[0]);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file net.h
+ * @brief framed tcp connections between a coordinator and its agents
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_NET_H
+#define __ID_NET_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Every frame is one of these, then size bytes of payload. Both ends must be
+ * the same build, as landslide's messages are passed along as raw structs. */
+struct net_header {
+	uint32_t magic;
+	uint32_t kind;
+	uint32_t job_id; /* 0 if not about any one job */
+	uint32_t size;
+};
+
+enum net_frame_kind {
+	NET_HELLO,   /* agent -> coordinator; the shared token (see -K) and how
+	              * many CPUs it offers, each NUL-terminated */
+	NET_JOB,     /* coordinator -> agent; test name, rebuild flag ("0"/"1"),
+	              * static config, and dynamic config, each NUL-terminated */
+	NET_STARTED, /* agent -> coordinator; text: landslide's stderr log */
+	NET_MSG,     /* either way; one message to or from landslide */
+	NET_FILE,    /* agent -> coordinator; a trace file's name, NUL, and
+	              * contents, to precede the FOUND_A_BUG naming it */
+	NET_EXIT,    /* agent -> coordinator; text: landslide's exit status */
+};
+
+/* trace files are the biggest thing sent; nothing legit comes close */
+#define NET_MAX_PAYLOAD (256 * 1024 * 1024)
+/* until a peer's said hello, it gets no more than this */
+#define NET_MAX_HELLO 1024
+
+int net_listen(const char *addr, unsigned int port);
+int net_accept(int listen_fd, char *peer, unsigned int peer_len);
+int net_connect(const char *host, unsigned int port);
+void net_set_recv_timeout(int fd, unsigned int secs);
+/* false if the connection's gone; callers serialize sends themselves */
+bool net_send(int fd, enum net_frame_kind kind, unsigned int job_id,
+	      const char *payload, unsigned int size);
+/* malloced payload, NUL-terminated past h->size; NULL if the connection's gone
+ * (or is speaking nonsense, or sends a frame bigger than max_size) */
+char *net_recv(int fd, struct net_header *h, unsigned int max_size);
+
+/* Frames for one job, queued by a connection's reader thread for whoever's
+ * talking to that job's landslide, with a pipe as the doorbell, like the
+ * fifos are for local landslides (see messaging.c). Closing it makes the
+ * doorbell read EOF once everything queued is popped. */
+struct net_frame;
+struct net_inbox {
+	struct net_frame *head;
+	struct net_frame **tail;
+	bool closed;
+	int doorbell[2];
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+void net_inbox_init(struct net_inbox *inbox);
+void net_inbox_push(struct net_inbox *inbox, char *payload, unsigned int size);
+char *net_inbox_pop(struct net_inbox *inbox, bool block, unsigned int *size,
+		    bool *closed);
+void net_inbox_close(struct net_inbox *inbox);
+void net_inbox_destroy(struct net_inbox *inbox);
+
+#endif
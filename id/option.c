@@ -6,7 +6,7 @@
 
 #define _XOPEN_SOURCE 700
 
-#include <ctype.h> /* isprint */
+#include <ctype.h> /* isprint, isspace */
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
@@ -16,12 +16,15 @@
 
 #include "array_list.h"
 #include "common.h"
+#include "io.h"
 #include "option.h"
 
 #define MINTIME ((unsigned long)600) /* 10 mins */
 #define DEFAULT_TIME "1h"
 #define DEFAULT_TEST_CASE "thr_exit_join"
 #define DEFAULT_PROGRESS_INTERVAL "10" /* seconds */
+/* agents on other hosts need to be let in on purpose (see -D) */
+#define DEFAULT_LISTEN_ADDR "127.0.0.1"
 
 /* The ETA factor heuristic controls how optimistic/pessimistic we are about
  * descheduling "too large" state spaces. At any point if the ETA for a state
@@ -100,12 +103,16 @@ static bool parse_time(char *str, unsigned long *result)
 			WARN("%ld year%s, are you sure?\n", *result,
 			     *result == 1 ? "" : "s");
 			*result *= 365;
+			/* fallthrough */
 		case 'd':
 			*result *= 24;
+			/* fallthrough */
 		case 'h':
 			*result *= 60;
+			/* fallthrough */
 		case 'm':
 			*result *= 60;
+			/* fallthrough */
 		case '\0':
 		case 's':
 			break;
@@ -116,13 +123,57 @@ static bool parse_time(char *str, unsigned long *result)
 	return true;
 }
 
+static bool parse_size(char *str, unsigned long *result)
+{
+	char *endp;
+	errno = 0;
+	long size = strtol(str, &endp, 0);
+	if (errno != 0 || endp == str) {
+		ERR("Size must be a number (got '%s')\n", str);
+		return false;
+	}
+	if (size < 0) {
+		ERR("Negative memory would be nice, but no\n");
+		return false;
+	}
+	*result = (unsigned long)size;
+	switch (*endp) {
+		case 'g': case 'G':
+			*result *= 1024;
+			/* fallthrough */
+		case 'm': case 'M':
+			*result *= 1024;
+			/* fallthrough */
+		case 'k': case 'K':
+			*result *= 1024;
+			/* fallthrough */
+		case '\0':
+			break;
+		default:
+			ERR("Unrecognized size format '%s'\n", str);
+			return false;
+	}
+	return true;
+}
+
 bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_len,
 		 unsigned long *max_time, unsigned long *num_cpus, bool *verbose,
 		 bool *leave_logs, bool *control_experiment, bool *use_wrapper_log,
 		 char *wrapper_log, unsigned int wrapper_log_len, bool *pintos,
 		 bool *use_icb, bool *preempt_everywhere, bool *pure_hb,
-		 bool *pathos, unsigned long *progress_report_interval,
-		 unsigned long *eta_factor, unsigned long *eta_thresh)
+		 bool *pathos, bool *warm_workers, bool *use_cache,
+		 char *cache_dir, unsigned int cache_dir_len, bool *use_metrics,
+		 char *metrics_file, unsigned int metrics_file_len, bool *use_record,
+		 char *record_file, unsigned int record_file_len,
+		 unsigned long *mem_budget, bool *pin_cpus, bool *skip_smt,
+		 enum bandit_policy *bandit_policy,
+		 unsigned long *progress_report_interval,
+		 unsigned long *eta_factor, unsigned long *eta_thresh,
+		 unsigned int *listen_port, char *listen_addr,
+		 unsigned int listen_addr_len, bool *agent,
+		 char *coordinator_host, unsigned int coordinator_host_len,
+		 unsigned int *coordinator_port, char *token,
+		 unsigned int token_len)
 {
 	/* Set up cmdline options & their default values */
 	unsigned int system_cpus = get_nprocs();
@@ -158,6 +209,9 @@ bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_
 	DEF_CMDLINE_FLAG('v', false, verbose, "Verbose output");
 	DEF_CMDLINE_FLAG('h', false, help, "Print this help text and exit");
 	DEF_CMDLINE_FLAG('l', false, leave_logs, "Don't delete log files from bug-free state spaces");
+	DEF_CMDLINE_FLAG('w', false, warm, "Keep landslide processes running between jobs (faster startup)");
+	DEF_CMDLINE_FLAG('a', false, pin, "Pin each landslide to its own core, and its memory to that core's NUMA node");
+	DEF_CMDLINE_FLAG('S', false, skip_smt, "With -a, use only one hyperthread per physical core");
 	DEF_CMDLINE_FLAG('C', true, control_experiment, "Control mode, i.e., test only 1 maximal state space");
 	DEF_CMDLINE_FLAG('P', true, pintos, "Pintos (not for 15-410 use)");
 	DEF_CMDLINE_FLAG('4', true, pathos, "Pathos (for 15-410 TA use only)");
@@ -189,7 +243,7 @@ bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_
 	getopt_buf[__buf_index_##varname + 1] = ':';			\
 	getopt_buf[__buf_index_##varname + 2] = '\0';			\
 
-	DEF_CMDLINE_OPTION('p', false, test_name, "Userspace test program name", DEFAULT_TEST_CASE);
+	DEF_CMDLINE_OPTION('p', false, test_name, "Userspace test program name(s), comma-separated", DEFAULT_TEST_CASE);
 	DEF_CMDLINE_OPTION('t', false, max_time, "Total time budget (suffix s/m/d/h/y)", DEFAULT_TIME);
 	DEF_CMDLINE_OPTION('c', false, num_cpus, "How many CPUs to use", half_the_cpus);
 	DEF_CMDLINE_OPTION('i', false, interval, "Progress report interval", DEFAULT_PROGRESS_INTERVAL);
@@ -199,6 +253,14 @@ bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_
 	 * Used by wrapper file to tie together which bug traces go where, etc.,
 	 * for purpose of snapshotting. */
 	DEF_CMDLINE_OPTION('L', true, log_name, "Log filename", NULL);
+	DEF_CMDLINE_OPTION('k', false, cache_dir, "Directory to remember results in across runs (skips unchanged state spaces)", NULL);
+	DEF_CMDLINE_OPTION('M', false, metrics_file, "File to write metrics to with each progress report (Prometheus textfile format)", NULL);
+	DEF_CMDLINE_OPTION('R', false, record_file, "File to record each job's timeline to, for quicksand-sim", NULL);
+	DEF_CMDLINE_OPTION('B', false, bandit, "Prioritize jobs by which PPs have found the most so far (off/ucb/thompson)", "off");
+	DEF_CMDLINE_OPTION('m', false, mem_budget, "Memory budget for all landslides together (suffix k/m/g; 0 = 90% of RAM)", "0");
+	DEF_CMDLINE_OPTION('D', false, listen_port, "[Address:]port to accept agents on, which lend their CPUs to this run (0 = none; address defaults to " DEFAULT_LISTEN_ADDR ")", "0");
+	DEF_CMDLINE_OPTION('A', false, coordinator, "Run as an agent, lending -c CPUs to the coordinator at host:port", NULL);
+	DEF_CMDLINE_OPTION('K', false, token_file, "File holding a secret token, which agents must share with their coordinator (needed with -D or -A)", NULL);
 #undef DEF_CMDLINE_OPTION
 
 	ready = true;
@@ -271,6 +333,80 @@ bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_
 		options_valid = false;
 	}
 
+	if (!parse_size(arg_mem_budget, mem_budget)) {
+		options_valid = false;
+	}
+
+	char *endp;
+	char *listen_colon = strrchr(arg_listen_port, ':');
+	char *port_str = listen_colon == NULL ? arg_listen_port : listen_colon + 1;
+	unsigned long port = strtoul(port_str, &endp, 10);
+	if (endp == port_str || *endp != '\0' || port > 65535 ||
+	    (listen_colon != NULL && (listen_colon == arg_listen_port || port == 0))) {
+		ERR("Listen port must be [address:]port (got '%s')\n",
+		    arg_listen_port);
+		options_valid = false;
+	} else if (listen_colon == NULL) {
+		scnprintf(listen_addr, listen_addr_len, "%s",
+			  DEFAULT_LISTEN_ADDR);
+	} else {
+		scnprintf(listen_addr, MIN(listen_addr_len,
+			  (unsigned int)(listen_colon - arg_listen_port + 1)),
+			  "%s", arg_listen_port);
+	}
+	*listen_port = port;
+
+	if ((*agent = (arg_coordinator != NULL))) {
+		char *colon = strrchr(arg_coordinator, ':');
+		port = colon == NULL ? 0 : strtoul(colon + 1, &endp, 10);
+		if (colon == NULL || colon == arg_coordinator ||
+		    *endp != '\0' || port == 0 || port > 65535) {
+			ERR("Coordinator must be host:port (got '%s')\n",
+			    arg_coordinator);
+			options_valid = false;
+		} else if (*listen_port != 0) {
+			ERR("Make up your mind (agent/coordinator)!\n");
+			options_valid = false;
+		} else {
+			scnprintf(coordinator_host, MIN(coordinator_host_len,
+				  (unsigned int)(colon - arg_coordinator + 1)),
+				  "%s", arg_coordinator);
+			*coordinator_port = port;
+		}
+	}
+
+	token[0] = '\0';
+	if (*listen_port != 0 || *agent) {
+		unsigned int size;
+		char *contents = arg_token_file == NULL ? NULL :
+			read_whole_file(arg_token_file, &size);
+		/* (ignoring the trailing newline most editors would leave) */
+		while (contents != NULL && size > 0 &&
+		       isspace((unsigned char)contents[size - 1])) {
+			contents[--size] = '\0';
+		}
+		if (arg_token_file == NULL) {
+			ERR("Agents and their coordinator need a token (-K)\n");
+			options_valid = false;
+		} else if (contents == NULL) {
+			ERR("Couldn't read token file '%s'\n", arg_token_file);
+			options_valid = false;
+		} else if (size == 0 || size >= token_len ||
+			   strlen(contents) != size) {
+			ERR("Token file '%s' must hold 1 to %u characters of "
+			    "text\n", arg_token_file, token_len - 1);
+			options_valid = false;
+		} else {
+			scnprintf(token, token_len, "%s", contents);
+		}
+		FREE(contents);
+	}
+
+	if (!bandit_parse_policy(arg_bandit, bandit_policy)) {
+		ERR("Unknown prioritization policy '%s'\n", arg_bandit);
+		options_valid = false;
+	}
+
 	*eta_factor = strtol(arg_eta_factor, NULL, 0);
 	if (errno != 0) {
 		ERR("ETA factor heuristic must be a number (got '%s')\n", arg_eta_factor);
@@ -308,18 +444,43 @@ bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_
 		ERR("Make up your mind (limited/pure happens-before)!\n");
 		options_valid = false;
 	}
+	if (arg_skip_smt && !arg_pin) {
+		WARN("-S without -a does nothing.\n");
+	}
 
+	if (strlen(arg_test_name) >= test_name_len) {
+		ERR("Too many test names for -p!\n");
+		options_valid = false;
+	} else if (strspn(arg_test_name, ",") == strlen(arg_test_name)) {
+		ERR("No test name given for -p!\n");
+		options_valid = false;
+	}
 	scnprintf(test_name, test_name_len, "%s", arg_test_name);
 
 	if ((*use_wrapper_log = (arg_log_name != NULL))) {
 		scnprintf(wrapper_log, wrapper_log_len, "%s", arg_log_name);
 	}
 
+	if ((*use_cache = (arg_cache_dir != NULL))) {
+		scnprintf(cache_dir, cache_dir_len, "%s", arg_cache_dir);
+	}
+
+	if ((*use_metrics = (arg_metrics_file != NULL))) {
+		scnprintf(metrics_file, metrics_file_len, "%s", arg_metrics_file);
+	}
+
+	if ((*use_record = (arg_record_file != NULL))) {
+		scnprintf(record_file, record_file_len, "%s", arg_record_file);
+	}
+
 	*verbose = arg_verbose;
 	*leave_logs = arg_leave_logs;
 	*control_experiment = arg_control_experiment;
 	*pintos = arg_pintos;
 	*pathos = arg_pathos;
+	*warm_workers = arg_warm;
+	*pin_cpus = arg_pin;
+	*skip_smt = arg_skip_smt;
 	*use_icb = arg_icb;
 	*preempt_everywhere = arg_everywhere;
 	*pure_hb = (!arg_pintos && !arg_pathos && !arg_limited_hb) || arg_pure_hb;
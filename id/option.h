@@ -7,6 +7,8 @@
 #ifndef __ID_OPTION_H
 #define __ID_OPTION_H
 
+#include "bandit.h"
+
 void usage(char *execname);
 
 bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_len,
@@ -14,7 +16,18 @@ bool get_options(int argc, char **argv, char *test_name, unsigned int test_name_
 		 bool *leave_logs, bool *control_experiment, bool *use_wrapper_log,
 		 char *wrapper_log, unsigned int wrapper_log_len, bool *pintos,
 		 bool *use_icb, bool *preempt_everywhere, bool *pure_hb,
-		 bool *pathos, unsigned long *progress_report_interval,
-		 unsigned long *eta_factor, unsigned long *eta_thresh);
+		 bool *pathos, bool *warm_workers, bool *use_cache,
+		 char *cache_dir, unsigned int cache_dir_len, bool *use_metrics,
+		 char *metrics_file, unsigned int metrics_file_len, bool *use_record,
+		 char *record_file, unsigned int record_file_len,
+		 unsigned long *mem_budget, bool *pin_cpus, bool *skip_smt,
+		 enum bandit_policy *bandit_policy,
+		 unsigned long *progress_report_interval,
+		 unsigned long *eta_factor, unsigned long *eta_thresh,
+		 unsigned int *listen_port, char *listen_addr,
+		 unsigned int listen_addr_len, bool *agent,
+		 char *coordinator_host, unsigned int coordinator_host_len,
+		 unsigned int *coordinator_port, char *token,
+		 unsigned int token_len);
 
 #endif
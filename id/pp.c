@@ -9,6 +9,9 @@
 #include <limits.h>
 #include <pthread.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "common.h"
 #include "job.h"
@@ -20,10 +23,19 @@
 static pthread_rwlock_t pp_registry_lock = PTHREAD_RWLOCK_INITIALIZER;
 static unsigned int next_id; /* also represents 1 + max legal index */
 static unsigned int max_generation = 0;
-static unsigned int registry_capacity;
-static struct pp **registry = NULL; /* NULL means not yet initialized */
+static bool registry_inited = false;
 
+/* The registry is stored in geometrically-growing chunks which are never moved
+ * or freed, so pp_get() can index it without taking the registry lock. A new
+ * pp's slot is filled in before next_id is (atomically) bumped to publish it. */
 #define INITIAL_CAPACITY 16
+#define MAX_CHUNKS 24
+static struct pp **registry[MAX_CHUNKS];
+
+/* Open-addressed hash index from test and config string to pp id + 1 (0 means
+ * empty). Protected by the registry lock; kept at most half full. */
+static unsigned int *registry_index = NULL;
+static unsigned int registry_index_capacity = 0; /* power of 2 */
 
 extern bool verbose;
 extern bool pure_hb;
@@ -32,11 +44,77 @@ extern bool pure_hb;
  * PP registry
  ******************************************************************************/
 
-static struct pp *pp_append(char *config_str, char *short_str, char *long_str,
+static struct pp **registry_slot(unsigned int id)
+{
+	/* chunk k holds INITIAL_CAPACITY << k pps, starting at this offset */
+	unsigned int chunk = 31 - __builtin_clz(id / INITIAL_CAPACITY + 1);
+	unsigned int base = INITIAL_CAPACITY * ((1U << chunk) - 1);
+	assert(chunk < MAX_CHUNKS && "too many pps");
+	return &registry[chunk][id - base];
+}
+
+static unsigned int registry_size()
+{
+	return __atomic_load_n(&next_id, __ATOMIC_ACQUIRE);
+}
+
+/* FNV-1a, seeded with the test */
+static unsigned int hash_config_str(struct test *test, const char *config_str)
+{
+	unsigned int hash = (2166136261U ^ test->index) * 16777619U;
+	for (const char *c = config_str; *c != '\0'; c++) {
+		hash ^= (unsigned char)*c;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* registry lock must be held (either mode); returns NULL if not found */
+static struct pp *index_lookup(struct test *test, const char *config_str)
+{
+	unsigned int mask = registry_index_capacity - 1;
+	unsigned int i = hash_config_str(test, config_str) & mask;
+	while (registry_index[i] != 0) {
+		struct pp *pp = *registry_slot(registry_index[i] - 1);
+		if (pp->test == test && 0 == strcmp(config_str, pp->config_str)) {
+			return pp;
+		}
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+/* registry write lock must be held */
+static void index_insert(struct pp *pp)
+{
+	unsigned int mask = registry_index_capacity - 1;
+	unsigned int i = hash_config_str(pp->test, pp->config_str) & mask;
+	while (registry_index[i] != 0) {
+		i = (i + 1) & mask;
+	}
+	registry_index[i] = pp->id + 1;
+}
+
+/* registry write lock must be held */
+static void index_grow()
+{
+	assert(registry_index_capacity < UINT_MAX / 2);
+	FREE(registry_index);
+	registry_index_capacity *= 2;
+	registry_index = XMALLOC(registry_index_capacity, unsigned int);
+	memset(registry_index, 0, registry_index_capacity * sizeof(unsigned int));
+	for (unsigned int i = 0; i < next_id; i++) {
+		index_insert(*registry_slot(i));
+	}
+}
+
+static struct pp *pp_append(struct test *test, char *config_str,
+			    char *short_str, char *long_str,
 			    unsigned int priority, bool deterministic,
 			    bool free_re_malloc, unsigned int generation)
 {
 	struct pp *pp = XMALLOC(1, struct pp);
+	pp->test           = test;
 	pp->config_str     = config_str;
 	pp->short_str      = short_str;
 	pp->long_str       = long_str;
@@ -54,121 +132,147 @@ static struct pp *pp_append(char *config_str, char *short_str, char *long_str,
 		max_generation = generation;
 	}
 
-	// TODO: convert to use array-list macross
-	if (next_id == registry_capacity) {
-		assert(registry_capacity < UINT_MAX / 2);
-		struct pp **resized = XMALLOC(registry_capacity * 2, struct pp *);
-		memcpy(resized, registry, next_id * sizeof(struct pp *));
-		FREE(registry);
-		registry = resized;
-		registry_capacity *= 2;
+	unsigned int chunk = 31 - __builtin_clz(next_id / INITIAL_CAPACITY + 1);
+	assert(chunk < MAX_CHUNKS && "too many pps");
+	if (registry[chunk] == NULL) {
+		registry[chunk] = XMALLOC(INITIAL_CAPACITY << chunk, struct pp *);
+	}
+	*registry_slot(next_id) = pp;
+	/* publish to lock-free readers only once the slot is filled in */
+	__atomic_store_n(&next_id, next_id + 1, __ATOMIC_RELEASE);
+
+	if (next_id * 2 > registry_index_capacity) {
+		index_grow(); /* also inserts the new pp */
+	} else {
+		index_insert(pp);
 	}
-	registry[next_id] = pp;
-	next_id++;
 	return pp;
 }
 
+/* the mutex (and, in kernel space, cli/sti) pps every test starts with */
+static void add_builtin_pps(struct test *test)
+{
+	pp_append(test,
+		  XSTRDUP(testing_pintos() ?
+			  "within_function sema_down" :
+			  testing_pathos() ?
+			  "within_function mutex_lock" :
+			  "within_user_function mutex_lock"),
+		  XSTRDUP(testing_pintos() ?
+			  "sema_down" : "mutex_lock"),
+		  XSTRDUP("<at beginning of mutex_lock>"),
+		  PRIORITY_MUTEX_LOCK, true, false, max_generation);
+	pp_append(test,
+		  XSTRDUP(testing_pintos() ?
+			  "within_function sema_up" :
+			  testing_pathos() ?
+			  "within_function mutex_unlock" :
+			  "within_user_function mutex_unlock"),
+		  XSTRDUP(testing_pintos() ?
+			  "sema_up" : "mutex_unlock"),
+		  XSTRDUP("<at end of mutex_unlock>"),
+		  PRIORITY_MUTEX_UNLOCK, true, false, max_generation);
+	if (testing_pintos() || testing_pathos()) {
+		pp_append(test,
+			  XSTRDUP(testing_pintos() ?
+				  "within_function intr_disable" :
+				  "within_function preempt_disable"),
+			  XSTRDUP("cli"),
+			  XSTRDUP("<just before cli>"),
+			  PRIORITY_CLI, true, false, max_generation);
+		pp_append(test,
+			  XSTRDUP(testing_pintos() ?
+				  "within_function intr_enable" :
+				  "within_function preempt_enable"),
+			  XSTRDUP("sti"),
+			  XSTRDUP("<just after sti>"),
+			  PRIORITY_STI, true, false, max_generation);
+	}
+}
+
 static void check_init() {
-	READ_LOCK(&pp_registry_lock);
-	bool need_init = registry == NULL;
-	RW_UNLOCK(&pp_registry_lock);
-	if (need_init) {
-		WRITE_LOCK(&pp_registry_lock);
-		if (registry == NULL) { /* DCL */
-			registry_capacity = INITIAL_CAPACITY;
-			next_id = 0;
-			registry = XMALLOC(registry_capacity, struct pp *);
-			struct pp *pp = pp_append(
-				XSTRDUP(testing_pintos() ?
-					"within_function sema_down" :
-					testing_pathos() ?
-					"within_function mutex_lock" :
-					"within_user_function mutex_lock"),
-				XSTRDUP(testing_pintos() ?
-					"sema_down" : "mutex_lock"),
-				XSTRDUP("<at beginning of mutex_lock>"),
-				PRIORITY_MUTEX_LOCK, true, false, max_generation);
-			assert(pp->id == 0);
-			pp = pp_append(
-				XSTRDUP(testing_pintos() ?
-					"within_function sema_up" :
-					testing_pathos() ?
-					"within_function mutex_unlock" :
-					"within_user_function mutex_unlock"),
-				XSTRDUP(testing_pintos() ?
-					"sema_up" : "mutex_unlock"),
-				XSTRDUP("<at end of mutex_unlock>"),
-				PRIORITY_MUTEX_UNLOCK, true, false, max_generation);
-			assert(pp->id == 1);
-			assert(next_id == 2);
-			if (testing_pintos() || testing_pathos()) {
-				pp = pp_append(
-					XSTRDUP(testing_pintos() ?
-						"within_function intr_disable" :
-						"within_function preempt_disable"),
-					XSTRDUP("cli"),
-					XSTRDUP("<just before cli>"),
-					PRIORITY_CLI, true, false, max_generation);
-				assert(pp->id == 2);
-				pp = pp_append(
-					XSTRDUP(testing_pintos() ?
-						"within_function intr_enable" :
-						"within_function preempt_enable"),
-					XSTRDUP("sti"),
-					XSTRDUP("<just after sti>"),
-					PRIORITY_STI, true, false, max_generation);
-				assert(pp->id == 3);
-				assert(next_id == 4);
-			}
+	if (__atomic_load_n(&registry_inited, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	WRITE_LOCK(&pp_registry_lock);
+	if (!registry_inited) { /* DCL */
+		next_id = 0;
+		registry_index_capacity = INITIAL_CAPACITY;
+		registry_index = XMALLOC(registry_index_capacity, unsigned int);
+		memset(registry_index, 0,
+		       registry_index_capacity * sizeof(unsigned int));
+		assert(num_tests() > 0 && "pps used before set_job_options");
+		for (unsigned int i = 0; i < num_tests(); i++) {
+			add_builtin_pps(get_test(i));
 		}
-		RW_UNLOCK(&pp_registry_lock);
+		__atomic_store_n(&registry_inited, true, __ATOMIC_RELEASE);
 	}
+	RW_UNLOCK(&pp_registry_lock);
 }
 
-struct pp *pp_new(char *config_str, char *short_str, char *long_str,
-		  unsigned int priority, bool deterministic, bool free_re_malloc,
-		  unsigned int generation, bool *duplicate)
+/* would reporting this pp again change anything about the existing one? */
+static bool pp_needs_update(struct pp *pp, unsigned int priority,
+			    bool deterministic, bool free_re_malloc)
+{
+	return priority < pp->priority ||
+		(deterministic && !pp->deterministic) ||
+		(!free_re_malloc && pp->free_re_malloc);
+}
+
+struct pp *pp_new(struct test *test, char *config_str, char *short_str,
+		  char *long_str, unsigned int priority, bool deterministic,
+		  bool free_re_malloc, unsigned int generation, bool *duplicate)
 {
 	struct pp *result;
-	bool already_present = false;
 	*duplicate = false;
 
 	check_init();
-	WRITE_LOCK(&pp_registry_lock);
-	/* try to find existing one */
-	for (unsigned int i = 0; i < next_id; i++) {
-		result = registry[i];
-		if (0 == strcmp(config_str, result->config_str)) {
-			already_present = true;
-			*duplicate = true;
-			if (priority < result->priority) {
-				DBG("updating priority of '%s' from %d to %d\n",
-				    config_str, result->priority, priority);
-				result->priority = priority;
-				result->generation = generation;
-			}
-			if (deterministic && !result->deterministic) {
-				DBG("updating '%s' to be a deterministic DR\n",
-				    config_str);
-				result->deterministic = true;
-			}
-			if (!free_re_malloc && result->free_re_malloc) {
-				DBG("updating '%s' to NOT be a free-re-malloc "
-				    "FP DR (it was found for realsies\n",
-				    config_str);
-				result->free_re_malloc = false;
-			}
-			break;
-		}
+
+	/* Fast path: most data race reports are repeats of known PPs, which
+	 * many job threads can look up at once under the read lock. */
+	READ_LOCK(&pp_registry_lock);
+	result = index_lookup(test, config_str);
+	bool need_update = result != NULL &&
+		pp_needs_update(result, priority, deterministic, free_re_malloc);
+	RW_UNLOCK(&pp_registry_lock);
+	if (result != NULL && !need_update) {
+		*duplicate = true;
+		return result;
 	}
 
-	if (!already_present) {
+	WRITE_LOCK(&pp_registry_lock);
+	/* try to find existing one (again, in case another thread added it) */
+	result = index_lookup(test, config_str);
+	if (result != NULL) {
+		*duplicate = true;
+		if (priority < result->priority) {
+			DBG("updating priority of '%s' from %d to %d\n",
+			    config_str, result->priority, priority);
+			result->priority = priority;
+			result->generation = generation;
+		}
+		if (deterministic && !result->deterministic) {
+			DBG("updating '%s' to be a deterministic DR\n",
+			    config_str);
+			result->deterministic = true;
+		}
+		if (!free_re_malloc && result->free_re_malloc) {
+			DBG("updating '%s' to NOT be a free-re-malloc "
+			    "FP DR (it was found for realsies\n",
+			    config_str);
+			result->free_re_malloc = false;
+		}
+	} else {
 		DBG("adding new pp '%s' priority %d\n", config_str, priority);
-		if (IS_DATA_RACE(priority)) {
+		if (IS_DATA_RACE(priority) && num_tests() > 1) {
+			WARN("Found a %sracy access in %s at %s\n",
+			     pure_hb ? "" : "potentially-", test->name,
+			     long_str);
+		} else if (IS_DATA_RACE(priority)) {
 			WARN("Found a %sracy access at %s\n",
 			     pure_hb ? "" : "potentially-", long_str);
 		}
-		result = pp_append(XSTRDUP(config_str), XSTRDUP(short_str),
+		result = pp_append(test, XSTRDUP(config_str), XSTRDUP(short_str),
 				   XSTRDUP(long_str), priority, deterministic,
 				   free_re_malloc, generation);
 	}
@@ -176,22 +280,26 @@ struct pp *pp_new(char *config_str, char *short_str, char *long_str,
 	return result;
 }
 
+/* lock-free; see registry_slot() */
 struct pp *pp_get(unsigned int id)
 {
 	check_init();
-	READ_LOCK(&pp_registry_lock);
-	assert(id < next_id && "nonexistent pp of that id");
-	struct pp *result = registry[id];
-	RW_UNLOCK(&pp_registry_lock);
+	assert(id < registry_size() && "nonexistent pp of that id");
+	struct pp *result = *registry_slot(id);
 	assert(result->id == id && "inconsistent PP id in PP registry");
 	return result;
 }
 
+unsigned int num_pps()
+{
+	return registry_size();
+}
+
 static void _print_live_data_race_pps_unlocked()
 {
 	bool any_exist = false;
 	for (unsigned int i = 0; i < next_id; i++) {
-		struct pp *pp = registry[i];
+		struct pp *pp = *registry_slot(i);
 		if (IS_DATA_RACE(pp->priority) && !pp->explored) {
 			// XXX: Better way of figuring out how to suppress
 			// unreadable obfuscated kernel addresses.
@@ -219,7 +327,12 @@ static void _print_live_data_race_pps_unlocked()
 					     "if the following info is convenient:\n");
 				}
 			}
-			WARN("Data race at %s\n", pp->long_str);
+			if (num_tests() > 1) {
+				WARN("Data race in %s at %s\n", pp->test->name,
+				     pp->long_str);
+			} else {
+				WARN("Data race at %s\n", pp->long_str);
+			}
 		}
 	}
 }
@@ -251,7 +364,7 @@ void print_free_re_malloc_false_positives()
 
 	READ_LOCK(&pp_registry_lock);
 	for (unsigned int i = 0; i < next_id; i++) {
-		struct pp *pp = registry[i];
+		struct pp *pp = *registry_slot(i);
 		if (pp->free_re_malloc) {
 			assert(IS_DATA_RACE(pp->priority));
 			if (!any_exist) {
@@ -273,54 +386,114 @@ void print_free_re_malloc_false_positives()
  * PP sets
  ******************************************************************************/
 
+#define PP_WORD(id) ((id) / PP_SET_WORD_BITS)
+#define PP_BIT(id)  ((uint64_t)1 << ((id) % PP_SET_WORD_BITS))
+
+/* are all bits of sub[0..n) also set in super[0..n)? */
+static bool bitmap_subset(const uint64_t *sub, const uint64_t *super,
+			  unsigned int n)
+{
+	unsigned int i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 2 <= n; i += 2) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&sub[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&super[i]);
+		/* andnot(b, a) is the pps in 'sub' which 'super' lacks */
+		__m128i missing = _mm_andnot_si128(b, a);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(missing, zero)) != 0xffff) {
+			return false;
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		if ((sub[i] & ~super[i]) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool bitmap_equals(const uint64_t *x, const uint64_t *y, unsigned int n)
+{
+	unsigned int i = 0;
+#ifdef __SSE2__
+	for (; i + 2 <= n; i += 2) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&x[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&y[i]);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xffff) {
+			return false;
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		if (x[i] != y[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* bitmap is zeroed; caller must fill it in and then call finalize. */
 static struct pp_set *alloc_pp_set(unsigned int capacity)
 {
 	unsigned int struct_size =
-		sizeof(struct pp_set) + (capacity * sizeof(bool));
-	return (struct pp_set *)XMALLOC(struct_size, char /* c.c */);
+		sizeof(struct pp_set) + (capacity * sizeof(uint64_t));
+	struct pp_set *set = (struct pp_set *)XMALLOC(struct_size, char /* c.c */);
+	set->capacity = capacity;
+	memset(set->bitmap, 0, capacity * sizeof(uint64_t));
+	return set;
 }
 
-struct pp_set *create_pp_set(unsigned int pp_mask)
+/* computes the cached size and hash from the bitmap contents */
+static void finalize_pp_set(struct pp_set *set)
+{
+	uint64_t hash = 0;
+	set->size = 0;
+	for (unsigned int i = 0; i < set->capacity; i++) {
+		set->size += __builtin_popcountll(set->bitmap[i]);
+		/* empty words must not perturb the hash, so that the same
+		 * set at a different capacity hashes the same. */
+		if (set->bitmap[i] != 0) {
+			hash ^= (set->bitmap[i] + i) * 0x9e3779b97f4a7c15ULL;
+			hash = (hash << 31) | (hash >> 33);
+		}
+	}
+	set->hash = (unsigned int)(hash ^ (hash >> 32));
+}
+
+struct pp_set *create_pp_set(struct test *test, unsigned int pp_mask)
 {
 	check_init();
 	READ_LOCK(&pp_registry_lock);
-	struct pp_set *set = alloc_pp_set(next_id);
-	set->size = 0;
-	set->capacity = next_id;
+	struct pp_set *set = alloc_pp_set(PP_SET_WORDS(next_id));
 	for (unsigned int i = 0; i < next_id; i++) {
-		set->array[i] = ((pp_mask & pp_get(i)->priority) != 0);
-		if (set->array[i]) {
-			set->size++;
+		struct pp *pp = *registry_slot(i);
+		if (pp->test == test && (pp_mask & pp->priority) != 0) {
+			set->bitmap[PP_WORD(i)] |= PP_BIT(i);
 		}
 	}
 	RW_UNLOCK(&pp_registry_lock);
+	finalize_pp_set(set);
 	return set;
 }
 
 struct pp_set *clone_pp_set(struct pp_set *set)
 {
 	struct pp_set *new_set = alloc_pp_set(set->capacity);
+	memcpy(new_set->bitmap, set->bitmap, set->capacity * sizeof(uint64_t));
 	new_set->size = set->size;
-	new_set->capacity = set->capacity;
-	for (unsigned int i = 0; i < new_set->capacity; i++) {
-		new_set->array[i] = set->array[i];
-	}
+	new_set->hash = set->hash;
 	return new_set;
 }
 
 struct pp_set *add_pp_to_set(struct pp_set *set, struct pp *pp)
 {
-	unsigned int new_capacity = MAX(set->capacity, pp->id + 1);
+	unsigned int new_capacity = MAX(set->capacity, PP_SET_WORDS(pp->id + 1));
 	struct pp_set *new_set = alloc_pp_set(new_capacity);
-	new_set->size = set->size;
-	new_set->capacity = new_capacity;
-	for (unsigned int i = 0; i < new_set->capacity; i++) {
-		new_set->array[i] = i < set->capacity && set->array[i];
-	}
-	if (!new_set->array[pp->id]) {
-		new_set->array[pp->id] = true;
-		new_set->size++;
-	}
+	memcpy(new_set->bitmap, set->bitmap, set->capacity * sizeof(uint64_t));
+	new_set->bitmap[PP_WORD(pp->id)] |= PP_BIT(pp->id);
+	finalize_pp_set(new_set);
 	return new_set;
 }
 
@@ -354,39 +527,39 @@ void print_pp_set(struct pp_set *set, bool short_strs)
 
 bool pp_set_contains(struct pp_set *set, struct pp *pp)
 {
-	return pp->id < set->capacity && set->array[pp->id];
+	return PP_WORD(pp->id) < set->capacity &&
+		(set->bitmap[PP_WORD(pp->id)] & PP_BIT(pp->id)) != 0;
+}
+
+unsigned int pp_set_hash(struct pp_set *set)
+{
+	return set->hash;
 }
 
 bool pp_set_equals(struct pp_set *x, struct pp_set *y)
 {
-	for (unsigned int i = 0; i < MAX(x->capacity, y->capacity); i++) {
-		if (i >= x->capacity && y->array[i]) {
-			/* y is bigger than x and has some new pp in it */
-			return false;
-		} else if (i >= y->capacity && x->array[i]) {
-			/* x is bigger than y and has some new pp in it */
-			return false;
-		} else if (x->array[i] ^ y->array[i]) {
-			return false;
-		}
+	if (x->size != y->size || x->hash != y->hash) {
+		return false;
 	}
-	return true;
+	/* With equal sizes, if the common prefix matches, then neither set can
+	 * have any further pps beyond it in its (longer) bitmap. */
+	return bitmap_equals(x->bitmap, y->bitmap, MIN(x->capacity, y->capacity));
 }
 
 bool pp_subset(struct pp_set *sub, struct pp_set *super)
 {
 	/* Does 'sub' have any PPs in it that 'super' doesn't? */
-	for (unsigned int i = 0; i < sub->capacity; i++) {
-		if (i >= super->capacity) {
-			/* 'sub' was created later... */
-			if (sub->array[i]) {
-				/* ...and also had a later such pp enabled. */
-				return false;
-			}
-		} else {
-			if (sub->array[i] && !super->array[i]) {
-				return false;
-			}
+	if (sub->size > super->size) {
+		return false;
+	}
+	if (!bitmap_subset(sub->bitmap, super->bitmap,
+			   MIN(sub->capacity, super->capacity))) {
+		return false;
+	}
+	/* 'sub' was created later, and may also have a later such pp enabled. */
+	for (unsigned int i = super->capacity; i < sub->capacity; i++) {
+		if (sub->bitmap[i] != 0) {
+			return false;
 		}
 	}
 	return true;
@@ -395,17 +568,22 @@ bool pp_subset(struct pp_set *sub, struct pp_set *super)
 struct pp *pp_next(struct pp_set *set, struct pp *current)
 {
 	unsigned int next_index = current == NULL ? 0 : current->id + 1;
-	if (next_index == set->capacity) {
+	unsigned int word_index = PP_WORD(next_index);
+	if (word_index >= set->capacity) {
 		return NULL;
 	}
 
-	while (!set->array[next_index]) {
-		next_index++;
-		if (next_index == set->capacity) {
+	/* mask off pps at or before 'current' in its own word */
+	uint64_t word = set->bitmap[word_index] &
+		(~(uint64_t)0 << (next_index % PP_SET_WORD_BITS));
+	while (word == 0) {
+		word_index++;
+		if (word_index == set->capacity) {
 			return NULL;
 		}
+		word = set->bitmap[word_index];
 	}
-	return pp_get(next_index);
+	return pp_get(word_index * PP_SET_WORD_BITS + __builtin_ctzll(word));
 }
 
 unsigned int compute_generation(struct pp_set *set)
@@ -420,15 +598,27 @@ unsigned int compute_generation(struct pp_set *set)
 	return max_generation;
 }
 
+/* bumped whenever any pp becomes explored, which changes (only ever worsens)
+ * the unexplored_priority() of any set containing it */
+static unsigned int explored_pps_epoch = 0;
+
+unsigned int explored_epoch()
+{
+	return __atomic_load_n(&explored_pps_epoch, __ATOMIC_ACQUIRE);
+}
+
 void record_explored_pps(struct pp_set *set)
 {
 	struct pp *pp;
-	/* nb. iteration takes the read lock */
 	FOR_EACH_PP(pp, set) {
 		/* strictly speaking the lock is not needed to protect the
 		 * explored flag, as it's write-once. */
 		WRITE_LOCK(&pp_registry_lock);
-		pp->explored = true;
+		if (!pp->explored) {
+			pp->explored = true;
+			__atomic_add_fetch(&explored_pps_epoch, 1,
+					   __ATOMIC_RELEASE);
+		}
 		RW_UNLOCK(&pp_registry_lock);
 	}
 }
@@ -444,7 +634,7 @@ struct pp_set *filter_unexplored_pps(struct pp_set *set)
 	FOR_EACH_PP(pp, new_set) {
 		READ_LOCK(&pp_registry_lock);
 		if (pp->explored) {
-			new_set->array[pp->id] = false;
+			new_set->bitmap[PP_WORD(pp->id)] &= ~PP_BIT(pp->id);
 		} else {
 			any = true;
 		}
@@ -455,6 +645,7 @@ struct pp_set *filter_unexplored_pps(struct pp_set *set)
 		free_pp_set(new_set);
 		return NULL;
 	} else {
+		finalize_pp_set(new_set);
 		return new_set;
 	}
 }
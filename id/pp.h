@@ -8,9 +8,12 @@
 #define __ID_PP_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "common.h"
 
+struct test;
+
 /* numerically-lower priorities are more urgent */
 #define PRIORITY_NONE         ((unsigned int)0x00)
 #define PRIORITY_DR_CONFIRMED ((unsigned int)0x01)
@@ -24,6 +27,7 @@
 
 struct pp {
 	/* all read-only once created */
+	struct test *test; /* each test has its own pps, even if alike */
 	char *config_str; /* e.g., "data_race 0xdeadbeef 0x47" */
 	char *short_str;
 	char *long_str;
@@ -36,17 +40,24 @@ struct pp {
 	bool explored; /* was a state space including this pp completed? */
 };
 
+/* PP sets are bitmaps indexed by pp id, packed 64 per word. Sets are not
+ * modified after creation, so the size and hash are computed once up front. */
+#define PP_SET_WORD_BITS 64
+#define PP_SET_WORDS(num_pps) (((num_pps) + PP_SET_WORD_BITS - 1) / PP_SET_WORD_BITS)
+
 struct pp_set {
-	unsigned int size;
-	unsigned int capacity;
-	bool array[0];
+	unsigned int size; /* number of pps in the set */
+	unsigned int capacity; /* number of words in the bitmap */
+	unsigned int hash; /* independent of capacity; equal sets hash equal */
+	uint64_t bitmap[0];
 };
 
 /* pp registry functions */
-struct pp *pp_new(char *config_str, char *short_str, char *long_str,
-		  unsigned int priority, bool deterministic, bool free_re_malloc,
-		  unsigned int generation, bool *duplicate);
+struct pp *pp_new(struct test *test, char *config_str, char *short_str,
+		  char *long_str, unsigned int priority, bool deterministic,
+		  bool free_re_malloc, unsigned int generation, bool *duplicate);
 struct pp *pp_get(unsigned int id);
+unsigned int num_pps(); /* registered so far */
 
 void print_live_data_race_pps();
 void try_print_live_data_race_pps(); /* signal handler safe; may do nothing. */
@@ -54,7 +65,7 @@ void try_print_live_data_race_pps(); /* signal handler safe; may do nothing. */
 void print_free_re_malloc_false_positives();
 
 /* pp set manipulation functions */
-struct pp_set *create_pp_set(unsigned int pp_mask);
+struct pp_set *create_pp_set(struct test *test, unsigned int pp_mask);
 struct pp_set *clone_pp_set(struct pp_set *set);
 struct pp_set *add_pp_to_set(struct pp_set *set, struct pp *pp);
 void free_pp_set(struct pp_set *set);
@@ -63,9 +74,11 @@ bool pp_set_equals(struct pp_set *x, struct pp_set *y);
 bool pp_subset(struct pp_set *sub, struct pp_set *super);
 struct pp *pp_next(struct pp_set *set, struct pp *current); /* for iteration */
 bool pp_set_contains(struct pp_set *set, struct pp *pp);
+unsigned int pp_set_hash(struct pp_set *set);
 
 unsigned int compute_generation(struct pp_set *set);
 void record_explored_pps(struct pp_set *set);
+unsigned int explored_epoch();
 struct pp_set *filter_unexplored_pps(struct pp_set *set);
 unsigned int unexplored_priority(struct pp_set *set);
 
@@ -0,0 +1,177 @@
+/**
+ * @file record.c
+ * @brief recording each job's timeline, for replay in the scheduling simulator
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ *
+ * With -R, every job's life is written out one event per line, so that
+ * quicksand-sim (see sim.c) can replay the same jobs under other scheduling
+ * policies. What matters for that is each job's *own* running time, not wall
+ * time, which mixes in however this run happened to schedule it; so each job
+ * keeps a clock that runs only while its landslide is up and not deferred.
+ * Every line starts with the wall-clock time (for reference), then the job:
+ *
+ *     J <wall> <job> <parent job, or -1> <parent's clock> <test> <#pps>
+ *       <pp ids...>
+ *     U <wall> <job> <setup usecs>           (landslide up; clock starts)
+ *     E <wall> <job> <clock> <branches> <proportion> <total> <lo> <hi>
+ *     D <wall> <job> <clock> <pp id> <confirmed>
+ *     B <wall> <job> <clock>
+ *     P <wall> <job> <clock>                 (deferred or parked)
+ *     R <wall> <job> <clock>                 (resumed)
+ *     F <wall> <job> <clock> <outcome>
+ *
+ * All times are in usecs. E's times are landslide's estimates of the job's
+ * total exploration time and its confidence interval. Tests are numbered in -p
+ * order. PP ids are only meaningful within the one recording.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "job.h"
+#include "pp.h"
+#include "record.h"
+#include "sync.h"
+#include "time.h"
+#include "xcalls.h"
+
+static FILE *record_file = NULL;
+/* protects the file and each job's record clock; a leaf lock */
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void record_init(const char *filename)
+{
+	if (filename == NULL) {
+		return;
+	}
+	record_file = fopen(filename, "w");
+	if (record_file == NULL) {
+		WARN("Couldn't open '%s' to record jobs (%s); not recording\n",
+		     filename, strerror(errno));
+		return;
+	}
+	/* so what's there is usable even if we crash */
+	setvbuf(record_file, NULL, _IOLBF, 0);
+}
+
+/* with record_lock held */
+static unsigned long job_clock(struct job *j)
+{
+	if (j->record_since == 0) {
+		return j->record_usecs;
+	} else {
+		return j->record_usecs + (timestamp() - j->record_since);
+	}
+}
+
+#define RECORD(j, kind, fmt, ...) do {					\
+		fprintf(record_file, kind " %lu %u %lu" fmt "\n",	\
+			time_elapsed(), (j)->id, job_clock(j),		\
+			##__VA_ARGS__);					\
+	} while (0)
+
+void record_job_spawned(struct job *j, struct job *parent)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	fprintf(record_file, "J %lu %u %d %lu %u %u", time_elapsed(), j->id,
+		parent == NULL ? -1 : (int)parent->id,
+		parent == NULL ? 0 : job_clock(parent), j->test->index,
+		j->config->size);
+	struct pp *pp;
+	FOR_EACH_PP(pp, j->config) {
+		fprintf(record_file, " %u", pp->id);
+	}
+	fprintf(record_file, "\n");
+	UNLOCK(&record_lock);
+}
+
+void record_job_up(struct job *j, unsigned long setup_usecs)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	fprintf(record_file, "U %lu %u %lu\n", time_elapsed(), j->id,
+		setup_usecs);
+	if (j->record_since == 0) {
+		j->record_since = timestamp();
+	}
+	UNLOCK(&record_lock);
+}
+
+void record_job_paused(struct job *j)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	RECORD(j, "P", "");
+	j->record_usecs = job_clock(j);
+	j->record_since = 0;
+	UNLOCK(&record_lock);
+}
+
+void record_job_resumed(struct job *j)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	if (j->record_since == 0) {
+		j->record_since = timestamp();
+	}
+	RECORD(j, "R", "");
+	UNLOCK(&record_lock);
+}
+
+void record_estimate(struct job *j, long double proportion,
+		     unsigned int elapsed_branches, long double total_usecs,
+		     long double total_usecs_lo, long double total_usecs_hi)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	RECORD(j, "E", " %u %.10Le %Lf %Lf %Lf", elapsed_branches, proportion,
+	       total_usecs, total_usecs_lo, total_usecs_hi);
+	UNLOCK(&record_lock);
+}
+
+void record_data_race(struct job *j, unsigned int pp_id, bool confirmed)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	RECORD(j, "D", " %u %d", pp_id, confirmed ? 1 : 0);
+	UNLOCK(&record_lock);
+}
+
+void record_bug(struct job *j)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	RECORD(j, "B", "");
+	UNLOCK(&record_lock);
+}
+
+void record_job_finished(struct job *j, const char *outcome)
+{
+	if (record_file == NULL) {
+		return;
+	}
+	LOCK(&record_lock);
+	RECORD(j, "F", " %s", outcome);
+	j->record_usecs = job_clock(j);
+	j->record_since = 0;
+	UNLOCK(&record_lock);
+}
@@ -0,0 +1,27 @@
+/**
+ * @file record.h
+ * @brief recording each job's timeline, for replay in the scheduling simulator
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_RECORD_H
+#define __ID_RECORD_H
+
+#include <stdbool.h>
+
+struct job;
+
+void record_init(const char *filename); /* NULL = off */
+
+void record_job_spawned(struct job *j, struct job *parent); /* parent may be NULL */
+void record_job_up(struct job *j, unsigned long setup_usecs);
+void record_job_paused(struct job *j);
+void record_job_resumed(struct job *j);
+void record_estimate(struct job *j, long double proportion,
+		     unsigned int elapsed_branches, long double total_usecs,
+		     long double total_usecs_lo, long double total_usecs_hi);
+void record_data_race(struct job *j, unsigned int pp_id, bool confirmed);
+void record_bug(struct job *j);
+void record_job_finished(struct job *j, const char *outcome);
+
+#endif
@@ -0,0 +1,471 @@
+/**
+ * @file remote.c
+ * @brief running jobs on agents on other hosts, as their coordinator
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ *
+ * With -D, quicksand also listens for agents (quicksand -A, see agent.c) to
+ * lend it their CPUs. Each CPU an agent offers becomes another workqueue
+ * thread here, so the PP registry, the bugs found, and all scheduling stay
+ * in this one process; only the landslides run over there. A job run from
+ * one of those threads has its config sent over instead of being started
+ * here (see run_job()); the agent starts a landslide on it and relays its
+ * messages back and forth, which messaging.c handles as usual, through an
+ * inbox per job (see net.h) in place of the shared-memory rings.
+ *
+ * One connection carries all of an agent's jobs, and one reader thread per
+ * agent sorts incoming frames by job. If it hangs up, its running jobs all
+ * exit with REMOTE_AGENT_LOST, which gets them rerun from scratch (see
+ * finish_job()), its suspended ones likewise as soon as any thread tries to
+ * resume them, and its CPUs' workqueue threads go away.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "array_list.h"
+#include "common.h"
+#include "io.h"
+#include "job.h"
+#include "net.h"
+#include "remote.h"
+#include "sync.h"
+#include "time.h"
+#include "work.h"
+#include "xcalls.h"
+
+struct agent {
+	int fd; /* -1 once lost */
+	char name[BUF_SIZE]; /* its host:port */
+	pthread_mutex_t send_lock; /* whole frames at a time; also guards fd */
+	/* protected by the remote lock */
+	bool lost;
+	ARRAY_LIST(struct remote_job *) jobs; /* with landslides (to be) up */
+};
+
+struct remote_job {
+	struct agent *agent;
+	unsigned int id;
+	struct net_inbox inbox; /* messages from its landslide */
+	/* protected by the remote lock */
+	bool started;
+	bool exited;
+	int exit_status;
+	char *log_filename; /* on the agent */
+	pthread_cond_t cond;
+};
+
+/* Agents must say hello promptly, with the right token, and have only so many
+ * CPUs, or they're hung up on: an agent gets our tests and configs, and what it
+ * says back is believed, so one that shouldn't be here mustn't get in, nor tie
+ * us up trying. */
+#define HELLO_TIMEOUT 10 /* secs */
+#define MAX_AGENT_CPUS 1024
+
+static bool listening = false;
+static int listen_fd = -1;
+static char token[BUF_SIZE];
+/* indexed by CPU, as numbered for the workqueue threads; NULL if local */
+static ARRAY_LIST(struct agent *) cpu_agents;
+/* protects the above, and what it says in the structs. taken before inboxes'
+ * own locks, and never with any other. */
+static pthread_mutex_t remote_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* with the remote lock held */
+static struct agent *agent_of(unsigned long cpu)
+{
+	if (!listening || cpu >= ARRAY_LIST_SIZE(&cpu_agents)) {
+		return NULL;
+	}
+	return *ARRAY_LIST_GET(&cpu_agents, cpu);
+}
+
+static void send_frame(struct agent *a, enum net_frame_kind kind,
+		       unsigned int job_id, const char *payload, unsigned int size)
+{
+	LOCK(&a->send_lock);
+	/* (if this fails, its reader thread will notice soon enough) */
+	if (a->fd != -1) {
+		net_send(a->fd, kind, job_id, payload, size);
+	}
+	UNLOCK(&a->send_lock);
+}
+
+/* with the remote lock held */
+static struct remote_job *find_job(struct agent *a, unsigned int id,
+				   unsigned int *index)
+{
+	struct remote_job **rj;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(&a->jobs, i, rj) {
+		if ((*rj)->id == id) {
+			*index = i;
+			return *rj;
+		}
+	}
+	return NULL;
+}
+
+/* with the remote lock held */
+static void job_exited(struct remote_job *rj, int exit_status)
+{
+	rj->exit_status = exit_status;
+	rj->exited = true;
+	net_inbox_close(&rj->inbox);
+	BROADCAST(&rj->cond);
+}
+
+/* Puts a trace file where the agent's landslide would have left it, had it run
+ * here, so move_trace_file() finds it just the same. */
+static void receive_file(struct agent *a, char *payload, unsigned int size)
+{
+	unsigned int name_len = strnlen(payload, size);
+	if (name_len == 0 || name_len == size || strchr(payload, '/') != NULL) {
+		WARN("Agent %s sent a file with a bad name; ignoring\n", a->name);
+		return;
+	}
+	char path[BUF_SIZE];
+	scnprintf(path, BUF_SIZE, "%s/%s", LANDSLIDE_PATH, payload);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	bool ok = fd >= 0 && write_all(fd, payload + name_len + 1,
+				       size - name_len - 1);
+	EXPECT(ok, "failed write '%s' from agent %s\n", path, a->name);
+	if (fd >= 0) {
+		XCLOSE(fd);
+	}
+}
+
+static void lose_agent(struct agent *a)
+{
+	LOCK(&a->send_lock);
+	XCLOSE(a->fd);
+	a->fd = -1;
+	UNLOCK(&a->send_lock);
+
+	LOCK(&remote_lock);
+	a->lost = true;
+	unsigned int num_jobs = ARRAY_LIST_SIZE(&a->jobs);
+	while (ARRAY_LIST_SIZE(&a->jobs) > 0) {
+		job_exited(*ARRAY_LIST_GET(&a->jobs, 0), REMOTE_AGENT_LOST);
+		ARRAY_LIST_REMOVE_SWAP(&a->jobs, 0);
+	}
+	UNLOCK(&remote_lock);
+
+	WARN("Lost agent %s; its %u job%s will be rerun\n", a->name, num_jobs,
+	     num_jobs == 1 ? "" : "s");
+	/* its threads must notice to leave, and any of its jobs that were
+	 * deferred can now be rerun by anyone */
+	signal_work();
+}
+
+/* with the remote lock held */
+static void add_agent_cpu(struct agent *a, unsigned long *cpu)
+{
+	*cpu = add_cpu_slot();
+	while (ARRAY_LIST_SIZE(&cpu_agents) <= *cpu) {
+		ARRAY_LIST_APPEND(&cpu_agents, NULL);
+	}
+	*ARRAY_LIST_GET(&cpu_agents, *cpu) = a;
+}
+
+/* Constant-time, so as not to say how much of a wrong token was right. */
+static bool token_matches(const char *given, unsigned int given_len)
+{
+	unsigned int len = strlen(token);
+	unsigned char diff = given_len != len;
+	for (unsigned int i = 0; i < given_len && i < len; i++) {
+		diff |= given[i] ^ token[i];
+	}
+	return diff == 0;
+}
+
+/* The NET_HELLO payload is the token and the number of CPUs; see net.h.
+ * Returns 0 if the agent's not welcome. */
+static unsigned long check_hello(struct agent *a, const struct net_header *h,
+				 const char *payload)
+{
+	if (payload == NULL || h->kind != NET_HELLO) {
+		WARN("Agent %s didn't say hello; hanging up\n", a->name);
+		return 0;
+	}
+	unsigned int token_len = strnlen(payload, h->size);
+	if (token_len == h->size || !token_matches(payload, token_len)) {
+		WARN("Agent %s has the wrong token; hanging up\n", a->name);
+		return 0;
+	}
+	const char *cpus = payload + token_len + 1;
+	char *endp;
+	unsigned long num_cpus = strtoul(cpus, &endp, 10);
+	if (endp == cpus || *endp != '\0' || num_cpus == 0) {
+		WARN("Agent %s offered '%s' CPUs; hanging up\n", a->name, cpus);
+		return 0;
+	} else if (num_cpus > MAX_AGENT_CPUS) {
+		WARN("Agent %s offered %lu CPUs; taking only %u\n", a->name,
+		     num_cpus, MAX_AGENT_CPUS);
+		num_cpus = MAX_AGENT_CPUS;
+	}
+	return num_cpus;
+}
+
+static void *agent_thread(void *arg)
+{
+	struct agent *a = (struct agent *)arg;
+	struct net_header h;
+	net_set_recv_timeout(a->fd, HELLO_TIMEOUT);
+	char *payload = net_recv(a->fd, &h, NET_MAX_HELLO);
+	unsigned long num_cpus = check_hello(a, &h, payload);
+	FREE(payload);
+	if (num_cpus == 0) {
+		lose_agent(a);
+		return NULL;
+	}
+	net_set_recv_timeout(a->fd, 0);
+
+	PRINT("Agent %s joined with %lu CPU%s\n", a->name, num_cpus,
+	      num_cpus == 1 ? "" : "s");
+	for (unsigned long i = 0; i < num_cpus; i++) {
+		unsigned long cpu;
+		LOCK(&remote_lock);
+		add_agent_cpu(a, &cpu);
+		UNLOCK(&remote_lock);
+		if (!work_add_cpu(cpu)) {
+			DBG("Agent %s joined too late to help\n", a->name);
+			break;
+		}
+	}
+
+	while ((payload = net_recv(a->fd, &h, NET_MAX_PAYLOAD)) != NULL) {
+		unsigned int index;
+		LOCK(&remote_lock);
+		struct remote_job *rj = find_job(a, h.job_id, &index);
+		if (rj == NULL) {
+			WARN("Agent %s sent a frame for unknown job %u\n",
+			     a->name, h.job_id);
+		} else if (h.kind == NET_STARTED) {
+			rj->log_filename = payload;
+			payload = NULL;
+			rj->started = true;
+			BROADCAST(&rj->cond);
+		} else if (h.kind == NET_MSG) {
+			net_inbox_push(&rj->inbox, payload, h.size);
+			payload = NULL;
+		} else if (h.kind == NET_FILE) {
+			receive_file(a, payload, h.size);
+		} else if (h.kind == NET_EXIT) {
+			job_exited(rj, atoi(payload));
+			ARRAY_LIST_REMOVE_SWAP(&a->jobs, index);
+		} else {
+			WARN("Agent %s sent a frame of unknown kind %u\n",
+			     a->name, h.kind);
+		}
+		UNLOCK(&remote_lock);
+		FREE(payload);
+	}
+	lose_agent(a);
+	return NULL;
+}
+
+static void *listen_thread(void MAYBE_UNUSED *arg)
+{
+	while (true) {
+		char peer[BUF_SIZE];
+		int fd = net_accept(listen_fd, peer, BUF_SIZE);
+		if (fd < 0) {
+			EXPECT(errno == EINTR || errno == ECONNABORTED,
+			       "failed accept agent\n");
+			continue;
+		}
+		struct agent *a = XMALLOC(1, struct agent);
+		a->fd = fd;
+		scnprintf(a->name, BUF_SIZE, "%s", peer);
+		MUTEX_INIT(&a->send_lock);
+		a->lost = false;
+		ARRAY_LIST_INIT(&a->jobs, 4);
+
+		pthread_t child;
+		int ret = pthread_create(&child, NULL, agent_thread, (void *)a);
+		assert(ret == 0 && "failed create agent thread");
+		ret = pthread_detach(child);
+		assert(ret == 0 && "failed detach agent thread");
+	}
+	return NULL;
+}
+
+/* to be called once the workqueue has started; returns false on failure.
+ * agents must present the given token to join. */
+bool remote_listen(const char *addr, unsigned int port, const char *agent_token)
+{
+	assert(!listening && "double remote listen");
+	assert(agent_token[0] != '\0' && "agents need a token");
+	scnprintf(token, BUF_SIZE, "%s", agent_token);
+	listen_fd = net_listen(addr, port);
+	if (listen_fd < 0) {
+		return false;
+	}
+	ARRAY_LIST_INIT(&cpu_agents, 16);
+	listening = true;
+	DBG("listening for agents on %s:%u\n", addr, port);
+
+	pthread_t child;
+	int ret = pthread_create(&child, NULL, listen_thread, NULL);
+	assert(ret == 0 && "failed create listener thread");
+	ret = pthread_detach(child);
+	assert(ret == 0 && "failed detach listener thread");
+	return true;
+}
+
+/* Is this CPU on an agent? */
+bool remote_cpu(unsigned long cpu)
+{
+	LOCK(&remote_lock);
+	bool result = agent_of(cpu) != NULL;
+	UNLOCK(&remote_lock);
+	return result;
+}
+
+/* False once its agent's gone, for its workqueue thread to leave. */
+bool remote_cpu_alive(unsigned long cpu)
+{
+	LOCK(&remote_lock);
+	struct agent *a = agent_of(cpu);
+	bool result = a == NULL || !a->lost;
+	UNLOCK(&remote_lock);
+	return result;
+}
+
+/* Sends the job's configs (already written out here) to the agent that CPU
+ * belongs to, and waits for its landslide to come up. Either way, the result
+ * is to be passed to remote_job_finish() once it's exited. */
+struct remote_job *remote_job_start(unsigned long cpu, struct job *j,
+				    bool rebuild, bool *child_alive)
+{
+	struct remote_job *rj = XMALLOC(1, struct remote_job);
+	rj->id = j->id;
+	net_inbox_init(&rj->inbox);
+	rj->started = false;
+	rj->exited = false;
+	rj->exit_status = REMOTE_AGENT_LOST;
+	rj->log_filename = NULL;
+	COND_INIT(&rj->cond);
+
+	LOCK(&remote_lock);
+	struct agent *a = agent_of(cpu);
+	assert(a != NULL && "job started remotely from a local cpu");
+	rj->agent = a;
+	if (a->lost) {
+		job_exited(rj, REMOTE_AGENT_LOST);
+	} else {
+		ARRAY_LIST_APPEND(&a->jobs, rj);
+	}
+	UNLOCK(&remote_lock);
+
+	unsigned int static_size, dynamic_size;
+	char *config_static = read_whole_file(j->config_static.filename,
+					      &static_size);
+	char *config_dynamic = read_whole_file(j->config_dynamic.filename,
+					       &dynamic_size);
+	assert(config_static != NULL && config_dynamic != NULL &&
+	       "failed read back config files");
+
+	const char *rebuild_str = rebuild ? "1" : "0";
+	unsigned int name_size = strlen(j->test->name) + 1;
+	unsigned int size = name_size + strlen(rebuild_str) + 1 +
+		static_size + 1 + dynamic_size + 1;
+	char *payload = XMALLOC(size, char);
+	char *p = payload;
+	memcpy(p, j->test->name, name_size);
+	p += name_size;
+	memcpy(p, rebuild_str, strlen(rebuild_str) + 1);
+	p += strlen(rebuild_str) + 1;
+	memcpy(p, config_static, static_size + 1);
+	p += static_size + 1;
+	memcpy(p, config_dynamic, dynamic_size + 1);
+	FREE(config_static);
+	FREE(config_dynamic);
+
+	DBG("[JOB %d] starting on agent %s\n", j->id, a->name);
+	send_frame(a, NET_JOB, j->id, payload, size);
+	FREE(payload);
+
+	LOCK(&remote_lock);
+	while (!rj->started && !rj->exited) {
+		WAIT(&rj->cond, &remote_lock);
+	}
+	*child_alive = rj->started;
+	UNLOCK(&remote_lock);
+	if (!*child_alive && rj->exit_status != REMOTE_AGENT_LOST) {
+		ERR("[JOB %d] There was a problem setting up Landslide on "
+		    "agent %s; see its output for details.\n", j->id, a->name);
+	}
+	return rj;
+}
+
+/* malloced; for display only, as the file itself is on the agent's host.
+ * NULL if its landslide never came up. */
+char *remote_job_log_filename(struct remote_job *rj)
+{
+	char *result = NULL;
+	LOCK(&remote_lock);
+	if (rj->log_filename != NULL) {
+		unsigned int len = strlen(rj->log_filename) +
+			strlen(rj->agent->name) + BUF_SIZE;
+		result = XMALLOC(len, char);
+		scnprintf(result, len, "%s (on %s)", rj->log_filename,
+			  rj->agent->name);
+	}
+	UNLOCK(&remote_lock);
+	return result;
+}
+
+int remote_job_doorbell(struct remote_job *rj)
+{
+	return rj->inbox.doorbell[0];
+}
+
+/* see recv() in messaging.c; the result is malloced */
+char *remote_job_recv(struct remote_job *rj, bool block, unsigned int *size,
+		      bool *hung_up)
+{
+	return net_inbox_pop(&rj->inbox, block, size, hung_up);
+}
+
+void remote_job_send(struct remote_job *rj, const char *payload,
+		     unsigned int size)
+{
+	send_frame(rj->agent, NET_MSG, rj->id, payload, size);
+}
+
+/* Waits for its landslide to have exited, frees it, and returns its exit
+ * status, or REMOTE_AGENT_LOST if it's unknown. */
+int remote_job_finish(struct remote_job *rj)
+{
+	LOCK(&remote_lock);
+	while (!rj->exited) {
+		WAIT(&rj->cond, &remote_lock);
+	}
+	int exit_status = rj->exit_status;
+	UNLOCK(&remote_lock);
+
+	net_inbox_destroy(&rj->inbox);
+	FREE(rj->log_filename);
+	FREE(rj);
+	return exit_status;
+}
+
+/* Can a suspended job, whose landslide is rj (NULL if local), be resumed from
+ * this CPU? Only from one on the same host -- unless that host is gone, in
+ * which case resuming it just finds that out, and it's rerun. */
+bool remote_job_resumable_on(struct remote_job *rj, unsigned long cpu)
+{
+	LOCK(&remote_lock);
+	struct agent *a = agent_of(cpu);
+	bool result = rj == NULL ? a == NULL : a == rj->agent || rj->agent->lost;
+	UNLOCK(&remote_lock);
+	return result;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file remote.h
+ * @brief running jobs on agents on other hosts, as their coordinator
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_REMOTE_H
+#define __ID_REMOTE_H
+
+#include <stdbool.h>
+
+struct job;
+struct remote_job;
+
+/* in place of an exit status, for jobs whose agent hung up on us */
+#define REMOTE_AGENT_LOST (-1)
+
+bool remote_listen(const char *addr, unsigned int port,
+		   const char *agent_token);
+
+bool remote_cpu(unsigned long cpu);
+bool remote_cpu_alive(unsigned long cpu);
+
+struct remote_job *remote_job_start(unsigned long cpu, struct job *j,
+				    bool rebuild, bool *child_alive);
+char *remote_job_log_filename(struct remote_job *rj);
+int remote_job_doorbell(struct remote_job *rj);
+char *remote_job_recv(struct remote_job *rj, bool block, unsigned int *size,
+		      bool *hung_up);
+void remote_job_send(struct remote_job *rj, const char *payload,
+		     unsigned int size);
+int remote_job_finish(struct remote_job *rj);
+bool remote_job_resumable_on(struct remote_job *rj, unsigned long cpu);
+
+#endif
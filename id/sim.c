@@ -0,0 +1,752 @@
+/**
+ * @file sim.c
+ * @brief quicksand-sim: replays recorded jobs under other scheduling policies
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ *
+ * Given a recording from landslide-id -R (see record.c for the format), this
+ * runs the same jobs again on a virtual clock with some number of virtual CPUs,
+ * scheduling them by whichever policy is asked for, and reports how soon the
+ * first bug was found and how well the CPUs were used. Each job still takes
+ * the same time to reach each of its events (estimates, data races, a bug) as
+ * it did when recorded; only when and where it runs changes. So a job only
+ * appears once its parent has run far enough to have discovered it, and
+ * doesn't appear at all if its parent was cancelled before then.
+ *
+ * Limits: jobs cut short in the recording (by the time limit, or by being
+ * cancelled) can't run past where they stopped, and jobs the recorded run never
+ * created (e.g. because an equivalent one already existed) won't be created
+ * here either.
+ *
+ * Usage: quicksand-sim [-c cpus] [-t time] [-p policy] [-e factor]
+ *                      [-E thresh] [-v] recording
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "array_list.h"
+#include "common.h"
+#include "time.h"
+#include "xcalls.h"
+
+bool verbose = false;
+
+/* as in messaging.c; see handle_estimate() */
+#define HOMESTRETCH (60 * 1000000)
+
+struct sim_event {
+	char kind; /* 'E' or 'B' */
+	unsigned long at; /* on the job's own clock */
+	unsigned int branches;
+	long double total_lo;
+	long double total_hi;
+};
+
+struct sim_job {
+	/* as recorded */
+	unsigned int id;
+	struct sim_job *parent;
+	unsigned long spawn_at; /* on the parent's clock */
+	unsigned int test;
+	ARRAY_LIST(unsigned int) pps; /* sorted */
+	unsigned long setup;
+	bool seen_up;
+	ARRAY_LIST(struct sim_event) events;
+	unsigned long length;
+	char outcome[16];
+	bool finished;
+
+	/* simulation state */
+	enum { SIM_UNBORN, SIM_READY, SIM_RUNNING, SIM_DEFERRED,
+	       SIM_DONE, SIM_CANCELLED } state;
+	unsigned long progress;
+	unsigned long setup_left;
+	unsigned int next_event;
+	long double eta_lo; /* remaining; 0 until the first estimate */
+	long double eta_hi;
+	unsigned int branches;
+	bool started;
+	bool found_bug;
+};
+
+struct sim {
+	ARRAY_LIST(struct sim_job *) jobs; /* indexed by id; may have holes */
+	unsigned int num_cpus;
+	struct sim_job **cpus; /* NULL if idle */
+	unsigned long now;
+	unsigned long budget; /* 0 for none */
+	unsigned long eta_factor;
+	unsigned int eta_thresh;
+	const struct policy *policy;
+	/* results */
+	unsigned long first_bug;
+	bool any_bug;
+	unsigned long busy; /* cpu time spent in setup or exploring */
+	unsigned long useful; /* ...by jobs that finished or found a bug */
+	unsigned int deferrals;
+};
+
+#define FOR_EACH_JOB(s, i, jp, j)					\
+	ARRAY_LIST_FOREACH(&(s)->jobs, i, jp) if (((j) = *(jp)) != NULL)
+
+/******************************************************************************
+ * Reading the recording
+ ******************************************************************************/
+
+static struct sim_job *get_job(struct sim *s, unsigned int id, bool create)
+{
+	while (create && ARRAY_LIST_SIZE(&s->jobs) <= id) {
+		ARRAY_LIST_APPEND(&s->jobs, NULL);
+	}
+	if (id >= ARRAY_LIST_SIZE(&s->jobs)) {
+		return NULL;
+	}
+	struct sim_job **jp = ARRAY_LIST_GET(&s->jobs, id);
+	if (*jp == NULL && create) {
+		*jp = XMALLOC(1, struct sim_job);
+		memset(*jp, 0, sizeof(**jp));
+		(*jp)->id = id;
+		ARRAY_LIST_INIT(&(*jp)->pps, 8);
+		ARRAY_LIST_INIT(&(*jp)->events, 16);
+	}
+	return *jp;
+}
+
+static int compare_pp_id(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void parse_spawn(struct sim *s, struct sim_job *j, char *rest)
+{
+	int parent_id;
+	unsigned int npps;
+	int consumed;
+	if (sscanf(rest, "%d %lu %u %u%n", &parent_id, &j->spawn_at, &j->test,
+		   &npps, &consumed) != 4) {
+		WARN("malformed spawn line for job %u\n", j->id);
+		return;
+	}
+	rest += consumed;
+	for (unsigned int i = 0; i < npps; i++) {
+		unsigned int pp_id;
+		if (sscanf(rest, " %u%n", &pp_id, &consumed) != 1) {
+			WARN("job %u is missing some PPs\n", j->id);
+			break;
+		}
+		rest += consumed;
+		ARRAY_LIST_APPEND(&j->pps, pp_id);
+	}
+	qsort(j->pps.array, ARRAY_LIST_SIZE(&j->pps), sizeof(unsigned int),
+	      compare_pp_id);
+	/* parents are always recorded first */
+	j->parent = parent_id < 0 ? NULL : get_job(s, parent_id, false);
+}
+
+static bool read_recording(struct sim *s, const char *filename)
+{
+	FILE *f = fopen(filename, "r");
+	if (f == NULL) {
+		ERR("couldn't open '%s': %s\n", filename, strerror(errno));
+		return false;
+	}
+	char *line = NULL;
+	size_t line_len = 0;
+	unsigned int lineno = 0;
+	while (getline(&line, &line_len, f) != -1) {
+		char kind;
+		unsigned long wall;
+		unsigned int id;
+		unsigned long at;
+		int consumed;
+		lineno++;
+		if (sscanf(line, "%c %lu %u%n", &kind, &wall, &id, &consumed) != 3) {
+			WARN("%s:%u: malformed line\n", filename, lineno);
+			continue;
+		}
+		struct sim_job *j = get_job(s, id, kind == 'J');
+		if (j == NULL) {
+			WARN("%s:%u: job %u was never spawned\n", filename,
+			     lineno, id);
+			continue;
+		}
+		char *rest = line + consumed;
+		struct sim_event e = { .kind = kind };
+
+		if (kind == 'J') {
+			parse_spawn(s, j, rest);
+		} else if (kind == 'U') {
+			/* later ones are parked jobs coming back; they're
+			 * just resumed here, for free */
+			if (!j->seen_up && sscanf(rest, "%lu", &j->setup) == 1) {
+				j->seen_up = true;
+			}
+		} else if (sscanf(rest, "%lu%n", &at, &consumed) != 1) {
+			WARN("%s:%u: malformed line\n", filename, lineno);
+		} else if (kind == 'F') {
+			j->length = at;
+			j->finished = true;
+			sscanf(rest + consumed, "%15s", j->outcome);
+		} else {
+			/* if it never finishes, it ran at least this long */
+			if (!j->finished) {
+				j->length = MAX(j->length, at);
+			}
+			e.at = at;
+			if (kind == 'B') {
+				ARRAY_LIST_APPEND(&j->events, e);
+			} else if (kind == 'E' &&
+				   sscanf(rest + consumed, "%u %*e %*f %Lf %Lf",
+					  &e.branches, &e.total_lo,
+					  &e.total_hi) == 3) {
+				ARRAY_LIST_APPEND(&j->events, e);
+			}
+			/* 'P' and 'R' were only the old policy's business, and
+			 * 'D's led to jobs that have their own spawn lines */
+		}
+	}
+	free(line);
+	fclose(f);
+	return true;
+}
+
+/******************************************************************************
+ * Policies
+ ******************************************************************************/
+
+/* Is a's PP set a subset of b's, in the same test? Both are sorted. */
+static bool pp_subset(struct sim_job *a, struct sim_job *b)
+{
+	if (a->test != b->test) {
+		return false;
+	}
+	unsigned int i = 0, k = 0;
+	while (i < ARRAY_LIST_SIZE(&a->pps)) {
+		if (k == ARRAY_LIST_SIZE(&b->pps)) {
+			return false;
+		}
+		unsigned int x = *ARRAY_LIST_GET(&a->pps, i);
+		unsigned int y = *ARRAY_LIST_GET(&b->pps, k);
+		if (x == y) {
+			i++;
+		} else if (x < y) {
+			return false;
+		}
+		k++;
+	}
+	return true;
+}
+
+static unsigned long time_left(struct sim *s)
+{
+	return s->budget == 0 ? ULONG_MAX / 2 : s->budget - s->now;
+}
+
+struct policy {
+	const char *name;
+	const char *description;
+	/* next job for an idle cpu, among READY and DEFERRED jobs, or NULL */
+	struct sim_job *(*pick)(struct sim *s);
+	/* called for a running job at each of its estimates */
+	bool (*should_defer)(struct sim *s, struct sim_job *j);
+};
+
+static bool never_defer(struct sim *s, struct sim_job *j)
+{
+	(void)s; (void)j;
+	return false;
+}
+
+static struct sim_job *pick_fifo(struct sim *s)
+{
+	struct sim_job **jp, *j;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, j) {
+		if (j->state == SIM_READY || j->state == SIM_DEFERRED) {
+			return j;
+		}
+	}
+	return NULL;
+}
+
+/* same as job_eta_surely_better() */
+static bool eta_surely_better(struct sim_job *j0, struct sim_job *j1)
+{
+	return j1->eta_hi < j0->eta_lo;
+}
+
+/* Is j a strict superset of a deferred job? Quicksand won't start those. */
+static bool shadowed(struct sim *s, struct sim_job *j)
+{
+	struct sim_job **jp, *j2;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, j2) {
+		if (j2->state == SIM_DEFERRED && pp_subset(j2, j) &&
+		    ARRAY_LIST_SIZE(&j2->pps) < ARRAY_LIST_SIZE(&j->pps)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Fresh jobs first, smallest first (the real thing also weighs which PPs are
+ * still unexplored, which isn't recorded), but never a superset of a deferred
+ * job; then deferred jobs, best upper-bound ETA first. */
+static struct sim_job *pick_quicksand(struct sim *s)
+{
+	struct sim_job **jp, *j;
+	unsigned int i;
+	struct sim_job *best = NULL;
+
+	FOR_EACH_JOB(s, i, jp, j) {
+		if (j->state == SIM_READY && !shadowed(s, j) &&
+		    (best == NULL ||
+		     ARRAY_LIST_SIZE(&j->pps) < ARRAY_LIST_SIZE(&best->pps))) {
+			best = j;
+		}
+	}
+	if (best != NULL) {
+		return best;
+	}
+	FOR_EACH_JOB(s, i, jp, j) {
+		if (j->state == SIM_DEFERRED &&
+		    (best == NULL || j->eta_hi < best->eta_hi)) {
+			best = j;
+		}
+	}
+	return best;
+}
+
+/* as in handle_estimate() and should_work_block(), except that pending jobs
+ * only count if pick_quicksand() would actually run them */
+static bool should_defer_quicksand(struct sim *s, struct sim_job *j)
+{
+	if (j->branches < s->eta_thresh || time_left(s) <= HOMESTRETCH ||
+	    (long double)time_left(s) * s->eta_factor >= j->eta_lo) {
+		return false;
+	}
+	struct sim_job **jp, *j2;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, j2) {
+		if (j2->state == SIM_READY && !pp_subset(j, j2) &&
+		    !shadowed(s, j2)) {
+			return true;
+		} else if (j2->state == SIM_DEFERRED && !pp_subset(j, j2) &&
+			   eta_surely_better(j, j2)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Whatever is expected to finish soonest; jobs not yet estimated count as
+ * though they'll take no time, so every job gets a look early on. */
+static struct sim_job *pick_shortest_eta(struct sim *s)
+{
+	struct sim_job **jp, *j;
+	unsigned int i;
+	struct sim_job *best = NULL;
+	FOR_EACH_JOB(s, i, jp, j) {
+		if ((j->state == SIM_READY || j->state == SIM_DEFERRED) &&
+		    (best == NULL || j->eta_hi < best->eta_hi)) {
+			best = j;
+		}
+	}
+	return best;
+}
+
+static bool should_defer_shortest_eta(struct sim *s, struct sim_job *j)
+{
+	if (j->branches < s->eta_thresh) {
+		return false;
+	}
+	struct sim_job *best = pick_shortest_eta(s);
+	return best != NULL && eta_surely_better(j, best);
+}
+
+static const struct policy policies[] = {
+	{ "quicksand", "as landslide-id does it (the default)",
+	  pick_quicksand, should_defer_quicksand },
+	{ "fifo", "in the order jobs were created, never deferring any",
+	  pick_fifo, never_defer },
+	{ "shortest-eta", "smallest upper-bound ETA first, preemptively",
+	  pick_shortest_eta, should_defer_shortest_eta },
+};
+
+/******************************************************************************
+ * Simulation
+ ******************************************************************************/
+
+static const char *job_name(struct sim_job *j)
+{
+	static char buf[BUF_SIZE];
+	scnprintf(buf, BUF_SIZE, "job %u (%u PPs)", j->id,
+		  ARRAY_LIST_SIZE(&j->pps));
+	return buf;
+}
+
+static void stop_running(struct sim *s, struct sim_job *j)
+{
+	for (unsigned int cpu = 0; cpu < s->num_cpus; cpu++) {
+		if (s->cpus[cpu] == j) {
+			s->cpus[cpu] = NULL;
+		}
+	}
+}
+
+/* like bug_already_found() */
+static bool bug_in_subspace(struct sim *s, struct sim_job *j)
+{
+	struct sim_job **jp, *j2;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, j2) {
+		if (j2->found_bug && pp_subset(j2, j)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void cancel(struct sim *s, struct sim_job *j, const char *why)
+{
+	DBG("[%9.3Lfs] cancelled %s (%s)\n", (long double)s->now / 1000000,
+	    job_name(j), why);
+	stop_running(s, j);
+	j->state = SIM_CANCELLED;
+}
+
+static void finish(struct sim *s, struct sim_job *j)
+{
+	DBG("[%9.3Lfs] finished %s\n", (long double)s->now / 1000000,
+	    job_name(j));
+	stop_running(s, j);
+	j->state = SIM_DONE;
+	s->useful += j->progress + j->setup;
+}
+
+static void found_bug(struct sim *s, struct sim_job *j)
+{
+	PRINT("[%9.3Lfs] %s found a bug\n", (long double)s->now / 1000000,
+	      job_name(j));
+	j->found_bug = true;
+	if (!s->any_bug) {
+		s->any_bug = true;
+		s->first_bug = s->now;
+	}
+	finish(s, j);
+
+	struct sim_job **jp, *j2;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, j2) {
+		if ((j2->state == SIM_READY || j2->state == SIM_RUNNING ||
+		     j2->state == SIM_DEFERRED) && pp_subset(j, j2)) {
+			cancel(s, j2, "bug already found");
+		}
+	}
+}
+
+static void fill_cpus(struct sim *s)
+{
+	for (unsigned int cpu = 0; cpu < s->num_cpus; cpu++) {
+		while (s->cpus[cpu] == NULL) {
+			struct sim_job *j = s->policy->pick(s);
+			if (j == NULL) {
+				return;
+			} else if (bug_in_subspace(s, j)) {
+				cancel(s, j, "bug already found");
+				continue;
+			}
+			DBG("[%9.3Lfs] cpu %u %s %s\n",
+			    (long double)s->now / 1000000, cpu,
+			    j->started ? "resumes" : "starts", job_name(j));
+			if (!j->started) {
+				j->started = true;
+				j->setup_left = j->setup;
+			}
+			j->state = SIM_RUNNING;
+			s->cpus[cpu] = j;
+		}
+	}
+}
+
+/* how long until anything happens to a running job */
+static unsigned long next_happening(struct sim *s, struct sim_job *j)
+{
+	if (j->setup_left > 0) {
+		return j->setup_left;
+	}
+	unsigned long until = j->length;
+	if (j->next_event < ARRAY_LIST_SIZE(&j->events)) {
+		until = MIN(until, ARRAY_LIST_GET(&j->events, j->next_event)->at);
+	}
+	struct sim_job **jp, *child;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, child) {
+		if (child->state == SIM_UNBORN && child->parent == j &&
+		    child->spawn_at > j->progress) {
+			until = MIN(until, child->spawn_at);
+		}
+	}
+	return until > j->progress ? until - j->progress : 0;
+}
+
+static void advance(struct sim *s, unsigned long delta)
+{
+	for (unsigned int cpu = 0; cpu < s->num_cpus; cpu++) {
+		struct sim_job *j = s->cpus[cpu];
+		if (j != NULL) {
+			unsigned long setup = MIN(delta, j->setup_left);
+			j->setup_left -= setup;
+			j->progress += delta - setup;
+			s->busy += delta;
+		}
+	}
+	s->now += delta;
+}
+
+static void spawn_children(struct sim *s, struct sim_job *j, bool all)
+{
+	struct sim_job **jp, *child;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, child) {
+		if (child->state == SIM_UNBORN && child->parent == j &&
+		    (all || child->spawn_at <= j->progress)) {
+			DBG("[%9.3Lfs] %s discovers ",
+			    (long double)s->now / 1000000, job_name(j));
+			DBG("%s\n", job_name(child));
+			child->state = SIM_READY;
+		}
+	}
+}
+
+static void handle_happenings(struct sim *s, struct sim_job *j)
+{
+	if (j->state != SIM_RUNNING || j->setup_left > 0) {
+		return;
+	}
+	spawn_children(s, j, false);
+	while (j->state == SIM_RUNNING &&
+	       j->next_event < ARRAY_LIST_SIZE(&j->events) &&
+	       ARRAY_LIST_GET(&j->events, j->next_event)->at <= j->progress) {
+		struct sim_event *e = ARRAY_LIST_GET(&j->events, j->next_event);
+		j->next_event++;
+		if (e->kind == 'B') {
+			found_bug(s, j);
+		} else {
+			j->branches = e->branches;
+			j->eta_lo = MAX(e->total_lo - e->at, 0.0L);
+			j->eta_hi = MAX(e->total_hi - e->at, 0.0L);
+			if (s->policy->should_defer(s, j)) {
+				DBG("[%9.3Lfs] defers %s\n",
+				    (long double)s->now / 1000000, job_name(j));
+				stop_running(s, j);
+				j->state = SIM_DEFERRED;
+				s->deferrals++;
+			}
+		}
+	}
+	if (j->state == SIM_RUNNING && j->progress >= j->length) {
+		/* (the recording may have cut it short) */
+		finish(s, j);
+	}
+	if (j->state == SIM_DONE) {
+		/* a rerun, or in any case found before the end */
+		spawn_children(s, j, true);
+	}
+}
+
+static void simulate(struct sim *s)
+{
+	struct sim_job **jp, *j;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, j) {
+		if (j->parent == NULL) {
+			j->state = SIM_READY;
+		}
+	}
+
+	while (s->budget == 0 || s->now < s->budget) {
+		fill_cpus(s);
+		unsigned long delta = ULONG_MAX;
+		bool any_running = false;
+		for (unsigned int cpu = 0; cpu < s->num_cpus; cpu++) {
+			if (s->cpus[cpu] != NULL) {
+				any_running = true;
+				delta = MIN(delta, next_happening(s, s->cpus[cpu]));
+			}
+		}
+		if (!any_running) {
+			break;
+		}
+		if (s->budget != 0) {
+			delta = MIN(delta, s->budget - s->now);
+		}
+		advance(s, delta);
+		for (unsigned int cpu = 0; cpu < s->num_cpus; cpu++) {
+			if (s->cpus[cpu] != NULL) {
+				handle_happenings(s, s->cpus[cpu]);
+			}
+		}
+	}
+}
+
+/******************************************************************************
+ * Results
+ ******************************************************************************/
+
+static void print_time(const char *what, unsigned long usecs)
+{
+	struct human_friendly_time hft;
+	human_friendly_time(usecs, &hft);
+	PRINT("%-24s", what);
+	print_human_friendly_time(&hft);
+	PRINT(" (%.3Lfs)\n", (long double)usecs / 1000000);
+}
+
+static void print_results(struct sim *s)
+{
+	unsigned int num_done = 0, num_cancelled = 0, num_unfinished = 0;
+	unsigned int num_never = 0, num_cut_short = 0;
+	struct sim_job **jp, *j;
+	unsigned int i;
+	FOR_EACH_JOB(s, i, jp, j) {
+		if (j->state == SIM_DONE) {
+			num_done++;
+		} else if (j->state == SIM_CANCELLED) {
+			num_cancelled++;
+		} else if (j->state == SIM_UNBORN) {
+			num_never++;
+		} else {
+			num_unfinished++;
+		}
+		if (!j->finished || strcmp(j->outcome, "timedout") == 0 ||
+		    strcmp(j->outcome, "cancelled") == 0) {
+			num_cut_short++;
+		}
+	}
+
+	PRINT("policy                  %s, %u cpus\n", s->policy->name,
+	      s->num_cpus);
+	if (s->any_bug) {
+		print_time("time to first bug", s->first_bug);
+	} else {
+		PRINT("time to first bug       (no bug found)\n");
+	}
+	print_time("makespan", s->now);
+	print_time("cpu time", s->busy);
+	if (s->now > 0) {
+		long double capacity = (long double)s->now * s->num_cpus;
+		PRINT("cpu utilisation         %.1Lf%%\n", s->busy * 100 / capacity);
+		PRINT("cpu efficiency          %.1Lf%% (on jobs that finished)\n",
+		      s->useful * 100 / capacity);
+	}
+	PRINT("jobs                    %u done, %u cancelled, %u unfinished, "
+	      "%u never discovered\n", num_done, num_cancelled, num_unfinished,
+	      num_never);
+	PRINT("deferrals               %u\n", s->deferrals);
+	if (num_cut_short > 0) {
+		WARN("%u jobs were cut short in the recording, so may look "
+		     "shorter than they are\n", num_cut_short);
+	}
+}
+
+/******************************************************************************
+ * Main
+ ******************************************************************************/
+
+static void sim_usage(char *execname)
+{
+	printf("Usage: %s [-c cpus] [-t time] [-p policy] [-e factor] "
+	       "[-E thresh] [-v] recording\n", execname);
+	printf("  -c  number of virtual cpus (default 1)\n");
+	printf("  -t  total time budget, suffix s/m/h/d (default 1h; 0 = none)\n");
+	printf("  -e  ETA factor heuristic (default 2)\n");
+	printf("  -E  ETA threshold heuristic (default 32)\n");
+	printf("  -v  print each scheduling decision\n");
+	printf("  -p  scheduling policy, one of:\n");
+	for (unsigned int i = 0; i < ARRAY_SIZE(policies); i++) {
+		printf("        %-14s%s\n", policies[i].name,
+		       policies[i].description);
+	}
+}
+
+static bool parse_budget(char *str, unsigned long *result)
+{
+	char *endp;
+	errno = 0;
+	unsigned long secs = strtoul(str, &endp, 0);
+	if (errno != 0 || endp == str) {
+		return false;
+	}
+	switch (*endp) {
+		case 'd': secs *= 24; /* fallthrough */
+		case 'h': secs *= 60; /* fallthrough */
+		case 'm': secs *= 60; /* fallthrough */
+		case 's': case '\0': break;
+		default: return false;
+	}
+	*result = secs * 1000000;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	struct sim s;
+	memset(&s, 0, sizeof(s));
+	ARRAY_LIST_INIT(&s.jobs, 64);
+	s.num_cpus = 1;
+	s.budget = 3600UL * 1000000;
+	s.eta_factor = 2;
+	s.eta_thresh = 32;
+	s.policy = &policies[0];
+
+	int c;
+	while ((c = getopt(argc, argv, "c:t:p:e:E:vh")) != -1) {
+		bool ok = true;
+		if (c == 'c') {
+			ok = (s.num_cpus = strtoul(optarg, NULL, 0)) > 0;
+		} else if (c == 't') {
+			ok = parse_budget(optarg, &s.budget);
+		} else if (c == 'e') {
+			ok = (s.eta_factor = strtoul(optarg, NULL, 0)) > 0;
+		} else if (c == 'E') {
+			s.eta_thresh = strtoul(optarg, NULL, 0);
+		} else if (c == 'v') {
+			verbose = true;
+		} else if (c == 'p') {
+			s.policy = NULL;
+			for (unsigned int i = 0; i < ARRAY_SIZE(policies); i++) {
+				if (strcmp(optarg, policies[i].name) == 0) {
+					s.policy = &policies[i];
+				}
+			}
+			ok = s.policy != NULL;
+		} else {
+			ok = false;
+		}
+		if (!ok) {
+			sim_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		sim_usage(argv[0]);
+		return 1;
+	}
+
+	if (!read_recording(&s, argv[optind])) {
+		return 1;
+	}
+	s.cpus = XMALLOC(s.num_cpus, struct sim_job *);
+	memset(s.cpus, 0, s.num_cpus * sizeof(struct sim_job *));
+	simulate(&s);
+	print_results(&s);
+	return 0;
+}
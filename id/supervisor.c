@@ -0,0 +1,147 @@
+/**
+ * @file supervisor.c
+ * @brief single thread that multiplexes all running landslides' messages
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "supervisor.h"
+#include "sync.h"
+#include "xcalls.h"
+
+#define MAX_EVENTS 64
+
+struct call {
+	void (*fn)(void *arg);
+	void *arg;
+	struct call *next;
+};
+
+static int epoll_fd = -1;
+static bool stopping = false;
+static pthread_t supervisor_thread;
+
+/* supervisor_call()s pending; the eventfd wakes the loop to run them. */
+static struct watch calls_watch;
+static struct call *calls = NULL;
+static struct call **calls_tail = &calls;
+static pthread_mutex_t calls_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void supervisor_watch(struct watch *w)
+{
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = w;
+	int ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, w->fd, &ev);
+	assert(ret == 0 && "failed add supervisor watch");
+}
+
+static void unwatch(int fd)
+{
+	/* the watcher may have closed it already, which removes it anyway */
+	int ret = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	assert((ret == 0 || errno == EBADF || errno == ENOENT) &&
+	       "failed remove supervisor watch");
+}
+
+void supervisor_call(void (*fn)(void *arg), void *arg)
+{
+	struct call *c = XMALLOC(1, struct call);
+	c->fn = fn;
+	c->arg = arg;
+	c->next = NULL;
+
+	LOCK(&calls_lock);
+	*calls_tail = c;
+	calls_tail = &c->next;
+	UNLOCK(&calls_lock);
+
+	uint64_t one = 1;
+	int ret = write(calls_watch.fd, &one, sizeof(one));
+	assert(ret == sizeof(one) && "failed wake supervisor");
+}
+
+static bool calls_ready(struct watch *w)
+{
+	uint64_t count;
+	int ret = read(w->fd, &count, sizeof(count));
+	assert(ret == sizeof(count) && "failed read supervisor eventfd");
+
+	LOCK(&calls_lock);
+	struct call *c = calls;
+	calls = NULL;
+	calls_tail = &calls;
+	UNLOCK(&calls_lock);
+
+	/* in the order they were made */
+	while (c != NULL) {
+		struct call *next = c->next;
+		c->fn(c->arg);
+		FREE(c);
+		c = next;
+	}
+	return true;
+}
+
+static void stop_ready(void MAYBE_UNUSED *arg)
+{
+	stopping = true;
+}
+
+static void *supervisor_main(void MAYBE_UNUSED *arg)
+{
+	struct epoll_event events[MAX_EVENTS];
+	DBG("supervisor ready\n");
+
+	while (!stopping) {
+		int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+		if (n < 0) {
+			assert(errno == EINTR && "epoll wait failed");
+			continue;
+		}
+		for (int i = 0; i < n; i++) {
+			struct watch *w = events[i].data.ptr;
+			int fd = w->fd;
+			if (!w->ready(w)) {
+				unwatch(fd);
+			}
+		}
+	}
+	return NULL;
+}
+
+void start_supervisor()
+{
+	assert(epoll_fd == -1 && "double supervisor start");
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	assert(epoll_fd >= 0 && "failed create epoll");
+
+	calls_watch.fd = eventfd(0, EFD_CLOEXEC);
+	assert(calls_watch.fd >= 0 && "failed create eventfd");
+	calls_watch.ready = calls_ready;
+	supervisor_watch(&calls_watch);
+
+	int ret = pthread_create(&supervisor_thread, NULL, supervisor_main, NULL);
+	assert(ret == 0 && "failed create supervisor thread");
+}
+
+/* to be called once all jobs are done */
+void stop_supervisor()
+{
+	supervisor_call(stop_ready, NULL);
+	int ret = pthread_join(supervisor_thread, NULL);
+	assert(ret == 0 && "failed join supervisor thread");
+	XCLOSE(calls_watch.fd);
+	XCLOSE(epoll_fd);
+	epoll_fd = -1;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file supervisor.h
+ * @brief single thread that multiplexes all running landslides' messages
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __ID_SUPERVISOR_H
+#define __ID_SUPERVISOR_H
+
+#include <stdbool.h>
+
+/* Something the supervisor polls for readability, e.g. a child's doorbell
+ * fifo. 'ready' runs on the supervisor thread; it returns false once it's done
+ * with the fd, which then stops being watched (it may also have closed it). */
+struct watch {
+	int fd;
+	bool (*ready)(struct watch *w);
+};
+
+void start_supervisor();
+void stop_supervisor();
+
+/* supervisor thread only */
+void supervisor_watch(struct watch *w);
+
+/* any thread; fn(arg) runs on the supervisor thread soon after */
+void supervisor_call(void (*fn)(void *arg), void *arg);
+
+#endif
@@ -48,6 +48,30 @@ void start_time(unsigned long usecs, unsigned int cpus)
 	}
 }
 
+/* for CPUs that join later, e.g. on agents (see remote.c); returns its index */
+unsigned int add_cpu_slot()
+{
+	LOCK(&cpu_time_lock);
+	assert(cpu_times != NULL);
+	struct cpu_time *old_cpu_times = cpu_times;
+	cpu_times = XMALLOC(num_cpus + 1, struct cpu_time);
+	memcpy(cpu_times, old_cpu_times, num_cpus * sizeof(struct cpu_time));
+	FREE(old_cpu_times);
+	cpu_times[num_cpus].previous_total = 0;
+	cpu_times[num_cpus].running_now = false;
+	unsigned int which = num_cpus++;
+	UNLOCK(&cpu_time_lock);
+	return which;
+}
+
+unsigned int num_cpu_slots()
+{
+	LOCK(&cpu_time_lock);
+	unsigned int result = num_cpus;
+	UNLOCK(&cpu_time_lock);
+	return result;
+}
+
 unsigned long time_elapsed()
 {
 	assert(start_timestamp != 0);
@@ -12,6 +12,8 @@
 unsigned long timestamp();
 
 void start_time(unsigned long usecs, unsigned int cpus);
+unsigned int add_cpu_slot();
+unsigned int num_cpu_slots();
 unsigned long time_elapsed();
 unsigned long time_remaining();
 
@@ -7,19 +7,27 @@
 #define _XOPEN_SOURCE 700
 #define _GNU_SOURCE
 
+#include <limits.h>
 #include <pthread.h>
 #include <sys/time.h>
 #include <sys/sysinfo.h>
 
 #include "array_list.h"
+#include "bandit.h"
 #include "bug.h"
+#include "cache.h"
 #include "job.h"
+#include "metrics.h"
 #include "pp.h"
+#include "record.h"
+#include "remote.h"
 #include "sync.h"
 #include "time.h"
 #include "work.h"
 
-/* lock order note: PP registry lock taken inside of workqueue_lock */
+/* lock order note: PP registry lock taken inside of workqueue_lock, as is the
+ * remote lock (see remote.c).
+ * jobs_by_config bucket locks are leaves, never held with any other lock. */
 
 typedef ARRAY_LIST(struct job *) job_list_t;
 static bool inited = false;
@@ -27,38 +35,414 @@ static bool started = false;
 static bool work_done = false;
 static bool progress_done = false;
 static unsigned int nonblocked_threads;
-static job_list_t workqueue; /* unordered set */
+/* threads waiting for work, and how many of them have been asked to take the
+ * place of a thread whose (remote) cpu went away; see leave_workqueue() */
+static unsigned int waiting_threads = 0;
+static unsigned int handoffs = 0;
+/* Pending jobs are split into those eligible to run, kept in a binary min-heap
+ * per test ordered by job_before(), and those "parked" for being supersets of
+ * blocked jobs (see blocked_subsets), which are never started until that
+ * changes. */
+static job_list_t *workqueues; /* heaps, indexed by test */
+static job_list_t parked_jobs; /* unordered set */
 static job_list_t running_or_done_jobs; /* unordered set */
 static job_list_t blocked_jobs; /* unordered set */
+/* every job ever added, hashed by test and PP set, for work_already_exists().
+ * each bucket has its own lock, independent of the workqueue lock. */
+#define JOB_HASH_BUCKETS 256
+static job_list_t jobs_by_config[JOB_HASH_BUCKETS];
+static pthread_mutex_t jobs_by_config_locks[JOB_HASH_BUCKETS];
+/* Newly-added jobs are pushed here without taking the workqueue lock, and moved
+ * into the pending queue by whoever next takes it (see drain_incoming_jobs()).
+ * A lock-free stack, linked through job->next_incoming. */
+static struct job *incoming_jobs = NULL;
 static pthread_mutex_t workqueue_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t workqueue_cond = PTHREAD_COND_INITIALIZER;
 static pthread_cond_t work_done_cond = PTHREAD_COND_INITIALIZER;
+/* the test whose jobs were last started in a new landslide; see next_test() */
+static struct test *current_test = NULL;
+#define TEST_SWITCH_SLACK_PER_CPU 60000000 /* usecs */
+static unsigned long test_switch_slack;
 
 static void check_init()
 {
 	if (!inited) {
 		LOCK(&workqueue_lock);
 		if (!inited) {
-			ARRAY_LIST_INIT(&workqueue, 16);
+			workqueues = XMALLOC(num_tests(), job_list_t);
+			for (unsigned int i = 0; i < num_tests(); i++) {
+				ARRAY_LIST_INIT(&workqueues[i], 16);
+			}
+			ARRAY_LIST_INIT(&parked_jobs, 16);
 			ARRAY_LIST_INIT(&running_or_done_jobs, 16);
 			ARRAY_LIST_INIT(&blocked_jobs, 16);
+			for (unsigned int i = 0; i < JOB_HASH_BUCKETS; i++) {
+				ARRAY_LIST_INIT(&jobs_by_config[i], 4);
+				MUTEX_INIT(&jobs_by_config_locks[i]);
+			}
 			inited = true;
 		}
 		UNLOCK(&workqueue_lock);
 	}
 }
 
+/* Pending job heap. The heap key is a job's unexplored priority, which changes
+ * whenever any of its PPs become explored -- but only ever for the worse. So
+ * a stale cached key is a lower bound on the true one, and it suffices to
+ * re-check only the top of the heap whenever the explored epoch has moved.
+ * All of the following are called with the workqueue lock held. */
+
+static void refresh_priority(struct job *j)
+{
+	/* read epoch first so a concurrent update makes us stale, not wrong */
+	j->wq_epoch = explored_epoch();
+	j->wq_priority = unexplored_priority(j->config);
+}
+
+/* Prefer the most urgent unexplored PPs; then the smallest state space. */
+static bool job_before(struct job *j0, struct job *j1)
+{
+	if (j0->wq_priority != j1->wq_priority) {
+		return j0->wq_priority < j1->wq_priority;
+	} else if (j0->config->size != j1->config->size) {
+		return j0->config->size < j1->config->size;
+	} else {
+		return j0->id < j1->id;
+	}
+}
+
+static void heap_swap(job_list_t *heap, unsigned int i, unsigned int k)
+{
+	ARRAY_LIST_SWAP(heap, i, k);
+	(*ARRAY_LIST_GET(heap, i))->heap_index = i;
+	(*ARRAY_LIST_GET(heap, k))->heap_index = k;
+}
+
+static void heap_sift_up(job_list_t *heap, unsigned int i)
+{
+	while (i > 0 && job_before(*ARRAY_LIST_GET(heap, i),
+				   *ARRAY_LIST_GET(heap, (i - 1) / 2))) {
+		heap_swap(heap, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_sift_down(job_list_t *heap, unsigned int i)
+{
+	while (true) {
+		unsigned int best = i;
+		unsigned int child = 2 * i + 1;
+		for (; child <= 2 * i + 2 && child < ARRAY_LIST_SIZE(heap);
+		     child++) {
+			if (job_before(*ARRAY_LIST_GET(heap, child),
+				       *ARRAY_LIST_GET(heap, best))) {
+				best = child;
+			}
+		}
+		if (best == i) {
+			break;
+		}
+		heap_swap(heap, i, best);
+		i = best;
+	}
+}
+
+static job_list_t *heap_of(struct job *j)
+{
+	return &workqueues[j->test->index];
+}
+
+static void heap_push(struct job *j)
+{
+	job_list_t *heap = heap_of(j);
+	refresh_priority(j);
+	j->heap_index = ARRAY_LIST_SIZE(heap);
+	ARRAY_LIST_APPEND(heap, j);
+	heap_sift_up(heap, j->heap_index);
+}
+
+static void heap_remove(struct job *j)
+{
+	job_list_t *heap = heap_of(j);
+	unsigned int i = j->heap_index;
+	assert(*ARRAY_LIST_GET(heap, i) == j && "heap index corrupt");
+	unsigned int last = ARRAY_LIST_SIZE(heap) - 1;
+	if (i != last) {
+		heap_swap(heap, i, last);
+	}
+	ARRAY_LIST_REMOVE_SWAP(heap, last);
+	j->heap_index = UINT_MAX;
+	if (i != last) {
+		heap_sift_up(heap, i);
+		heap_sift_down(heap, i);
+	}
+}
+
+/* Returns the most urgent eligible pending job, or NULL if none. */
+static struct job *heap_peek(job_list_t *heap)
+{
+	while (ARRAY_LIST_SIZE(heap) > 0) {
+		struct job *top = *ARRAY_LIST_GET(heap, 0);
+		if (top->wq_epoch == explored_epoch()) {
+			return top;
+		}
+		/* Key went stale and may have gotten worse. Re-sort. */
+		refresh_priority(top);
+		heap_sift_down(heap, 0);
+	}
+	return NULL;
+}
+
+/* Which test's pending jobs to start next, or NULL if none have any. Starting
+ * a job of another test than last time means rebuilding landslide (see job.c),
+ * holding up every other startup meanwhile; so stay with the current test
+ * until it's had test_switch_slack more CPU time than the neediest one, or has
+ * run out of pending jobs. */
+static struct test *next_test()
+{
+	struct test *neediest = NULL;
+	for (unsigned int i = 0; i < num_tests(); i++) {
+		struct test *test = get_test(i);
+		if (ARRAY_LIST_SIZE(&workqueues[i]) > 0 &&
+		    (neediest == NULL || test->cputime < neediest->cputime)) {
+			neediest = test;
+		}
+	}
+	if (current_test != NULL && neediest != NULL &&
+	    ARRAY_LIST_SIZE(&workqueues[current_test->index]) > 0 &&
+	    current_test->cputime <= neediest->cputime + test_switch_slack) {
+		return current_test;
+	}
+	return neediest;
+}
+
+/* Jobs of different tests never subsume each other, even with alike PPs. */
+static bool job_subset(struct job *sub, struct job *super)
+{
+	return sub->test == super->test && pp_subset(sub->config, super->config);
+}
+
+/* Subset relations between pending and blocked jobs are checked on every
+ * scheduling decision, but change only when a job enters or leaves the blocked
+ * queue. So each job caches how many blocked jobs are subsets of it, and these
+ * counts are updated upon those (much rarer) transitions instead, moving jobs
+ * between the heap and the parked list as needed. */
+
+static unsigned int count_blocked_subsets(struct job *j)
+{
+	struct job **j_blocked;
+	unsigned int i;
+	unsigned int count = 0;
+	ARRAY_LIST_FOREACH(&blocked_jobs, i, j_blocked) {
+		if (job_subset(*j_blocked, j)) {
+			count++;
+		}
+	}
+	return count;
+}
+
+static void add_blocked_job(struct job *j)
+{
+	struct job **j_pending;
+	unsigned int i;
+	job_list_t newly_parked;
+
+	ARRAY_LIST_APPEND(&blocked_jobs, j);
+
+	ARRAY_LIST_FOREACH(&parked_jobs, i, j_pending) {
+		if (job_subset(j, *j_pending)) {
+			(*j_pending)->blocked_subsets++;
+		}
+	}
+	/* Collect first; removing from the heap reorders it. (Only j's own
+	 * test's pending jobs can be supersets of it.) */
+	ARRAY_LIST_INIT(&newly_parked, 4);
+	ARRAY_LIST_FOREACH(heap_of(j), i, j_pending) {
+		if (pp_subset(j->config, (*j_pending)->config)) {
+			ARRAY_LIST_APPEND(&newly_parked, *j_pending);
+		}
+	}
+	ARRAY_LIST_FOREACH(&newly_parked, i, j_pending) {
+		assert((*j_pending)->blocked_subsets == 0);
+		(*j_pending)->blocked_subsets = 1;
+		heap_remove(*j_pending);
+		ARRAY_LIST_APPEND(&parked_jobs, *j_pending);
+	}
+	ARRAY_LIST_FREE(&newly_parked);
+}
+
+static void remove_blocked_job(unsigned int index)
+{
+	struct job *j = *ARRAY_LIST_GET(&blocked_jobs, index);
+	/* O(n) removal preserves the ETA-sorted order. */
+	ARRAY_LIST_REMOVE(&blocked_jobs, index);
+
+	/* Any pending superset of j was necessarily parked. */
+	unsigned int i = 0;
+	while (i < ARRAY_LIST_SIZE(&parked_jobs)) {
+		struct job *pending = *ARRAY_LIST_GET(&parked_jobs, i);
+		if (job_subset(j, pending)) {
+			assert(pending->blocked_subsets > 0);
+			pending->blocked_subsets--;
+			if (pending->blocked_subsets == 0) {
+				ARRAY_LIST_REMOVE_SWAP(&parked_jobs, i);
+				heap_push(pending);
+				continue;
+			}
+		}
+		i++;
+	}
+}
+
+/* Must be called with the workqueue lock held before looking at the pending
+ * queue (i.e., workqueue or parked_jobs). */
+static void drain_incoming_jobs()
+{
+	struct job *j = __atomic_exchange_n(&incoming_jobs, NULL,
+					    __ATOMIC_ACQUIRE);
+	while (j != NULL) {
+		struct job *next = j->next_incoming;
+		j->next_incoming = NULL;
+		j->blocked_subsets = count_blocked_subsets(j);
+		if (j->blocked_subsets > 0) {
+			ARRAY_LIST_APPEND(&parked_jobs, j);
+		} else {
+			heap_push(j);
+		}
+		j = next;
+	}
+}
+
+static unsigned int job_bucket(struct test *test, struct pp_set *set)
+{
+	return (pp_set_hash(set) + test->index) % JOB_HASH_BUCKETS;
+}
+
+/* Job creation is frequent (every new data race PP makes up to 2), and comes
+ * from the job threads, so it avoids the workqueue lock entirely. */
 void add_work(struct job *j)
 {
 	check_init();
-	LOCK(&workqueue_lock);
-	ARRAY_LIST_APPEND(&workqueue, j);
-	UNLOCK(&workqueue_lock);
+
+	unsigned int bucket = job_bucket(j->test, j->config);
+	LOCK(&jobs_by_config_locks[bucket]);
+	ARRAY_LIST_APPEND(&jobs_by_config[bucket], j);
+	UNLOCK(&jobs_by_config_locks[bucket]);
+
+	struct job *head = __atomic_load_n(&incoming_jobs, __ATOMIC_RELAXED);
+	do {
+		j->next_incoming = head;
+	} while (!__atomic_compare_exchange_n(&incoming_jobs, &head, j, true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+/* Like add_work() for each, then signal_work(), but the whole lot goes on the
+ * incoming stack in one go, for a job's batch of data race jobs. */
+void add_work_batch(struct job **jobs, unsigned int num_jobs)
+{
+	if (num_jobs == 0) {
+		return;
+	}
+	check_init();
+
+	for (unsigned int i = 0; i < num_jobs; i++) {
+		unsigned int bucket = job_bucket(jobs[i]->test, jobs[i]->config);
+		LOCK(&jobs_by_config_locks[bucket]);
+		ARRAY_LIST_APPEND(&jobs_by_config[bucket], jobs[i]);
+		UNLOCK(&jobs_by_config_locks[bucket]);
+		/* (chained as if each were pushed by add_work() in turn) */
+		jobs[i]->next_incoming = i == 0 ? NULL : jobs[i - 1];
+	}
+
+	struct job *first = jobs[0];
+	struct job *head = __atomic_load_n(&incoming_jobs, __ATOMIC_RELAXED);
+	do {
+		first->next_incoming = head;
+	} while (!__atomic_compare_exchange_n(&incoming_jobs, &head,
+					      jobs[num_jobs - 1], true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+	signal_work();
 }
 
 void signal_work()
 {
+	/* Since add_work doesn't take the lock, take it here, so a WQ thread
+	 * can't miss the new work between draining it and going to sleep. */
+	LOCK(&workqueue_lock);
 	BROADCAST(&workqueue_cond);
+	UNLOCK(&workqueue_lock);
+}
+
+static bool get_ram_usage(unsigned long *totalram, unsigned long *availram)
+{
+	bool have_memavail = false;
+	FILE *proc_meminfo = fopen("/proc/meminfo", "r");
+	if (proc_meminfo != NULL) {
+		char buf[BUF_SIZE];
+		while (fgets(buf, BUF_SIZE, proc_meminfo) != NULL) {
+			if (sscanf(buf, "MemAvailable: %lu kB", availram) == 1) {
+				have_memavail = true;
+				*availram *= 1024;
+				break;
+			}
+		}
+		fclose(proc_meminfo);
+	}
+
+	struct sysinfo info;
+	int ret = sysinfo(&info);
+	if (ret == 0) {
+		*totalram = info.totalram;
+		if (!have_memavail) {
+			WARN("MemAvailable not supported, "
+			     "falling back to sysinfo to check ram usage\n");
+			*availram = info.freeram;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+#define RAM_USAGE_DANGERZONE 90 /* percent */
+#define PARK_DEFERRED_JOBS   50 /* percent, at most */
+
+/* Memory budget. Every job whose landslide is alive holds memory, suspended
+ * or running alike (those parked on disk don't), and a job about to get a new
+ * landslide will likely grow about as big as the biggest one seen so far. All
+ * of the following are called with the workqueue lock held. */
+static unsigned long mem_budget; /* bytes */
+static bool waiting_for_memory = false;
+
+static void add_memory_usage(job_list_t *jobs, unsigned long *committed,
+			     unsigned long *projected)
+{
+	struct job **j;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(jobs, i, j) {
+		READ_LOCK(&(*j)->stats_lock);
+		*committed += (*j)->rss;
+		*projected = MAX(*projected, (*j)->peak_rss);
+		RW_UNLOCK(&(*j)->stats_lock);
+	}
+}
+
+static void memory_usage(unsigned long *committed, unsigned long *projected)
+{
+	*committed = 0;
+	*projected = 0;
+	add_memory_usage(&running_or_done_jobs, committed, projected);
+	add_memory_usage(&blocked_jobs, committed, projected);
+}
+
+/* Is there room to start up another landslide? */
+static bool memory_for_new_landslide()
+{
+	unsigned long committed, projected;
+	memory_usage(&committed, &projected);
+	return committed + projected <= mem_budget;
 }
 
 bool should_work_block(struct job *j)
@@ -70,24 +454,28 @@ bool should_work_block(struct job *j)
 	unsigned int i_blocked;
 
 	LOCK(&workqueue_lock);
+	drain_incoming_jobs();
+
+	/* Suspending j doesn't free its memory, so switching to anything that
+	 * would need a new landslide is only an option if that fits too. */
+	bool can_grow = memory_for_new_landslide();
+	/* With -B, only switch to something more promising, too. */
+	long double score = bandit_enabled() ? bandit_score(j->config) : 0;
 
 	/* Are there any pending jobs to run instead? Skip jobs that are strict
-	 * supersets of our PP set as we know in advance they'll take longer. */
-	ARRAY_LIST_FOREACH(&workqueue, i_pending, j_pending) {
-		if (!pp_subset(j->config, (*j_pending)->config)) {
-			/* Pending job is smaller or different. One last check:
-			 * is it just a bigger version of another blocked job?
-			 * Then, prefer that blocked job (in 3rd loop below). */
-			bool any_blocked_subsets = false;
-			ARRAY_LIST_FOREACH(&blocked_jobs, i_blocked, j_blocked) {
-				if (pp_subset((*j_blocked)->config,
-					      (*j_pending)->config)) {
-					any_blocked_subsets = true;
-					break;
-				}
-			}
-			/* The pending job is truly new. Ok to switch to it. */
-			if (!any_blocked_subsets) {
+	 * supersets of our PP set as we know in advance they'll take longer.
+	 * (Parked jobs, being bigger versions of other blocked jobs, are not
+	 * considered; we prefer those blocked jobs in the loop below.) Only
+	 * the test that would be started next has any to consider. */
+	struct test *test = can_grow ? next_test() : NULL;
+	if (test != NULL) {
+		ARRAY_LIST_FOREACH(&workqueues[test->index], i_pending,
+				   j_pending) {
+			if (!job_subset(j, *j_pending) &&
+			    (!bandit_enabled() ||
+			     bandit_score((*j_pending)->config) > score)) {
+				/* The pending job is truly new. Ok to switch
+				 * to it. */
 				result = true;
 				break;
 			}
@@ -95,14 +483,19 @@ bool should_work_block(struct job *j)
 	}
 
 	if (!result) {
-		/* Is there another blocked job with better ETA? As before, make
-		 * sure it's known in advance to be smaller or different. */
+		/* Is there another blocked job with a surely better ETA? As
+		 * before, make sure it's known in advance to be smaller or
+		 * different. */
 		i_blocked = ARRAY_LIST_SIZE(&blocked_jobs);
 		while (i_blocked > 0) {
 			i_blocked--;
 			j_blocked = ARRAY_LIST_GET(&blocked_jobs, i_blocked);
-			if (!pp_subset(j->config, (*j_blocked)->config) &&
-			    compare_job_eta(j, (*j_blocked)) > 0) {
+			if (!job_subset(j, *j_blocked) &&
+			    job_eta_surely_better(j, *j_blocked) &&
+			    (can_grow || (*j_blocked)->park_filename == NULL) &&
+			    job_resumable_on(*j_blocked, j->current_cpu) &&
+			    (!bandit_enabled() ||
+			     bandit_score((*j_blocked)->config) > score)) {
 				/* Blocked job is smaller with better ETA. */
 				result = true;
 				break;
@@ -114,119 +507,182 @@ bool should_work_block(struct job *j)
 	return result;
 }
 
-static bool work_already_exists_on(struct pp_set *new_set, job_list_t *q)
+/* Is there any pending, running, blocked, or done job of this test with this
+ * exact set? */
+bool work_already_exists(struct test *test, struct pp_set *new_set)
 {
+	bool result = false;
 	struct job **j;
 	unsigned int i;
-	ARRAY_LIST_FOREACH(q, i, j) {
-		if (pp_set_equals(new_set, (*j)->config)) {
-			return true;
+
+	check_init();
+	unsigned int bucket = job_bucket(test, new_set);
+	LOCK(&jobs_by_config_locks[bucket]);
+	ARRAY_LIST_FOREACH(&jobs_by_config[bucket], i, j) {
+		if ((*j)->test == test && pp_set_equals(new_set, (*j)->config)) {
+			result = true;
+			break;
 		}
 	}
-	return false;
+	UNLOCK(&jobs_by_config_locks[bucket]);
+
+	return result;
 }
 
-bool work_already_exists(struct pp_set *new_set)
+/* For pending jobs made redundant since they were added. Don't bother
+ * occupying a CPU just to cancel them. (Already out of the heap.) */
+static void cancel_redundant_job(struct job *j)
 {
-	bool result = false;
-
-	LOCK(&workqueue_lock);
-	if (!result) result = work_already_exists_on(new_set, &workqueue);
-	if (!result) result = work_already_exists_on(new_set, &running_or_done_jobs);
-	if (!result) result = work_already_exists_on(new_set, &blocked_jobs);
-	UNLOCK(&workqueue_lock);
+	WRITE_LOCK(&j->stats_lock);
+	j->cancelled = true;
+	STATS_WRITE_UNLOCK(j);
+	record_job_finished(j, "cancelled");
+	ARRAY_LIST_APPEND(&running_or_done_jobs, j);
+}
 
-	return result;
+/* Can the blocked job at this index be resumed? Not if it has a strict subset
+ * job farther up the list (i.e., with worse ETA) -- we'll trust that bad ETA
+ * instead, and prefer to resume the subset job. (Compare this reasoning to the
+ * 2nd half of should_work_block().) */
+static bool blocked_job_eligible(unsigned long wq_id, unsigned int index,
+				 bool can_grow, bool *skipped_for_memory)
+{
+	struct job *j = *ARRAY_LIST_GET(&blocked_jobs, index);
+	if (!job_resumable_on(j, wq_id)) {
+		/* suspended on some other host; see remote.c */
+		return false;
+	} else if (!can_grow && j->park_filename != NULL) {
+		*skipped_for_memory = true;
+		return false;
+	}
+	for (unsigned int i = 0; i < index; i++) {
+		if (job_subset(*ARRAY_LIST_GET(&blocked_jobs, i), j)) {
+			return false;
+		}
+	}
+	return true;
 }
 
-/* returns NULL if no work is available */
-static struct job *get_work(unsigned long wq_id, bool *was_blocked)
+/* With -B, fresh and blocked jobs compete on their bandit scores (see
+ * bandit.c), rather than fresh jobs always coming first and blocked ones
+ * going by ETA. Ties go to fresh jobs, then to the usual heap order. */
+static struct job *get_work_by_score(unsigned long wq_id, bool can_grow,
+				     bool *was_blocked, bool *skipped_for_memory)
 {
 	struct job *best_job = NULL;
-	unsigned int best_index;
-	unsigned int best_priority;
-	unsigned int best_size;
-
+	long double best_score = 0;
+	unsigned int best_blocked = UINT_MAX;
 	struct job **j;
 	unsigned int i;
 
-	/* If time is up, there may still yet be work to do -- kicking awake
-	 * all the blocked jobs so that they can exit cleanly (which they will
-	 * do immediately -- see messaging.c). Otherwise, during normal time,
-	 * prioritize "fresh" jobs from the pending queue. */
-	if (!TIME_UP()) {
-		unsigned int num_skipped = 0;
-		ARRAY_LIST_FOREACH(&workqueue, i, j) {
-			/* Don't ever start new pending jobs if they're strict
-			 * supersets of already deferred ones. */
-			struct job **j2;
-			unsigned int i2;
-			bool any_deferred_subsets = false;
-			ARRAY_LIST_FOREACH(&blocked_jobs, i2, j2) {
-				if (pp_subset((*j2)->config, (*j)->config)) {
-					any_deferred_subsets = true;
-					break;
-				}
-			}
-			if (any_deferred_subsets) {
-				num_skipped++;
-				continue;
+	struct test *test = next_test();
+	if (!can_grow) {
+		*skipped_for_memory = test != NULL;
+	} else if (test != NULL) {
+		/* Collect first; removing from the heap reorders it. */
+		job_list_t *heap = &workqueues[test->index];
+		job_list_t redundant;
+		ARRAY_LIST_INIT(&redundant, 4);
+		ARRAY_LIST_FOREACH(heap, i, j) {
+			if (bug_already_found(test, (*j)->config)) {
+				ARRAY_LIST_APPEND(&redundant, *j);
 			}
+		}
+		ARRAY_LIST_FOREACH(&redundant, i, j) {
+			heap_remove(*j);
+			cancel_redundant_job(*j);
+		}
+		ARRAY_LIST_FREE(&redundant);
 
-			/* Is the pending job the best one so far? */
-			unsigned int priority = unexplored_priority((*j)->config);
-			unsigned int size = (*j)->config->size;
-			if (best_job == NULL || priority < best_priority ||
-			    (priority == best_priority && size < best_size)) {
+		ARRAY_LIST_FOREACH(heap, i, j) {
+			long double score = bandit_score((*j)->config);
+			if (best_job == NULL || score > best_score ||
+			    (score == best_score && job_before(*j, best_job))) {
 				best_job = *j;
-				best_index = i;
-				best_priority = priority;
-				best_size = size;
+				best_score = score;
+			}
+		}
+	}
+
+	for (i = 0; i < ARRAY_LIST_SIZE(&blocked_jobs); i++) {
+		if (blocked_job_eligible(wq_id, i, can_grow,
+					 skipped_for_memory)) {
+			struct job *blocked = *ARRAY_LIST_GET(&blocked_jobs, i);
+			long double score = bandit_score(blocked->config);
+			if (best_job == NULL || score > best_score) {
+				best_job = blocked;
+				best_score = score;
+				best_blocked = i;
+			}
+		}
+	}
+
+	if (best_job == NULL) {
+		return NULL;
+	} else if (best_blocked != UINT_MAX) {
+		remove_blocked_job(best_blocked);
+		*was_blocked = true;
+	} else {
+		heap_remove(best_job);
+		*was_blocked = false;
+	}
+	DBG("WQ thread %lu chose %s job %d (score %Lf)\n", wq_id,
+	    *was_blocked ? "blocked" : "fresh", best_job->id, best_score);
+	ARRAY_LIST_APPEND(&running_or_done_jobs, best_job);
+	return best_job;
+}
+
+/* Fresh jobs first, by heap order; then blocked jobs, best ETA first. */
+static struct job *get_work_by_order(unsigned long wq_id, bool time_up,
+				     bool can_grow, bool *was_blocked,
+				     bool *skipped_for_memory)
+{
+	struct job *best_job = NULL;
+	unsigned int best_index;
+
+	struct test *test;
+
+	if (!time_up && !can_grow) {
+		*skipped_for_memory = next_test() != NULL;
+	} else if (!time_up) {
+		while (best_job == NULL && (test = next_test()) != NULL) {
+			best_job = heap_peek(&workqueues[test->index]);
+			heap_remove(best_job);
+			if (bug_already_found(test, best_job->config)) {
+				cancel_redundant_job(best_job);
+				best_job = NULL;
 			}
 		}
-		if (num_skipped > 0) {
+		/* Don't ever start new pending jobs if they're strict
+		 * supersets of already deferred ones. */
+		if (ARRAY_LIST_SIZE(&parked_jobs) > 0) {
 			DBG("WQ thread %lu skipped %u pending jobs, each "
-			    "bigger than one deferred.\n", wq_id, num_skipped);
+			    "bigger than one deferred.\n", wq_id,
+			    ARRAY_LIST_SIZE(&parked_jobs));
 		}
 	}
 
 	if (best_job != NULL) {
 		/* Found best fresh job. Move it to the active queue. */
-		ARRAY_LIST_REMOVE_SWAP(&workqueue, best_index);
 		ARRAY_LIST_APPEND(&running_or_done_jobs, best_job);
 		*was_blocked = false;
 		/* Notionally asserting this. Of course it could race and trip.
 		 * assert(!TIME_UP()); */
 	} else {
-		/* No fresh job. Find the blocked job with the best ETA.
-		 * However, if a job's ETA looks good but it has a strict subset
-		 * job farther up the list with way worse ETA, we'll trust that
-		 * bad ETA instead. At the very least, we'll prefer to resume
-		 * the subset job instead. But even better still would be a 3rd
-		 * unrelated job with better ETA than that subset job. (Compare
-		 * this reasoning to the 2nd half of should-work-block().) */
+		/* No fresh job. Find the blocked job with the best ETA. */
 		best_index = ARRAY_LIST_SIZE(&blocked_jobs);
 		while (best_index > 0) {
 			best_index--;
 			best_job = *ARRAY_LIST_GET(&blocked_jobs, best_index);
-			/* Check for a subset job with bigger (worse) ETA. */
-			bool subset_has_worse_eta = false;
-			for (i = 0; i < best_index; i++) {
-				j = ARRAY_LIST_GET(&blocked_jobs, i);
-				if (pp_subset((*j)->config, best_job->config)) {
-					/* This blocked job is unacceptable. */
-					subset_has_worse_eta = true;
-					break;
-				}
-			}
-			if (!subset_has_worse_eta) {
-				/* No matches, above. This job is acceptable. */
+			if (blocked_job_eligible(wq_id, best_index, can_grow,
+						 skipped_for_memory)) {
 				break;
 			}
+			best_job = NULL;
 		}
 		/* Was a best blocked job found? (The list can be empty ofc.) */
 		if (best_job != NULL) {
-			ARRAY_LIST_REMOVE(&blocked_jobs, best_index);
+			remove_blocked_job(best_index);
 			ARRAY_LIST_APPEND(&running_or_done_jobs, best_job);
 			*was_blocked = true;
 		}
@@ -234,11 +690,55 @@ static struct job *get_work(unsigned long wq_id, bool *was_blocked)
 	return best_job;
 }
 
-static void move_job_to_blocked_queue(struct job *j)
+/* returns NULL if no work is available */
+static struct job *get_work(unsigned long wq_id, bool *was_blocked)
+{
+	struct job *best_job;
+
+	/* If time is up, there may still yet be work to do -- kicking awake
+	 * all the blocked jobs so that they can exit cleanly (which they will
+	 * do immediately -- see messaging.c). Otherwise, during normal time,
+	 * prioritize "fresh" jobs from the pending queue. */
+	drain_incoming_jobs();
+	bool time_up = TIME_UP();
+	/* Starting a new landslide (for a fresh job, or one parked on disk)
+	 * needs room in the memory budget -- unless no other thread is busy to
+	 * free any up later, in which case we'd wait forever. Resuming a merely
+	 * suspended job is free, as its memory is already counted. */
+	bool can_grow = time_up || nonblocked_threads <= 1 ||
+		memory_for_new_landslide();
+	bool skipped_for_memory = false;
+	if (bandit_enabled() && !time_up) {
+		best_job = get_work_by_score(wq_id, can_grow, was_blocked,
+					     &skipped_for_memory);
+	} else {
+		best_job = get_work_by_order(wq_id, time_up, can_grow,
+					     was_blocked, &skipped_for_memory);
+	}
+	if (best_job == NULL && skipped_for_memory) {
+		DBG("WQ thread %lu waiting for memory to start more "
+		    "jobs.\n", wq_id);
+		waiting_for_memory = true;
+	} else if (best_job != NULL &&
+		   (!*was_blocked || best_job->park_filename != NULL) &&
+		   best_job->test != current_test) {
+		/* it'll need a landslide built for its test */
+		if (current_test != NULL) {
+			DBG("WQ thread %lu switching from test %s (%lu usecs) "
+			    "to %s (%lu usecs)\n", wq_id, current_test->name,
+			    current_test->cputime, best_job->test->name,
+			    best_job->test->cputime);
+		}
+		current_test = best_job->test;
+	}
+	return best_job;
+}
+
+/* Must be called with the workqueue lock held. */
+static void requeue_blocked_job(struct job *j)
 {
 	struct job **j2;
 	unsigned int i;
-	LOCK(&workqueue_lock);
 
 	/* Find job on active jobs list and remove it. */
 	ARRAY_LIST_FOREACH(&running_or_done_jobs, i, j2) {
@@ -252,7 +752,7 @@ static void move_job_to_blocked_queue(struct job *j)
 	ARRAY_LIST_REMOVE_SWAP(&running_or_done_jobs, i);
 
 	/* Put it on blocked queue and bubble-sort it. */
-	ARRAY_LIST_APPEND(&blocked_jobs, j);
+	add_blocked_job(j);
 	i = ARRAY_LIST_SIZE(&blocked_jobs) - 1;
 	/* Lower ETA jobs stay closer to the end of the array. */
 	while (i > 0 && compare_job_eta(*ARRAY_LIST_GET(&blocked_jobs, i),
@@ -261,20 +761,37 @@ static void move_job_to_blocked_queue(struct job *j)
 		ARRAY_LIST_SWAP(&blocked_jobs, i, i-1);
 		i--;
 	}
+}
 
-	signal_work();
+static void move_job_to_blocked_queue(struct job *j)
+{
+	LOCK(&workqueue_lock);
+	requeue_blocked_job(j);
+	BROADCAST(&workqueue_cond);
 	UNLOCK(&workqueue_lock);
 }
 
 static void process_work(struct job *j, bool was_blocked)
 {
-	if (bug_already_found(j->config)) {
+	if (bug_already_found(j->test, j->config)) {
 		/* Optimization for subset-foundabug jobs where the bug was not
 		 * found until after the work was added, but before we start the
 		 * job. Don't waste time compiling landslide before checking. */
+		WRITE_LOCK(&j->stats_lock);
 		j->cancelled = true;
+		STATS_WRITE_UNLOCK(j);
+		record_job_finished(j, "cancelled");
+	} else if (!was_blocked && cache_replay_job(j)) {
+		/* Explored in a previous run; see cache.c. */
+		record_job_finished(j, "cached");
+		if (j->should_reproduce) {
+			record_explored_pps(j->config);
+		}
 	} else {
-		if (was_blocked) {
+		if (was_blocked && j->park_filename != NULL) {
+			/* Its landslide is gone; a new one resumes from disk. */
+			start_job(j);
+		} else if (was_blocked) {
 			// DBG("[JOB %d] process(): waking up blocked job\n", j->id);
 			resume_job(j);
 		} else {
@@ -291,9 +808,10 @@ static void process_work(struct job *j, bool was_blocked)
 			bool need_rerun = j->need_rerun;
 			RW_UNLOCK(&j->stats_lock);
 			if (need_rerun) {
-				WARN("[JOB %d] failed on branch 1, needs rerun\n",
+				WARN("[JOB %d] didn't finish, needs rerun\n",
 				     j->id);
-				add_work(new_job(j->config, j->should_reproduce));
+				add_work(new_job(j->test, j->config,
+						 j->should_reproduce, j));
 			} else
 			/* Job ran to completion. */
 			/* Don't let "small" jobs mark DRs as verified: they're
@@ -306,6 +824,20 @@ static void process_work(struct job *j, bool was_blocked)
 	}
 }
 
+/* For a thread whose agent's gone, with the workqueue lock held. Like running
+ * out of work, except there may well be some left (its agent's jobs, for one),
+ * so if it was the last thread busy, it hands its place to a waiting one. */
+static void leave_workqueue(unsigned long id)
+{
+	DBG("WQ thread %lu leaving; its cpu is gone\n", id);
+	nonblocked_threads--;
+	if (nonblocked_threads == 0 && waiting_threads > 0) {
+		nonblocked_threads++;
+		handoffs++;
+	}
+	BROADCAST(&workqueue_cond);
+}
+
 static void *workqueue_thread(void *arg)
 {
 	unsigned long id = (unsigned long)arg;
@@ -314,6 +846,10 @@ static void *workqueue_thread(void *arg)
 
 	LOCK(&workqueue_lock);
 	while (true) {
+		if (!remote_cpu_alive(id)) {
+			leave_workqueue(id);
+			break;
+		}
 		bool was_blocked;
 		struct job *j = get_work(id, &was_blocked);
 		if (j != NULL) {
@@ -321,10 +857,17 @@ static void *workqueue_thread(void *arg)
 			DBG("WQ thread %lu got work: job %u\n", id, j->id);
 			start_using_cpu(id);
 			j->current_cpu = id;
+			unsigned long started_at = timestamp();
 			process_work(j, was_blocked);
 			j->current_cpu = (unsigned long)-1;
 			stop_using_cpu(id);
 			LOCK(&workqueue_lock);
+			j->test->cputime += timestamp() - started_at;
+			if (waiting_for_memory) {
+				/* whatever j was holding may be free now */
+				waiting_for_memory = false;
+				BROADCAST(&workqueue_cond);
+			}
 		} else {
 			nonblocked_threads--;
 			/* wait for new work to be generated */
@@ -336,8 +879,13 @@ static void *workqueue_thread(void *arg)
 			} else {
 				/* wait for another thread to make work */
 				// DBG("WQ thread %lu waiting for work\n", id);
+				waiting_threads++;
 				WAIT(&workqueue_cond, &workqueue_lock);
-				if (nonblocked_threads == 0) {
+				waiting_threads--;
+				if (handoffs > 0) {
+					/* counted already by whoever left */
+					handoffs--;
+				} else if (nonblocked_threads == 0) {
 					/* all other threads ran out of work too */
 					DBG("WQ thread %lu woken to quit\n", id);
 					break;
@@ -353,92 +901,173 @@ static void *workqueue_thread(void *arg)
 	return NULL;
 }
 
-static bool get_ram_usage(unsigned long *totalram, unsigned long *availram)
-{
-	bool have_memavail = false;
-	FILE *proc_meminfo = fopen("/proc/meminfo", "r");
-	if (proc_meminfo != NULL) {
-		char buf[BUF_SIZE];
-		while (fgets(buf, BUF_SIZE, proc_meminfo) != NULL) {
-			if (sscanf(buf, "MemAvailable: %lu kB", availram) == 1) {
-				have_memavail = true;
-				*availram *= 1024;
-				break;
-			}
-		}
-		fclose(proc_meminfo);
-	}
-
-	struct sysinfo info;
-	int ret = sysinfo(&info);
-	if (ret == 0) {
-		*totalram = info.totalram;
-		if (!have_memavail) {
-			WARN("MemAvailable not supported, "
-			     "falling back to sysinfo to check ram usage\n");
-			*availram = info.freeram;
-		}
-		return true;
-	}
-
-	return false;
-}
-
-#define RAM_USAGE_DANGERZONE 90 /* percent */
-#define KILL_DEFERRED_JOBS   50 /* percent */
-
 static void cant_swap() /* called with workqueue lock held */
 {
-	/* Too many suspended deferred jobs can hog memory. If the machine is in
-	 * danger of swapping, kill off half the */
+	/* Too many suspended deferred jobs can hog memory. If they put us over
+	 * the memory budget, or the machine is in danger of swapping anyway,
+	 * park just enough of them on disk to make up the difference. Each
+	 * one's landslide writes out its exploration tree and exits, and the
+	 * job stays deferred, to be resumed from the file by a new landslide;
+	 * if that can't be done (e.g. ICB), the job is killed instead. */
+	unsigned long committed, projected;
+	memory_usage(&committed, &projected);
+	unsigned long excess = committed > mem_budget ? committed - mem_budget : 0;
+
+	/* The budget only sees landslides; keep an eye on everything else. */
 	unsigned long totalram, availram;
 	if (!get_ram_usage(&totalram, &availram)) {
 		WARN("can't swap, making bad decisions\n");
+	} else {
+		/* i know, i know, check for overflow */
+		unsigned long min_availram =
+			totalram * (100 - RAM_USAGE_DANGERZONE) / 100;
+		if (availram < min_availram) {
+			excess = MAX(excess, min_availram - availram);
+		}
+	}
+	if (excess == 0) {
 		return;
 	}
 
-	/* i know, i know, check for overflow */
-	if (availram > totalram * (100 - RAM_USAGE_DANGERZONE) / 100) {
+	/* Jobs already parked hold no memory; don't count those. Nor those
+	 * suspended on agents, which hold none of ours. */
+	struct job **victim;
+	unsigned int i;
+	unsigned int num_suspended = 0;
+	ARRAY_LIST_FOREACH(&blocked_jobs, i, victim) {
+		if ((*victim)->park_filename == NULL && !job_remote(*victim)) {
+			num_suspended++;
+		}
+	}
+	if (num_suspended == 0) {
 		return;
 	}
+	/* Not knowing every job's footprint, don't go overboard either. */
+	unsigned int max_to_park =
+		MAX(1U, num_suspended * PARK_DEFERRED_JOBS / 100);
 
-	WARN("Killing %d%% of deferred jobs to avoid swapping...\n",
-	     KILL_DEFERRED_JOBS);
-
-	unsigned int num_to_kill =
-		ARRAY_LIST_SIZE(&blocked_jobs) * KILL_DEFERRED_JOBS / 100;
-
-	for (unsigned int i = 0; i < num_to_kill; i++) {
-		/* check for race with all blocked jobs waking */
-		if (ARRAY_LIST_SIZE(&blocked_jobs) == 0) {
-			break;
-		}
+	/* Choose all the victims up front, then drop the lock just once while
+	 * they all shut down in parallel. */
+	job_list_t victims;
+	unsigned long freed = 0;
+	ARRAY_LIST_INIT(&victims, max_to_park + 1);
+	i = 0;
+	while (freed < excess && ARRAY_LIST_SIZE(&victims) < max_to_park) {
 		/* jobs with the worst ETAs live at the front of the queue;
 		 * we're least likely to ever resume those ngrmadly. */
-		struct job *victim = *ARRAY_LIST_GET(&blocked_jobs, 0);
-		ARRAY_LIST_REMOVE(&blocked_jobs, 0);
-		ARRAY_LIST_APPEND(&running_or_done_jobs, victim);
+		struct job *j = *ARRAY_LIST_GET(&blocked_jobs, i);
+		if (j->park_filename == NULL && !job_remote(j)) {
+			READ_LOCK(&j->stats_lock);
+			freed += j->rss;
+			RW_UNLOCK(&j->stats_lock);
+			ARRAY_LIST_APPEND(&victims, j);
+			remove_blocked_job(i);
+		} else {
+			i++;
+		}
+	}
 
-		UNLOCK(&workqueue_lock);
+	WARN("Parking %u deferred job%s (%lu MiB) to avoid swapping...\n",
+	     ARRAY_LIST_SIZE(&victims), ARRAY_LIST_SIZE(&victims) == 1 ? "" : "s",
+	     freed / (1024 * 1024));
+	ARRAY_LIST_FOREACH(&victims, i, victim) {
+		ARRAY_LIST_APPEND(&running_or_done_jobs, *victim);
+	}
 
-		/* wake the job but set its kill flag so its next should_abort
+	UNLOCK(&workqueue_lock);
+
+	ARRAY_LIST_FOREACH(&victims, i, victim) {
+		/* wake the job but set its park flag so its next should_abort
 		 * message returns true before any more branches execute. */
-		WRITE_LOCK(&victim->stats_lock);
-		victim->kill_job = true;
-		RW_UNLOCK(&victim->stats_lock);
-		resume_job(victim);
-		if (wait_on_job(victim)) {
+		WRITE_LOCK(&(*victim)->stats_lock);
+		(*victim)->park_job = true;
+		STATS_WRITE_UNLOCK((*victim));
+		resume_job(*victim);
+	}
+	ARRAY_LIST_FOREACH(&victims, i, victim) {
+		if (wait_on_job(*victim)) {
 			assert(0 && "can't swap, eating stuff you make me chew");
 		}
+		WRITE_LOCK(&(*victim)->stats_lock);
+		(*victim)->park_job = false;
+		STATS_WRITE_UNLOCK((*victim));
+	}
 
-		LOCK(&workqueue_lock);
+	LOCK(&workqueue_lock);
+
+	unsigned int num_parked = 0;
+	ARRAY_LIST_FOREACH(&victims, i, victim) {
+		if ((*victim)->park_filename != NULL) {
+			requeue_blocked_job(*victim);
+			num_parked++;
+		}
+	}
+	ARRAY_LIST_FREE(&victims);
+	if (num_parked > 0) {
+		DBG("Parked %u deferred jobs on disk.\n", num_parked);
+		BROADCAST(&workqueue_cond);
 	}
 }
 
 extern bool verbose;
 #define TOO_MANY_PENDING_JOBS 5
 
-static void print_all_job_stats()
+/* A progress report is collected under the workqueue lock, which only takes
+ * copying out the job pointers (jobs are never freed), then printed after
+ * dropping it, reading each job's stats through its published snapshot. So
+ * no worker waits on the report being written, however long it gets. */
+struct report_entry {
+	struct job *j;
+	bool pending;
+	bool blocked;
+};
+
+struct progress_report {
+	unsigned long committed;
+	unsigned int num_pending;
+	bool summarize_pending;
+	ARRAY_LIST(struct report_entry) entries;
+};
+
+static void add_report_entries(struct progress_report *r, job_list_t *jobs,
+			       bool pending, bool blocked)
+{
+	struct job **j;
+	unsigned int i;
+	ARRAY_LIST_FOREACH(jobs, i, j) {
+		struct report_entry e = { .j = *j, .pending = pending,
+		                          .blocked = blocked };
+		ARRAY_LIST_APPEND(&r->entries, e);
+	}
+}
+
+/* with workqueue lock held */
+static void collect_all_job_stats(struct progress_report *r)
+{
+	unsigned long projected;
+	memory_usage(&r->committed, &projected);
+
+	drain_incoming_jobs();
+	r->num_pending = ARRAY_LIST_SIZE(&parked_jobs);
+	for (unsigned int i = 0; i < num_tests(); i++) {
+		r->num_pending += ARRAY_LIST_SIZE(&workqueues[i]);
+	}
+	r->summarize_pending = !verbose && r->num_pending >= TOO_MANY_PENDING_JOBS;
+
+	ARRAY_LIST_INIT(&r->entries, ARRAY_LIST_SIZE(&running_or_done_jobs) +
+			ARRAY_LIST_SIZE(&blocked_jobs) + 1);
+	add_report_entries(r, &running_or_done_jobs, false, false);
+	if (!r->summarize_pending) {
+		for (unsigned int i = 0; i < num_tests(); i++) {
+			add_report_entries(r, &workqueues[i], true, false);
+		}
+		add_report_entries(r, &parked_jobs, true, false);
+	}
+	add_report_entries(r, &blocked_jobs, false, true);
+}
+
+/* without workqueue lock held */
+static void print_all_job_stats(struct progress_report *r)
 {
 	struct human_friendly_time time_since_start;
 	const char *header = "==== PROGRESS REPORT ====";
@@ -449,25 +1078,22 @@ static void print_all_job_stats()
 	print_human_friendly_time(&time_since_start);
 	PRINT("\n");
 
-	bool summarize_pending = !verbose &&
-		ARRAY_LIST_SIZE(&workqueue) >= TOO_MANY_PENDING_JOBS;
+	if (r->committed != 0) {
+		PRINT("memory in use: ");
+		print_human_friendly_size(r->committed);
+		PRINT(" of ");
+		print_human_friendly_size(mem_budget);
+		PRINT(" budget\n");
+	}
 
-	struct job **j;
+	struct report_entry *e;
 	unsigned int i;
-	ARRAY_LIST_FOREACH(&running_or_done_jobs, i, j) {
-		print_job_stats(*j, false, false);
-	}
-	if (!summarize_pending) {
-		ARRAY_LIST_FOREACH(&workqueue, i, j) {
-			print_job_stats(*j, true, false);
-		}
-	}
-	ARRAY_LIST_FOREACH(&blocked_jobs, i, j) {
-		print_job_stats(*j, false, true);
+	ARRAY_LIST_FOREACH(&r->entries, i, e) {
+		print_job_stats(e->j, e->pending, e->blocked);
 	}
-	if (summarize_pending) {
+	if (r->summarize_pending) {
 		PRINT("And %d more pending jobs should time allow.\n",
-		      ARRAY_LIST_SIZE(&workqueue));
+		      r->num_pending);
 	}
 	print_free_re_malloc_false_positives();
 	for (unsigned int i = 0; i < strlen(header); i++) {
@@ -476,6 +1102,24 @@ static void print_all_job_stats()
 	PRINT("\n");
 }
 
+/* without workqueue lock held */
+static void write_progress_report(struct progress_report *r)
+{
+	print_all_job_stats(r);
+
+	struct metrics *m = metrics_begin(r->num_pending, r->committed,
+					  mem_budget);
+	if (m != NULL) {
+		struct report_entry *e;
+		unsigned int i;
+		ARRAY_LIST_FOREACH(&r->entries, i, e) {
+			metrics_add_job(m, e->j, e->pending, e->blocked);
+		}
+		metrics_end(m);
+	}
+	ARRAY_LIST_FREE(&r->entries);
+}
+
 static void *progress_report_thread(void *arg)
 {
 	unsigned long interval = (unsigned long)arg;
@@ -493,11 +1137,15 @@ static void *progress_report_thread(void *arg)
 		return NULL;
 	}
 
+	struct progress_report report;
 	LOCK(&workqueue_lock);
 	while (true) {
 		if (work_done) {
 			/* Execution is done. Stop printing progress reports. */
-			print_all_job_stats();
+			collect_all_job_stats(&report);
+			UNLOCK(&workqueue_lock);
+			write_progress_report(&report);
+			LOCK(&workqueue_lock);
 			progress_done = true;
 			SIGNAL(&workqueue_cond);
 			UNLOCK(&workqueue_lock);
@@ -516,7 +1164,10 @@ static void *progress_report_thread(void *arg)
 							 &wait_time);
 			if (ret == ETIMEDOUT) {
 				cant_swap(); /* x100 */
-				print_all_job_stats();
+				collect_all_job_stats(&report);
+				UNLOCK(&workqueue_lock);
+				write_progress_report(&report);
+				LOCK(&workqueue_lock);
 			} else {
 				/* Signalled; execution is done. Go around the
 				 * loop again; next time we'll fall out. */
@@ -529,12 +1180,24 @@ static void *progress_report_thread(void *arg)
 	return NULL;
 }
 
-void start_work(unsigned long num_cpus, unsigned long progress_report_interval)
+void start_work(unsigned long num_cpus, unsigned long progress_report_interval,
+		unsigned long arg_mem_budget)
 {
 	check_init();
 	assert(!started);
 	started = true;
 
+	unsigned long totalram, availram;
+	if (arg_mem_budget != 0) {
+		mem_budget = arg_mem_budget;
+	} else if (get_ram_usage(&totalram, &availram)) {
+		mem_budget = totalram / 100 * RAM_USAGE_DANGERZONE;
+	} else {
+		WARN("can't tell how much RAM there is; no memory budget\n");
+		mem_budget = ULONG_MAX;
+	}
+	DBG("memory budget: %lu MiB\n", mem_budget / (1024 * 1024));
+
 	pthread_t child;
 	int ret = pthread_create(&child, NULL, progress_report_thread,
 				 (void *)progress_report_interval);
@@ -542,6 +1205,7 @@ void start_work(unsigned long num_cpus, unsigned long progress_report_interval)
 	ret = pthread_detach(child);
 	assert(ret == 0 && "failed detach progress report thread");
 
+	test_switch_slack = num_cpus * TEST_SWITCH_SLACK_PER_CPU;
 	nonblocked_threads = num_cpus;
 	for (unsigned long i = 0; i < num_cpus; i++) {
 		ret = pthread_create(&child, NULL, workqueue_thread, (void *)i);
@@ -551,6 +1215,25 @@ void start_work(unsigned long num_cpus, unsigned long progress_report_interval)
 	}
 }
 
+/* For cpus that turn up after the fact (agents; see remote.c). Returns false
+ * if it's too late for them to be any use. */
+bool work_add_cpu(unsigned long id)
+{
+	LOCK(&workqueue_lock);
+	bool added = started && !work_done && nonblocked_threads > 0;
+	if (added) {
+		nonblocked_threads++;
+		pthread_t child;
+		int ret = pthread_create(&child, NULL, workqueue_thread,
+					 (void *)id);
+		assert(ret == 0 && "failed create worker thread");
+		ret = pthread_detach(child);
+		assert(ret == 0 && "failed detach worker thread");
+	}
+	UNLOCK(&workqueue_lock);
+	return added;
+}
+
 void wait_to_finish_work()
 {
 	assert(inited && started);
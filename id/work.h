@@ -9,12 +9,16 @@
 
 struct job;
 struct pp_set;
+struct test;
 
 void add_work(struct job *j);
 void signal_work();
+void add_work_batch(struct job **jobs, unsigned int num_jobs);
 bool should_work_block(struct job *j);
-bool work_already_exists(struct pp_set *new_set);
-void start_work(unsigned long num_cpus, unsigned long progress_report_interval);
+bool work_already_exists(struct test *test, struct pp_set *new_set);
+void start_work(unsigned long num_cpus, unsigned long progress_report_interval,
+		unsigned long mem_budget);
+bool work_add_cpu(unsigned long id);
 void wait_to_finish_work();
 
 #endif
@@ -89,6 +89,14 @@
 		       (oldfd), __newfd);				\
 	} while (0)
 
+#define XFLOCK(fd, op) do {						\
+		int __ret;						\
+		do {							\
+			__ret = flock((fd), (op));			\
+		} while (__ret != 0 && errno == EINTR);			\
+		EXPECT(__ret == 0, "failed flock fd %d\n", (fd));	\
+	} while (0)
+
 #define XGETTIMEOFDAY(tv) do {						\
 		int __ret = gettimeofday((tv), NULL);			\
 		EXPECT(__ret == 0, "failed gettimeofday");		\
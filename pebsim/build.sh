@@ -59,6 +59,12 @@ function output_pipe {
 	fi
 	OUTPUT_PIPE=$1
 }
+function message_rings {
+	echo -n
+}
+function resume_parked_tree {
+	echo -n
+}
 
 # Doesn't work without the "./". Everything is awful forever.
 if [ ! -f "./$LANDSLIDE_CONFIG" ]; then
@@ -235,33 +241,7 @@ if [ ! -z "$QUICKSAND_CONFIG_DYNAMIC" ]; then
 	fi
 	# ./landslide defines QUICKSAND_CONFIG_TEMP as a temp file to use here
 	[ ! -z "$QUICKSAND_CONFIG_TEMP" ] || die "failed make temp file for PP config"
-
-	# commands are K, U, DR, I, and O.
-	function within_function {
-		echo "K 0x`get_func $1` 0x`get_func_end $1` 1" >> "$QUICKSAND_CONFIG_TEMP" || die "couldn't write to $QUICKSAND_CONFIG_TEMP"
-	}
-	function without_function {
-		echo "K 0x`get_func $1` 0x`get_func_end $1` 0" >> "$QUICKSAND_CONFIG_TEMP" || die "couldn't write to $QUICKSAND_CONFIG_TEMP"
-	}
-	function within_user_function {
-		echo "U 0x`get_user_func $1` 0x`get_user_func_end $1` 1" >> "$QUICKSAND_CONFIG_TEMP" || die "couldn't write to $QUICKSAND_CONFIG_TEMP"
-	}
-	function without_user_function {
-		echo "U 0x`get_user_func $1` 0x`get_user_func_end $1` 0" >> "$QUICKSAND_CONFIG_TEMP" || die "couldn't write to $QUICKSAND_CONFIG_TEMP"
-	}
-	function data_race {
-		if [ -z "$1" -o -z "$2" -o -z "$3" -o -z "$4" ]; then
-			die "data_race needs four args: got \"$1\" and \"$2\" and \"$3\" and \"$4\""
-		fi
-		echo "DR $1 $2 $3 $4" >> "$QUICKSAND_CONFIG_TEMP" || die "couldn't write to $QUICKSAND_CONFIG_TEMP"
-	}
-	function input_pipe {
-		echo "I $1" >> "$QUICKSAND_CONFIG_TEMP" || die "couldn't write to $QUICKSAND_CONFIG_TEMP"
-	}
-	function output_pipe {
-		echo "O $1" >> "$QUICKSAND_CONFIG_TEMP" || die "couldn't write to $QUICKSAND_CONFIG_TEMP"
-	}
-	source "$QUICKSAND_CONFIG_DYNAMIC"
+	./ppgen.sh "$QUICKSAND_CONFIG_STATIC" "$QUICKSAND_CONFIG_DYNAMIC" "$QUICKSAND_CONFIG_TEMP" || die "ppgen.sh failed."
 fi
 
 #### Accept simics-4.0 license if not already ####
@@ -279,7 +259,10 @@ fi
 #### Do the needful ####
 
 msg "Generating simics config..."
-./configgen.sh > landslide-config.py || die "configgen.sh failed."
+# Generate to a temp file and rename, so concurrent quicksand jobs sharing one
+# build never see each other's half-written config.
+./configgen.sh > landslide-config.py.$$ || (rm -f landslide-config.py.$$; die "configgen.sh failed.")
+mv landslide-config.py.$$ landslide-config.py || die "couldn't install landslide-config.py"
 if [ -z "$SKIP_HEADER" ]; then
 	msg "Generating header file..."
 	./definegen.sh > $HEADER || (rm -f $HEADER; die "definegen.sh failed.")
@@ -290,6 +273,17 @@ fi
 if [ ! -f $STUDENT ]; then
 	die "$STUDENT doesn't seem to exist yet. Please implement it."
 fi
-# XXX FIXME: Shouldn't need to 'make clean' here. But trying to hack around bug #114.
-(cd ../work && make clean && make) || die "Building landslide failed."
-success "Build succeeded."
+# Quicksand runs many jobs with the same static config, which can all share a
+# single build, so only rebuild if the generated header or any module source
+# changed since last time (or the module went missing).
+BUILD_STAMP=../work/modules/landslide/.build-md5
+MY_BUILD_MD5=`cat ../work/modules/landslide/*.[ch] | md5sum | cut -d' ' -f1`
+if [ -f "$BUILD_STAMP" ] && [ "`cat $BUILD_STAMP`" = "$MY_BUILD_MD5" ] && ls ../work/*/lib/landslide.so >/dev/null 2>&1; then
+	msg "Landslide already built from this config; skipping."
+else
+	rm -f "$BUILD_STAMP"
+	# XXX FIXME: Shouldn't need to 'make clean' here. But trying to hack around bug #114.
+	(cd ../work && make clean && make) || die "Building landslide failed."
+	echo "$MY_BUILD_MD5" > "$BUILD_STAMP" || die "couldn't write $BUILD_STAMP"
+	success "Build succeeded."
+fi
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# @file cachekey.sh
+# @brief Identifies the kernel image, config, and landslide under test, for
+#        quicksand's cross-run result cache (see id/cache.c).
+# @author Ben Blum
+
+# usage: cachekey.sh
+# Prints one hash, which changes whenever anything in the kernel image (for
+# pebbles, this includes the user test programs), the landslide config, or
+# landslide itself does.
+
+source ./getfunc.sh
+
+# Only KERNEL_IMG is needed from the config; ignore everything else.
+source ./ignore-pps.sh
+
+if [ -z "$LANDSLIDE_CONFIG" ]; then
+	LANDSLIDE_CONFIG=config.landslide
+fi
+if [ ! -f "./$LANDSLIDE_CONFIG" ]; then
+	die "Where's $LANDSLIDE_CONFIG?"
+fi
+PINTOS_KERNEL=
+source ./$LANDSLIDE_CONFIG
+if [ ! -f "$KERNEL_IMG" ]; then
+	die "Invalid kernel image $KERNEL_IMG"
+fi
+
+# Landslide's search is as much a part of the results as what it searches, so
+# the module's source counts too, as build.sh would build it. (Not the built
+# module, which needn't exist yet, nor the header definegen makes for each test
+# from the config, which is already counted.)
+LANDSLIDE_SRC=`ls ../work/modules/landslide/*.[ch] | grep -v '/student_specifics\.h$'`
+cat "$KERNEL_IMG" "./$LANDSLIDE_CONFIG" $LANDSLIDE_SRC | md5sum | cut -d' ' -f1
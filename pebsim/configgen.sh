@@ -42,6 +42,12 @@ function id_magic {
 function input_pipe {
 	echo -n
 }
+function message_rings {
+	echo -n
+}
+function resume_parked_tree {
+	echo -n
+}
 OUTPUT_PIPE=
 function output_pipe {
 	OUTPUT_PIPE=$1
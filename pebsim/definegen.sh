@@ -130,6 +130,7 @@ TESTING_MUTEXES=0
 DR_PPS_RESPECT_WITHIN_FUNCTIONS=0
 PREEMPT_EVERYWHERE=0
 PURE_HAPPENS_BEFORE=0
+WARM_WORKER=0
 source $CONFIG
 
 source ./symbols.sh
@@ -380,6 +381,10 @@ if [ "$PURE_HAPPENS_BEFORE" = "1" ]; then
 	echo "#define PURE_HAPPENS_BEFORE"
 fi
 
+if [ "$WARM_WORKER" = "1" ]; then
+	echo "#define WARM_WORKER"
+fi
+
 echo
 
 #############################################
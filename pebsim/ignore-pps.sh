@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# @file ignore-pps.sh
+# @brief Stubs out the PP-defining functions a landslide config calls, for
+#        scripts that source the config only for KERNEL_IMG, TEST_CASE, etc.
+# @author Ben Blum
+
+# usage: source ./ignore-pps.sh (before sourcing the config)
+# Any PPs the config defines are definegen's business; see definegen.sh.
+
+function sched_func {
+	echo -n
+}
+function ignore_sym {
+	echo -n
+}
+function within_function {
+	echo -n
+}
+function without_function {
+	echo -n
+}
+function within_user_function {
+	echo -n
+}
+function without_user_function {
+	echo -n
+}
+function ignore_dr_function {
+	echo -n
+}
+function data_race {
+	echo -n
+}
+function disk_io_func {
+	echo -n
+}
+function extra_sym {
+	echo -n
+}
+function starting_threads {
+	echo -n
+}
+function id_magic {
+	echo -n
+}
+function input_pipe {
+	echo -n
+}
+function output_pipe {
+	echo -n
+}
+function message_rings {
+	echo -n
+}
+function resume_parked_tree {
+	echo -n
+}
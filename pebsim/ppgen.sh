@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# @file ppgen.sh
+# @brief Translates a quicksand dynamic PP config into landslide's PP format.
+# @author Ben Blum
+
+# usage: ppgen.sh QUICKSAND_CONFIG_STATIC QUICKSAND_CONFIG_DYNAMIC OUTPUT_FILE
+# Used by build.sh for the first job a landslide instance runs, and directly by
+# quicksand to hand subsequent jobs to already-running (warm) instances.
+
+source ./getfunc.sh
+
+QUICKSAND_CONFIG_STATIC="$1"
+QUICKSAND_CONFIG_DYNAMIC="$2"
+PPGEN_OUTPUT="$3"
+
+if [ -z "$QUICKSAND_CONFIG_STATIC" -o -z "$QUICKSAND_CONFIG_DYNAMIC" -o -z "$PPGEN_OUTPUT" ]; then
+	die "usage: $0 QUICKSAND_CONFIG_STATIC QUICKSAND_CONFIG_DYNAMIC OUTPUT_FILE"
+fi
+
+# The static configs are needed for KERNEL_IMG, TEST_CASE, etc., but any pps
+# defined in them are definegen's business, not ours.
+source ./ignore-pps.sh
+
+if [ -z "$LANDSLIDE_CONFIG" ]; then
+	LANDSLIDE_CONFIG=config.landslide
+fi
+if [ ! -f "./$LANDSLIDE_CONFIG" ]; then
+	die "Where's $LANDSLIDE_CONFIG?"
+fi
+PINTOS_KERNEL=
+source ./$LANDSLIDE_CONFIG
+if [ ! -f "$QUICKSAND_CONFIG_STATIC" ]; then
+	die "Where's $QUICKSAND_CONFIG_STATIC?"
+fi
+source "$QUICKSAND_CONFIG_STATIC"
+if [ ! -f "$QUICKSAND_CONFIG_DYNAMIC" ]; then
+	die "Where's $QUICKSAND_CONFIG_DYNAMIC?"
+fi
+
+# commands are K, U, DR, I, O, R, and P.
+function within_function {
+	echo "K 0x`get_func $1` 0x`get_func_end $1` 1" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function without_function {
+	echo "K 0x`get_func $1` 0x`get_func_end $1` 0" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function within_user_function {
+	echo "U 0x`get_user_func $1` 0x`get_user_func_end $1` 1" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function without_user_function {
+	echo "U 0x`get_user_func $1` 0x`get_user_func_end $1` 0" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function data_race {
+	if [ -z "$1" -o -z "$2" -o -z "$3" -o -z "$4" ]; then
+		die "data_race needs four args: got \"$1\" and \"$2\" and \"$3\" and \"$4\""
+	fi
+	echo "DR $1 $2 $3 $4" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function input_pipe {
+	echo "I $1" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function output_pipe {
+	# (also lets die() unblock the master, as in build.sh)
+	OUTPUT_PIPE=$1
+	echo "O $1" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function message_rings {
+	echo "R $1" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+function resume_parked_tree {
+	echo "P $1" >> "$PPGEN_OUTPUT" || die "couldn't write to $PPGEN_OUTPUT"
+}
+source "$QUICKSAND_CONFIG_DYNAMIC"
@@ -7,6 +7,8 @@
 #define MODULE_NAME "ESTIMATE"
 #define MODULE_COLOUR COLOUR_DARK COLOUR_CYAN
 
+#include <math.h> /* just for HUGE_VALL */
+
 #include "common.h"
 #include "estimate.h"
 #include "explore.h"
@@ -346,6 +348,86 @@ long double estimate_proportion(struct hax *root, struct hax *current)
 	return root->proportion;
 }
 
+/******************************************************************************
+ * confidence bounds
+ ******************************************************************************/
+
+/* Knuth's estimator: each branch stands for a whole tree in which every nobe
+ * has as many children as its counterpart on this branch has marked, so the
+ * tree's time is each transition's usecs times however many copies of it
+ * there would be. Computed bottom-up, so each nobe's is its own transition
+ * plus however many copies of its child's subtree. */
+static long double knuth_estimate(struct hax *current)
+{
+	long double subtree_usecs = (long double)current->usecs;
+	for (struct hax *h = current->parent; h != NULL; h = h->parent) {
+		assert(h->marked_children > 0);
+		subtree_usecs = (long double)h->usecs +
+			subtree_usecs * h->marked_children;
+	}
+	return subtree_usecs;
+}
+
+/* no libm in here */
+static long double sqrt_ld(long double x)
+{
+	if (x <= 0.0L) {
+		return 0.0L;
+	}
+	long double root = x > 1.0L ? x : 1.0L;
+	for (unsigned int i = 0; i < 128; i++) {
+		long double next = (root + x / root) / 2.0L;
+		if (next >= root) {
+			break;
+		}
+		root = next;
+	}
+	return root;
+}
+
+/* ~95%; the samples are far from normal, but this is only a heuristic for
+ * how much the estimate might still move, not a promise. */
+#define CONFIDENCE_Z 2.0L
+
+void estimate_spread_init(struct estimate_spread *s)
+{
+	s->samples = 0;
+	s->mean = 0.0L;
+	s->m2 = 0.0L;
+}
+
+void estimate_time_bounds(struct estimate_spread *s, struct hax *current,
+			  long double usecs, uint64_t elapsed_usecs,
+			  long double *lo, long double *hi)
+{
+	assert(current->estimate_computed && "estimate bounds before estimate");
+
+	long double sample = knuth_estimate(current);
+	s->samples++;
+	long double delta = sample - s->mean;
+	s->mean += delta / s->samples;
+	s->m2 += delta * (sample - s->mean);
+
+	if (s->samples < 2) {
+		*lo = (long double)elapsed_usecs;
+		*hi = HUGE_VALL;
+		return;
+	}
+
+	/* standard error of the mean of the samples so far */
+	long double error = CONFIDENCE_Z *
+		sqrt_ld(s->m2 / (s->samples - 1) / s->samples);
+	*lo = usecs - error;
+	*hi = usecs + error;
+	/* can't take less time than it already has */
+	if (*lo < (long double)elapsed_usecs) {
+		*lo = (long double)elapsed_usecs;
+	}
+	if (*hi < *lo) {
+		*hi = *lo;
+	}
+}
+
 /******************************************************************************
  * pretty-printing / convenience
  ******************************************************************************/
@@ -430,9 +512,16 @@ void print_estimates(struct ls_state *ls)
 		 usecs / 1000000, (long double)ls->save.total_usecs / 1000000,
 		 (usecs - (long double)ls->save.total_usecs) / 1000000);
 
+	long double usecs_lo, usecs_hi;
+	estimate_time_bounds(&ls->save.spread, ls->save.current, usecs,
+			     ls->save.total_usecs, &usecs_lo, &usecs_hi);
+	lsprintf(DEV, COLOUR_BOLD COLOUR_GREEN "Estimated time bounds: "
+		 "%Lfs to %Lfs (%u samples)\n" COLOUR_DEFAULT,
+		 usecs_lo / 1000000, usecs_hi / 1000000, ls->save.spread.samples);
+
 	uint64_t time_asleep =
 		message_estimate(&ls->mess, proportion, branches,
-				 usecs, ls->save.total_usecs,
+				 usecs, usecs_lo, usecs_hi, ls->save.total_usecs,
 				 ls->sched.icb_preemption_count, ls->icb_bound);
 	fudge_time(&ls->save.last_save_time, time_asleep);
 }
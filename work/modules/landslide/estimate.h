@@ -22,9 +22,25 @@ uint64_t update_time(struct timeval *tv);
 void untag_blocked_branch(struct hax *ancestor, struct hax *leaf,
 			  struct agent *a, bool was_ancestor);
 
+/* Knuth's estimator, taken once per branch, gives an independent (if noisy)
+ * estimate of the total exploration time each time. Their spread says how far
+ * to trust estimate_time(), which is steadier, but says nothing of its error. */
+struct estimate_spread {
+	unsigned int samples;
+	long double mean;
+	long double m2; /* sum of squared differences from the mean (Welford) */
+};
+
+void estimate_spread_init(struct estimate_spread *s);
+
 /* main interface. */
 long double estimate_time(struct hax *root, struct hax *current);
 long double estimate_proportion(struct hax *root, struct hax *current);
+/* Confidence interval around estimate_time(); hi is infinite until there are
+ * enough branches to say. Call after estimate_time() for the current branch. */
+void estimate_time_bounds(struct estimate_spread *s, struct hax *current,
+			  long double usecs, uint64_t elapsed_usecs,
+			  long double *lo, long double *hi);
 void print_estimates(struct ls_state *ls);
 
 #endif
@@ -490,24 +490,72 @@ static bool test_ended_safely(struct ls_state *ls)
 	return true;
 }
 
+/* As a warm worker, instead of quitting when done with a job, ask the master
+ * for another one. Returns true if we got one and rewound to the start of the
+ * test to run it; false if it's time to quit. */
+static bool warm_restart(struct ls_state *ls)
+{
+#ifdef WARM_WORKER
+	char pps_filename[BUF_SIZE];
+	if (!message_job_finished(&ls->mess, pps_filename, BUF_SIZE)) {
+		return false;
+	}
+
+	lsprintf(ALWAYS, COLOUR_BOLD COLOUR_GREEN
+		 "**** Starting next job with PPs from %s. ****\n"
+		 COLOUR_DEFAULT, pps_filename);
+	save_warm_restart(&ls->save, ls);
+	reload_dynamic_pps(ls, pps_filename);
+	mem_reset_data_races(&ls->kern_mem);
+	mem_reset_data_races(&ls->user_mem);
+	if (ls->pps.parked_tree_filename != NULL) {
+		save_unpark(&ls->save, ls, ls->pps.parked_tree_filename);
+	}
+#ifdef ICB
+	ls->icb_bound = ICB_START_BOUND;
+#endif
+	ls->icb_need_increment_bound = false;
+	ls->end_branch_early_due_to_trylock_prob = false;
+	return true;
+#else
+	return false;
+#endif
+}
+
 static void found_no_bug(struct ls_state *ls)
 {
 	lsprintf(ALWAYS, COLOUR_BOLD COLOUR_GREEN
 		 "**** Execution tree explored; you survived! ****\n"
 		 COLOUR_DEFAULT);
 	PRINT_TREE_INFO(DEV, ls);
-	SIM_quit(LS_NO_KNOWN_BUG);
+	if (!warm_restart(ls)) {
+		SIM_quit(LS_NO_KNOWN_BUG);
+	}
 }
 
-static void check_should_abort(struct ls_state *ls)
+/* Returns true if the job was aborted, but we moved on to another one. If the
+ * master wants the tree parked, h and tid are where we would have gone next. */
+static bool check_should_abort(struct ls_state *ls, struct hax *h,
+			       unsigned int tid)
 {
-	if (should_abort(&ls->mess)) {
+	char park_filename[BUF_SIZE];
+	if (should_abort(&ls->mess, park_filename, BUF_SIZE)) {
 		lsprintf(ALWAYS, COLOUR_BOLD COLOUR_YELLOW
 			 "**** Abort requested by master process. ****\n"
 			 COLOUR_DEFAULT);
+		if (park_filename[0] != '\0' && h != NULL &&
+		    save_park(&ls->save, ls, h, tid, park_filename)) {
+			lsprintf(ALWAYS, COLOUR_BOLD COLOUR_YELLOW "Exploration "
+				 "tree parked in %s.\n" COLOUR_DEFAULT,
+				 park_filename);
+		}
 		PRINT_TREE_INFO(DEV, ls);
-		SIM_quit(LS_NO_KNOWN_BUG);
+		if (!warm_restart(ls)) {
+			SIM_quit(LS_NO_KNOWN_BUG);
+		}
+		return true;
 	}
+	return false;
 }
 
 void landslide_assert_fail(const char *message, const char *file,
@@ -541,7 +589,9 @@ static bool time_travel(struct ls_state *ls)
 	print_estimates(ls);
 	lsprintf(BRANCH, "ICB preemption count this branch = %u\n",
 		 ls->sched.icb_preemption_count);
-	check_should_abort(ls);
+	if (check_should_abort(ls, h, tid)) {
+		return true;
+	}
 
 	if (h != NULL) {
 		assert(!h->all_explored);
@@ -563,6 +613,13 @@ static bool time_travel(struct ls_state *ls)
 
 static void check_test_state(struct ls_state *ls)
 {
+#ifdef WARM_WORKER
+	/* Remember where the test began, to come back for the next job. */
+	if (ls->test.test_ever_caused && ls->save.warm_start == NULL) {
+		save_warm_start(&ls->save, ls);
+	}
+#endif
+
 	/* When a test case finishes, break the simulation so the wrapper can
 	 * decide what to do. */
 	if ((test_update_state(ls) && !ls->test.test_is_running) || ls->end_branch_early_due_to_trylock_prob) {
@@ -622,7 +679,11 @@ void landslide_entrypoint(conf_object_t *obj, void *trace_entry)
 		ls->absolute_trigger_count++;
 
 		if (ls->just_jumped) {
-			sched_recover(ls);
+			/* A warm restart lands before the tree's root, where
+			 * there's no choice in flight to recover. */
+			if (ls->save.root != NULL) {
+				sched_recover(ls);
+			}
 			ls->just_jumped = false;
 		}
 
@@ -18,16 +18,37 @@
 void lockset_init(struct lockset *l)
 {
 	ARRAY_LIST_INIT(&l->list, 16);
+	l->refcount = MM_XMALLOC(1, unsigned int);
+	*l->refcount = 1;
 }
 
 void lockset_free(struct lockset *l)
 {
-	ARRAY_LIST_FREE(&l->list);
+	assert(*l->refcount > 0);
+	if (--*l->refcount == 0) {
+		ARRAY_LIST_FREE(&l->list);
+		MM_FREE(l->refcount);
+	}
 }
 
 void lockset_clone(struct lockset *dest, const struct lockset *src)
 {
-	ARRAY_LIST_CLONE(&dest->list, &src->list);
+	*dest = *src;
+	(*dest->refcount)++;
+}
+
+/* Makes the list safe to modify, copying it if another lockset shares it. */
+static void lockset_own(struct lockset *l)
+{
+	assert(*l->refcount > 0);
+	if (*l->refcount == 1) {
+		return;
+	}
+	(*l->refcount)--;
+	typeof(l->list) shared = l->list;
+	ARRAY_LIST_CLONE(&l->list, &shared);
+	l->refcount = MM_XMALLOC(1, unsigned int);
+	*l->refcount = 1;
 }
 
 void lockset_print(verbosity v, struct lockset *l)
@@ -93,6 +114,7 @@ bool lockset_intersect(struct lockset *l0, struct lockset *l1)
 static void _lockset_add(struct lockset *l, unsigned int lock_addr, enum lock_type type)
 {
 	struct lock new_lock = { .addr = lock_addr, .type = type };
+	lockset_own(l);
 	ARRAY_LIST_APPEND(&l->list, new_lock);
 
 	/* sort */
@@ -161,6 +183,7 @@ static bool _lockset_remove(struct lockset *l, unsigned int lock_addr, enum lock
 	struct lock *lock;
 	ARRAY_LIST_FOREACH(&l->list, i, lock) {
 		if (lock->addr == lock_addr && SAME_LOCK_TYPE(lock->type, type)) {
+			lockset_own(l);
 			ARRAY_LIST_REMOVE(&l->list, i);
 			return true;
 		}
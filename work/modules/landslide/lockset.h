@@ -29,9 +29,12 @@ struct lock {
 	enum lock_type type;
 };
 
-/* Tracks the locks held by a given thread, for data race detection. */
+/* Tracks the locks held by a given thread, for data race detection.
+ * Clones share the list, copy-on-write, as a thread's locks rarely change
+ * between one save point (or recorded memory access) and the next. */
 struct lockset {
 	ARRAY_LIST(struct lock) list;
+	unsigned int *refcount; /* locksets sharing the list */
 };
 
 /* For efficient storage of locksets on memory accesses. */
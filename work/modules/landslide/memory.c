@@ -57,14 +57,37 @@ void init_malloc_actions(struct malloc_actions *flags)
 	flags->palloc_request_size = 0x2badd00d;
 }
 
+static void retain_chunk(void *value)
+{
+	struct chunk *c = (struct chunk *)value;
+	assert(c->refcount > 0);
+	c->refcount++;
+}
+
+static void release_chunk(void *value)
+{
+	struct chunk *c = (struct chunk *)value;
+	assert(c->refcount > 0);
+	if (--c->refcount == 0) {
+		if (c->malloc_trace != NULL) free_stack_trace(c->malloc_trace);
+		if (c->free_trace   != NULL) free_stack_trace(c->free_trace);
+		MM_FREE(c);
+	}
+}
+
+static const struct ptree_ops chunk_ops = {
+	.retain = retain_chunk,
+	.release = release_chunk,
+};
+
 static void mem_heap_init(struct mem_state *m)
 {
-	m->malloc_heap.rb_node = NULL;
+	ptree_init(&m->malloc_heap, &chunk_ops);
 	m->heap_size = 0;
 	m->heap_next_id = 0;
 	m->guest_init_done = false;
 	m->in_mm_init = false;
-	m->palloc_heap.rb_node = NULL;
+	ptree_init(&m->palloc_heap, &chunk_ops);
 #ifndef ALLOW_REENTRANT_MALLOC_FREE
 	init_malloc_actions(&m->flags);
 #endif
@@ -85,6 +108,105 @@ void mem_init(struct ls_state *ls)
 	mem_heap_init(&ls->user_mem);
 }
 
+static void free_data_races(struct rb_node *nobe)
+{
+	if (nobe == NULL)
+		return;
+	free_data_races(nobe->rb_left);
+	free_data_races(nobe->rb_right);
+	MM_FREE(rb_entry(nobe, struct data_race, nobe));
+}
+
+/* Data races are normally remembered for the lifetime of the process, across
+ * all branches. A warm worker starting a new job must forget them, lest it
+ * fail to report (and count as deterministic) ones the last job found. */
+void mem_reset_data_races(struct mem_state *m)
+{
+	free_data_races(m->data_races.rb_node);
+	m->data_races.rb_node = NULL;
+	m->data_races_suspected = 0;
+	m->data_races_confirmed = 0;
+}
+
+/* Adds what's known about an eip pair's orders to the candidates, merging it
+ * with what we've seen of the pair ourselves, if anything. */
+static void merge_data_race(struct mem_state *m, unsigned int first_eip,
+			    unsigned int other_eip, bool first_before_other,
+			    bool other_before_first, bool allow_duplicate)
+{
+	struct rb_node **p = &m->data_races.rb_node;
+	struct rb_node *parent = NULL;
+	struct data_race *dr;
+
+	assert(first_eip < other_eip);
+	assert(first_before_other || other_before_first);
+
+	while (*p != NULL) {
+		parent = *p;
+		dr = rb_entry(parent, struct data_race, nobe);
+		if (first_eip < dr->first_eip ||
+		    (first_eip == dr->first_eip && other_eip < dr->other_eip)) {
+			p = &(*p)->rb_left;
+		} else if (first_eip > dr->first_eip ||
+			   (first_eip == dr->first_eip && other_eip > dr->other_eip)) {
+			p = &(*p)->rb_right;
+		} else {
+			assert(allow_duplicate && "duplicate data race in parked tree");
+			bool was_confirmed =
+				dr->first_before_other && dr->other_before_first;
+			dr->first_before_other |= first_before_other;
+			dr->other_before_first |= other_before_first;
+			if (!was_confirmed && dr->first_before_other &&
+			    dr->other_before_first) {
+				m->data_races_confirmed++;
+			}
+			return;
+		}
+	}
+
+	dr = MM_XMALLOC(1, struct data_race);
+	dr->first_eip          = first_eip;
+	dr->other_eip          = other_eip;
+	dr->first_before_other = first_before_other;
+	dr->other_before_first = other_before_first;
+
+	rb_link_node(&dr->nobe, parent, p);
+	rb_insert_color(&dr->nobe, &m->data_races);
+
+	m->data_races_suspected++;
+	if (dr->first_before_other && dr->other_before_first) {
+		m->data_races_confirmed++;
+	}
+}
+
+/* Re-adds a data race candidate remembered by a parked tree (see save.c). */
+void mem_restore_data_race(struct mem_state *m, const struct data_race *saved)
+{
+	merge_data_race(m, saved->first_eip, saved->other_eip,
+			saved->first_before_other, saved->other_before_first,
+			false);
+}
+
+/* Learns of a data race candidate that some other landslide observed (see
+ * messaging.c), so that seeing it in one order here is enough to confirm it,
+ * if it was already seen in the other there. The orders come in execution
+ * order ("eip0 ran before eip1"), so they're swapped into ours; see the
+ * comment on struct data_race. */
+void mem_learn_data_race(struct mem_state *m, unsigned int eip0,
+			 unsigned int eip1, bool eip0_before_eip1,
+			 bool eip1_before_eip0)
+{
+	if (eip0 == eip1) {
+		return;
+	} else if (eip0 < eip1) {
+		merge_data_race(m, eip0, eip1, eip1_before_eip0,
+				eip0_before_eip1, true);
+	} else {
+		merge_data_race(m, eip1, eip0, eip0_before_eip1,
+				eip1_before_eip0, true);
+	}
+}
+
 /* The user mem heap tracking can only work for a single address space. We want
  * to pay attention to the userspace program under test, not the shell or init
  * or idle or anything like that. Figure out what that process's cr3 is. */
@@ -191,12 +313,24 @@ static struct chunk *find_containing_chunk(struct rb_root *root, unsigned int ad
 	}
 }
 
+/* As above, for the malloc and palloc heaps. Chunks in them never overlap, so
+ * the only candidate is the one with the nearest base at or below addr. */
+static struct chunk *find_heap_chunk(const struct ptree *heap, unsigned int addr)
+{
+	struct chunk *c = ptree_find_le(heap, addr, NULL);
+	if (c != NULL && addr < c->base + c->len) {
+		return c;
+	} else {
+		return NULL;
+	}
+}
+
 /* As above, but searches both the malloc and palloc heap (if it exists). */
 static struct chunk *find_alloced_chunk(struct mem_state *m, unsigned int addr)
 {
-	struct chunk *c = find_containing_chunk(&m->malloc_heap, addr);
+	struct chunk *c = find_heap_chunk(&m->malloc_heap, addr);
 	if (c == NULL) {
-		c = find_containing_chunk(&m->palloc_heap, addr);
+		c = find_heap_chunk(&m->palloc_heap, addr);
 		/* Pages used to back malloc are still illegal. */
 		if (c != NULL && c->pages_reserved_for_malloc) {
 			c = NULL;
@@ -205,7 +339,7 @@ static struct chunk *find_alloced_chunk(struct mem_state *m, unsigned int addr)
 	return c;
 }
 
-
+/* The freed tree is an ordinary rbtree, emptied at every save point. */
 static void insert_chunk(struct rb_root *root, struct chunk *c, bool coalesce)
 {
 	struct chunk *parent = NULL;
@@ -217,7 +351,7 @@ static void insert_chunk(struct rb_root *root, struct chunk *c, bool coalesce)
 	if (coalesce && p == NULL) {
 		assert(parent != NULL);
 		parent->len = MAX(parent->len, c->len + c->base - parent->base);
-		MM_FREE(c);
+		release_chunk(c);
 		return;
 	}
 
@@ -228,35 +362,52 @@ static void insert_chunk(struct rb_root *root, struct chunk *c, bool coalesce)
 	rb_insert_color(&c->nobe, root);
 }
 
-static struct chunk *remove_chunk(struct rb_root *root, unsigned int addr)
+/* Returns the chunk containing addr, no longer in the heap, and all the
+ * caller's to modify (copied, if still shared with a snapshot of the heap). */
+static struct chunk *remove_heap_chunk(struct ptree *heap, unsigned int addr)
 {
-	struct chunk *target = NULL;
-	struct rb_node **p = find_insert_location(root, addr, &target);
-
-	if (p == NULL) {
-		assert(target != NULL);
-		rb_erase(&target->nobe, root);
-		return target;
-	} else {
+	struct chunk *c = find_heap_chunk(heap, addr);
+	if (c == NULL) {
 		/* no containing block found */
 		return NULL;
 	}
+	MAYBE_UNUSED struct chunk *removed = ptree_remove(heap, c->base);
+	assert(removed == c);
+	if (c->refcount > 1) {
+		struct chunk *copy = MM_XMALLOC(1, struct chunk);
+		*copy = *c;
+		copy->refcount = 1;
+		copy->malloc_trace = c->malloc_trace == NULL ? NULL :
+			share_stack_trace(c->malloc_trace);
+		copy->free_trace = c->free_trace == NULL ? NULL :
+			share_stack_trace(c->free_trace);
+		release_chunk(c);
+		c = copy;
+	}
+	return c;
 }
 
-static void print_heap(verbosity v, struct rb_node *nobe, bool rightmost)
+struct print_heap_state {
+	verbosity v;
+	bool first;
+};
+
+static void print_heap_chunk(unsigned int base, void *value, void *arg)
 {
-	if (nobe == NULL) {
-		return;
+	struct chunk *c = (struct chunk *)value;
+	struct print_heap_state *state = (struct print_heap_state *)arg;
+	assert(c->base == base);
+	if (!state->first) {
+		printf(state->v, ", ");
 	}
+	printf(state->v, "[0x%x | %d]", c->base, c->len);
+	state->first = false;
+}
 
-	struct chunk *c = rb_entry(nobe, struct chunk, nobe);
-
-	print_heap(v, c->nobe.rb_left, false);
-	printf(v, "[0x%x | %d]", c->base, c->len);
-	if (!rightmost || c->nobe.rb_right != NULL) {
-		printf(v, ", ");
-	}
-	print_heap(v, c->nobe.rb_right, rightmost);
+static void print_heap(verbosity v, const struct ptree *heap)
+{
+	struct print_heap_state state = { .v = v, .first = true };
+	ptree_foreach(heap, print_heap_chunk, &state);
 }
 
 /* Attempt to find a freed chunk among all transitions */
@@ -347,7 +498,7 @@ static void print_freed_chunk_info(struct chunk *c,
  * and flags depending on which heap (kmalloc, kpalloc, umalloc) is used. */
 #define INIT_PTRS(m, heap, init, alloc, free, reqsize)				\
 	struct mem_state *m = in_kernel ? &ls->kern_mem : &ls->user_mem;	\
-	MAYBE_UNUSED struct rb_root *heap =					\
+	MAYBE_UNUSED struct ptree *heap =					\
 		is_palloc ? &m->palloc_heap : &m->malloc_heap;			\
 	MAYBE_UNUSED bool *init  = &m->in_mm_init; /* gross, but harmless. */	\
 	MAYBE_UNUSED bool *alloc = is_palloc ?					\
@@ -404,6 +555,7 @@ static void mem_exit_bad_place(struct ls_state *ls, bool in_kernel, bool is_pall
 		chunk->id = m->heap_next_id;
 		chunk->malloc_trace = stack_trace(ls);
 		chunk->free_trace = NULL;
+		chunk->refcount = 1;
 		/* In pintos, malloc() uses palloc() to back the arenas. We want
 		 * to check for UAFs in both types of allocations, so specially
 		 * flag palloced pages that should still UAF if there's an
@@ -416,7 +568,11 @@ static void mem_exit_bad_place(struct ls_state *ls, bool in_kernel, bool is_pall
 		m->heap_size += *request_size;
 		assert(m->heap_next_id != INT_MAX && "need a wider type");
 		m->heap_next_id++;
-		insert_chunk(heap, chunk, false);
+		assert(find_heap_chunk(heap, chunk->base) == NULL &&
+		       "allocated a block already contained in the heap?");
+		MAYBE_UNUSED bool replaced =
+			ptree_insert(heap, chunk->base, chunk);
+		assert(!replaced);
 	}
 
 	*in_alloc = false;
@@ -434,7 +590,7 @@ static void mem_enter_free(struct ls_state *ls, bool in_kernel, bool is_palloc,
 			    *in_alloc ? "Malloc" : "Free");
 	}
 
-	chunk = remove_chunk(heap, base);
+	chunk = remove_heap_chunk(heap, base);
 
 	if (base == 0) {
 		assert(chunk == NULL);
@@ -802,11 +958,11 @@ static void use_after_free(struct ls_state *ls, unsigned int addr,
 
 	// TODO: do something analogous to a wrong_panic() assert here
 	lsprintf(BUG, "Malloc() heap contents: {");
-	print_heap(BUG, m->malloc_heap.rb_node, true);
+	print_heap(BUG, &m->malloc_heap);
 	printf(BUG, "}\n");
-	if (m->palloc_heap.rb_node != NULL) {
+	if (m->palloc_heap.size > 0) {
 		lsprintf(BUG, "Palloc() heap contents: {");
-		print_heap(BUG, m->palloc_heap.rb_node, true);
+		print_heap(BUG, &m->palloc_heap);
 		printf(BUG, "}\n");
 	}
 
@@ -1229,8 +1385,11 @@ static void print_data_race(struct ls_state *ls, struct hax *h0, struct hax *h1,
 #else
 	if (confirmed && l0->interrupce_enabled) {
 #endif
+		/* (l0 was later, so it's only sent with its pair if the
+		 * pair's been seen both ways; see messaging.c) */
 		message_data_race(&ls->mess, l0->eip, h0->chosen_thread,
-			l0->last_call, l0->most_recent_syscall, confirmed,
+			l0->last_call, l0->most_recent_syscall,
+			confirmed ? l1->eip : 0, in_kernel, confirmed,
 			deterministic, free_re_malloc);
 	}
 #ifdef DR_FALSE_NEGATIVE_EXPERIMENT
@@ -1239,8 +1398,8 @@ static void print_data_race(struct ls_state *ls, struct hax *h0, struct hax *h1,
 	if ((confirmed || !too_suspicious) && l1->interrupce_enabled) {
 #endif
 		message_data_race(&ls->mess, l1->eip, h1->chosen_thread,
-			l1->last_call, l1->most_recent_syscall, confirmed,
-			deterministic, free_re_malloc);
+			l1->last_call, l1->most_recent_syscall, l0->eip,
+			in_kernel, confirmed, deterministic, free_re_malloc);
 	}
 }
 
@@ -1451,3 +1610,43 @@ bool mem_shm_intersect(struct ls_state *ls, struct hax *h0, struct hax *h1,
 
 	return conflicts > 0;
 }
+
+#if 0
+/* a race learned from another landslide must stay suspected when seen here in
+ * the same order, and be confirmed only when seen here in the other order */
+void data_race_test()
+{
+	struct mem_state m;
+	m.data_races.rb_node = NULL;
+	m.data_races_suspected = 0;
+	m.data_races_confirmed = 0;
+
+	/* quicksand says 0x100 ran before 0x200 */
+	mem_learn_data_race(&m, 0x200, 0x100, false, true);
+	assert(m.data_races_suspected == 1);
+	assert(m.data_races_confirmed == 0);
+
+	/* same order here (check_data_race gets the later access first) */
+	assert(!check_data_race(&m, 0x200, 0x100));
+	assert(m.data_races_confirmed == 0);
+
+	/* learning the same order again changes nothing either */
+	mem_learn_data_race(&m, 0x100, 0x200, true, false);
+	assert(m.data_races_suspected == 1);
+	assert(m.data_races_confirmed == 0);
+
+	/* the other order confirms it */
+	assert(check_data_race(&m, 0x100, 0x200));
+	assert(m.data_races_suspected == 1);
+	assert(m.data_races_confirmed == 1);
+
+	/* and a race learned both ways is confirmed from the start */
+	mem_learn_data_race(&m, 0x300, 0x400, true, true);
+	assert(m.data_races_suspected == 2);
+	assert(m.data_races_confirmed == 2);
+	assert(check_data_race(&m, 0x300, 0x400));
+
+	mem_reset_data_races(&m);
+	assert(m.data_races.rb_node == NULL);
+}
+#endif
@@ -10,6 +10,7 @@
 #include <simics/api.h> /* for bool, of all things... */
 
 #include "lockset.h"
+#include "ptree.h"
 #include "rbtree.h"
 #include "vector_clock.h"
 #include "variable_queue.h"
@@ -84,7 +85,12 @@ struct mem_access {
 struct data_race {
 	int first_eip;
 	int other_eip;
-	/* which order were they observed in? "confirmed" iff both are true. */
+	/* which order were they observed in? "confirmed" iff both are true.
+	 * NB. these are from check_data_race()'s point of view, which is
+	 * handed the later access first: first_before_other means first_eip
+	 * (the lower) was the *later* access, and other_before_first means it
+	 * was the earlier one. (quicksand speaks in execution order, so what it
+	 * tells us is swapped to match in mem_learn_data_race().) */
 	bool first_before_other;
 	bool other_before_first;
 	// TODO: record stack traces?
@@ -101,7 +107,10 @@ struct chunk {
 	unsigned int base;
 	unsigned int len;
 	unsigned int id; /* distinguishes chunks in same-space-different-time */
-	struct rb_node nobe;
+	/* while in a heap, shared with that heap's snapshots (see ptree.h), so
+	 * never modified; once freed, privately owned by the freed tree */
+	unsigned int refcount;
+	struct rb_node nobe; /* for the freed tree only */
 	/* for use-after-free reporting */
 	struct stack_trace *malloc_trace;
 	struct stack_trace *free_trace;
@@ -120,7 +129,8 @@ struct malloc_actions {
 
 struct mem_state {
 	/**** heap state tracking ****/
-	struct rb_root malloc_heap;
+	/* chunks by base; persistent, so save points snapshot them for free */
+	struct ptree malloc_heap;
 	unsigned int heap_size;
 	unsigned int heap_next_id; /* generation counter for chunks */
 
@@ -129,7 +139,7 @@ struct mem_state {
 	 * The above fields for size and generation counter are shared for
 	 * simplicity of code, but others need to be duplicated. In pebbles
 	 * this is deadcode. */
-	struct rb_root palloc_heap;
+	struct ptree palloc_heap;
 
 	/* dynamic allocation request state */
 	bool guest_init_done;
@@ -165,6 +175,11 @@ struct mem_state {
  ******************************************************************************/
 
 void mem_init(struct ls_state *);
+void mem_reset_data_races(struct mem_state *m);
+void mem_restore_data_race(struct mem_state *m, const struct data_race *saved);
+void mem_learn_data_race(struct mem_state *m, unsigned int eip0,
+			 unsigned int eip1, bool eip0_before_eip1,
+			 bool eip1_before_eip0);
 void init_malloc_actions(struct malloc_actions *);
 
 void mem_update(struct ls_state *);
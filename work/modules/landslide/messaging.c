@@ -10,19 +10,63 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "common.h"
 #include "compiler.h"
 #include "estimate.h"
+#include "landslide.h"
+#include "memory.h"
 #include "messaging.h"
 #include "student_specifics.h"
 #include "stack.h"
 
 /* Spec. */
 
+/* Messages in each direction go through a single-producer single-consumer
+ * ring in a shared memory file that quicksand creates and we map. A record is
+ * a header, the fixed-size message struct, and a variable-length string.
+ * The fifos are only doorbells (and tell us if quicksand goes away); see
+ * id/messaging.c, which this must match. */
+
 #define MESSAGE_BUF_SIZE 256
 
+#define RING_SIZE (64 * 1024) /* power of 2 */
+#define RING_ALIGN 8
+#define CACHELINE 64
+#define RECORD_MAX_TEXT (RING_SIZE / 4)
+/* how many times to poll for a reply before sleeping on the doorbell */
+#define RING_SPIN 4096
+
+struct ring {
+	/* written by the consumer */
+	unsigned int head;
+	unsigned int consumer_waiting;
+	char consumer_pad[CACHELINE - 2 * sizeof(unsigned int)];
+	/* written by the producer */
+	unsigned int tail;
+	unsigned int producer_waiting;
+	char producer_pad[CACHELINE - 2 * sizeof(unsigned int)];
+	char buf[RING_SIZE];
+};
+
+struct message_rings {
+	unsigned int magic;
+	char pad[CACHELINE - sizeof(unsigned int)];
+	struct ring to_quicksand;
+	struct ring to_landslide;
+};
+
+struct record_header {
+	unsigned int size; /* of the whole record, including this header */
+	unsigned int msg_size; /* 0 for padding up to the end of the ring */
+};
+
+#define RECORD_SIZE(msg_size, text_len) \
+	((sizeof(struct record_header) + (msg_size) + (text_len) + \
+	  RING_ALIGN - 1) & ~(RING_ALIGN - 1))
+
 struct output_message {
 	unsigned int magic;
 
@@ -33,36 +77,42 @@ struct output_message {
 		FOUND_A_BUG = 3,
 		SHOULD_CONTINUE = 4,
 		ASSERT_FAILED = 5,
+		JOB_FINISHED = 6,
 	} tag;
 
 	union {
+		/* text: pretty-printed stack of the racing access */
 		struct {
 			unsigned int eip;
 			unsigned int tid;
 			unsigned int last_call;
 			unsigned int most_recent_syscall;
+			/* the other access of the pair (0 if not sent); if
+			 * unconfirmed, eip was observed to come first */
+			unsigned int other_eip;
 			bool confirmed;
 			bool deterministic;
 			bool free_re_malloc; // for pldi experimence; means dont use as PP
-			char pretty_printed[MESSAGE_BUF_SIZE];
+			bool in_kernel;
 		} dr;
 
 		struct {
 			long double proportion;
 			unsigned int elapsed_branches;
 			long double total_usecs;
+			/* confidence interval around total_usecs */
+			long double total_usecs_lo;
+			long double total_usecs_hi;
 			long double elapsed_usecs;
 			unsigned int icb_cur_bound;
 		} estimate;
 
+		/* text: trace filename */
 		struct {
-			char trace_filename[MESSAGE_BUF_SIZE];
 			unsigned int icb_preemption_count;
 		} bug;
 
-		struct {
-			char assert_message[MESSAGE_BUF_SIZE];
-		} crash_report;
+		/* (ASSERT_FAILED's text is the assert message) */
 	} content;
 };
 
@@ -72,7 +122,13 @@ struct input_message {
 		SHOULD_CONTINUE_REPLY = 0,
 		SUSPEND_TIME = 1,
 		RESUME_TIME = 2,
+		NEXT_JOB = 3,
+		KNOWN_DATA_RACE = 4,
 	} tag;
+	/* NEXT_JOB's text names the next job's translated dynamic PPs.
+	 * KNOWN_DATA_RACE's, a data race candidate from another job, in the
+	 * format of a parked tree's (see save.c); these may come before any
+	 * reply, and recv() deals with them itself. */
 	bool value;
 };
 
@@ -82,36 +138,190 @@ struct input_message {
 
 #ifdef ID_WRAPPER_MAGIC
 
-static void send(struct messaging_state *state, struct output_message *m)
+static bool ring_readable(struct ring *r, unsigned int head)
+{
+	return __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) != head;
+}
+
+/* true if the consumer has moved its head up to at least min_head */
+static bool ring_writable(struct ring *r, unsigned int min_head)
+{
+	return (int)(__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) - min_head) >= 0;
+}
+
+static void ring_doorbell(int fd, unsigned int *waiting)
+{
+	if (__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST)) {
+		char c = 0;
+		int ret = write(fd, &c, 1);
+		assert(ret == 1 && "ring doorbell failed");
+	}
+}
+
+/* Blocks on our doorbell fifo until ready(r, arg) holds. Replies to our
+ * requests usually come back within microseconds, so poll for a bit first.
+ * Returns false if quicksand hung up first. */
+static bool ring_wait(int doorbell_fd, unsigned int *waiting,
+		      bool (*ready)(struct ring *r, unsigned int arg),
+		      struct ring *r, unsigned int arg)
+{
+	for (int i = 0; i < RING_SPIN; i++) {
+		if (ready(r, arg)) {
+			return true;
+		}
+	}
+	while (!ready(r, arg)) {
+		__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+		if (ready(r, arg)) {
+			__atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+			break;
+		}
+		char buf[64];
+		int ret = read(doorbell_fd, buf, sizeof(buf));
+		if (ret == 0) {
+			return ready(r, arg);
+		}
+		assert(ret > 0 && "read doorbell failed");
+	}
+	return true;
+}
+
+/* Makes everything written so far visible to quicksand. */
+static void flush(struct messaging_state *state)
+{
+	struct ring *r = &state->rings->to_quicksand;
+	if (r->tail != state->send_pos) {
+		__atomic_store_n(&r->tail, state->send_pos, __ATOMIC_SEQ_CST);
+		ring_doorbell(state->output_fd, &r->consumer_waiting);
+	}
+}
+
+/* Writes a record, but doesn't publish it until the next flush() unless
+ * 'batch' is false. Data races come in bunches, and quicksand needn't hear
+ * about them until the end of the branch. */
+static void send_record(struct messaging_state *state, struct output_message *m,
+			const char *text, bool batch)
 {
 	assert(state->pipes_opened);
+	struct ring *r = &state->rings->to_quicksand;
 	m->magic = ID_WRAPPER_MAGIC;
-	int ret = write(state->output_fd, m, sizeof(struct output_message));
-	assert(ret == sizeof(struct output_message) && "write failed");
+
+	if (text == NULL) {
+		text = "";
+	}
+	unsigned int text_len = strlen(text) + 1;
+	assert(text_len <= RECORD_MAX_TEXT && "output msg text too long");
+	unsigned int size = RECORD_SIZE(sizeof(*m), text_len);
+
+	/* records don't wrap; pad out the end of the ring if need be */
+	unsigned int pos = state->send_pos;
+	unsigned int room = RING_SIZE - (pos & (RING_SIZE - 1));
+	unsigned int needed = size <= room ? size : room + size;
+	if (!ring_writable(r, pos + needed - RING_SIZE)) {
+		/* quicksand can't make room for what it can't see */
+		flush(state);
+		bool alive = ring_wait(state->input_fd, &r->producer_waiting,
+				       ring_writable, r, pos + needed - RING_SIZE);
+		assert(alive && "quicksand hung up while we waited to send");
+	}
+	struct record_header *h;
+	if (size > room) {
+		h = (struct record_header *)&r->buf[pos & (RING_SIZE - 1)];
+		h->size = room;
+		h->msg_size = 0;
+		pos += room;
+	}
+
+	h = (struct record_header *)&r->buf[pos & (RING_SIZE - 1)];
+	h->size = size;
+	h->msg_size = sizeof(*m);
+	memcpy(h + 1, m, sizeof(*m));
+	memcpy((char *)(h + 1) + sizeof(*m), text, text_len);
+	state->send_pos = pos + size;
+
+	if (!batch) {
+		flush(state);
+	}
 }
 
-static void recv(struct messaging_state *state, struct input_message *m)
+static void send(struct messaging_state *state, struct output_message *m,
+		 const char *text)
+{
+	send_record(state, m, text, false);
+}
+
+static void release(struct messaging_state *state, struct ring *r,
+		    unsigned int size)
+{
+	__atomic_store_n(&r->head, r->head + size, __ATOMIC_SEQ_CST);
+	ring_doorbell(state->output_fd, &r->producer_waiting);
+}
+
+static void learn_data_race(struct messaging_state *state, const char *text)
+{
+	struct ls_state *ls = container_of(state, struct ls_state, mess);
+	char space;
+	unsigned int x, y;
+	int z, w;
+	int ret = sscanf(text, "%c %x %x %d %d", &space, &x, &y, &z, &w);
+	assert(ret == 5 && (space == 'k' || space == 'u') &&
+	       "invalid known data race");
+	lsprintf(DEV, "learned of data race 0x%x/0x%x (%d %d) from quicksand\n",
+		 x, y, z, w);
+	mem_learn_data_race(space == 'k' ? &ls->kern_mem : &ls->user_mem,
+			    x, y, z != 0, w != 0);
+}
+
+/* Returns the message's text, valid until the next recv(). */
+static const char *recv(struct messaging_state *state, struct input_message *m)
 {
 	assert(state->pipes_opened);
-	int ret = read(state->input_fd, m, sizeof(struct input_message));
-	if (ret == 0) {
-		/* pipe closed */
-		m->tag = SHOULD_CONTINUE_REPLY;
-		m->value = true;
-	} else if (ret != sizeof(struct input_message)) {
-		assert(false && "read failed");
-	} else {
+	struct ring *r = &state->rings->to_landslide;
+
+	if (state->recv_pending != 0) {
+		release(state, r, state->recv_pending);
+		state->recv_pending = 0;
+	}
+
+	while (ring_wait(state->input_fd, &r->consumer_waiting,
+			 ring_readable, r, r->head)) {
+		struct record_header *h =
+			(struct record_header *)&r->buf[r->head & (RING_SIZE - 1)];
+		if (h->msg_size == 0) {
+			release(state, r, h->size);
+			continue;
+		}
+		assert(h->msg_size == sizeof(*m) && "wrong input msg size");
+		memcpy(m, h + 1, sizeof(*m));
 		assert(m->magic == ID_WRAPPER_MAGIC && "wrong magic");
+		const char *text = (const char *)(h + 1) + sizeof(*m);
+		if (m->tag == KNOWN_DATA_RACE) {
+			learn_data_race(state, text);
+			release(state, r, h->size);
+			continue;
+		}
+		state->recv_pending = h->size;
+		return text;
 	}
+
+	/* pipe closed */
+	m->tag = SHOULD_CONTINUE_REPLY;
+	m->value = true;
+	return "";
 }
 
 #else /* !defined ID_WRAPPER_MAGIC */
 
-static void send(struct messaging_state *state, struct output_message *m) { }
+static void send_record(struct messaging_state *state, struct output_message *m,
+			const char *text, bool batch) { }
+
+static void send(struct messaging_state *state, struct output_message *m,
+		 const char *text) { }
 
-static void recv(struct messaging_state *state, struct input_message *m) {
+static const char *recv(struct messaging_state *state, struct input_message *m) {
 	m->tag = SHOULD_CONTINUE_REPLY;
 	m->value = false;
+	return "";
 }
 
 #endif
@@ -123,18 +333,31 @@ static void recv(struct messaging_state *state, struct input_message *m) {
 void messaging_init(struct messaging_state *state)
 {
 	state->pipes_opened = false;
+	state->rings = NULL;
+	state->send_pos = 0;
+	state->recv_pending = 0;
 }
 
 void messaging_open_pipes(struct messaging_state *state,
-			  const char *input_name, const char *output_name)
+			  const char *input_name, const char *output_name,
+			  const char *rings_name)
 {
 #ifdef ID_WRAPPER_MAGIC
 	assert(!state->pipes_opened && "double call of messaging open pipes");
 	state->pipes_opened = true;
 
-	assert(input_name != NULL && output_name != NULL &&
+	assert(input_name != NULL && output_name != NULL && rings_name != NULL &&
 	       "have magic quicksand cookie but how do i get to warp zone?");
 
+	int rings_fd = open(rings_name, O_RDWR);
+	assert(rings_fd >= 0 && "opening message rings failed");
+	state->rings = mmap(NULL, sizeof(struct message_rings),
+			    PROT_READ | PROT_WRITE, MAP_SHARED, rings_fd, 0);
+	assert(state->rings != MAP_FAILED && "mapping message rings failed");
+	close(rings_fd);
+	assert(state->rings->magic == ID_WRAPPER_MAGIC && "wrong rings magic");
+	state->send_pos = state->rings->to_quicksand.tail;
+
 	/* See run_job() in id/job.c for the protocol. Order is important. */
 	lsprintf(INFO, "opening output pipe %s\n", output_name);
 	state->output_fd = open(output_name, O_WRONLY);
@@ -143,22 +366,23 @@ void messaging_open_pipes(struct messaging_state *state,
 
 	struct output_message m;
 	m.tag = THUNDERBIRDS_ARE_GO;
-	send(state, &m);
+	send(state, &m, NULL);
 
 	lsprintf(INFO, "opening input pipe %s\n", input_name);
 	state->input_fd = open(input_name, O_RDONLY);
 	lsprintf(INFO, "aim for the open spot\n");
 	assert(state->input_fd >= 0 && "opening input pipe failed");
 #else
-	assert(input_name == NULL && output_name == NULL &&
+	assert(input_name == NULL && output_name == NULL && rings_name == NULL &&
 	       "can't use messaging pipes without the magic quicksand cookie!");
 #endif
 }
 
 void message_data_race(struct messaging_state *state, unsigned int eip,
 		       unsigned int tid, unsigned int last_call,
-		       unsigned int most_recent_syscall, bool confirmed,
-		       bool deterministic, bool free_re_malloc)
+		       unsigned int most_recent_syscall, unsigned int other_eip,
+		       bool in_kernel, bool confirmed, bool deterministic,
+		       bool free_re_malloc)
 {
 	struct output_message m;
 	m.tag = DATA_RACE;
@@ -170,11 +394,13 @@ void message_data_race(struct messaging_state *state, unsigned int eip,
 #endif
 	m.content.dr.last_call = last_call;
 	m.content.dr.most_recent_syscall = most_recent_syscall;
+	m.content.dr.other_eip = other_eip;
+	m.content.dr.in_kernel = in_kernel;
 	m.content.dr.confirmed = confirmed;
 	m.content.dr.deterministic = deterministic;
 	m.content.dr.free_re_malloc = free_re_malloc;
 
-	char *buf = &m.content.dr.pretty_printed[0];
+	char buf[MESSAGE_BUF_SIZE];
 	struct stack_frame f;
 	unsigned int pos = 0;
 
@@ -190,11 +416,12 @@ void message_data_race(struct messaging_state *state, unsigned int eip,
 		destroy_frame(&f);
 	}
 
-	send(state, &m);
+	send_record(state, &m, buf, true);
 }
 
 uint64_t message_estimate(struct messaging_state *state, long double proportion,
 			  unsigned int elapsed_branches, long double total_usecs,
+			  long double total_usecs_lo, long double total_usecs_hi,
 			  unsigned long elapsed_usecs,
 			  unsigned int icb_preemptions, unsigned int icb_bound)
 {
@@ -203,10 +430,12 @@ uint64_t message_estimate(struct messaging_state *state, long double proportion,
 	m.content.estimate.proportion = proportion;
 	m.content.estimate.elapsed_branches = elapsed_branches;
 	m.content.estimate.total_usecs = total_usecs;
+	m.content.estimate.total_usecs_lo = total_usecs_lo;
+	m.content.estimate.total_usecs_hi = total_usecs_hi;
 	m.content.estimate.elapsed_usecs = elapsed_usecs;
 	//m.content.estimate.icb_preemption_count = icb_preemptions; // not needed
 	m.content.estimate.icb_cur_bound = icb_bound;
-	send(state, &m);
+	send(state, &m, NULL);
 
 	/* Ask whether or not our execution is being suspended. If so we must
 	 * record the pause and resume times to not screw up ETA estimates. */
@@ -239,22 +468,30 @@ void message_found_a_bug(struct messaging_state *state, const char *trace_filena
 {
 	struct output_message m;
 	m.tag = FOUND_A_BUG;
-	assert(strlen(trace_filename) < MESSAGE_BUF_SIZE && "name too long");
-	strcpy(m.content.bug.trace_filename, trace_filename);
 	m.content.bug.icb_preemption_count = icb_preemptions;
 	//m.content.bug.icb_cur_bound = icb_bound; // not needed
-	send(state, &m);
+	send(state, &m, trace_filename);
 }
 
-bool should_abort(struct messaging_state *state)
+/* If aborting, the master may also name a file to park the tree in, for some
+ * later landslide to resume; otherwise park_filename is set empty. */
+bool should_abort(struct messaging_state *state, char *park_filename,
+		  unsigned int park_filename_len)
 {
 	struct output_message m;
 	m.tag = SHOULD_CONTINUE;
-	send(state, &m);
+	send(state, &m, NULL);
 
 	struct input_message result;
-	recv(state, &result);
+	const char *park = recv(state, &result);
 	assert(result.tag == SHOULD_CONTINUE_REPLY);
+	if (result.value && park[0] != '\0') {
+		assert(strlen(park) < park_filename_len &&
+		       "park filename too long");
+		strcpy(park_filename, park);
+	} else {
+		park_filename[0] = '\0';
+	}
 	return result.value;
 }
 
@@ -263,7 +500,28 @@ void message_assert_fail(struct messaging_state *state, const char *message,
 {
 	struct output_message m;
 	m.tag = ASSERT_FAILED;
-	scnprintf(m.content.crash_report.assert_message, MESSAGE_BUF_SIZE,
-		  "%s:%u: %s(): %s", file, line, function, message);
-	send(state, &m);
+	char buf[MESSAGE_BUF_SIZE];
+	scnprintf(buf, MESSAGE_BUF_SIZE, "%s:%u: %s(): %s",
+		  file, line, function, message);
+	send(state, &m, buf);
+}
+
+bool message_job_finished(struct messaging_state *state, char *pps_filename,
+			  unsigned int pps_filename_len)
+{
+	struct output_message m;
+	m.tag = JOB_FINISHED;
+	send(state, &m, NULL);
+
+	struct input_message result;
+	const char *next_pps = recv(state, &result);
+	if (result.tag == NEXT_JOB && result.value) {
+		assert(strlen(next_pps) < pps_filename_len &&
+		       "next job's pp filename too long");
+		strcpy(pps_filename, next_pps);
+		return true;
+	} else {
+		/* no more work, pipe closed, or running in standalone mode */
+		return false;
+	}
 }
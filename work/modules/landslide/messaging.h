@@ -7,31 +7,48 @@
 #ifndef __LS_MESSAGING_H
 #define __LS_MESSAGING_H
 
+struct message_rings;
+
 struct messaging_state {
 	bool pipes_opened;
+	/* the fifos are only doorbells; messages go through the rings */
 	int input_fd;
 	int output_fd;
+	struct message_rings *rings;
+	/* end of records written but not yet published (batched data races) */
+	unsigned int send_pos;
+	/* size of the last record recv()d, released on the next recv() */
+	unsigned int recv_pending;
 };
 
 void messaging_init(struct messaging_state *m);
-void messaging_open_pipes(struct messaging_state *m, const char *i, const char *o);
+void messaging_open_pipes(struct messaging_state *m, const char *i, const char *o,
+			  const char *rings);
 
 #define DR_TID_WILDCARD 0x15410de0u /* 0 could be a valid tid */
 void message_data_race(struct messaging_state *m, unsigned int eip,
 		       unsigned int last_call, unsigned int tid,
-		       unsigned int most_recent_syscall, bool confirmed,
-		       bool deterministic, bool free_re_malloc);
+		       unsigned int most_recent_syscall, unsigned int other_eip,
+		       bool in_kernel, bool confirmed, bool deterministic,
+		       bool free_re_malloc);
 
 /* returns the # of useconds that landslide was put to sleep for */
 uint64_t message_estimate(struct messaging_state *m, long double proportion,
 			  unsigned int elapsed_branches, long double total_usecs,
+			  long double total_usecs_lo, long double total_usecs_hi,
 			  unsigned long elapsed_usecs,
 			  unsigned int icb_preemptions, unsigned int icb_bound);
 
 void message_found_a_bug(struct messaging_state *m, const char *trace_filename,
 			 unsigned int icb_preemptions, unsigned int icb_bound);
 
-bool should_abort(struct messaging_state *m);
+bool should_abort(struct messaging_state *m, char *park_filename,
+		  unsigned int park_filename_len);
+
+/* For warm workers. Returns true, with the filename of the next job's dynamic
+ * PPs, if the master has more work for us; false if we should quit. */
+bool message_job_finished(struct messaging_state *m, char *pps_filename,
+			  unsigned int pps_filename_len);
 
 void message_assert_fail(struct messaging_state *state, const char *message,
 			 const char *file, unsigned int line, const char *function);
@@ -15,6 +15,7 @@
 #include "kspec.h"
 #include "landslide.h"
 #include "pp.h"
+#include "save.h"
 #include "stack.h"
 #include "student_specifics.h"
 #include "x86.h"
@@ -27,6 +28,8 @@ void pps_init(struct pp_config *p)
 	ARRAY_LIST_INIT(&p->data_races,   16);
 	p->output_pipe_filename = NULL;
 	p->input_pipe_filename  = NULL;
+	p->message_rings_filename = NULL;
+	p->parked_tree_filename = NULL;
 
 	/* Load PPs from static config (e.g. if not running under quicksand) */
 
@@ -63,13 +66,8 @@ void pps_init(struct pp_config *p)
 	}
 }
 
-bool load_dynamic_pps(struct ls_state *ls, const char *filename)
+static void parse_dynamic_pps(struct pp_config *p, const char *filename)
 {
-	struct pp_config *p = &ls->pps;
-	if (p->dynamic_pps_loaded) {
-		return false;
-	}
-
 	lsprintf(DEV, "using dynamic PPs from %s\n", filename);
 	FILE *pp_file = fopen(filename, "r");
 	assert(pp_file != NULL && "failed open pp file");
@@ -94,6 +92,20 @@ bool load_dynamic_pps(struct ls_state *ls, const char *filename)
 			assert(p->input_pipe_filename == NULL);
 			p->input_pipe_filename = MM_XSTRDUP(buf + 2);
 			lsprintf(DEV, "input %s\n", p->input_pipe_filename);
+		} else if (buf[0] == 'R') {
+			/* shared memory for the messages themselves */
+			assert(buf[1] == ' ');
+			assert(buf[2] != ' ' && buf[2] != '\0');
+			assert(p->message_rings_filename == NULL);
+			p->message_rings_filename = MM_XSTRDUP(buf + 2);
+			lsprintf(DEV, "rings %s\n", p->message_rings_filename);
+		} else if (buf[0] == 'P') {
+			/* parked exploration tree to resume */
+			assert(buf[1] == ' ');
+			assert(buf[2] != ' ' && buf[2] != '\0');
+			assert(p->parked_tree_filename == NULL);
+			p->parked_tree_filename = MM_XSTRDUP(buf + 2);
+			lsprintf(DEV, "parked tree %s\n", p->parked_tree_filename);
 		} else if ((ret = sscanf(buf, "K %x %x %i", &x, &y, &z)) != 0) {
 			/* kernel within function directive */
 			assert(ret == 3 && "invalid kernel within PP");
@@ -130,14 +142,52 @@ bool load_dynamic_pps(struct ls_state *ls, const char *filename)
 	if (unlink(filename) < 0) {
 		lsprintf(DEV, "warning: failed rm temp PP file %s\n", filename);
 	}
+}
+
+bool load_dynamic_pps(struct ls_state *ls, const char *filename)
+{
+	struct pp_config *p = &ls->pps;
+	if (p->dynamic_pps_loaded) {
+		return false;
+	}
 
+	parse_dynamic_pps(p, filename);
 	p->dynamic_pps_loaded = true;
 
 	messaging_open_pipes(&ls->mess, p->input_pipe_filename,
-			     p->output_pipe_filename);
+			     p->output_pipe_filename, p->message_rings_filename);
+	if (p->parked_tree_filename != NULL) {
+		save_unpark(&ls->save, ls, p->parked_tree_filename);
+	}
 	return true;
 }
 
+/* Swaps out the current job's PPs for the next one's, for warm workers. The
+ * messaging pipes stay open, so the new file must not name any. */
+void reload_dynamic_pps(struct ls_state *ls, const char *filename)
+{
+	struct pp_config *p = &ls->pps;
+	char *input_pipe_filename  = p->input_pipe_filename;
+	char *output_pipe_filename = p->output_pipe_filename;
+	char *message_rings_filename = p->message_rings_filename;
+	assert(p->dynamic_pps_loaded);
+
+	ARRAY_LIST_FREE(&p->kern_withins);
+	ARRAY_LIST_FREE(&p->user_withins);
+	ARRAY_LIST_FREE(&p->data_races);
+	MM_FREE(p->parked_tree_filename);
+	pps_init(p);
+
+	parse_dynamic_pps(p, filename);
+	assert(p->input_pipe_filename == NULL && p->output_pipe_filename == NULL
+	       && p->message_rings_filename == NULL
+	       && "warm worker's next job tried to change messaging pipes");
+	p->input_pipe_filename  = input_pipe_filename;
+	p->output_pipe_filename = output_pipe_filename;
+	p->message_rings_filename = message_rings_filename;
+	p->dynamic_pps_loaded = true;
+}
+
 static bool check_withins(struct ls_state *ls, pp_within_list_t *pps)
 {
 #ifndef PREEMPT_EVERYWHERE
@@ -39,10 +39,14 @@ struct pp_config {
 	ARRAY_LIST(struct pp_data_race) data_races;
 	char *output_pipe_filename;
 	char *input_pipe_filename;
+	char *message_rings_filename;
+	/* a tree another landslide parked, to pick up where it left off */
+	char *parked_tree_filename;
 };
 
 void pps_init(struct pp_config *p);
 bool load_dynamic_pps(struct ls_state *ls, const char *filename);
+void reload_dynamic_pps(struct ls_state *ls, const char *filename);
 
 bool kern_within_functions(struct ls_state *ls);
 bool user_within_functions(struct ls_state *ls);
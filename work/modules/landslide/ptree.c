@@ -0,0 +1,443 @@
+/**
+ * @file ptree.c
+ * @brief persistent (path-copying) balanced trees, for cheap snapshots
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#define MODULE_NAME "PTREE"
+#define MODULE_COLOUR COLOUR_DARK COLOUR_GREY
+
+#include "common.h"
+#include "compiler.h"
+#include "ptree.h"
+
+struct pt_node {
+	unsigned int refcount; /* versions and parent nodes pointing here */
+	unsigned int height;
+	unsigned int key;
+	void *value;
+	struct pt_node *left;
+	struct pt_node *right;
+};
+
+/* Convention for the recursive helpers below: each takes over the caller's
+ * reference to the subtree passed in, and returns one to the subtree that
+ * replaces it. */
+
+static unsigned int height(const struct pt_node *n)
+{
+	return n == NULL ? 0 : n->height;
+}
+
+static void fix_height(struct pt_node *n)
+{
+	n->height = 1 + MAX(height(n->left), height(n->right));
+}
+
+static struct pt_node *node_new(unsigned int key, void *value)
+{
+	struct pt_node *n = MM_XMALLOC(1, struct pt_node);
+	n->refcount = 1;
+	n->height = 1;
+	n->key = key;
+	n->value = value;
+	n->left = NULL;
+	n->right = NULL;
+	return n;
+}
+
+static void node_put(const struct ptree_ops *ops, struct pt_node *n)
+{
+	if (n == NULL) {
+		return;
+	}
+	assert(n->refcount > 0);
+	if (--n->refcount == 0) {
+		node_put(ops, n->left);
+		node_put(ops, n->right);
+		ops->release(n->value);
+		MM_FREE(n);
+	}
+}
+
+/* Makes the node safe to modify: returns it as is if no other version or
+ * parent shares it, or else a private copy of it, sharing its children. */
+static struct pt_node *node_own(const struct ptree_ops *ops, struct pt_node *n)
+{
+	assert(n != NULL && n->refcount > 0);
+	if (n->refcount == 1) {
+		return n;
+	}
+	struct pt_node *copy = node_new(n->key, n->value);
+	copy->height = n->height;
+	copy->left = n->left;
+	copy->right = n->right;
+	if (copy->left != NULL) {
+		copy->left->refcount++;
+	}
+	if (copy->right != NULL) {
+		copy->right->refcount++;
+	}
+	ops->retain(copy->value);
+	n->refcount--; /* the caller's reference moves to the copy */
+	return copy;
+}
+
+/* n, and its child on the side rotated from, must already be owned */
+static struct pt_node *rotate_right(struct pt_node *n)
+{
+	struct pt_node *l = n->left;
+	n->left = l->right;
+	l->right = n;
+	fix_height(n);
+	fix_height(l);
+	return l;
+}
+
+static struct pt_node *rotate_left(struct pt_node *n)
+{
+	struct pt_node *r = n->right;
+	n->right = r->left;
+	r->left = n;
+	fix_height(n);
+	fix_height(r);
+	return r;
+}
+
+/* n must be owned, with subtrees each already balanced. */
+static struct pt_node *rebalance(const struct ptree_ops *ops, struct pt_node *n)
+{
+	int balance = (int)height(n->left) - (int)height(n->right);
+	if (balance > 1) {
+		n->left = node_own(ops, n->left);
+		if (height(n->left->left) < height(n->left->right)) {
+			n->left->right = node_own(ops, n->left->right);
+			n->left = rotate_left(n->left);
+		}
+		return rotate_right(n);
+	} else if (balance < -1) {
+		n->right = node_own(ops, n->right);
+		if (height(n->right->right) < height(n->right->left)) {
+			n->right->left = node_own(ops, n->right->left);
+			n->right = rotate_right(n->right);
+		}
+		return rotate_left(n);
+	} else {
+		fix_height(n);
+		return n;
+	}
+}
+
+static struct pt_node *insert_node(const struct ptree_ops *ops,
+				   struct pt_node *n, unsigned int key,
+				   void *value, bool *replaced)
+{
+	if (n == NULL) {
+		return node_new(key, value);
+	}
+	n = node_own(ops, n);
+	if (key < n->key) {
+		n->left = insert_node(ops, n->left, key, value, replaced);
+	} else if (key > n->key) {
+		n->right = insert_node(ops, n->right, key, value, replaced);
+	} else {
+		ops->release(n->value);
+		n->value = value;
+		*replaced = true;
+		return n;
+	}
+	return rebalance(ops, n);
+}
+
+/* Unlinks the leftmost node of a nonempty subtree, handing back its key and
+ * (the reference to) its value. */
+static struct pt_node *remove_min_node(const struct ptree_ops *ops,
+				       struct pt_node *n, unsigned int *key,
+				       void **value)
+{
+	n = node_own(ops, n);
+	if (n->left == NULL) {
+		struct pt_node *right = n->right;
+		*key = n->key;
+		*value = n->value;
+		MM_FREE(n);
+		return right;
+	}
+	n->left = remove_min_node(ops, n->left, key, value);
+	return rebalance(ops, n);
+}
+
+/* The key must be present (else this would copy a path for nothing). */
+static struct pt_node *remove_node(const struct ptree_ops *ops,
+				   struct pt_node *n, unsigned int key,
+				   void **value)
+{
+	assert(n != NULL && "removing key not in ptree");
+	n = node_own(ops, n);
+	if (key < n->key) {
+		n->left = remove_node(ops, n->left, key, value);
+	} else if (key > n->key) {
+		n->right = remove_node(ops, n->right, key, value);
+	} else {
+		*value = n->value;
+		if (n->left == NULL || n->right == NULL) {
+			struct pt_node *child =
+				n->left != NULL ? n->left : n->right;
+			MM_FREE(n);
+			return child;
+		}
+		n->right = remove_min_node(ops, n->right, &n->key, &n->value);
+	}
+	return rebalance(ops, n);
+}
+
+/******************************************************************************
+ * Interface
+ ******************************************************************************/
+
+void ptree_init(struct ptree *t, const struct ptree_ops *ops)
+{
+	t->root = NULL;
+	t->size = 0;
+	t->ops = ops;
+}
+
+/* dest must not hold a tree already */
+void ptree_copy(struct ptree *dest, const struct ptree *src)
+{
+	dest->root = src->root;
+	dest->size = src->size;
+	dest->ops = src->ops;
+	if (dest->root != NULL) {
+		dest->root->refcount++;
+	}
+}
+
+void ptree_destroy(struct ptree *t)
+{
+	node_put(t->ops, t->root);
+	t->root = NULL;
+	t->size = 0;
+}
+
+void *ptree_find(const struct ptree *t, unsigned int key)
+{
+	const struct pt_node *n = t->root;
+	while (n != NULL) {
+		if (key < n->key) {
+			n = n->left;
+		} else if (key > n->key) {
+			n = n->right;
+		} else {
+			return n->value;
+		}
+	}
+	return NULL;
+}
+
+void *ptree_find_le(const struct ptree *t, unsigned int key,
+		    unsigned int *found_key)
+{
+	const struct pt_node *n = t->root;
+	const struct pt_node *best = NULL;
+	while (n != NULL) {
+		if (key < n->key) {
+			n = n->left;
+		} else {
+			best = n;
+			n = n->right;
+		}
+	}
+	if (best == NULL) {
+		return NULL;
+	}
+	if (found_key != NULL) {
+		*found_key = best->key;
+	}
+	return best->value;
+}
+
+bool ptree_insert(struct ptree *t, unsigned int key, void *value)
+{
+	bool replaced = false;
+	t->root = insert_node(t->ops, t->root, key, value, &replaced);
+	if (!replaced) {
+		t->size++;
+	}
+	return replaced;
+}
+
+void *ptree_remove(struct ptree *t, unsigned int key)
+{
+	if (ptree_find(t, key) == NULL) {
+		return NULL;
+	}
+	void *value = NULL;
+	t->root = remove_node(t->ops, t->root, key, &value);
+	assert(t->size > 0);
+	t->size--;
+	return value;
+}
+
+static void foreach_node(const struct pt_node *n,
+			 void (*f)(unsigned int key, void *value, void *arg),
+			 void *arg)
+{
+	if (n == NULL) {
+		return;
+	}
+	foreach_node(n->left, f, arg);
+	f(n->key, n->value, arg);
+	foreach_node(n->right, f, arg);
+}
+
+void ptree_foreach(const struct ptree *t,
+		   void (*f)(unsigned int key, void *value, void *arg), void *arg)
+{
+	foreach_node(t->root, f, arg);
+}
+
+#if 0
+static unsigned int test_live_values = 0;
+
+struct test_value {
+	unsigned int refcount;
+	unsigned int key;
+};
+
+static void test_retain(void *value)
+{
+	((struct test_value *)value)->refcount++;
+}
+
+static void test_release(void *value)
+{
+	struct test_value *v = (struct test_value *)value;
+	assert(v->refcount > 0);
+	if (--v->refcount == 0) {
+		assert(test_live_values > 0);
+		test_live_values--;
+		MM_FREE(v);
+	}
+}
+
+static const struct ptree_ops test_ops = {
+	.retain = test_retain,
+	.release = test_release,
+};
+
+static struct test_value *test_value_new(unsigned int key)
+{
+	struct test_value *v = MM_XMALLOC(1, struct test_value);
+	v->refcount = 1;
+	v->key = key;
+	test_live_values++;
+	return v;
+}
+
+/* checks AVL balance, heights, ordering (lo <= keys < hi), and values; returns
+ * the node count */
+static unsigned int test_check_node(const struct pt_node *n,
+				    unsigned long long lo, unsigned long long hi)
+{
+	if (n == NULL) {
+		return 0;
+	}
+	assert(n->refcount > 0);
+	assert(n->key >= lo && n->key < hi);
+	assert(((struct test_value *)n->value)->key == n->key);
+	int balance = (int)height(n->left) - (int)height(n->right);
+	assert(balance >= -1 && balance <= 1);
+	assert(n->height == 1 + MAX(height(n->left), height(n->right)));
+	return 1 + test_check_node(n->left, lo, n->key) +
+		test_check_node(n->right, n->key + 1ULL, hi);
+}
+
+static void test_check(const struct ptree *t)
+{
+	assert(test_check_node(t->root, 0, UINT_MAX + 1ULL) == t->size);
+}
+
+#define TEST_KEYS 512
+#define TEST_SNAPSHOTS 8
+
+void ptree_test()
+{
+	struct ptree t;
+	struct ptree snapshots[TEST_SNAPSHOTS];
+	/* which keys each snapshot had, to check later changes don't show */
+	bool present[TEST_SNAPSHOTS + 1][TEST_KEYS] = {{ false }};
+	bool *now = present[TEST_SNAPSHOTS];
+	unsigned int seed = 15410;
+
+	ptree_init(&t, &test_ops);
+	test_check(&t);
+	assert(ptree_find(&t, 0) == NULL);
+	assert(ptree_find_le(&t, 0, NULL) == NULL);
+	assert(ptree_remove(&t, 0) == NULL);
+
+	/* ascending inserts, the classic way to unbalance a naive tree */
+	for (unsigned int key = 0; key < TEST_KEYS; key += 2) {
+		assert(!ptree_insert(&t, key, test_value_new(key)));
+		now[key] = true;
+		test_check(&t);
+	}
+	assert(t.size == TEST_KEYS / 2);
+	assert(height(t.root) <= 9); /* ~1.44 log2(256) */
+
+	unsigned int found_key;
+	struct test_value *v = ptree_find_le(&t, 7, &found_key);
+	assert(v != NULL && v->key == 6 && found_key == 6);
+	v = ptree_find_le(&t, 8, &found_key);
+	assert(v != NULL && v->key == 8 && found_key == 8);
+
+	/* a mix of inserts, replacements, and removes, snapshotting as we go */
+	for (unsigned int s = 0; s < TEST_SNAPSHOTS; s++) {
+		ptree_copy(&snapshots[s], &t);
+		memcpy(present[s], now, sizeof(present[s]));
+
+		for (unsigned int i = 0; i < TEST_KEYS; i++) {
+			seed = seed * 1103515245 + 12345;
+			unsigned int key = (seed >> 16) % TEST_KEYS;
+			if (now[key] && (seed & 1)) {
+				v = ptree_remove(&t, key);
+				assert(v != NULL && v->key == key);
+				test_release(v);
+				now[key] = false;
+			} else {
+				bool replaced =
+					ptree_insert(&t, key, test_value_new(key));
+				assert(replaced == now[key]);
+				now[key] = true;
+			}
+			test_check(&t);
+		}
+
+		/* nothing that happened since should show in any snapshot */
+		for (unsigned int s2 = 0; s2 <= s; s2++) {
+			test_check(&snapshots[s2]);
+			for (unsigned int key = 0; key < TEST_KEYS; key++) {
+				assert((ptree_find(&snapshots[s2], key) != NULL)
+				       == present[s2][key]);
+			}
+		}
+	}
+
+	for (unsigned int key = 0; key < TEST_KEYS; key++) {
+		assert((ptree_find(&t, key) != NULL) == now[key]);
+	}
+
+	/* every version shares values with the others; none may be freed until
+	 * the last one referencing it is */
+	for (unsigned int s = 0; s < TEST_SNAPSHOTS; s++) {
+		ptree_destroy(&snapshots[s]);
+		assert(snapshots[s].root == NULL && snapshots[s].size == 0);
+		test_check(&t);
+	}
+	assert(test_live_values == t.size);
+	ptree_destroy(&t);
+	assert(test_live_values == 0);
+}
+#undef TEST_KEYS
+#undef TEST_SNAPSHOTS
+#endif
@@ -0,0 +1,53 @@
+/**
+ * @file ptree.h
+ * @brief persistent (path-copying) balanced trees, for cheap snapshots
+ * @author Ben Blum <bblum@andrew.cmu.edu>
+ */
+
+#ifndef __LS_PTREE_H
+#define __LS_PTREE_H
+
+#include <stdbool.h>
+
+/* An AVL tree map from unsigned int keys to values, whose nodes are reference
+ * counted and shared between all the copies ("versions") of the tree. Copying
+ * a tree is O(1); a change to one copy copies only the nodes on the path to
+ * the changed key (and only those still shared with another version), so it's
+ * O(log n), and the other versions never see it. Values are treated as
+ * immutable once inserted: to change one, insert a new value over it. Values
+ * may not be NULL.
+ *
+ * Since path copying duplicates nodes but not their values, a value may hang
+ * off several nodes (of one version or many), so each kind of tree says how to
+ * count references to its values. */
+struct ptree_ops {
+	void (*retain)(void *value);
+	void (*release)(void *value); /* frees it once unreferenced */
+};
+
+struct pt_node;
+
+struct ptree {
+	struct pt_node *root;
+	unsigned int size;
+	const struct ptree_ops *ops;
+};
+
+void ptree_init(struct ptree *t, const struct ptree_ops *ops);
+void ptree_copy(struct ptree *dest, const struct ptree *src);
+void ptree_destroy(struct ptree *t);
+
+void *ptree_find(const struct ptree *t, unsigned int key);
+/* the value with the greatest key <= the given key, or NULL */
+void *ptree_find_le(const struct ptree *t, unsigned int key,
+		    unsigned int *found_key);
+/* takes the caller's reference to value; returns true if it replaced one */
+bool ptree_insert(struct ptree *t, unsigned int key, void *value);
+/* returns the value, with a reference now owned by the caller, or NULL */
+void *ptree_remove(struct ptree *t, unsigned int key);
+
+/* in key order */
+void ptree_foreach(const struct ptree *t,
+		   void (*f)(unsigned int key, void *value, void *arg), void *arg);
+
+#endif
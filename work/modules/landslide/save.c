@@ -5,6 +5,7 @@
  */
 
 #include <inttypes.h>
+#include <stdio.h> /* for parked tree files */
 #include <string.h> /* for memcmp, strlen */
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -25,6 +26,7 @@
 #include "landslide.h"
 #include "lockset.h"
 #include "memory.h"
+#include "ptree.h"
 #include "save.h"
 #include "schedule.h"
 #include "stack.h"
@@ -127,6 +129,9 @@ static void copy_malloc_actions(struct malloc_actions *dest, const struct malloc
 	dest->palloc_request_size = src->palloc_request_size;
 }
 
+/* The agent struct itself must be copied, to be linked into the new state's
+ * queues, but its locksets, clock, and pre-vanish trace are only shared (see
+ * lockset.h, vector_clock.h), so this costs the same however long it's run. */
 #define COPY_FIELD(name) do { a_dest->name = a_src->name; } while (0)
 static struct agent *copy_agent(struct agent *a_src)
 {
@@ -202,7 +207,7 @@ static struct agent *copy_agent(struct agent *a_src)
 	copy_malloc_actions(&a_dest->user_malloc_flags, &a_src->user_malloc_flags);
 #endif
 	a_dest->pre_vanish_trace = (a_src->pre_vanish_trace == NULL) ?
-		NULL : copy_stack_trace(a_src->pre_vanish_trace);
+		NULL : share_stack_trace(a_src->pre_vanish_trace);
 
 	a_dest->do_explore = false;
 
@@ -279,7 +284,7 @@ static void copy_sched(struct sched_state *dest, const struct sched_state *src)
 	dest->voluntary_resched_tid  = src->voluntary_resched_tid;
 	dest->voluntary_resched_stack =
 		(src->voluntary_resched_stack == NULL) ? NULL :
-			copy_stack_trace(src->voluntary_resched_stack);
+			share_stack_trace(src->voluntary_resched_stack);
 	lockset_clone(&dest->known_semaphores, &src->known_semaphores);
 #ifdef PURE_HAPPENS_BEFORE
 	lock_clocks_copy(&dest->lock_clocks, &src->lock_clocks);
@@ -304,48 +309,13 @@ static void copy_test(struct test_state *dest, const struct test_state *src)
 		dest->current_test = MM_XSTRDUP(src->current_test);
 	}
 }
-static struct rb_node *dup_chunk(const struct rb_node *nobe,
-				 const struct rb_node *parent)
-{
-	if (nobe == NULL)
-		return NULL;
-
-	struct chunk *src = rb_entry(nobe, struct chunk, nobe);
-	struct chunk *dest = MM_XMALLOC(1, struct chunk);
-
-	/* dup rb node contents */
-	int colour_flag = src->nobe.rb_parent_color & 1;
-
-	assert(((unsigned long)parent & 1) == 0);
-	dest->nobe.rb_parent_color = (unsigned long)parent | colour_flag;
-	dest->nobe.rb_right = dup_chunk(src->nobe.rb_right, &dest->nobe);
-	dest->nobe.rb_left  = dup_chunk(src->nobe.rb_left, &dest->nobe);
-
-	dest->base = src->base;
-	dest->len  = src->len;
-	dest->id   = src->id;
-
-	if (src->malloc_trace == NULL) {
-		dest->malloc_trace = NULL;
-	} else {
-		dest->malloc_trace = copy_stack_trace(src->malloc_trace);
-	}
-	if (src->free_trace == NULL) {
-		dest->free_trace = NULL;
-	} else {
-		dest->free_trace = copy_stack_trace(src->free_trace);
-	}
-
-	dest->pages_reserved_for_malloc = src->pages_reserved_for_malloc;
-
-	return &dest->nobe;
-}
 static void copy_mem(struct mem_state *dest, const struct mem_state *src, bool in_tree)
 {
 	dest->guest_init_done     = src->guest_init_done;
 	dest->in_mm_init          = src->in_mm_init;
-	dest->malloc_heap.rb_node = dup_chunk(src->malloc_heap.rb_node, NULL);
-	dest->palloc_heap.rb_node = dup_chunk(src->palloc_heap.rb_node, NULL);
+	/* persistent; no copying, just sharing (see ptree.h) */
+	ptree_copy(&dest->malloc_heap, &src->malloc_heap);
+	ptree_copy(&dest->palloc_heap, &src->palloc_heap);
 	dest->heap_size           = src->heap_size;
 	dest->heap_next_id        = src->heap_next_id;
 #ifndef ALLOW_REENTRANT_MALLOC_FREE
@@ -479,10 +449,8 @@ static void free_shm(struct rb_node *nobe)
 
 static void free_mem(struct mem_state *m, bool in_tree)
 {
-	free_heap(m->malloc_heap.rb_node);
-	m->malloc_heap.rb_node = NULL;
-	free_heap(m->palloc_heap.rb_node);
-	m->palloc_heap.rb_node = NULL;
+	ptree_destroy(&m->malloc_heap);
+	ptree_destroy(&m->palloc_heap);
 	free_shm(m->shm.rb_node);
 	m->shm.rb_node = NULL;
 	free_heap(m->freed.rb_node);
@@ -563,6 +531,27 @@ static void free_hax(struct hax *h)
 	free_haxs_children(h);
 }
 
+/* Copy that which is not glowing green. */
+static void save_ls(struct hax *h, struct ls_state *ls)
+{
+	h->oldsched = MM_XMALLOC(1, struct sched_state);
+	copy_sched(h->oldsched, &ls->sched);
+
+	h->oldtest = MM_XMALLOC(1, struct test_state);
+	copy_test(h->oldtest, &ls->test);
+
+	h->old_kern_mem = MM_XMALLOC(1, struct mem_state);
+	copy_mem(h->old_kern_mem, &ls->kern_mem, true);
+
+	h->old_user_mem = MM_XMALLOC(1, struct mem_state);
+	copy_mem(h->old_user_mem, &ls->user_mem, true);
+
+	h->old_user_sync = MM_XMALLOC(1, struct user_sync_state);
+	copy_user_sync(h->old_user_sync, &ls->user_sync, 0);
+
+	h->old_symtable = get_symtable();
+}
+
 /* Reverse that which is not glowing green. */
 static void restore_ls(struct ls_state *ls, struct hax *h)
 {
@@ -726,12 +715,137 @@ static void shimsham_shm(struct ls_state *ls, struct hax *h, bool in_kernel)
 	}
 }
 
+/******************************************************************************
+ * parked trees
+ ******************************************************************************/
+
+/* A parked tree is what a later landslide needs to pick up exploration where a
+ * cancelled one left off: the branch from the root to the nobe it was about to
+ * backtrack to, which it re-executes by making the same choices again, plus
+ * enough about everything off that branch for explore() and the estimator to
+ * behave as though it had been there all along. Off-branch nobes are stateless
+ * husks in the live tree anyway, so recreating them as such loses nothing.
+ *
+ * The file is text, one directive per line:
+ *   S <choice poince> <choices> <jumps> <triggers> <depth total> <usecs> <tid>
+ *   N <tid> <eip> <all explored> <is pp> <marked> <usecs> <prop> <subtree usecs>
+ *   C <tid>  -- an already-explored child of the last N, off the branch
+ *   T <tid>  -- a child of the last N tagged for exploration
+ *   D <k|u> <first eip> <other eip> <first before other> <other before first>
+ * The S line's tid is the one the frontier nobe (the last N) will run next. */
+
+struct parked_nobe {
+	int chosen_thread;
+	unsigned int eip;
+	bool all_explored;
+	bool is_preemption_point;
+	unsigned long marked_children;
+	uint64_t usecs;
+	long double proportion;
+	long double subtree_usecs;
+	ARRAY_LIST(int) explored_children;
+	ARRAY_LIST(int) tagged_children;
+};
+
+struct parked_tree {
+	ARRAY_LIST(struct parked_nobe) path;
+	int next_tid;
+	/* save_state stats as of the park, as though it had longjmped */
+	uint64_t total_choice_poince;
+	uint64_t total_choices;
+	uint64_t total_jumps;
+	uint64_t total_triggers;
+	uint64_t depth_total;
+	uint64_t total_usecs;
+	struct estimate_spread spread;
+};
+
+static void free_parked_tree(struct parked_tree *p)
+{
+	unsigned int i;
+	struct parked_nobe *n;
+	ARRAY_LIST_FOREACH(&p->path, i, n) {
+		ARRAY_LIST_FREE(&n->explored_children);
+		ARRAY_LIST_FREE(&n->tagged_children);
+	}
+	ARRAY_LIST_FREE(&p->path);
+	MM_FREE(p);
+}
+
+/* Called on each new nobe while retracing a parked tree's branch. Gives it back
+ * its off-branch children, tags, and estimates, or gives up on the resume if
+ * this execution didn't go the way the parked one did. */
+static void resume_nobe(struct save_state *ss, struct hax *h)
+{
+	struct parked_tree *p = ss->resume;
+	assert(p != NULL);
+	assert(h->depth < ARRAY_LIST_SIZE(&p->path));
+	struct parked_nobe *n = ARRAY_LIST_GET(&p->path, h->depth);
+
+	if (h->chosen_thread != n->chosen_thread || h->eip != n->eip) {
+		lsprintf(ALWAYS, COLOUR_BOLD COLOUR_YELLOW "Parked tree diverged "
+			 "at #%d (tid %d at 0x%x, expected tid %d at 0x%x); "
+			 "exploring afresh from here.\n" COLOUR_DEFAULT, h->depth,
+			 h->chosen_thread, h->eip, n->chosen_thread, n->eip);
+		free_parked_tree(p);
+		ss->resume = NULL;
+		return;
+	}
+
+	unsigned int i;
+	int *tid;
+	ARRAY_LIST_FOREACH(&n->explored_children, i, tid) {
+		struct hax *child = MM_XMALLOC(1, struct hax);
+		memset(child, 0, sizeof(*child));
+		child->chosen_thread = *tid;
+		child->parent = h;
+		child->depth = h->depth + 1;
+		child->all_explored = true;
+		Q_INIT_HEAD(&child->children);
+		Q_INSERT_TAIL(&h->children, child, sibling);
+	}
+
+	struct agent *a;
+	FOR_EACH_RUNNABLE_AGENT(a, h->oldsched,
+		a->do_explore = false;
+		ARRAY_LIST_FOREACH(&n->tagged_children, i, tid) {
+			if (*tid == a->tid) {
+				a->do_explore = true;
+			}
+		}
+	);
+
+	h->all_explored = n->all_explored;
+	h->is_preemption_point = h->is_preemption_point || n->is_preemption_point;
+	h->marked_children = n->marked_children;
+	h->usecs = n->usecs;
+	h->proportion = n->proportion;
+	h->subtree_usecs = n->subtree_usecs;
+
+	if (h->depth + 1 == ARRAY_LIST_SIZE(&p->path)) {
+		/* Reached the frontier; next is the choice it was parked on. */
+		ss->total_choice_poince = p->total_choice_poince;
+		ss->total_choices       = p->total_choices;
+		ss->total_jumps         = p->total_jumps;
+		ss->total_triggers      = p->total_triggers;
+		ss->depth_total         = p->depth_total;
+		ss->total_usecs         = p->total_usecs;
+		ss->spread              = p->spread;
+		lsprintf(ALWAYS, COLOUR_BOLD COLOUR_GREEN "Resumed parked tree "
+			 "at #%d; continuing with TID %d.\n" COLOUR_DEFAULT,
+			 h->depth, p->next_tid);
+		free_parked_tree(p);
+		ss->resume = NULL;
+	}
+}
+
 /******************************************************************************
  * interface
  ******************************************************************************/
 
 void save_init(struct save_state *ss)
 {
+	ss->warm_start = NULL;
 	ss->root = NULL;
 	ss->current = NULL;
 	ss->next_tid = -1;
@@ -741,6 +855,8 @@ void save_init(struct save_state *ss)
 	ss->total_triggers = 0;
 	ss->depth_total = 0;
 	ss->total_usecs = 0;
+	estimate_spread_init(&ss->spread);
+	ss->resume = NULL;
 
 	update_time(&ss->last_save_time);
 }
@@ -878,22 +994,7 @@ void save_setjmp(struct save_state *ss, struct ls_state *ls,
 		assert(!h->all_explored); /* exploration invariant */
 	}
 
-	h->oldsched = MM_XMALLOC(1, struct sched_state);
-	copy_sched(h->oldsched, &ls->sched);
-
-	h->oldtest = MM_XMALLOC(1, struct test_state);
-	copy_test(h->oldtest, &ls->test);
-
-	h->old_kern_mem = MM_XMALLOC(1, struct mem_state);
-	copy_mem(h->old_kern_mem, &ls->kern_mem, true);
-
-	h->old_user_mem = MM_XMALLOC(1, struct mem_state);
-	copy_mem(h->old_user_mem, &ls->user_mem, true);
-
-	h->old_user_sync = MM_XMALLOC(1, struct user_sync_state);
-	copy_user_sync(h->old_user_sync, &ls->user_sync, 0);
-
-	h->old_symtable = get_symtable();
+	save_ls(h, ls);
 
 	if (h->depth > 0) {
 		h->conflicts      = MM_XMALLOC(h->depth, bool);
@@ -941,6 +1042,10 @@ void save_setjmp(struct save_state *ss, struct ls_state *ls,
 
 	run_command(ls->cmd_file, CMD_BOOKMARK, (lang_void *)h);
 	ss->total_choices++;
+
+	if (ss->resume != NULL) {
+		resume_nobe(ss, h);
+	}
 }
 
 void save_longjmp(struct save_state *ss, struct ls_state *ls, struct hax *h)
@@ -1012,6 +1117,7 @@ void save_reset_tree(struct save_state *ss, struct ls_state *ls)
 	ss->total_triggers = 0;
 	ss->depth_total = 0;
 	ss->total_usecs = root->usecs;
+	estimate_spread_init(&ss->spread);
 }
 #else
 void save_reset_tree(struct save_state *ss, struct ls_state *ls)
@@ -1019,3 +1125,264 @@ void save_reset_tree(struct save_state *ss, struct ls_state *ls)
 	assert(0 && "how did this get here i am not good with computer");
 }
 #endif
+
+#ifdef WARM_WORKER
+/* Snapshots the state at the start of the test, before any PPs could have
+ * mattered, to rewind to when a warm worker is given its next job. The root of
+ * the tree is no good for this, being placed at the first PP after the test
+ * spawns threads -- where that is depends on the job's PPs. */
+void save_warm_start(struct save_state *ss, struct ls_state *ls)
+{
+	struct hax *h = MM_XMALLOC(1, struct hax);
+
+	assert(ss->warm_start == NULL && "double warm start");
+	assert(ss->root == NULL && "decision tree already started before test?");
+
+	h->eip           = ls->eip;
+	h->trigger_count = ls->trigger_count;
+	h->chosen_thread = -1;
+	h->stack_trace   = NULL;
+	h->parent        = NULL;
+	h->depth         = 0;
+	Q_INIT_HEAD(&h->children);
+	h->conflicts      = NULL;
+	h->happens_before = NULL;
+	save_ls(h, ls);
+
+	lsprintf(DEV, "warm start at eip 0x%x, trigger %lu\n",
+		 h->eip, h->trigger_count);
+	run_command(ls->cmd_file, CMD_BOOKMARK, (lang_void *)h);
+	ss->warm_start = h;
+}
+
+/* Throws away the whole decision tree and rewinds to the warm start. */
+void save_warm_restart(struct save_state *ss, struct ls_state *ls)
+{
+	struct hax *h = ss->current;
+
+	assert(ss->warm_start != NULL && "no warm start to restart from");
+	assert(ss->root != NULL && ss->current != NULL);
+
+	/* Only ancestors of the current nobe still have state and bookmarks;
+	 * each one frees its already-stateless children as we go up. */
+	while (h != NULL) {
+		struct hax *parent = h->parent;
+		free_hax(h);
+		run_command(ls->cmd_file, CMD_DELETE, (lang_void *)h);
+		h = parent;
+	}
+	MM_FREE(ss->root);
+
+	ss->root = NULL;
+	ss->current = NULL;
+	ss->next_tid = -1;
+	ss->total_choice_poince = 0;
+	ss->total_choices = 0;
+	ss->total_jumps = 0;
+	ss->total_triggers = 0;
+	ss->depth_total = 0;
+	ss->total_usecs = 0;
+	estimate_spread_init(&ss->spread);
+	if (ss->resume != NULL) {
+		/* the next job may bring its own; this one's is stale */
+		free_parked_tree(ss->resume);
+		ss->resume = NULL;
+	}
+
+	restore_ls(ls, ss->warm_start);
+	run_command(ls->cmd_file, CMD_SKIPTO, (lang_void *)ss->warm_start);
+	update_time(&ss->last_save_time);
+}
+#else
+void save_warm_start(struct save_state *ss, struct ls_state *ls)
+{
+	assert(0 && "warm start without WARM_WORKER");
+}
+void save_warm_restart(struct save_state *ss, struct ls_state *ls)
+{
+	assert(0 && "warm restart without WARM_WORKER");
+}
+#endif
+
+#ifdef ICB
+/* The preemption bound is part of what the tree would need to remember, and
+ * save_reset_tree() throws the tree away wholesale anyway. */
+bool save_park(struct save_state *ss, struct ls_state *ls, struct hax *h,
+	       unsigned int tid, const char *filename)
+{
+	return false;
+}
+#else
+static void park_data_races(FILE *f, struct mem_state *m, char space)
+{
+	for (struct rb_node *nobe = rb_first(&m->data_races); nobe != NULL;
+	     nobe = rb_next(nobe)) {
+		struct data_race *dr = rb_entry(nobe, struct data_race, nobe);
+		fprintf(f, "D %c 0x%x 0x%x %d %d\n", space, dr->first_eip,
+			dr->other_eip, dr->first_before_other ? 1 : 0,
+			dr->other_before_first ? 1 : 0);
+	}
+}
+
+bool save_park(struct save_state *ss, struct ls_state *ls, struct hax *h,
+	       unsigned int tid, const char *filename)
+{
+	assert(ss->root != NULL && ss->current != NULL);
+	assert(ss->current->estimate_computed);
+
+	FILE *f = fopen(filename, "w");
+	if (f == NULL) {
+		lsprintf(ALWAYS, "warning: couldn't open %s to park tree\n",
+			 filename);
+		return false;
+	}
+
+	/* Count the jump as save_longjmp() would have. */
+	fprintf(f, "S %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+		" %" PRIu64 " %u %u %La %La\n", ss->total_choice_poince,
+		ss->total_choices, ss->total_jumps + 1, ss->total_triggers,
+		ss->depth_total + ss->current->depth, ss->total_usecs, tid,
+		ss->spread.samples, ss->spread.mean, ss->spread.m2);
+
+	struct hax **path = MM_XMALLOC(h->depth + 1, struct hax *);
+	for (struct hax *h2 = h; h2 != NULL; h2 = h2->parent) {
+		path[h2->depth] = h2;
+	}
+
+	for (unsigned int i = 0; i <= h->depth; i++) {
+		struct hax *n = path[i];
+		struct hax *next = i < h->depth ? path[i + 1] : NULL;
+		struct hax *child;
+		struct agent *a;
+
+		fprintf(f, "N %d 0x%x %d %d %lu %" PRIu64 " %La %La\n",
+			n->chosen_thread, n->eip, n->all_explored ? 1 : 0,
+			n->is_preemption_point ? 1 : 0, n->marked_children,
+			n->usecs, n->proportion, n->subtree_usecs);
+		Q_FOREACH(child, &n->children, sibling) {
+			if (child != next) {
+				assert(child->all_explored &&
+				       "unexplored child off the current branch");
+				fprintf(f, "C %d\n", child->chosen_thread);
+			}
+		}
+		FOR_EACH_RUNNABLE_AGENT(a, n->oldsched,
+			if (a->do_explore) {
+				fprintf(f, "T %d\n", a->tid);
+			}
+		);
+	}
+	MM_FREE(path);
+
+	park_data_races(f, &ls->kern_mem, 'k');
+	park_data_races(f, &ls->user_mem, 'u');
+
+	bool ok = !ferror(f);
+	ok = fclose(f) == 0 && ok;
+	if (!ok) {
+		lsprintf(ALWAYS, "warning: couldn't write parked tree to %s\n",
+			 filename);
+	}
+	return ok;
+}
+#endif
+
+/* Loads a tree parked by save_park() in a previous landslide. Its data races go
+ * straight back in; its nobes get restored as the first branch retraces them. */
+void save_unpark(struct save_state *ss, struct ls_state *ls, const char *filename)
+{
+	assert(ss->root == NULL && "unparking into a tree already started");
+	assert(ss->resume == NULL && "unparking twice");
+
+	FILE *f = fopen(filename, "r");
+	assert(f != NULL && "failed open parked tree");
+
+	struct parked_tree *p = MM_XMALLOC(1, struct parked_tree);
+	ARRAY_LIST_INIT(&p->path, 64);
+	bool got_stats = false;
+	char buf[BUF_SIZE];
+
+	while (fgets(buf, BUF_SIZE, f) != NULL) {
+		struct parked_nobe *last = ARRAY_LIST_SIZE(&p->path) == 0 ? NULL :
+			ARRAY_LIST_GET(&p->path, ARRAY_LIST_SIZE(&p->path) - 1);
+		int x, y, z, w;
+		char space;
+
+		if (buf[0] == 'S') {
+			int ret = sscanf(buf, "S %" SCNu64 " %" SCNu64 " %" SCNu64
+					 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %d"
+					 " %u %La %La",
+					 &p->total_choice_poince, &p->total_choices,
+					 &p->total_jumps, &p->total_triggers,
+					 &p->depth_total, &p->total_usecs,
+					 &p->next_tid, &p->spread.samples,
+					 &p->spread.mean, &p->spread.m2);
+			assert(ret == 10 && "invalid parked tree stats");
+			got_stats = true;
+		} else if (buf[0] == 'N') {
+			struct parked_nobe n;
+			int ret = sscanf(buf, "N %d %x %d %d %lu %" SCNu64 " %La %La",
+					 &n.chosen_thread, &n.eip, &x, &y,
+					 &n.marked_children, &n.usecs,
+					 &n.proportion, &n.subtree_usecs);
+			assert(ret == 8 && "invalid parked tree nobe");
+			n.all_explored = x != 0;
+			n.is_preemption_point = y != 0;
+			ARRAY_LIST_INIT(&n.explored_children, 8);
+			ARRAY_LIST_INIT(&n.tagged_children, 8);
+			ARRAY_LIST_APPEND(&p->path, n);
+		} else if (buf[0] == 'C') {
+			int ret = sscanf(buf, "C %d", &x);
+			assert(ret == 1 && last != NULL && "invalid parked child");
+			ARRAY_LIST_APPEND(&last->explored_children, x);
+		} else if (buf[0] == 'T') {
+			int ret = sscanf(buf, "T %d", &x);
+			assert(ret == 1 && last != NULL && "invalid parked tag");
+			ARRAY_LIST_APPEND(&last->tagged_children, x);
+		} else if (buf[0] == 'D') {
+			int ret = sscanf(buf, "D %c %x %x %d %d", &space, &x, &y, &z, &w);
+			assert(ret == 5 && (space == 'k' || space == 'u') &&
+			       "invalid parked data race");
+			struct data_race dr = { .first_eip = x, .other_eip = y,
+			                        .first_before_other = z != 0,
+			                        .other_before_first = w != 0 };
+			mem_restore_data_race(space == 'k' ? &ls->kern_mem :
+					      &ls->user_mem, &dr);
+		} else {
+			lsprintf(DEV, "warning: unrecognized directive in "
+				 "parked tree file: '%s'\n", buf);
+		}
+	}
+	fclose(f);
+
+	if (unlink(filename) < 0) {
+		lsprintf(DEV, "warning: failed rm parked tree %s\n", filename);
+	}
+
+	assert(got_stats && ARRAY_LIST_SIZE(&p->path) > 0 && "empty parked tree");
+	lsprintf(ALWAYS, COLOUR_BOLD COLOUR_GREEN "Resuming parked tree; "
+		 "retracing %u choices to its frontier.\n" COLOUR_DEFAULT,
+		 ARRAY_LIST_SIZE(&p->path));
+	ss->resume = p;
+}
+
+bool save_resume_choice(struct save_state *ss, unsigned int *tid)
+{
+	struct parked_tree *p = ss->resume;
+	if (p == NULL) {
+		return false;
+	}
+
+	/* The choice being made now is of who runs after the nobe about to be
+	 * created, which will be the root if there's no tree yet. */
+	unsigned int depth = ss->root == NULL ? 0 : ss->current->depth + 1;
+	if (depth + 1 < ARRAY_LIST_SIZE(&p->path)) {
+		*tid = ARRAY_LIST_GET(&p->path, depth + 1)->chosen_thread;
+	} else {
+		/* resume_nobe() stops resuming once it restores the frontier,
+		 * which this will be; after it, the parked choice is taken. */
+		assert(depth + 1 == ARRAY_LIST_SIZE(&p->path));
+		*tid = p->next_tid;
+	}
+	return true;
+}
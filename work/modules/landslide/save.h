@@ -13,8 +13,11 @@
 
 struct ls_state;
 struct hax;
+struct parked_tree;
 
 struct save_state {
+	/* Out-of-tree snapshot of the start of the test; used iff WARM_WORKER. */
+	struct hax *warm_start;
 	/* The root of the decision tree, or NULL if save_setjmp() was never
 	 * called. */
 	struct hax *root;
@@ -34,6 +37,12 @@ struct save_state {
 	 * on the last nobe in the previous branch. */
 	struct timeval last_save_time;
 	uint64_t total_usecs;
+	/* how much the per-branch estimates disagree; see estimate.h */
+	struct estimate_spread spread;
+
+	/* If set, the first branch is retracing the path to the frontier of a
+	 * parked tree, restoring its nobes as it goes; see save_unpark(). */
+	struct parked_tree *resume;
 };
 
 void save_init(struct save_state *);
@@ -53,4 +62,15 @@ void save_longjmp(struct save_state *, struct ls_state *, struct hax *);
 
 void save_reset_tree(struct save_state *ss, struct ls_state *ls);
 
+void save_warm_start(struct save_state *ss, struct ls_state *ls);
+void save_warm_restart(struct save_state *ss, struct ls_state *ls);
+
+/* Writes out the exploration state, as of a longjmp to h to run tid next, for a
+ * later landslide to resume. Returns false if this state can't be parked. */
+bool save_park(struct save_state *ss, struct ls_state *ls, struct hax *h,
+	       unsigned int tid, const char *filename);
+void save_unpark(struct save_state *ss, struct ls_state *ls, const char *filename);
+/* While resuming, which tid to choose at the next choice point. */
+bool save_resume_choice(struct save_state *ss, unsigned int *tid);
+
 #endif
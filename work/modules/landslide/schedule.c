@@ -1818,6 +1818,32 @@ void sched_update(struct ls_state *ls)
 				CURRENT(s, delayed_vr_exit_eip) = ls->eip;
 				ls->eip = delay_instruction(ls->cpu0);
 			}
+			bool will_record = ls->test.test_ever_caused &&
+				ls->test.start_population != s->most_agents_ever;
+			unsigned int resume_tid;
+			if (will_record &&
+			    save_resume_choice(&ls->save, &resume_tid)) {
+				/* Retracing a parked tree; go where it went. */
+				struct agent *a =
+					agent_by_tid_or_null(&s->rq, resume_tid);
+				if (a == NULL && CURRENT(s, tid) == resume_tid) {
+					a = s->cur_agent;
+				}
+				if (a == NULL) {
+					a = agent_by_tid_or_null(&s->sq, resume_tid);
+				}
+				if (a == NULL) {
+					lsprintf(DEV, "parked tree's TID %d isn't "
+						 "runnable; keeping arbiter's "
+						 "choice %d\n", resume_tid,
+						 chosen->tid);
+				} else if (a != chosen) {
+					lsprintf(DEV, "parked tree overrides "
+						 "arbiter choice %d with %d\n",
+						 chosen->tid, a->tid);
+					chosen = a;
+				}
+			}
 			/* Effect the choice that was made... */
 			if (chosen != s->cur_agent ||
 			    agent_by_tid_or_null(&s->sq, CURRENT(s, tid)) != NULL) {
@@ -1837,8 +1863,7 @@ void sched_update(struct ls_state *ls)
 				s->entering_timer = true;
 			}
 			/* Record the choice that was just made. */
-			if (ls->test.test_ever_caused &&
-			    ls->test.start_population != s->most_agents_ever) {
+			if (will_record) {
 				save_setjmp(&ls->save, ls, chosen->tid,
 					    our_choice, false, !data_race,
 					    data_race_eip, voluntary);
@@ -164,6 +164,7 @@ struct stack_trace *copy_stack_trace(struct stack_trace *src)
 {
 	struct stack_trace *dest = MM_XMALLOC(1, struct stack_trace);
 	struct stack_frame *f_src;
+	dest->refcount = 1;
 	dest->tid = src->tid;
 	Q_INIT_HEAD(&dest->frames);
 
@@ -178,8 +179,20 @@ struct stack_trace *copy_stack_trace(struct stack_trace *src)
 	return dest;
 }
 
+/* A new reference to the same trace, to be freed separately. */
+struct stack_trace *share_stack_trace(struct stack_trace *st)
+{
+	assert(st->refcount > 0);
+	st->refcount++;
+	return st;
+}
+
 void free_stack_trace(struct stack_trace *st)
 {
+	assert(st->refcount > 0);
+	if (--st->refcount > 0) {
+		return;
+	}
 	while (Q_GET_SIZE(&st->frames) > 0) {
 		struct stack_frame *f = Q_GET_HEAD(&st->frames);
 		assert(f != NULL);
@@ -267,6 +280,7 @@ struct stack_trace *stack_trace(struct ls_state *ls)
 	unsigned int stack_ptr = GET_CPU_ATTR(cpu, esp);
 
 	struct stack_trace *st = MM_XMALLOC(1, struct stack_trace);
+	st->refcount = 1;
 	st->tid = tid;
 	Q_INIT_HEAD(&st->frames);
 
@@ -23,7 +23,9 @@ struct stack_frame {
 
 Q_NEW_HEAD(struct stack_frames, struct stack_frame);
 
+/* Immutable once taken, so copies of a trace can just share it. */
 struct stack_trace {
+	unsigned int refcount;
 	unsigned int tid;
 	struct stack_frames frames;
 };
@@ -39,6 +41,7 @@ void print_eip(verbosity v, unsigned int eip);
 void print_stack_trace(verbosity v, struct stack_trace *st);
 unsigned int html_stack_trace(char *buf, unsigned int maxlen, struct stack_trace *st);
 struct stack_trace *copy_stack_trace(struct stack_trace *src);
+struct stack_trace *share_stack_trace(struct stack_trace *st);
 void free_stack_trace(struct stack_trace *st);
 
 /* actual logic */
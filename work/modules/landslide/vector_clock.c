@@ -28,17 +28,44 @@ void vc_init(struct vector_clock *vc)
 		struct epoch bottom = { .tid = i, .timestamp = 0 };
 		ARRAY_LIST_APPEND(&vc->v, bottom);
 	}
+	vc->refcount = MM_XMALLOC(1, unsigned int);
+	*vc->refcount = 1;
 }
 
 /* don't pass something already inited for vc_new, or this will leak!  */
 void vc_copy(struct vector_clock *vc_new, const struct vector_clock *vc_existing)
 {
+	*vc_new = *vc_existing;
+	(*vc_new->refcount)++;
+}
+
+void vc_destroy(struct vector_clock *vc)
+{
+	assert(*vc->refcount > 0);
+	if (--*vc->refcount == 0) {
+		ARRAY_LIST_FREE(&vc->v);
+		MM_FREE(vc->refcount);
+	}
+}
+
+/* Makes the epochs safe to modify, copying them if another clock shares them.
+ * Keeps the capacity, as a clock being written to may soon grow. */
+static void vc_own(struct vector_clock *vc)
+{
+	assert(*vc->refcount > 0);
+	if (*vc->refcount == 1) {
+		return;
+	}
+	(*vc->refcount)--;
+	typeof(vc->v) shared = vc->v;
 	unsigned int i;
 	struct epoch *e;
-	ARRAY_LIST_INIT(&vc_new->v, ARRAY_LIST_SIZE(&vc_existing->v));
-	ARRAY_LIST_FOREACH(&vc_existing->v, i, e) {
-		ARRAY_LIST_APPEND(&vc_new->v, *e);
+	ARRAY_LIST_INIT(&vc->v, shared.capacity);
+	ARRAY_LIST_FOREACH(&shared, i, e) {
+		ARRAY_LIST_APPEND(&vc->v, *e);
 	}
+	vc->refcount = MM_XMALLOC(1, unsigned int);
+	*vc->refcount = 1;
 }
 
 static bool vc_find(struct vector_clock *vc, unsigned int tid, struct epoch **e)
@@ -67,6 +94,7 @@ static bool vc_find(struct vector_clock *vc, unsigned int tid, struct epoch **e)
 void vc_inc(struct vector_clock *vc, unsigned int tid)
 {
 	struct epoch *e;
+	vc_own(vc);
 	if (vc_find(vc, tid, &e)) {
 		e->timestamp++;
 	} else {
@@ -94,6 +122,12 @@ void vc_merge(struct vector_clock *vc_dest, struct vector_clock *vc_src)
 	struct epoch *e_dest;
 	struct epoch *e_src;
 
+	/* skip copying a shared clock for a merge that wouldn't change it */
+	if (*vc_dest->refcount > 1 && vc_happens_before(vc_src, vc_dest)) {
+		return;
+	}
+	vc_own(vc_dest);
+
 	/* step 1: anything that vc_dest has, find it in vc_src and merge it */
 	ARRAY_LIST_FOREACH(&vc_dest->v, i, e_dest) {
 		if (vc_find(vc_src, e_dest->tid, &e_src)) {
@@ -274,100 +308,60 @@ void vc_test()
  * Lock clock map
  ******************************************************************************/
 
+/* Immutable once in the map, being shared by its copies; setting a lock's
+ * clock replaces the whole entry. */
 struct lock_clock {
-	unsigned int lock_addr;
+	unsigned int refcount;
 	struct vector_clock c;
-	struct rb_node nobe;
 };
 
-/* "ls" is kind of already a reserved variable name */
-void lock_clocks_init(struct lock_clocks *lc)
+static void retain_clock(void *value)
 {
-	lc->map.rb_node = NULL;
-	lc->num_lox = 0;
+	struct lock_clock *clock = (struct lock_clock *)value;
+	assert(clock->refcount > 0);
+	clock->refcount++;
 }
 
-static void free_lock_clocks(struct rb_node *nobe)
+static void release_clock(void *value)
 {
-	if (nobe == NULL) {
-		return;
+	struct lock_clock *clock = (struct lock_clock *)value;
+	assert(clock->refcount > 0);
+	if (--clock->refcount == 0) {
+		vc_destroy(&clock->c);
+		MM_FREE(clock);
 	}
-
-	free_lock_clocks(nobe->rb_left);
-	free_lock_clocks(nobe->rb_right);
-
-	struct lock_clock *clock = rb_entry(nobe, struct lock_clock, nobe);
-	vc_destroy(&clock->c);
-	MM_FREE(clock);
 }
 
-void lock_clocks_destroy(struct lock_clocks *lc)
+static const struct ptree_ops lock_clock_ops = {
+	.retain = retain_clock,
+	.release = release_clock,
+};
+
+/* "ls" is kind of already a reserved variable name */
+void lock_clocks_init(struct lock_clocks *lc)
 {
-	free_lock_clocks(lc->map.rb_node);
-	lc->map.rb_node = NULL;
+	ptree_init(&lc->map, &lock_clock_ops);
 	lc->num_lox = 0;
 }
 
-static struct rb_node *dup_clock(const struct rb_node *nobe,
-				 const struct rb_node *parent)
+void lock_clocks_destroy(struct lock_clocks *lc)
 {
-	if (nobe == NULL) {
-		return NULL;
-	}
-
-	struct lock_clock *src = rb_entry(nobe, struct lock_clock, nobe);
-	struct lock_clock *dest = MM_XMALLOC(1, struct lock_clock);
-
-	int colour_flag = src->nobe.rb_parent_color & 1;
-	assert(((unsigned long)parent & 1) == 0);
-	dest->nobe.rb_parent_color = (unsigned long)parent | colour_flag;
-	dest->nobe.rb_right = dup_clock(src->nobe.rb_right, &dest->nobe);
-	dest->nobe.rb_left  = dup_clock(src->nobe.rb_left,  &dest->nobe);
-
-	dest->lock_addr = src->lock_addr;
-	vc_copy(&dest->c, &src->c);
-
-	return &dest->nobe;
+	ptree_destroy(&lc->map);
+	lc->num_lox = 0;
 }
 
 void lock_clocks_copy(struct lock_clocks *lm_new, const struct lock_clocks *lm_existing)
 {
-	lm_new->map.rb_node = dup_clock(lm_existing->map.rb_node, NULL);
+	ptree_copy(&lm_new->map, &lm_existing->map);
 	lm_new->num_lox = lm_existing->num_lox;
 }
 
-/* see function of same name in memory.c...
- * returns NULL if lock_addr already exists; if so, chunk will point to it */
-static struct rb_node **find_insert_location(struct rb_root *root,
-					     unsigned int lock_addr,
-					     struct lock_clock **clock)
-{
-	struct rb_node **p = &root->rb_node;
-
-	while (*p) {
-		*clock = rb_entry(*p, struct lock_clock, nobe);
-
-		/* Both same lock type; branch based on addr comparison */
-		if (lock_addr < (*clock)->lock_addr) {
-			p = &(*p)->rb_left;
-		} else if (lock_addr > (*clock)->lock_addr) {
-			p = &(*p)->rb_right;
-		/* Found a match */
-		} else {
-			return NULL;
-		}
-	}
-
-	return p;
-}
-
+/* The result is shared with other copies of the map; don't modify it. */
 bool lock_clock_find(struct lock_clocks *lc, unsigned int lock_addr,
 		     struct vector_clock **result)
 {
-	struct lock_clock *entry;
-	struct rb_node **p = find_insert_location(&lc->map, lock_addr, &entry);
-	if (p == NULL) {
-		assert(entry != NULL && "find insert location is broken?");
+	struct lock_clock *entry = ptree_find(&lc->map, lock_addr);
+	if (entry != NULL) {
 		*result = &entry->c;
 		return true;
 	} else {
@@ -386,22 +380,11 @@ struct vector_clock *lock_clock_get(struct lock_clocks *lc, unsigned int lock_ad
 void lock_clock_set(struct lock_clocks *lc, unsigned int lock_addr,
 		    struct vector_clock *vc)
 {
-	struct lock_clock *parent = NULL;
-	struct rb_node **p = find_insert_location(&lc->map, lock_addr, &parent);
-	if (p == NULL) {
-		/* lock already had a clock */
-		assert(parent->lock_addr == lock_addr);
-		vc_destroy(&parent->c);
-		vc_copy(&parent->c, vc);
-	} else {
-		/* insert a fresh one */
-		struct lock_clock *entry = MM_XMALLOC(1, struct lock_clock);
-		entry->lock_addr = lock_addr;
-		vc_copy(&entry->c, vc);
-
-		rb_init_node(&entry->nobe);
-		rb_link_node(&entry->nobe, parent != NULL ? &parent->nobe : NULL, p);
-		rb_insert_color(&entry->nobe, &lc->map);
+	struct lock_clock *entry = MM_XMALLOC(1, struct lock_clock);
+	entry->refcount = 1;
+	vc_copy(&entry->c, vc);
+	/* (replacing the lock's old clock, if it had one) */
+	if (!ptree_insert(&lc->map, lock_addr, entry)) {
 		lc->num_lox++;
 	}
 }
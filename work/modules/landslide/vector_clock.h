@@ -9,28 +9,33 @@
 
 #include "array_list.h"
 #include "common.h"
-#include "rbtree.h"
+#include "ptree.h"
 
 struct epoch {
 	unsigned int tid;
 	unsigned int timestamp;
 };
 
+/* Copies share the epochs, copy-on-write, as most clocks are copied (for save
+ * points, lock releases, and recorded memory accesses) far more often than
+ * they tick. */
 struct vector_clock {
 	ARRAY_LIST(struct epoch) v;
+	unsigned int *refcount; /* clocks sharing v */
 };
 
 /* The global set of all vector clocks associated with each mutex/xchg.
  * Corresponds to "L" in the fasttrack paper. Stored in sched_state.
- * C, W, and R are stored individually in the agent and mem_access strux. */
+ * C, W, and R are stored individually in the agent and mem_access strux.
+ * Persistent (see ptree.h), so copying it for a save point is free. */
 struct lock_clocks {
-	struct rb_root map;
+	struct ptree map;
 	unsigned int num_lox;
 };
 
 void vc_init(struct vector_clock *vc);
 void vc_copy(struct vector_clock *vc_new, const struct vector_clock *vc_existing);
-#define vc_destroy(vc) do { ARRAY_LIST_FREE(&(vc)->v); } while (0)
+void vc_destroy(struct vector_clock *vc);
 void vc_inc(struct vector_clock *vc, unsigned int tid);
 unsigned int vc_get(struct vector_clock *vc, unsigned int tid);
 void vc_merge(struct vector_clock *vc_dest, struct vector_clock *vc_src);